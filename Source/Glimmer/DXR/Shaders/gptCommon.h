@@ -145,6 +145,21 @@ struct SceneData
     CameraData camera_prev;
 };
 
+// HLSL has no member initializers. the defaults are in the C++ side of this struct (gpt::TextureData):
+// all 0 except page_offset = -1, which makes the texture non-virtual.
+struct TextureData
+{
+    int2 size;              // level 0
+    int page_offset;        // offset in the page table. -1 if not virtual
+    int atlas;
+    int tiled_levels;       // levels in the page table. lower levels are in the tail
+    int tile_size;
+    int border;
+    int slots_per_row;
+    float2 atlas_texel_size;
+    int2 pad;
+};
+
 struct vertex_t
 {
     float3 position;
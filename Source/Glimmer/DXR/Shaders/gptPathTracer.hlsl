@@ -33,6 +33,15 @@ StructuredBuffer<int3>          g_indices[]     : register(t0, space3);
 StructuredBuffer<vertex_t>      g_vertices[]    : register(t0, space4);
 Texture2D<float4>               g_textures[]    : register(t0, space5);
 
+// virtual textures. see VirtualTextureManagerDXR
+#define kMaxTileAtlases 4       // gptDXRMaxTileAtlasCount
+#define kTileFeedbackSize 4096  // gptDXRTileFeedbackSize
+#define kNonResident 0xffffffff
+StructuredBuffer<TextureData>   g_texture_data  : register(t0, space6);
+StructuredBuffer<uint>          g_page_table    : register(t1, space6);
+Texture2D<float4>               g_tile_atlases[kMaxTileAtlases] : register(t2, space6);
+RWStructuredBuffer<uint>        g_tile_feedback : register(u0, space6);
+
 SamplerState g_sampler_default : register(s0, space1);
 
 
@@ -111,34 +120,129 @@ vertex_t GetInterpolatedVertex(float2 barycentric)
     return GetInterpolatedVertex(InstanceID(), PrimitiveIndex(), barycentric);
 }
 
-float3 GetDiffuse(MaterialData md, float2 uv)
+// texture LOD by ray cones ("Texture Level of Detail Strategies for Real-Time Ray Tracing", Akenine-Moller et al.)
+// lod given to SampleTexture() and Get*() is independent of texture size: log2 of the footprint in uv space.
+// the size of each texture is added on sampling.
+static const float LOD_FINEST = -64.0f;
+
+// angle between rays of neighbor pixels
+float GetCameraSpreadAngle()
+{
+    CameraData cam = GetCamera();
+    return 2.0f / (abs(cam.proj[1][1]) * float(cam.screen_size.y));
+}
+
+// 0.5 * log2(uv area / world area) of the triangle
+float GetTriangleLOD(int instance_id, int face_id)
+{
+    int ib_id = g_instances[instance_id].ib_id;
+    int vb_id = g_instances[instance_id].vb_id;
+    int3 indices = g_indices[ib_id][face_id];
+    vertex_t v0 = g_vertices[vb_id][indices[0]];
+    vertex_t v1 = g_vertices[vb_id][indices[1]];
+    vertex_t v2 = g_vertices[vb_id][indices[2]];
+
+    float4x4 transform = g_instances[instance_id].transform;
+    float3 e1 = mul_v(transform, v1.position - v0.position);
+    float3 e2 = mul_v(transform, v2.position - v0.position);
+    float2 t1 = v1.uv - v0.uv;
+    float2 t2 = v2.uv - v0.uv;
+    float ta = abs(t1.x * t2.y - t2.x * t1.y);
+    float pa = length(cross(e1, e2));
+    return 0.5f * log2(max(ta, 1e-20f) / max(pa, 1e-20f));
+}
+
+// lod of a ray cone of cone_width hitting the face along D
+float GetRayConeLOD(int instance_id, int face_id, float cone_width, float3 D, float3 Nf)
+{
+    return GetTriangleLOD(instance_id, face_id) + log2(max(cone_width, 1e-8f) / max(abs(dot(Nf, D)), 1e-4f));
+}
+
+// tid: 12 bits, level: 4 bits, tile x/y: 8 bits each
+uint TileKey(int tid, int level, int2 tile)
+{
+    return (uint(tid) << 20) | (uint(level) << 16) | (uint(tile.y) << 8) | uint(tile.x);
+}
+
+// the feedback buffer is a hash table that keeps the last writer of each entry.
+// requests that collide are dropped for this frame, but tiles wanted by many rays get through.
+void RequestTile(uint key)
+{
+    uint i = (key * 2654435761u) % kTileFeedbackSize;
+    if (g_tile_feedback[i] != key)
+        g_tile_feedback[i] = key;
+}
+
+// samples the tile of the wanted level if resident, otherwise the nearest coarser resident one, otherwise the tail.
+// tiles are sampled bilinearly. there is no filtering between levels.
+float4 SampleVirtualTexture(int tid, TextureData td, float2 uv, float lod)
+{
+    float level = max(lod + 0.5f * log2(float(td.size.x * td.size.y)), 0.0f);
+    int li = int(level);
+    uv = saturate(uv);
+
+    int page = td.page_offset;
+    for (int l = 0; l < td.tiled_levels; ++l) {
+        int2 size = max(td.size >> l, 1);
+        int2 count = (size + td.tile_size - 1) / td.tile_size;
+        if (l >= li) {
+            float2 texel = uv * float2(size);
+            int2 tile = min(int2(texel) / td.tile_size, count - 1);
+            if (l == li)
+                RequestTile(TileKey(tid, l, tile));
+
+            uint slot = g_page_table[page + count.x * tile.y + tile.x];
+            if (slot != kNonResident) {
+                int padded = td.tile_size + td.border * 2;
+                int2 origin = int2(slot % td.slots_per_row, slot / td.slots_per_row) * padded + td.border;
+                float2 p = float2(origin) + (texel - float2(tile * td.tile_size));
+                return g_tile_atlases[NonUniformResourceIndex(td.atlas)].SampleLevel(g_sampler_default, p * td.atlas_texel_size, 0);
+            }
+        }
+        page += count.x * count.y;
+    }
+    return g_textures[tid].SampleLevel(g_sampler_default, uv, max(level - float(td.tiled_levels), 0.0f));
+}
+
+float4 SampleTexture(int tid, float2 uv, float lod)
+{
+    TextureData td = g_texture_data[tid];
+    if (td.page_offset >= 0)
+        return SampleVirtualTexture(tid, td, uv, lod);
+
+    uint width, height, levels;
+    g_textures[tid].GetDimensions(0, width, height, levels);
+    return g_textures[tid].SampleLevel(g_sampler_default, uv, lod + 0.5f * log2(float(width * height)));
+}
+
+float3 GetDiffuse(MaterialData md, float2 uv, float lod = LOD_FINEST)
 {
     float3 r = md.diffuse;
     int tid = md.diffuse_tex;
     if (tid != -1)
-        r *= g_textures[tid].SampleLevel(g_sampler_default, uv, 0).xyz;
+        r *= SampleTexture(tid, uv, lod).xyz;
     return r;
 }
 
-float3 GetEmissive(MaterialData md, float2 uv)
+float3 GetEmissive(MaterialData md, float2 uv, float lod = LOD_FINEST)
 {
     float3 r = md.emissive;
     int tid = md.emissive_tex;
     if (tid != -1)
-        r += g_textures[tid].SampleLevel(g_sampler_default, uv, 0).xyz;
+        r += SampleTexture(tid, uv, lod).xyz;
     return r;
 }
 
-float GetRoughness(MaterialData md, float2 uv)
+float GetRoughness(MaterialData md, float2 uv, float lod = LOD_FINEST)
 {
     float r = md.roughness;
     int tid = md.roughness_tex;
     if (tid != -1)
-        r *= g_textures[tid].SampleLevel(g_sampler_default, uv, 0).x;
+        r *= SampleTexture(tid, uv, lod).x;
     return r;
 }
 
-float3 GetNormal(vertex_t V, MaterialData md)
+float3 GetNormal(vertex_t V, MaterialData md, float lod = LOD_FINEST)
 {
     float3 normal = V.normal;
     int tid = md.normal_tex;
@@ -147,7 +251,7 @@ float3 GetNormal(vertex_t V, MaterialData md)
         float3 binormal = normalize(cross(normal, tangent));
         float3x3 tbn = float3x3(tangent, binormal, normal);
 
-        float3 tn = g_textures[tid].SampleLevel(g_sampler_default, V.uv, 0).xyz * 2.0f - 1.0f;
+        float3 tn = SampleTexture(tid, V.uv, lod).xyz * 2.0f - 1.0f;
         tn.xy *= -1.0f;
         normal = mul(tbn, tn);
     }
@@ -166,6 +270,8 @@ struct RadiancePayload
     uint   seed;
     uint   iteration;
     uint   done;
+    float  cone_width;  // ray cone at origin
+    float  cone_spread;
 
     void init()
     {
@@ -177,6 +283,8 @@ struct RadiancePayload
         seed = 0;
         iteration = 0;
         done = false;
+        cone_width = 0.0f;
+        cone_spread = 0.0f;
     }
 };
 
@@ -189,6 +297,7 @@ struct OcclusionPayload
     int face_id;
     float2 barycentrics;
     uint   missed;
+    float  cone_width;
 
     void init()
     {
@@ -199,6 +308,7 @@ struct OcclusionPayload
         face_id = -1;
         barycentrics = 0.0f;
         missed = false;
+        cone_width = 0.0f;
     }
 };
 
@@ -284,6 +394,7 @@ void RayGenRadiance()
         RadiancePayload payload;
         payload.init();
         payload.seed = seed;
+        payload.cone_spread = GetCameraSpreadAngle();
         float2 jitter = float2(rnd55(seed), rnd55(seed));
         GetCameraRay(payload.origin, payload.direction, si, jitter);
 
@@ -341,12 +452,14 @@ void MissRadiance(inout RadiancePayload payload : SV_RayRadiancePayload)
 }
 
 
-bool TraceOcclusion(in RayDesc ray, out float3 direction, out float3 attenuation)
+// shadow rays converge to lights. the cone width at the origin is used as is.
+bool TraceOcclusion(in RayDesc ray, float cone_width, out float3 direction, out float3 attenuation)
 {
     OcclusionPayload payload;
     payload.init();
     payload.origin = ray.Origin;
     payload.direction = ray.Direction;
+    payload.cone_width = cone_width;
 
     //uint ray_flags = RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH;
     // todo: repeat this if !payload.occluded
@@ -357,12 +470,13 @@ bool TraceOcclusion(in RayDesc ray, out float3 direction, out float3 attenuation
     return payload.instance_id != -1;
 }
 
-OcclusionPayload TraceEmissive(in RayDesc ray)
+OcclusionPayload TraceEmissive(in RayDesc ray, float cone_width)
 {
     OcclusionPayload payload;
     payload.init();
     payload.origin = ray.Origin;
     payload.direction = ray.Direction;
+    payload.cone_width = cone_width;
 
     uint ray_flags = 0;
     TraceRay(g_tlas, ray_flags, LM_SHADOW | LM_LIGHT_SOURCE, RT_OCCLUSION, 0, RT_OCCLUSION, ray, payload);
@@ -464,7 +578,7 @@ float2 BRDF(float3 N, float3 V, float3 L, float roughness, float f0)
     return float2(diffuse, specular);
 }
 
-float3 GetLightRadiance(float3 P, float3 N, float3 V, float roughness, float F0, int light_index, inout uint seed)
+float3 GetLightRadiance(float3 P, float3 N, float3 V, float roughness, float F0, float cone_width, int light_index, inout uint seed)
 {
     float3 radiance = 0.0f;
 
@@ -481,7 +595,7 @@ float3 GetLightRadiance(float3 P, float3 N, float3 V, float roughness, float F0,
         ray.TMax = GetCamera().far_plane;
 
         float3 attenuation;
-        if (!TraceOcclusion(ray, L, attenuation)) {
+        if (!TraceOcclusion(ray, cone_width, L, attenuation)) {
             float weight = 1.0f;
             float2 ds = BRDF(N, V, L, roughness, F0);
 
@@ -501,7 +615,7 @@ float3 GetLightRadiance(float3 P, float3 N, float3 V, float roughness, float F0,
             ray.TMax = Ld;
 
             float3 attenuation;
-            if (!TraceOcclusion(ray, L, attenuation)) {
+            if (!TraceOcclusion(ray, cone_width, L, attenuation)) {
                 float weight = max(pow2((light.range - Ld) / light.range), 0.0f);
                 float2 ds = BRDF(N, V, L, roughness, F0);
 
@@ -522,7 +636,7 @@ float3 GetLightRadiance(float3 P, float3 N, float3 V, float roughness, float F0,
             ray.TMax = Ld;
 
             float3 attenuation;
-            if (!TraceOcclusion(ray, L, attenuation)) {
+            if (!TraceOcclusion(ray, cone_width, L, attenuation)) {
                 float weight = max(pow2((light.range - Ld) / light.range), 0.0f);
                 float2 ds = BRDF(N, V, L, roughness, F0);
 
@@ -553,7 +667,7 @@ float3 GetLightRadiance(float3 P, float3 N, float3 V, float roughness, float F0,
         ray.TMin = 0.0f;
         ray.TMax = Ld + 0.01f; // todo: improve offset
 
-        OcclusionPayload epl = TraceEmissive(ray);
+        OcclusionPayload epl = TraceEmissive(ray, cone_width);
         if (epl.instance_id == -1) { // hit transparent face
             epl.instance_id = ii;
             epl.face_id = fid;
@@ -566,7 +680,8 @@ float3 GetLightRadiance(float3 P, float3 N, float3 V, float roughness, float F0,
             float2 ds = BRDF(N, V, L, roughness, F0);
 
             MaterialData lmd = g_materials[g_instances[ii].material_id];
-            float3 emissive = GetEmissive(lmd, hv.uv) * light.intensity;
+            float lod = GetRayConeLOD(epl.instance_id, epl.face_id, cone_width, L, GetFaceNormal(epl.instance_id, epl.face_id));
+            float3 emissive = GetEmissive(lmd, hv.uv, lod) * light.intensity;
             radiance = emissive * epl.attenuation * (weight * (ds.x + ds.y));
         }
     }
@@ -614,15 +729,18 @@ void ClosestHitRadiance(inout RadiancePayload payload : SV_RayRadiancePayload, i
 
     bool backface = HitKind() == HIT_KIND_TRIANGLE_BACK_FACE;
     float3 Nf = GetFaceNormal();
-    float3 N = GetNormal(vertex, md);
+    float cone_width = payload.cone_width + payload.cone_spread * RayTCurrent();
+    float lod = GetRayConeLOD(InstanceID(), PrimitiveIndex(), cone_width, WorldRayDirection(), Nf);
+    float3 N = GetNormal(vertex, md, lod);
     float3 P_ = GetHitPosition();
     float3 P = offset_ray(P_, Nf);
     float3 V = normalize(payload.origin - P);
 
-    float roughness = GetRoughness(md, vertex.uv);
+    float roughness = GetRoughness(md, vertex.uv, lod);
     float fresnel = md.fresnel;
     uint seed = payload.seed;
     payload.t = RayTCurrent();
+    payload.cone_width = cone_width;
 
     if (payload.iteration == 0)
         g_rw_normal_buffer[GetScreenIndex().xy] = float4(N, 0.0f);
@@ -633,7 +751,7 @@ void ClosestHitRadiance(inout RadiancePayload payload : SV_RayRadiancePayload, i
         Refract(payload.origin, payload.direction, N, Nf, md.refraction_index, backface);
 
         if (backface) {
-            payload.attenuation *= GetDiffuse(md, vertex.uv) * ((1.0f - md.opacity) / (1.0f + payload.t * payload.t));
+            payload.attenuation *= GetDiffuse(md, vertex.uv, lod) * ((1.0f - md.opacity) / (1.0f + payload.t * payload.t));
         }
         else {
             //// diffuse & emissive
@@ -651,10 +769,12 @@ void ClosestHitRadiance(inout RadiancePayload payload : SV_RayRadiancePayload, i
         float3 diffuse_dir = onb_inverse_transform(cosine_sample_hemisphere(rnd01(seed), rnd01(seed)), N);
         payload.direction = normalize(lerp(reflect_dir, diffuse_dir, roughness));
         payload.origin = P;
+        // rough surfaces scatter the next ray. widen the cone in proportion to roughness.
+        payload.cone_spread += roughness * (PI * 0.25f);
 
         // diffuse & emissive
-        payload.attenuation *= GetDiffuse(md, vertex.uv);
-        payload.radiance += GetEmissive(md, vertex.uv);
+        payload.attenuation *= GetDiffuse(md, vertex.uv, lod);
+        payload.radiance += GetEmissive(md, vertex.uv, lod);
     }
 
     float3 radiance = 0.0f;
@@ -665,11 +785,11 @@ void ClosestHitRadiance(inout RadiancePayload payload : SV_RayRadiancePayload, i
     float light_contribution;
     PickLight(P, N, seed, light_index, light_contribution);
     if (light_index != -1)
-        radiance += GetLightRadiance(P, N, V, roughness, fresnel, light_index, seed) / light_contribution;
+        radiance += GetLightRadiance(P, N, V, roughness, fresnel, cone_width, light_index, seed) / light_contribution;
 #else
     // enumerate all light
     for (int li = 0; li < GetLightCount(); ++li)
-        radiance += GetLightRadiance(P, N, V, roughness, fresnel, li, seed);
+        radiance += GetLightRadiance(P, N, V, roughness, fresnel, cone_width, li, seed);
 #endif
 
 #ifdef gptEnableRimLight
@@ -697,14 +817,15 @@ void ClosestHitOcclusion(inout OcclusionPayload payload : SV_RayPayload, in Buil
     if (md.type == MT_TRANSPARENT) {
         vertex_t V = GetInterpolatedVertex(attr.barycentrics);
         float3 Nf = GetFaceNormal();
-        float3 N = GetNormal(V, md);
+        float lod = GetRayConeLOD(InstanceID(), PrimitiveIndex(), payload.cone_width, WorldRayDirection(), Nf);
+        float3 N = GetNormal(V, md, lod);
         bool backface = HitKind() == HIT_KIND_TRIANGLE_BACK_FACE;
 
         payload.origin = GetHitPosition();
         Refract(payload.origin, payload.direction, N, Nf, md.refraction_index, backface);
 
         if (!backface) {
-            payload.attenuation *= GetDiffuse(md, V.uv) * (1.0f - md.opacity);
+            payload.attenuation *= GetDiffuse(md, V.uv, lod) * (1.0f - md.opacity);
         }
     }
     else if (md.type == MT_PORTAL) {
@@ -93,6 +93,8 @@ void ContextDXR::clear()
     m_meshes.clear();
     m_mesh_instances.clear();
     m_scenes.clear();
+    if (m_virtual_textures)
+        m_virtual_textures->clear();
 }
 
 ICameraPtr ContextDXR::createCamera()
@@ -135,6 +137,24 @@ ITexturePtr ContextDXR::createTexture(int width, int height, Format format)
     return r;
 }
 
+ITexturePtr ContextDXR::createVirtualTexture(const char* path)
+{
+    auto tiles = std::make_shared<mu::TiledTextureReader>();
+    if (!tiles->open(path)) {
+        SetErrorLog("failed to open %s\n", path);
+        return nullptr;
+    }
+    if (GetTileFormat(tiles->getLayout()) == Format::Unknown) {
+        SetErrorLog("unsupported tile format %s\n", path);
+        return nullptr;
+    }
+
+    auto r = new TextureDXR(tiles);
+    r->m_context = this;
+    m_textures.insert(r);
+    return r;
+}
+
 IMaterialPtr ContextDXR::createMaterial()
 {
     auto r = new MaterialDXR();
@@ -348,6 +368,9 @@ bool ContextDXR::initializeDevice()
             { D3D12_DESCRIPTOR_RANGE_TYPE_SRV, gptDXRMaxMeshCount,          0, 4, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND },
             // textures
             { D3D12_DESCRIPTOR_RANGE_TYPE_SRV, gptDXRMaxTextureCount,       0, 5, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND },
+            // virtual textures: texture data / page table / tile atlases, tile feedback
+            { D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2 + gptDXRMaxTileAtlasCount, 0, 6, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND },
+            { D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1,                           0, 6, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND },
         };
 
         // sampler
@@ -473,6 +496,7 @@ bool ContextDXR::initializeDevice()
         m_srv_indices   = m_desc_alloc_srv.allocate(gptDXRMaxMeshCount);
         m_srv_vertices  = m_desc_alloc_srv.allocate(gptDXRMaxMeshCount);
         m_srv_textures  = m_desc_alloc_srv.allocate(gptDXRMaxTextureCount);
+        m_srv_virtual_textures = m_desc_alloc_srv.allocate(3 + gptDXRMaxTileAtlasCount);
 
         // need to figure out better way...
         m_srv_deform_meshes = m_desc_alloc_srv.allocate(gptDXRMaxDeformMeshCount * 6);
@@ -497,6 +521,7 @@ bool ContextDXR::initializeDevice()
         sd.AddressV = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
         sd.AddressW = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
         sd.ComparisonFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+        sd.MaxLOD = D3D12_FLOAT32_MAX; // zero-initialized MaxLOD would clamp to the top level
         m_device->CreateSampler(&sd, m_sampler_default.hcpu);
     }
 
@@ -505,6 +530,7 @@ bool ContextDXR::initializeDevice()
         SetErrorLog("failed to create deformer\n");
         return false;
     }
+    m_virtual_textures = std::make_shared<VirtualTextureManagerDXR>(this);
 
     gptTimestampInitialize(m_timestamp, m_device, m_cmd_queue_direct);
     return true;
@@ -589,6 +615,7 @@ void ContextDXR::updateResources()
     each_ref(m_textures, [&](auto& tex) {
         tex.updateResources();
     });
+    m_virtual_textures->updateResources();
 
 
     // materials
@@ -774,6 +801,8 @@ void ContextDXR::dispatchRays()
     });
     gptTimestampQuery(m_timestamp, cl_rays, "DispatchRays end");
 
+    m_virtual_textures->copyFeedback();
+
 
     // handle render target readback
     gptTimestampQuery(m_timestamp, cl_rays, "Readback begin");
@@ -812,6 +841,7 @@ void ContextDXR::finish()
         // reset state
         m_clm_direct->reset();
         m_deformer->reset();
+        m_virtual_textures->processFeedback();
 
         // clear dirty flags
         m_scenes.clearDirty();
@@ -883,18 +913,18 @@ ID3D12ResourcePtr ContextDXR::createUploadBuffer(uint64_t size)
 }
 
 
-ID3D12ResourcePtr ContextDXR::createTexture(int width, int height, DXGI_FORMAT format)
+ID3D12ResourcePtr ContextDXR::createTexture(int width, int height, DXGI_FORMAT format, int mip_levels)
 {
     D3D12_RESOURCE_DESC desc{};
     desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
     desc.Width = width;
     desc.Height = height;
     desc.DepthOrArraySize = 1;
-    desc.MipLevels = 1;
+    desc.MipLevels = UINT16(mip_levels);
     desc.Format = format;
     desc.SampleDesc.Count = 1;
     desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-    desc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+    desc.Flags = IsBlockCompressed(format) ? D3D12_RESOURCE_FLAG_NONE : D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
     D3D12_HEAP_FLAGS flags = D3D12_HEAP_FLAG_NONE;
     D3D12_RESOURCE_STATES initial_state = D3D12_RESOURCE_STATE_COMMON;
 
@@ -911,6 +941,14 @@ ID3D12ResourcePtr ContextDXR::createTextureUploadBuffer(int width, int height, D
     return createBuffer(size, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, kUploadHeapProps);
 }
 
+ID3D12ResourcePtr ContextDXR::createTextureUploadBuffer(ID3D12Resource* dst)
+{
+    auto desc = dst->GetDesc();
+    UINT64 size = 0;
+    m_device->GetCopyableFootprints(&desc, 0, desc.MipLevels, 0, nullptr, nullptr, nullptr, &size);
+    return createBuffer(size, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, kUploadHeapProps);
+}
+
 ID3D12ResourcePtr ContextDXR::createTextureReadbackBuffer(int width, int height, DXGI_FORMAT format)
 {
     UINT texel_size = GetTexelSize(format);
@@ -1030,6 +1068,45 @@ void ContextDXR::uploadTexture(ID3D12Resource* dst, ID3D12Resource* staging, UIN
     m_cl->CopyTextureRegion(&dst_loc, 0, 0, 0, &src_loc, nullptr);
 }
 
+void ContextDXR::uploadTextureMips(ID3D12Resource* dst, ID3D12Resource* staging, const void* src_)
+{
+    auto desc = dst->GetDesc();
+    UINT num_levels = desc.MipLevels;
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(num_levels);
+    std::vector<UINT> num_rows(num_levels);
+    std::vector<UINT64> row_sizes(num_levels);
+    m_device->GetCopyableFootprints(&desc, 0, num_levels, 0, footprints.data(), num_rows.data(), row_sizes.data(), nullptr);
+
+    bool mapped_ok = Map(staging, [&](char* mapped) {
+        auto* src = (const char*)src_;
+        for (UINT li = 0; li < num_levels; ++li) {
+            auto& fp = footprints[li];
+            char* dst_rows = mapped + fp.Offset;
+            for (UINT yi = 0; yi < num_rows[li]; ++yi) {
+                memcpy(dst_rows, src, row_sizes[li]);
+                src += row_sizes[li];
+                dst_rows += fp.Footprint.RowPitch;
+            }
+        }
+    });
+    if (!mapped_ok)
+        return;
+
+    for (UINT li = 0; li < num_levels; ++li) {
+        D3D12_TEXTURE_COPY_LOCATION dst_loc{};
+        dst_loc.pResource = dst;
+        dst_loc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        dst_loc.SubresourceIndex = li;
+
+        D3D12_TEXTURE_COPY_LOCATION src_loc{};
+        src_loc.pResource = staging;
+        src_loc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+        src_loc.PlacedFootprint = footprints[li];
+
+        m_cl->CopyTextureRegion(&dst_loc, 0, 0, 0, &src_loc, nullptr);
+    }
+}
+
 void ContextDXR::copyTexture(ID3D12Resource* dst, ID3D12Resource* src, UINT width, UINT height, DXGI_FORMAT format)
 {
     if (!dst || !src) {
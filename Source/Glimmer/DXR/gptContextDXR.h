@@ -3,6 +3,7 @@
 #include "Foundation/gptUtils.h"
 #include "gptEntityDXR.h"
 #include "gptDeformerDXR.h"
+#include "gptVirtualTextureDXR.h"
 
 namespace gpt {
 
@@ -18,6 +19,7 @@ public:
     IRenderTargetPtr createRenderTarget(int width, int height, Format format) override;
     IRenderTargetPtr createRenderTarget(IWindow* window, Format format) override;
     ITexturePtr      createTexture(int width, int height, Format format) override;
+    ITexturePtr      createVirtualTexture(const char* path) override;
     IMaterialPtr     createMaterial() override;
     IMeshPtr         createMesh() override;
     IMeshInstancePtr createMeshInstance(IMesh* v) override;
@@ -47,8 +49,9 @@ public:
     ID3D12ResourcePtr createBuffer(uint64_t size);
     ID3D12ResourcePtr createUploadBuffer(uint64_t size);
 
-    ID3D12ResourcePtr createTexture(int width, int height, DXGI_FORMAT format);
+    ID3D12ResourcePtr createTexture(int width, int height, DXGI_FORMAT format, int mip_levels = 1);
     ID3D12ResourcePtr createTextureUploadBuffer(int width, int height, DXGI_FORMAT format);
+    ID3D12ResourcePtr createTextureUploadBuffer(ID3D12Resource* dst); // for all subresources of dst
     ID3D12ResourcePtr createTextureReadbackBuffer(int width, int height, DXGI_FORMAT format);
 
 
@@ -70,6 +73,8 @@ public:
     void writeTexture(ID3D12Resource* dst, ID3D12Resource* staging, UINT width, UINT height, DXGI_FORMAT format, const Body& src);
     void uploadTexture(ID3D12Resource* dst, ID3D12Resource* staging, const void* src, UINT width, UINT height, DXGI_FORMAT format);
     void uploadTexture(ID3D12Resource* dst, ID3D12Resource* staging, UINT width, UINT height, DXGI_FORMAT format);
+    // src: all mip levels of dst packed without padding
+    void uploadTextureMips(ID3D12Resource* dst, ID3D12Resource* staging, const void* src);
     void copyTexture(ID3D12Resource* dst, ID3D12Resource* src, UINT width, UINT height, DXGI_FORMAT format);
     void readbackTexture(void* dst, ID3D12Resource* staging, UINT width, UINT height, DXGI_FORMAT format);
     void copyResource(ID3D12Resource* dst, ID3D12Resource* src);
@@ -104,6 +109,7 @@ public:
     CommandListManagerDXRPtr m_clm_direct;
     ID3D12GraphicsCommandList4Ptr m_cl;
     DeformerDXRPtr m_deformer;
+    VirtualTextureManagerDXRPtr m_virtual_textures;
     ID3D12FencePtr m_fence;
     uint64_t m_fence_value = 0;
     uint64_t m_fv_upload = 0;
@@ -134,6 +140,7 @@ public:
     DescriptorHandleDXR m_srv_indices;
     DescriptorHandleDXR m_srv_vertices;
     DescriptorHandleDXR m_srv_textures;
+    DescriptorHandleDXR m_srv_virtual_textures; // texture data, page table, tile atlases and tile feedback
     DescriptorHandleDXR m_srv_deform_meshes;
     DescriptorHandleDXR m_srv_deform_instances;
     DescriptorHandleDXR m_sampler_default;
@@ -128,6 +128,11 @@ TextureDXR::TextureDXR(int width, int height, Format format)
 {
 }
 
+TextureDXR::TextureDXR(std::shared_ptr<mu::TiledTextureReader> tiles)
+    : super(tiles)
+{
+}
+
 void* TextureDXR::getDeviceObject() const
 {
     return m_texture;
@@ -138,8 +143,8 @@ void TextureDXR::updateResources()
     ContextDXR* ctx = m_context;
     if (!m_texture) {
         auto format = GetDXGIFormatTyped(m_format);
-        m_texture = ctx->createTexture(m_width, m_height, format);
-        m_buf_upload = ctx->createTextureUploadBuffer(m_width, m_height, format);
+        m_texture = ctx->createTexture(m_width, m_height, format, m_mip_count);
+        m_buf_upload = ctx->createTextureUploadBuffer(m_texture);
         gptSetName(m_texture, m_name + " Texture");
         gptSetName(m_buf_upload, m_name + " Upload Buffer");
 
@@ -147,7 +152,7 @@ void TextureDXR::updateResources()
         ctx->createTextureSRV(m_srv, m_texture);
     }
     if (isDirty(DirtyFlag::TextureData)) {
-        ctx->uploadTexture(m_texture, m_buf_upload, m_data.cdata(), m_width, m_height, GetDXGIFormatTyped(m_format));
+        ctx->uploadTextureMips(m_texture, m_buf_upload, m_data.cdata());
         ctx->addResourceBarrier(m_texture, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON);
     }
 }
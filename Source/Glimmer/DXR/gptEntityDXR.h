@@ -77,6 +77,7 @@ using super = DXREntity<Texture>;
 friend class ContextDXR;
 public:
     TextureDXR(int width, int height, Format format);
+    TextureDXR(std::shared_ptr<mu::TiledTextureReader> tiles);
     void* getDeviceObject() const override;
 
     void updateResources();
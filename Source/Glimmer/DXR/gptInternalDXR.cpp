@@ -466,6 +466,12 @@ DXGI_FORMAT GetDXGIFormatTyped(Format format)
     case Format::RGf32: return DXGI_FORMAT_R32G32_FLOAT;
     case Format::RGBAf32: return DXGI_FORMAT_R32G32B32A32_FLOAT;
 
+    case Format::BC1: return DXGI_FORMAT_BC1_UNORM;
+    case Format::BC4: return DXGI_FORMAT_BC4_UNORM;
+    case Format::BC5: return DXGI_FORMAT_BC5_UNORM;
+    case Format::BC6H: return DXGI_FORMAT_BC6H_UF16;
+    case Format::BC7: return DXGI_FORMAT_BC7_UNORM;
+
     default: return DXGI_FORMAT_UNKNOWN;
     }
 }
@@ -484,10 +490,22 @@ DXGI_FORMAT GetDXGIFormatTypeless(Format format)
     case Format::RGf32: return DXGI_FORMAT_R32G32_TYPELESS;
     case Format::RGBAf32: return DXGI_FORMAT_R32G32B32A32_TYPELESS;
 
+    case Format::BC1: return DXGI_FORMAT_BC1_TYPELESS;
+    case Format::BC4: return DXGI_FORMAT_BC4_TYPELESS;
+    case Format::BC5: return DXGI_FORMAT_BC5_TYPELESS;
+    case Format::BC6H: return DXGI_FORMAT_BC6H_TYPELESS;
+    case Format::BC7: return DXGI_FORMAT_BC7_TYPELESS;
+
     default: return DXGI_FORMAT_UNKNOWN;
     }
 }
 
+bool IsBlockCompressed(DXGI_FORMAT format)
+{
+    return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM) ||
+        (format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
+
 template<
     DXGI_FORMAT r8, DXGI_FORMAT rg8, DXGI_FORMAT rgba8,
     DXGI_FORMAT r16, DXGI_FORMAT rg16, DXGI_FORMAT rgba16,
@@ -14,9 +14,12 @@
 #define gptDXRMaxLightCount 256
 #define gptDXRMaxMeshLightCount 256
 #define gptDXRMaxTextureCount 2048
+#define gptDXRMaxTileAtlasCount 4
+#define gptDXRTileFeedbackSize 4096
+#define gptDXRMaxTileUploadsPerFrame 64
 #define gptDXRMaxShaderRecords 64
 #define gptDXRSwapChainBuffers 2
-#define gptDXRMaxPayloadSize 64
+#define gptDXRMaxPayloadSize 80
 
 
 namespace gpt {
@@ -228,6 +231,7 @@ static const DWORD kTimeoutMS = 3000;
 UINT GetTexelSize(DXGI_FORMAT rtf);
 DXGI_FORMAT GetDXGIFormatTyped(Format format);
 DXGI_FORMAT GetDXGIFormatTypeless(Format format);
+bool IsBlockCompressed(DXGI_FORMAT format);
 DXGI_FORMAT GetFloatFormat(DXGI_FORMAT format);
 DXGI_FORMAT GetUIntFormat(DXGI_FORMAT format);
 DXGI_FORMAT GetTypelessFormat(DXGI_FORMAT format);
@@ -0,0 +1,399 @@
+#include "pch.h"
+#ifdef _WIN32
+#include "Foundation/gptLog.h"
+#include "gptContextDXR.h"
+#include "gptVirtualTextureDXR.h"
+
+namespace gpt {
+
+static const uint32_t kEmptyFeedback = ~0u;
+static const uint32_t kNonResident = ~0u;
+static const int kMaxAtlasSize = 16384;
+
+// descriptors of ContextDXR::m_srv_virtual_textures
+enum
+{
+    kSRVTextureData,
+    kSRVPages,
+    kSRVAtlases,
+    kUAVFeedback = kSRVAtlases + gptDXRMaxTileAtlasCount,
+};
+
+
+VirtualTextureManagerDXR::VirtualTextureManagerDXR(ContextDXR* ctx)
+    : m_context(ctx)
+{
+    auto& device = ctx->m_device;
+
+    // atlases are bound with null descriptors until they are created
+    for (int i = 0; i < gptDXRMaxTileAtlasCount; ++i) {
+        D3D12_SHADER_RESOURCE_VIEW_DESC desc{};
+        desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+        desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+        desc.Texture2D.MipLevels = 1;
+        device->CreateShaderResourceView(nullptr, &desc, (ctx->m_srv_virtual_textures + (kSRVAtlases + i)).hcpu);
+    }
+
+    size_t feedback_size = sizeof(uint32_t) * gptDXRTileFeedbackSize;
+    m_buf_feedback = ctx->createBuffer(feedback_size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, kDefaultHeapProps);
+    m_buf_feedback_clear = ctx->createUploadBuffer(feedback_size);
+    m_buf_feedback_readback = ctx->createBuffer(feedback_size, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, kReadbackHeapProps);
+    gptSetName(m_buf_feedback, "Tile Feedback Buffer");
+    Map(m_buf_feedback_clear, [feedback_size](void* dst) {
+        memset(dst, 0xff, feedback_size);
+    });
+    auto uav = ctx->m_srv_virtual_textures + kUAVFeedback;
+    ctx->createBufferUAV(uav, m_buf_feedback, sizeof(uint32_t));
+}
+
+VirtualTextureManagerDXR::~VirtualTextureManagerDXR()
+{
+    clear();
+}
+
+void VirtualTextureManagerDXR::clear()
+{
+    m_loader.cancelAll();
+    m_loader.wait();
+    m_pending.clear();
+    m_loaded.clear();
+    m_entries.clear();
+    m_atlases.clear();
+    m_pages.clear();
+    m_dirty_entries = m_dirty_pages = true;
+}
+
+bool VirtualTextureManagerDXR::decodeKey(Key key, int& tid, int& level, int& x, int& y) const
+{
+    if (key > ~uint32_t(0))
+        return false;
+    mu::DecodeTileKey((uint32_t)key, tid, level, x, y);
+    if (tid >= (int)m_entries.size() || m_entries[tid].page_offset < 0)
+        return false;
+    return m_entries[tid].tiles->getLayout().getTileIndex(level, x, y) >= 0;
+}
+
+int VirtualTextureManagerDXR::findOrCreateAtlas(DXGI_FORMAT format, int padded_tile_size)
+{
+    for (int i = 0; i < (int)m_atlases.size(); ++i) {
+        auto& a = m_atlases[i];
+        if (a.format == format && a.padded_tile_size == padded_tile_size)
+            return i;
+    }
+    if (m_atlases.size() == gptDXRMaxTileAtlasCount)
+        return -1;
+
+    auto* ctx = m_context;
+    m_atlases.push_back({});
+    auto& a = m_atlases.back();
+    a.format = format;
+    a.padded_tile_size = padded_tile_size;
+
+    // footprint of a tile in the upload buffer
+    D3D12_RESOURCE_DESC tile_desc{};
+    tile_desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    tile_desc.Width = padded_tile_size;
+    tile_desc.Height = padded_tile_size;
+    tile_desc.DepthOrArraySize = 1;
+    tile_desc.MipLevels = 1;
+    tile_desc.Format = format;
+    tile_desc.SampleDesc.Count = 1;
+    UINT64 tile_bytes = 0;
+    ctx->m_device->GetCopyableFootprints(&tile_desc, 0, 1, 0, &a.footprint, &a.num_rows, &a.row_size, &tile_bytes);
+    a.upload_stride = align_to(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, tile_bytes);
+
+    // as many slots as the budget allows
+    size_t budget = Globals::getInstance().getVirtualTextureBudget();
+    int max_per_row = kMaxAtlasSize / padded_tile_size;
+    int slots = (int)std::min<size_t>(budget / (a.num_rows * a.row_size), (size_t)max_per_row * max_per_row);
+    slots = std::max(slots, 1);
+    a.slots_per_row = std::min(slots, max_per_row);
+    int rows = mu::ceildiv(slots, a.slots_per_row);
+    a.size = { a.slots_per_row * padded_tile_size, rows * padded_tile_size };
+    a.residency.reset(a.slots_per_row * rows);
+
+    a.texture = ctx->createTexture(a.size.x, a.size.y, format);
+    a.buf_upload = ctx->createUploadBuffer(a.upload_stride * gptDXRMaxTileUploadsPerFrame);
+    gptSetName(a.texture, "Tile Atlas");
+
+    auto srv = ctx->m_srv_virtual_textures + (kSRVAtlases + m_atlases.size() - 1);
+    ctx->createTextureSRV(srv, a.texture);
+    return (int)m_atlases.size() - 1;
+}
+
+void VirtualTextureManagerDXR::releaseTiles(int tid)
+{
+    auto& e = m_entries[tid];
+    if (e.page_offset < 0)
+        return;
+
+    auto& layout = e.tiles->getLayout();
+    auto& residency = m_atlases[e.atlas].residency;
+    for (int level = 0; level < layout.tiled_level_count; ++level) {
+        auto n = layout.getTileCount(level);
+        for (int y = 0; y < n.y; ++y) {
+            for (int x = 0; x < n.x; ++x) {
+                Key key = mu::EncodeTileKey(tid, level, x, y);
+                residency.release(key);
+                auto it = m_pending.find(key);
+                if (it != m_pending.end()) {
+                    m_loader.cancel(it->second);
+                    m_pending.erase(it);
+                }
+            }
+        }
+    }
+}
+
+// sync entries with the virtual textures of the context. returns true if anything is changed
+bool VirtualTextureManagerDXR::updateEntries()
+{
+    auto* ctx = m_context;
+    std::vector<std::shared_ptr<mu::TiledTextureReader>> current(ctx->m_textures.capacity());
+    std::vector<Format> formats(current.size());
+    for (auto* ptex : ctx->m_textures) {
+        if (ptex->isVirtual()) {
+            current[ptex->getID()] = ptex->getTiles();
+            formats[ptex->getID()] = ptex->getTileFormat();
+        }
+    }
+
+    bool changed = current.size() != m_entries.size();
+    for (size_t i = 0; !changed && i < current.size(); ++i)
+        changed = current[i] != m_entries[i].tiles;
+    if (!changed)
+        return false;
+
+    // release tiles of removed or replaced textures
+    for (int tid = 0; tid < (int)m_entries.size(); ++tid) {
+        if (tid >= (int)current.size() || current[tid] != m_entries[tid].tiles)
+            releaseTiles(tid);
+    }
+
+    // assign page table ranges. pages of remaining textures are moved to their new offsets
+    std::vector<Entry> entries(current.size());
+    RawVector<uint32_t> pages;
+    for (int tid = 0; tid < (int)current.size(); ++tid) {
+        auto& tiles = current[tid];
+        if (!tiles)
+            continue;
+        auto& e = entries[tid];
+        e.tiles = tiles;
+
+        auto& layout = tiles->getLayout();
+        if (!mu::CanEncodeTileKeys(tid, layout)) {
+            // out of the range of tile keys. only the tail is used
+            continue;
+        }
+        e.atlas = findOrCreateAtlas(GetDXGIFormatTyped(formats[tid]), layout.padded_tile_size);
+        if (e.atlas < 0)
+            continue;
+
+        int num_pages = layout.tile_offsets.back();
+        e.page_offset = (int)pages.size();
+        pages.resize(pages.size() + num_pages);
+        auto* dst = pages.data() + e.page_offset;
+        if (tid < (int)m_entries.size() && m_entries[tid].tiles == tiles && m_entries[tid].page_offset >= 0)
+            memcpy(dst, m_pages.cdata() + m_entries[tid].page_offset, sizeof(uint32_t) * num_pages);
+        else
+            std::fill(dst, dst + num_pages, kNonResident);
+    }
+    m_entries.swap(entries);
+    m_pages.swap(pages);
+    m_dirty_entries = m_dirty_pages = true;
+    return true;
+}
+
+void VirtualTextureManagerDXR::clearFeedback()
+{
+    auto* ctx = m_context;
+    ctx->addResourceBarrier(m_buf_feedback, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+    ctx->copyBuffer(m_buf_feedback, m_buf_feedback_clear, sizeof(uint32_t) * gptDXRTileFeedbackSize);
+    ctx->addResourceBarrier(m_buf_feedback, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+}
+
+void VirtualTextureManagerDXR::updateResources()
+{
+    auto* ctx = m_context;
+    if (!m_feedback_cleared) {
+        clearFeedback();
+        m_feedback_cleared = true;
+    }
+    updateEntries();
+
+    // upload loaded tiles
+    std::vector<LoadedTile> loaded;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex_loaded);
+        loaded.swap(m_loaded);
+    }
+    std::vector<int> upload_counts(m_atlases.size());
+    std::vector<LoadedTile> deferred;
+    for (auto& tile : loaded) {
+        int tid, level, x, y;
+        if (!decodeKey(tile.key, tid, level, x, y) || m_entries[tid].tiles != tile.tiles)
+            continue; // the texture is gone
+        if (tile.data.empty()) {
+            // the read failed. it will be requested again if still needed
+            m_pending.erase(tile.key);
+            continue;
+        }
+        auto& e = m_entries[tid];
+        auto& a = m_atlases[e.atlas];
+        int& count = upload_counts[e.atlas];
+        if (count == gptDXRMaxTileUploadsPerFrame) {
+            deferred.push_back(std::move(tile));
+            continue;
+        }
+        m_pending.erase(tile.key);
+
+        Key evicted;
+        int slot = a.residency.allocate(tile.key, &evicted);
+        if (slot < 0)
+            continue; // all slots are in use by the last frame. it will be requested again if still needed
+        if (evicted != mu::TileResidency::kInvalidKey) {
+            int etid, elevel, ex, ey;
+            if (decodeKey(evicted, etid, elevel, ex, ey))
+                m_pages[m_entries[etid].page_offset + m_entries[etid].tiles->getLayout().getTileIndex(elevel, ex, ey)] = kNonResident;
+        }
+        m_pages[e.page_offset + e.tiles->getLayout().getTileIndex(level, x, y)] = slot;
+        m_dirty_pages = true;
+
+        // to the upload buffer
+        UINT64 offset = a.upload_stride * count;
+        if (count == 0)
+            ctx->addResourceBarrier(a.texture, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
+        ++count;
+        D3D12_RANGE range{ 0, 0 };
+        Map(a.buf_upload, 0, &range, [&](char* mapped) {
+            const char* src = tile.data.cdata();
+            char* dst = mapped + offset;
+            for (UINT yi = 0; yi < a.num_rows; ++yi) {
+                memcpy(dst, src, a.row_size);
+                src += a.row_size;
+                dst += a.footprint.Footprint.RowPitch;
+            }
+        });
+
+        D3D12_TEXTURE_COPY_LOCATION dst_loc{};
+        dst_loc.pResource = a.texture;
+        dst_loc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        dst_loc.SubresourceIndex = 0;
+
+        D3D12_TEXTURE_COPY_LOCATION src_loc{};
+        src_loc.pResource = a.buf_upload;
+        src_loc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+        src_loc.PlacedFootprint = a.footprint;
+        src_loc.PlacedFootprint.Offset = offset;
+
+        UINT dx = UINT(slot % a.slots_per_row * a.padded_tile_size);
+        UINT dy = UINT(slot / a.slots_per_row * a.padded_tile_size);
+        ctx->m_cl->CopyTextureRegion(&dst_loc, dx, dy, 0, &src_loc, nullptr);
+    }
+    for (size_t i = 0; i < m_atlases.size(); ++i) {
+        if (upload_counts[i] > 0)
+            ctx->addResourceBarrier(m_atlases[i].texture, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON);
+    }
+    if (!deferred.empty()) {
+        std::unique_lock<std::mutex> lock(m_mutex_loaded);
+        for (auto& tile : deferred)
+            m_loaded.push_back(std::move(tile));
+    }
+
+    // texture data
+    if (m_dirty_entries) {
+        bool allocated = ctx->updateBuffer(m_buf_texture_data, m_buf_texture_data_staging, sizeof(TextureData) * gptDXRMaxTextureCount, [this](TextureData* dst) {
+            for (int tid = 0; tid < gptDXRMaxTextureCount; ++tid) {
+                TextureData td{};
+                td.page_offset = -1; // not virtual
+                if (tid < (int)m_entries.size() && m_entries[tid].page_offset >= 0) {
+                    auto& e = m_entries[tid];
+                    auto& layout = e.tiles->getLayout();
+                    auto& a = m_atlases[e.atlas];
+                    td.size = { layout.desc.width, layout.desc.height };
+                    td.page_offset = e.page_offset;
+                    td.atlas = e.atlas;
+                    td.tiled_levels = layout.tiled_level_count;
+                    td.tile_size = layout.desc.tile_size;
+                    td.border = layout.desc.border;
+                    td.slots_per_row = a.slots_per_row;
+                    td.atlas_texel_size = { 1.0f / a.size.x, 1.0f / a.size.y };
+                }
+                dst[tid] = td;
+            }
+        });
+        if (allocated) {
+            gptSetName(m_buf_texture_data, "Texture Data Buffer");
+            auto srv = ctx->m_srv_virtual_textures + kSRVTextureData;
+            ctx->createBufferSRV(srv, m_buf_texture_data, sizeof(TextureData));
+        }
+        m_dirty_entries = false;
+    }
+
+    // page table
+    if (m_dirty_pages) {
+        bool allocated = ctx->updateBuffer(m_buf_pages, m_buf_pages_staging, sizeof(uint32_t) * m_pages.size(), [this](uint32_t* dst) {
+            memcpy(dst, m_pages.cdata(), sizeof(uint32_t) * m_pages.size());
+        });
+        if (allocated) {
+            gptSetName(m_buf_pages, "Page Table Buffer");
+            auto srv = ctx->m_srv_virtual_textures + kSRVPages;
+            ctx->createBufferSRV(srv, m_buf_pages, sizeof(uint32_t));
+        }
+        m_dirty_pages = false;
+    }
+}
+
+void VirtualTextureManagerDXR::copyFeedback()
+{
+    auto* ctx = m_context;
+    ctx->addResourceBarrier(m_buf_feedback, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    ctx->copyBuffer(m_buf_feedback_readback, m_buf_feedback, sizeof(uint32_t) * gptDXRTileFeedbackSize);
+    ctx->addResourceBarrier(m_buf_feedback, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    clearFeedback();
+}
+
+void VirtualTextureManagerDXR::processFeedback()
+{
+    if (m_entries.empty())
+        return;
+
+    // tiles touched from here are protected from eviction until the next uploads are done
+    for (auto& a : m_atlases)
+        a.residency.nextFrame();
+
+    RawVector<uint32_t> keys;
+    keys.resize_discard(gptDXRTileFeedbackSize);
+    m_context->readbackBuffer(keys.data(), m_buf_feedback_readback, sizeof(uint32_t) * gptDXRTileFeedbackSize);
+    std::sort(keys.begin(), keys.end());
+    auto* end = std::unique(keys.begin(), keys.end());
+
+    for (auto* pkey = keys.begin(); pkey != end; ++pkey) {
+        Key key = *pkey;
+        int tid, level, x, y;
+        if (key == kEmptyFeedback || !decodeKey(key, tid, level, x, y))
+            continue;
+
+        auto& e = m_entries[tid];
+        if (m_atlases[e.atlas].residency.find(key) >= 0 || m_pending.find(key) != m_pending.end())
+            continue;
+
+        // coarse levels first. they cover larger areas and the finer levels fall back to them
+        auto tiles = e.tiles;
+        m_pending[key] = m_loader.enqueue([this, key, tiles, level, x, y]() {
+            LoadedTile tile;
+            tile.key = key;
+            tile.tiles = tiles;
+            tile.data.resize_discard(tiles->getLayout().tile_data_size);
+            // a failed tile is still reported so that updateResources() drops it from m_pending
+            if (!tiles->readTile(level, x, y, tile.data.data()))
+                tile.data.clear();
+            std::unique_lock<std::mutex> lock(m_mutex_loaded);
+            m_loaded.push_back(std::move(tile));
+        }, level);
+    }
+}
+
+} // namespace gpt
+#endif // _WIN32
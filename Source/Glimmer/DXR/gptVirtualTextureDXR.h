@@ -0,0 +1,83 @@
+#pragma once
+
+#ifdef _WIN32
+namespace gpt {
+
+class ContextDXR;
+
+// streams tiles of virtual textures into atlases.
+// the shader writes keys of the tiles it wants into a feedback buffer. it is read back after the frame and missing
+// tiles are loaded on worker threads, coarse levels first. loaded tiles are copied into the atlas of their format in
+// the next frame, evicting the least recently used ones. the page table maps tiles to atlas slots.
+class VirtualTextureManagerDXR
+{
+public:
+    using Key = mu::TileResidency::Key;
+
+    VirtualTextureManagerDXR(ContextDXR* ctx);
+    ~VirtualTextureManagerDXR();
+    void clear();
+
+    // these record commands on the context's command list
+    void updateResources(); // before DispatchRays()
+    void copyFeedback();    // after DispatchRays()
+    // after the frame is completed
+    void processFeedback();
+
+public:
+    struct Atlas
+    {
+        DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+        int padded_tile_size = 0;
+        int slots_per_row = 0;
+        int2 size{};
+        ID3D12ResourcePtr texture;
+        ID3D12ResourcePtr buf_upload;
+        UINT64 upload_stride = 0;
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint{};
+        UINT num_rows = 0;
+        UINT64 row_size = 0;
+        mu::TileResidency residency;
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<mu::TiledTextureReader> tiles;
+        int atlas = -1;
+        int page_offset = -1;
+    };
+
+    struct LoadedTile
+    {
+        Key key;
+        std::shared_ptr<mu::TiledTextureReader> tiles;
+        RawVector<char> data; // empty if the read failed
+    };
+
+    bool updateEntries();
+    int findOrCreateAtlas(DXGI_FORMAT format, int padded_tile_size);
+    void releaseTiles(int tid);
+    void clearFeedback();
+    bool decodeKey(Key key, int& tid, int& level, int& x, int& y) const;
+
+    ContextDXR* m_context = nullptr;
+    std::vector<Atlas> m_atlases;
+    std::vector<Entry> m_entries; // indexed by texture id
+    RawVector<uint32_t> m_pages;  // atlas slot of each tile. ~0 if not resident
+    bool m_dirty_entries = true;
+    bool m_dirty_pages = true;
+
+    ID3D12ResourcePtr m_buf_texture_data, m_buf_texture_data_staging;
+    ID3D12ResourcePtr m_buf_pages, m_buf_pages_staging;
+    ID3D12ResourcePtr m_buf_feedback, m_buf_feedback_clear, m_buf_feedback_readback;
+    bool m_feedback_cleared = false;
+
+    mu::ThreadPool m_loader;
+    std::unordered_map<Key, mu::ThreadPool::TaskID> m_pending;
+    std::vector<LoadedTile> m_loaded;
+    std::mutex m_mutex_loaded;
+};
+using VirtualTextureManagerDXRPtr = std::shared_ptr<VirtualTextureManagerDXR>;
+
+} // namespace gpt
+#endif // _WIN32
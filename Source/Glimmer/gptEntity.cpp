@@ -21,6 +21,72 @@ int GetTexelSize(Format v)
     }
 }
 
+mu::ImageFormat ToImageFormat(Format v)
+{
+    switch (v) {
+    case Format::Ru8: return mu::ImageFormat::Ru8;
+    case Format::RGu8: return mu::ImageFormat::RGu8;
+    case Format::RGBAu8: return mu::ImageFormat::RGBAu8;
+    case Format::Rf16: return mu::ImageFormat::Rf16;
+    case Format::RGf16: return mu::ImageFormat::RGf16;
+    case Format::RGBAf16: return mu::ImageFormat::RGBAf16;
+    case Format::Rf32: return mu::ImageFormat::Rf32;
+    case Format::RGf32: return mu::ImageFormat::RGf32;
+    case Format::RGBAf32: return mu::ImageFormat::RGBAf32;
+    default: return mu::ImageFormat::Unknown;
+    }
+}
+
+mu::BlockFormat ToBlockFormat(Format v)
+{
+    switch (v) {
+    case Format::BC1: return mu::BlockFormat::BC1;
+    case Format::BC4: return mu::BlockFormat::BC4;
+    case Format::BC5: return mu::BlockFormat::BC5;
+    case Format::BC6H: return mu::BlockFormat::BC6H;
+    case Format::BC7: return mu::BlockFormat::BC7;
+    default: return mu::BlockFormat::Unknown;
+    }
+}
+
+static Format ToFormat(mu::ImageFormat v)
+{
+    switch (v) {
+    case mu::ImageFormat::Ru8: return Format::Ru8;
+    case mu::ImageFormat::RGu8: return Format::RGu8;
+    case mu::ImageFormat::RGBAu8: return Format::RGBAu8;
+    case mu::ImageFormat::Rf16: return Format::Rf16;
+    case mu::ImageFormat::RGf16: return Format::RGf16;
+    case mu::ImageFormat::RGBAf16: return Format::RGBAf16;
+    case mu::ImageFormat::Rf32: return Format::Rf32;
+    case mu::ImageFormat::RGf32: return Format::RGf32;
+    case mu::ImageFormat::RGBAf32: return Format::RGBAf32;
+    default: return Format::Unknown;
+    }
+}
+
+Format GetTileFormat(const mu::TiledTextureLayout& layout)
+{
+    switch (layout.desc.block_format) {
+    case mu::BlockFormat::BC1: return Format::BC1;
+    case mu::BlockFormat::BC4: return Format::BC4;
+    case mu::BlockFormat::BC5: return Format::BC5;
+    case mu::BlockFormat::BC6H: return Format::BC6H;
+    case mu::BlockFormat::BC7: return Format::BC7;
+    default: return ToFormat(layout.desc.format);
+    }
+}
+
+// size of levels [0, num_levels) packed without padding
+static size_t GetMipChainSize(int width, int height, Format format, int num_levels)
+{
+    auto bf = ToBlockFormat(format);
+    if (bf == mu::BlockFormat::Unknown)
+        return mu::GetMipChainSize(width, height, ToImageFormat(format), num_levels);
+
+    return mu::GetBlockCompressedMipChainSize(width, height, bf, num_levels);
+}
+
 Globals& Globals::getInstance()
 {
     static Globals s_inst;
@@ -66,6 +132,10 @@ void Globals::enableForceUpdateAS(bool v)
 {
     setFlag(GlobalFlag::ForceUpdateAS, v);
 }
+void Globals::enableKaiserMipFilter(bool v)
+{
+    setFlag(GlobalFlag::KaiserMipFilter, v);
+}
 void Globals::setSamplesPerFrame(int v)
 {
     m_samples_per_frame = v;
@@ -74,6 +144,10 @@ void Globals::setMaxTraceDepth(int v)
 {
     m_max_trace_depth = v;
 }
+void Globals::setVirtualTextureBudget(size_t v)
+{
+    m_virtual_texture_budget = v;
+}
 
 bool Globals::isGenerateTangentsEnabled() const
 {
@@ -95,6 +169,10 @@ bool Globals::isForceUpdateASEnabled() const
 {
     return getFlag(GlobalFlag::ForceUpdateAS);
 }
+bool Globals::isKaiserMipFilterEnabled() const
+{
+    return getFlag(GlobalFlag::KaiserMipFilter);
+}
 int Globals::getSamplesPerFrame() const
 {
     return m_samples_per_frame;
@@ -103,26 +181,78 @@ int Globals::getMaxTraceDepth() const
 {
     return m_max_trace_depth;
 }
+size_t Globals::getVirtualTextureBudget() const
+{
+    return m_virtual_texture_budget;
+}
 
 Texture::Texture(int width, int height, Format format)
 {
     m_width = width;
     m_height = height;
     m_format = format;
-    m_data.resize_zeroclear(m_width * m_height * GetTexelSize(m_format));
+
+    // block compressed textures must have the base level size in multiples of 4
+    auto bf = ToBlockFormat(m_format);
+    if (bf != mu::BlockFormat::Unknown && (m_width % 4 != 0 || m_height % 4 != 0))
+        m_format = ToFormat(mu::GetBlockSourceFormat(bf));
+
+    m_mip_count = mu::GetMipCount(m_width, m_height);
+    m_data.resize_zeroclear(GetMipChainSize(m_width, m_height, m_format, m_mip_count));
     markDirty(DirtyFlag::Texture);
 }
 
+Texture::Texture(std::shared_ptr<mu::TiledTextureReader> tiles)
+    : Texture(tiles->getLayout().getTailSize().x, tiles->getLayout().getTailSize().y, GetTileFormat(tiles->getLayout()))
+{
+    m_tiles = tiles;
+    m_tile_format = GetTileFormat(m_tiles->getLayout());
+
+    RawVector<char> tail;
+    tail.resize_discard(m_tiles->getLayout().tail_data_size);
+    if (m_tiles->readTail(tail.data()))
+        upload(tail.cdata());
+}
+
 void Texture::upload(const void* src)
+{
+    auto filter = Globals::getInstance().isKaiserMipFilterEnabled() ? mu::MipFilter::Kaiser : mu::MipFilter::Box;
+    auto bf = ToBlockFormat(m_format);
+    if (bf == mu::BlockFormat::Unknown) {
+        mu::GenerateMipChain(m_data.data(), src, m_width, m_height, ToImageFormat(m_format), m_mip_count, filter);
+    }
+    else {
+        // generate the chain in the source format and encode each level
+        auto src_format = mu::GetBlockSourceFormat(bf);
+        RawVector<char> chain;
+        chain.resize_discard(mu::GetMipChainSize(m_width, m_height, src_format, m_mip_count));
+        mu::GenerateMipChain(chain.data(), src, m_width, m_height, src_format, m_mip_count, filter);
+        mu::EncodeMipChain(m_data.data(), chain.cdata(), m_width, m_height, bf, m_mip_count);
+    }
+    markDirty(DirtyFlag::TextureData);
+}
+
+void Texture::uploadMipChain(const void* src)
 {
     m_data.assign((const char*)src, m_data.size());
     markDirty(DirtyFlag::TextureData);
 }
 
-int Texture::getWidth() const { return m_width; }
-int Texture::getHeight() const { return m_height; }
+int Texture::getWidth() const { return m_tiles ? m_tiles->getLayout().desc.width : m_width; }
+int Texture::getHeight() const { return m_tiles ? m_tiles->getLayout().desc.height : m_height; }
 Format Texture::getFormat() const { return m_format; }
-Span<char> Texture::getData() const { return m_data; }
+int Texture::getMipCount() const { return m_tiles ? m_tiles->getLayout().level_count : m_mip_count; }
+Span<char> Texture::getData() const { return getMipData(0); }
+bool Texture::isVirtual() const { return m_tiles != nullptr; }
+const std::shared_ptr<mu::TiledTextureReader>& Texture::getTiles() const { return m_tiles; }
+Format Texture::getTileFormat() const { return m_tile_format; }
+
+Span<char> Texture::getMipData(int level) const
+{
+    size_t offset = GetMipChainSize(m_width, m_height, m_format, level);
+    size_t size = GetMipChainSize(m_width, m_height, m_format, level + 1) - offset;
+    return MakeSpan((char*)m_data.cdata() + offset, size);
+}
 
 
 RenderTarget::RenderTarget(int width, int height, Format format)
@@ -13,6 +13,7 @@ enum class GlobalFlag : uint32_t
     Timestamp           = 0x00000004,
     PowerStableState    = 0x00000008,
     ForceUpdateAS       = 0x00000010,
+    KaiserMipFilter     = 0x00000020,
 };
 
 enum class RenderFlag : uint32_t
@@ -73,6 +74,9 @@ inline LayerMask operator|(LayerMask a, LayerMask b) { return (LayerMask)((uint3
 
 
 int GetTexelSize(Format v);
+mu::ImageFormat ToImageFormat(Format v);
+mu::BlockFormat ToBlockFormat(Format v);
+Format GetTileFormat(const mu::TiledTextureLayout& layout); // format of the tiles and the tail of a virtual texture
 
 #define gptDefCompare(T)\
     bool operator==(const T& v) const { return std::memcmp(this, &v, sizeof(*this)) == 0; }\
@@ -201,6 +205,22 @@ struct SceneData
 };
 gptAssertAlign16(SceneData);
 
+struct TextureData
+{
+    int2 size{};            // level 0
+    int page_offset = -1;   // offset in the page table. -1 if not virtual
+    int atlas = 0;
+    int tiled_levels = 0;   // levels in the page table. lower levels are in the tail
+    int tile_size = 0;
+    int border = 0;
+    int slots_per_row = 0;
+    float2 atlas_texel_size{};
+    int2 pad{};
+
+    gptDefCompare(TextureData);
+};
+gptAssertAlign16(TextureData);
+
 struct vertex_t
 {
     float3 point;
@@ -331,16 +351,20 @@ public:
     void enableTimestamp(bool v) override;
     void enablePowerStableState(bool v) override;
     void enableForceUpdateAS(bool v) override;
+    void enableKaiserMipFilter(bool v) override;
     void setSamplesPerFrame(int v) override;
     void setMaxTraceDepth(int v) override;
+    void setVirtualTextureBudget(size_t v) override;
 
     bool isGenerateTangentsEnabled() const;
     bool isStrictUpdateCheckEnabled() const;
     bool isTimestampEnabled() const;
     bool isPowerStableStateEnabled() const;
     bool isForceUpdateASEnabled() const;
+    bool isKaiserMipFilterEnabled() const override;
     int getSamplesPerFrame() const;
     int getMaxTraceDepth() const;
+    size_t getVirtualTextureBudget() const;
 
 private:
     Globals();
@@ -351,6 +375,7 @@ private:
     uint32_t m_flags = 0;
     int m_samples_per_frame = 1;
     int m_max_trace_depth = 4;
+    size_t m_virtual_texture_budget = 256 * 1024 * 1024;
 };
 
 
@@ -363,17 +388,30 @@ class Texture : public EntityBase<ITexture>
 {
 public:
     Texture(int width, int height, Format format);
+    // virtual texture. the texture itself holds the mip tail
+    Texture(std::shared_ptr<mu::TiledTextureReader> tiles);
     void upload(const void* src) override;
+    void uploadMipChain(const void* src) override;
     int getWidth() const override;
     int getHeight() const override;
     Format getFormat() const override;
+    int getMipCount() const override;
     Span<char> getData() const override;
+    Span<char> getMipData(int level) const;
+
+    bool isVirtual() const;
+    const std::shared_ptr<mu::TiledTextureReader>& getTiles() const;
+    Format getTileFormat() const;
 
 protected:
     int m_width = 0;
     int m_height = 0;
+    int m_mip_count = 1;
     Format m_format = Format::RGBAu8;
-    RawVector<char> m_data;
+    RawVector<char> m_data; // all levels packed
+
+    std::shared_ptr<mu::TiledTextureReader> m_tiles;
+    Format m_tile_format = Format::Unknown;
 };
 gptDefRefPtr(Texture);
 gptDefBaseT(Texture, ITexture)
@@ -20,6 +20,14 @@ enum class Format : uint32_t
     Rf32,
     RGf32,
     RGBAf32,
+
+    // block compressed. ITexture::upload() takes RGBAu8 (BC1, BC7), Ru8 (BC4), RGu8 (BC5) or RGBAf16 (BC6H) and encodes it.
+    // textures whose size is not a multiple of 4 fall back to that uncompressed format.
+    BC1,
+    BC4,
+    BC5,
+    BC6H,
+    BC7,
 };
 
 enum class LightType : uint32_t
@@ -238,8 +246,13 @@ public:
     virtual void enableTimestamp(bool v) = 0;
     virtual void enablePowerStableState(bool v) = 0;
     virtual void enableForceUpdateAS(bool v) = 0;
+    // Kaiser filter for mipmaps of textures. sharper than the default box filter but slower to generate.
+    virtual void enableKaiserMipFilter(bool v) = 0;
+    virtual bool isKaiserMipFilterEnabled() const = 0;
     virtual void setSamplesPerFrame(int v) = 0;
     virtual void setMaxTraceDepth(int v) = 0;
+    // GPU memory for resident tiles of virtual textures, per tile format. read when the first virtual texture of a format is created.
+    virtual void setVirtualTextureBudget(size_t v) = 0;
 protected:
     virtual ~IGlobals() {}
 };
@@ -264,12 +277,17 @@ class ITexture : public IObject
 public:
     // actual upload will be done in IContext::render()
     // but the data is copied in upload() and so src can be discarded after calling this.
+    // mipmaps are generated from src in upload(). block compressed formats are encoded there too.
     virtual void upload(const void* src) = 0;
+    // src is levels [0, getMipCount()) of getFormat() packed without padding, block compressed formats already encoded.
+    // it is copied as is, so the chain can be prepared on other threads and this stays cheap.
+    virtual void uploadMipChain(const void* src) = 0;
 
     virtual int         getWidth() const = 0;
     virtual int         getHeight() const = 0;
     virtual Format      getFormat() const = 0;
-    virtual Span<char>  getData() const = 0;
+    virtual int         getMipCount() const = 0;
+    virtual Span<char>  getData() const = 0; // level 0
     virtual void*       getDeviceObject() const = 0;
 };
 using ITexturePtr = ref_ptr<ITexture>;
@@ -496,6 +514,9 @@ public:
     virtual IRenderTargetPtr createRenderTarget(int width, int height, Format format) = 0;
     virtual IRenderTargetPtr createRenderTarget(IWindow* window, Format format) = 0;
     virtual ITexturePtr      createTexture(int width, int height, Format format) = 0;
+    // texture backed by a tile file made by mu::WriteTiledTexture(). tiles hit by rays are loaded in the background and
+    // evicted in LRU order under the budget (see IGlobals::setVirtualTextureBudget()). returns null if path can't be opened.
+    virtual ITexturePtr      createVirtualTexture(const char* path) = 0;
     virtual IMaterialPtr     createMaterial() = 0;
     virtual IMeshPtr         createMesh() = 0;
     virtual IMeshInstancePtr createMeshInstance(IMesh* v) = 0;
@@ -11,6 +11,8 @@
 #include "muSIMD.h"
 #include "muAlgorithm.h"
 #include "muImage.h"
+#include "muBlockCompression.h"
+#include "muVirtualTexture.h"
 #include "muFont.h"
 #include "muTLS.h"
 #include "muMisc.h"
@@ -18,6 +20,7 @@
 #include "muConcurrency.h"
 #include "muCompression.h"
 #include "muStream.h"
+#include "muAsyncIO.h"
 
 namespace mu {
 
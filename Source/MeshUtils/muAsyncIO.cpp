@@ -0,0 +1,566 @@
+#include "pch.h"
+#include "muAsyncIO.h"
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/stat.h>
+#endif
+#ifdef muEnableIOUring
+    #include <cerrno>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <linux/io_uring.h>
+#endif
+
+namespace mu {
+
+// larger reads are split. io_uring takes 32 bit lengths and ReadFile() takes DWORD
+static const size_t kMaxReadSize = 1024 * 1024 * 1024;
+
+using FileHandle = intptr_t;
+static const FileHandle kInvalidFile = -1;
+
+static bool OpenForRead(const char* path, FileHandle& file, uint64_t& file_size)
+{
+#ifdef _WIN32
+    HANDLE h = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(h, &size)) {
+        ::CloseHandle(h);
+        return false;
+    }
+    file = (FileHandle)h;
+    file_size = (uint64_t)size.QuadPart;
+#else
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    file = (FileHandle)fd;
+    file_size = (uint64_t)st.st_size;
+#endif
+    return true;
+}
+
+// returns bytes read, 0 at the end of the file, or -1 on error
+static int64_t ReadAt(FileHandle file, void* dst, size_t size, uint64_t offset)
+{
+    size = std::min(size, kMaxReadSize);
+#ifdef _WIN32
+    OVERLAPPED ov{};
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD read = 0;
+    if (!::ReadFile((HANDLE)file, dst, (DWORD)size, &read, &ov))
+        return ::GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+    return (int64_t)read;
+#else
+    for (;;) {
+        ssize_t n = ::pread((int)file, dst, size, (off_t)offset);
+        if (n >= 0 || errno != EINTR)
+            return (int64_t)n;
+    }
+#endif
+}
+
+static void CloseFile(FileHandle& file)
+{
+    if (file == kInvalidFile)
+        return;
+#ifdef _WIN32
+    ::CloseHandle((HANDLE)file);
+#else
+    ::close((int)file);
+#endif
+    file = kInvalidFile;
+}
+
+
+struct AsyncIO::Op
+{
+    IORequest req;
+    Callback cb;
+    std::promise<IOResult> promise;
+    IOResult result;
+    FileHandle file = kInvalidFile;
+    char* dst = nullptr;
+    size_t size = 0; // bytes to read
+    size_t done = 0;
+    bool failed = false;
+
+    ~Op() { CloseFile(file); }
+
+    // open the file and decide the size to read
+    bool prepare()
+    {
+        uint64_t file_size = 0;
+        if (!OpenForRead(req.path.c_str(), file, file_size) || req.offset > file_size)
+            return false;
+        size_t avail = size_t(file_size - req.offset);
+        size = req.size ? std::min(req.size, avail) : avail;
+        if (req.dst) {
+            dst = (char*)req.dst;
+        }
+        else {
+            result.data.resize_discard(size);
+            dst = result.data.data();
+        }
+        return true;
+    }
+};
+
+
+#ifdef muEnableIOUring
+
+static int io_uring_setup(unsigned entries, io_uring_params* p)
+{
+    return (int)::syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return (int)::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// IORING_OP_READ and IORING_REGISTER_PROBE came with the same kernel (5.6). on older kernels the probe itself fails
+static bool IsReadSupported(int fd)
+{
+    const unsigned num_ops = IORING_OP_READ + 1;
+    std::vector<char> buf(sizeof(io_uring_probe) + sizeof(io_uring_probe_op) * num_ops);
+    auto* probe = (io_uring_probe*)buf.data();
+    if (io_uring_register(fd, IORING_REGISTER_PROBE, probe, num_ops) < 0)
+        return false;
+    return probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0;
+}
+
+struct AsyncIO::Ring
+{
+    int fd = -1;
+    void* sq_ptr = nullptr;
+    size_t sq_size = 0;
+    void* cq_ptr = nullptr;
+    size_t cq_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    unsigned entries = 0;
+    unsigned in_flight = 0;
+    std::vector<Op*> ops; // submitted reads. owned by the ring until their completion is reaped
+    bool broken = false;  // waiting for completions failed. the ring thread has left and nothing more is submitted
+    std::thread thread;
+
+    ~Ring()
+    {
+        if (sqes)
+            ::munmap(sqes, sqes_size);
+        if (cq_ptr && cq_ptr != sq_ptr)
+            ::munmap(cq_ptr, cq_size);
+        if (sq_ptr)
+            ::munmap(sq_ptr, sq_size);
+        if (fd != -1)
+            ::close(fd);
+    }
+
+    // caller must hold the lock. user_data 0 is the stop request
+    void push(uint8_t opcode, FileHandle file, void* dst, size_t size, uint64_t offset, uint64_t user_data)
+    {
+        unsigned tail = *sq_tail;
+        unsigned index = tail & sq_mask;
+        auto& sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = (int)file;
+        sqe.addr = (uint64_t)dst;
+        sqe.len = (uint32_t)std::min(size, kMaxReadSize);
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        ++in_flight;
+    }
+
+    void release(Op* op)
+    {
+        auto it = std::find(ops.begin(), ops.end(), op);
+        if (it != ops.end()) {
+            *it = ops.back();
+            ops.pop_back();
+        }
+    }
+
+    // caller must hold the lock. submits the pushed entries. on a hard error, entries the kernel has not taken are
+    // taken back and their user_data are added to dropped, so that nothing waits for them.
+    bool submit(std::vector<uint64_t>& dropped)
+    {
+        for (;;) {
+            unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            unsigned tail = *sq_tail;
+            if (head == tail)
+                return true;
+            if (io_uring_enter(fd, tail - head, 0, 0) >= 0 || errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+
+            head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            for (unsigned i = head; i != tail; ++i)
+                dropped.push_back(sqes[sq_array[i & sq_mask]].user_data);
+            __atomic_store_n(sq_tail, head, __ATOMIC_RELEASE);
+            in_flight -= tail - head;
+            return false;
+        }
+    }
+};
+
+bool AsyncIO::setupRing(int queue_depth)
+{
+    io_uring_params params{};
+    int fd = io_uring_setup((unsigned)queue_depth, &params);
+    if (fd < 0)
+        return false;
+    if (!IsReadSupported(fd)) {
+        ::close(fd);
+        return false;
+    }
+
+    auto ring = std::make_unique<Ring>();
+    auto& r = *ring;
+    r.fd = fd;
+    r.entries = params.sq_entries;
+    r.sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    r.cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+        r.sq_size = r.cq_size = std::max(r.sq_size, r.cq_size);
+
+    r.sq_ptr = ::mmap(nullptr, r.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (r.sq_ptr == MAP_FAILED) {
+        r.sq_ptr = nullptr;
+        return false;
+    }
+    if (single_mmap) {
+        r.cq_ptr = r.sq_ptr;
+    }
+    else {
+        r.cq_ptr = ::mmap(nullptr, r.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (r.cq_ptr == MAP_FAILED) {
+            r.cq_ptr = nullptr;
+            return false;
+        }
+    }
+    r.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, r.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+        return false;
+    r.sqes = (io_uring_sqe*)sqes;
+
+    auto* sq = (char*)r.sq_ptr;
+    auto* cq = (char*)r.cq_ptr;
+    r.sq_head = (unsigned*)(sq + params.sq_off.head);
+    r.sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    r.sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    r.sq_array = (unsigned*)(sq + params.sq_off.array);
+    r.cq_head = (unsigned*)(cq + params.cq_off.head);
+    r.cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    r.cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    r.cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    m_ring = std::move(ring);
+    m_ring->thread = std::thread([this]() { processRing(); });
+    return true;
+}
+
+// caller must hold m_mutex. ops that end without a read (the file can't be opened, nothing to read, or the ring refused
+// them) are added to done. caller must complete() them after unlocking
+void AsyncIO::submitRing(std::vector<OpPtr>& done)
+{
+    auto& r = *m_ring;
+    if (r.broken) {
+        for (auto& op : m_waiting) {
+            op->failed = true;
+            done.push_back(std::move(op));
+        }
+        m_waiting.clear();
+        return;
+    }
+
+    std::vector<uint64_t> dropped;
+    for (;;) {
+        while (!m_waiting.empty() && r.in_flight < r.entries) {
+            OpPtr op = std::move(m_waiting.front());
+            m_waiting.pop_front();
+            // the file is opened as the read goes to the ring, so that queued requests don't hold file handles and
+            // buffers. ops coming back for the rest of a short read are already opened
+            if (op->file == kInvalidFile && !op->prepare())
+                op->failed = true;
+            if (op->failed || op->size == 0) {
+                done.push_back(std::move(op));
+                continue;
+            }
+            Op* p = op.release();
+            r.ops.push_back(p);
+            r.push(IORING_OP_READ, p->file, p->dst + p->done, p->size - p->done, p->req.offset + p->done, (uint64_t)p);
+        }
+        // on failure the ring has room again. keep going until m_waiting is empty, or no completion would ever submit the rest
+        if (r.submit(dropped) || m_waiting.empty())
+            break;
+    }
+    for (auto user_data : dropped) {
+        OpPtr op((Op*)user_data);
+        r.release(op.get());
+        op->failed = true;
+        done.push_back(std::move(op));
+    }
+}
+
+void AsyncIO::processRing()
+{
+    auto& r = *m_ring;
+    std::vector<OpPtr> completed;
+    bool stop = false;
+    while (!stop) {
+        if (io_uring_enter(r.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            // no completion can be reaped anymore. fail the reads in flight and the queued ones, or wait() never returns
+            std::unique_lock<std::mutex> lock(m_mutex);
+            r.broken = true;
+            for (Op* p : r.ops) {
+                OpPtr op(p);
+                op->failed = true;
+                completed.push_back(std::move(op));
+            }
+            r.ops.clear();
+            r.in_flight = 0;
+            submitRing(completed);
+            lock.unlock();
+
+            for (auto& op : completed)
+                complete(std::move(op));
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        unsigned head = *r.cq_head;
+        unsigned tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            auto& cqe = r.cqes[head & r.cq_mask];
+            --r.in_flight;
+            if (cqe.user_data == 0) {
+                stop = true;
+                continue;
+            }
+
+            OpPtr op((Op*)cqe.user_data);
+            r.release(op.get());
+            if (cqe.res > 0)
+                op->done += (size_t)cqe.res;
+            else if (cqe.res < 0 && cqe.res != -EAGAIN && cqe.res != -EINTR)
+                op->failed = true;
+
+            if (!op->failed && cqe.res != 0 && op->done < op->size)
+                m_waiting.push_front(std::move(op)); // short read. read the rest
+            else
+                completed.push_back(std::move(op));
+        }
+        __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+        submitRing(completed);
+        lock.unlock();
+
+        for (auto& op : completed)
+            complete(std::move(op));
+        completed.clear();
+    }
+}
+
+#else // muEnableIOUring
+
+struct AsyncIO::Ring {};
+
+#endif // muEnableIOUring
+
+
+AsyncIO::AsyncIO(int queue_depth)
+    : m_queue_depth(std::max(queue_depth, 1))
+{
+#ifdef muEnableIOUring
+    if (setupRing(m_queue_depth))
+        return;
+    m_ring.reset();
+#endif
+    m_pool = std::make_unique<ThreadPool>(m_queue_depth);
+}
+
+AsyncIO::~AsyncIO()
+{
+    wait();
+#ifdef muEnableIOUring
+    if (m_ring) {
+        bool stopped;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_ring->broken) {
+                // the ring thread has already left
+                stopped = true;
+            }
+            else {
+                std::vector<uint64_t> dropped;
+                m_ring->push(IORING_OP_NOP, -1, nullptr, 0, 0, 0);
+                stopped = m_ring->submit(dropped);
+            }
+        }
+        if (stopped) {
+            m_ring->thread.join();
+        }
+        else {
+            // the ring thread can't be woken. nothing is in flight, so it stays blocked on the ring, which is leaked
+            // to keep it valid
+            m_ring->thread.detach();
+            m_ring.release();
+        }
+    }
+#endif
+}
+
+std::future<IOResult> AsyncIO::read(const IORequest& req, const Callback& cb)
+{
+    auto op = std::make_unique<Op>();
+    op->req = req;
+    op->cb = cb;
+    auto ret = op->promise.get_future();
+
+    std::vector<OpPtr> ops;
+    ops.push_back(std::move(op));
+    submit(ops);
+    return ret;
+}
+
+std::future<IOResult> AsyncIO::readFile(const char* path, const Callback& cb)
+{
+    IORequest req;
+    req.path = path;
+    return read(req, cb);
+}
+
+std::vector<std::future<IOResult>> AsyncIO::read(const std::vector<IORequest>& reqs, const BatchCallback& cb)
+{
+    std::vector<std::future<IOResult>> ret;
+    std::vector<OpPtr> ops;
+    ret.reserve(reqs.size());
+    ops.reserve(reqs.size());
+    for (size_t i = 0; i < reqs.size(); ++i) {
+        auto op = std::make_unique<Op>();
+        op->req = reqs[i];
+        if (cb)
+            op->cb = [cb, i](IOResult& result) { cb(i, result); };
+        ret.push_back(op->promise.get_future());
+        ops.push_back(std::move(op));
+    }
+    submit(ops);
+    return ret;
+}
+
+void AsyncIO::submit(std::vector<OpPtr>& ops)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_pending += ops.size();
+    }
+
+    if (m_ring) {
+#ifdef muEnableIOUring
+        // files are opened by submitRing() when the reads go to the ring
+        std::vector<OpPtr> done;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            for (auto& op : ops)
+                m_waiting.push_back(std::move(op));
+            submitRing(done);
+        }
+        for (auto& op : done)
+            complete(std::move(op));
+#endif
+    }
+    else {
+        for (auto& op : ops) {
+            // std::function needs copyable captures. the task owns op from here
+            Op* p = op.release();
+            m_pool->enqueue([this, p]() {
+                OpPtr op(p);
+                readSync(*op);
+                complete(std::move(op));
+            });
+        }
+    }
+    ops.clear();
+}
+
+void AsyncIO::readSync(Op& op)
+{
+    if (!op.prepare()) {
+        op.failed = true;
+        return;
+    }
+    while (op.done < op.size) {
+        int64_t n = ReadAt(op.file, op.dst + op.done, op.size - op.done, op.req.offset + op.done);
+        if (n < 0)
+            op.failed = true;
+        if (n <= 0)
+            break;
+        op.done += (size_t)n;
+    }
+}
+
+void AsyncIO::complete(OpPtr op)
+{
+    CloseFile(op->file);
+    auto& result = op->result;
+    result.ok = !op->failed;
+    result.size = op->done;
+    if (!op->req.dst)
+        result.data.resize(op->done);
+
+    if (op->cb)
+        op->cb(result);
+    op->promise.set_value(std::move(result));
+    op.reset();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (--m_pending == 0)
+        m_cond_idle.notify_all();
+}
+
+void AsyncIO::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond_idle.wait(lock, [this]() { return m_pending == 0; });
+}
+
+size_t AsyncIO::getPendingCount() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_pending;
+}
+
+bool AsyncIO::isIOUring() const
+{
+    return m_ring != nullptr;
+}
+
+} // namespace mu
@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include "muMath.h"
+#include "muRawVector.h"
+#include "muConcurrency.h"
+
+#if defined(muEnableIOUring) && !defined(__linux__)
+    #undef muEnableIOUring
+#endif
+
+namespace mu {
+
+struct IORequest
+{
+    std::string path;
+    uint64_t offset = 0;
+    size_t size = 0;      // 0: to the end of the file
+    void* dst = nullptr;  // nullptr: read into IOResult::data. otherwise it must have room for size bytes
+};
+
+struct IOResult
+{
+    bool ok = false;
+    size_t size = 0;      // bytes read. can be less than requested at the end of the file
+    RawVector<char> data; // empty if IORequest::dst is given
+};
+
+// asynchronous file reads.
+// requests are queued and completed on background threads, so the caller can decode one file while others are read.
+// with muEnableIOUring (Linux 5.6+), reads go through an io_uring and a batch is submitted with one syscall.
+// otherwise, or if the kernel refuses io_uring or lacks IORING_OP_READ, they are pread() (ReadFile() on Windows) on a ThreadPool.
+// if the ring fails to submit or to wait for completions, the reads complete with IOResult::ok == false.
+// callbacks run on an I/O thread before the future becomes ready. heavy work should be passed to other threads.
+class AsyncIO
+{
+public:
+    using Callback = std::function<void(IOResult& result)>;
+    using BatchCallback = std::function<void(size_t index, IOResult& result)>;
+
+    // queue_depth: max reads in flight. also the number of threads of the fallback
+    explicit AsyncIO(int queue_depth = 32);
+    // waits for the queued requests
+    ~AsyncIO();
+    AsyncIO(const AsyncIO& v) = delete;
+    AsyncIO& operator=(const AsyncIO& v) = delete;
+
+    std::future<IOResult> read(const IORequest& req, const Callback& cb = {});
+    std::future<IOResult> readFile(const char* path, const Callback& cb = {});
+    // callback receives the index in reqs
+    std::vector<std::future<IOResult>> read(const std::vector<IORequest>& reqs, const BatchCallback& cb = {});
+
+    // wait until all requests are completed
+    void wait();
+    size_t getPendingCount() const;
+    bool isIOUring() const;
+
+private:
+    struct Op;
+    using OpPtr = std::unique_ptr<Op>;
+    struct Ring;
+
+    void submit(std::vector<OpPtr>& ops);
+    void complete(OpPtr op);
+    void readSync(Op& op);
+#ifdef muEnableIOUring
+    bool setupRing(int queue_depth);
+    void submitRing(std::vector<OpPtr>& done);
+    void processRing();
+#endif
+
+    int m_queue_depth = 0;
+    std::unique_ptr<ThreadPool> m_pool;
+    std::unique_ptr<Ring> m_ring;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond_idle;
+    std::deque<OpPtr> m_waiting; // not yet submitted to the ring. files are opened as they leave it
+    size_t m_pending = 0;        // not yet completed
+};
+
+} // namespace mu
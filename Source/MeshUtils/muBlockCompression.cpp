@@ -0,0 +1,1145 @@
+#include "pch.h"
+#include "muMath.h"
+#include "muHalf.h"
+#include "muBlockCompression.h"
+#include "muConcurrency.h"
+#include <climits>
+
+namespace mu {
+
+static const int kBCWeights2[4] = { 0, 21, 43, 64 };
+static const int kBCWeights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const int kBCWeights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// subset of each pixel (bit i: pixel i) of the 64 two subset partitions. BC6H uses the first 32
+static const uint16_t kBCPartition2[64] = {
+    0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+    0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+    0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+    0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+    0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+    0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+    0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+    0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+};
+
+// subset of each pixel (bits 2i+1:2i: pixel i) of the 64 three subset partitions
+static const uint32_t kBCPartition3[64] = {
+    0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+    0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+    0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+    0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+    0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+    0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+    0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+    0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254,
+};
+
+// index of the anchor pixel of subset 1 in two subset partitions and subset 1 and 2 in three subset ones.
+// the MSB of an anchor index is implicitly 0
+static const uint8_t kBCAnchor2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+     6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+};
+static const uint8_t kBCAnchor3[2][64] = {
+    {
+         3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+         3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+         8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+         3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+    },
+    {
+        15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+        15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+        15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+        15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+    },
+};
+
+int GetBlockSize(BlockFormat f)
+{
+    switch (f) {
+    case BlockFormat::BC1:
+    case BlockFormat::BC4:
+        return 8;
+    case BlockFormat::BC5:
+    case BlockFormat::BC6H:
+    case BlockFormat::BC7:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+ImageFormat GetBlockSourceFormat(BlockFormat f)
+{
+    switch (f) {
+    case BlockFormat::BC1: return ImageFormat::RGBAu8;
+    case BlockFormat::BC4: return ImageFormat::Ru8;
+    case BlockFormat::BC5: return ImageFormat::RGu8;
+    case BlockFormat::BC6H: return ImageFormat::RGBAf16;
+    case BlockFormat::BC7: return ImageFormat::RGBAu8;
+    default: return ImageFormat::Unknown;
+    }
+}
+
+int2 GetBlockCount(int width, int height)
+{
+    return { (width + 3) / 4, (height + 3) / 4 };
+}
+
+size_t GetBlockCompressedSize(int width, int height, BlockFormat f)
+{
+    auto n = GetBlockCount(width, height);
+    return (size_t)n.x * n.y * GetBlockSize(f);
+}
+
+size_t GetBlockCompressedMipChainSize(int width, int height, BlockFormat f, int num_levels)
+{
+    size_t ret = 0;
+    for (int i = 0; i < num_levels; ++i) {
+        auto size = GetMipSize(width, height, i);
+        ret += GetBlockCompressedSize(size.x, size.y, f);
+    }
+    return ret;
+}
+
+
+// common
+
+// little endian bit stream of a 128 bit block
+struct bc_bits
+{
+    uint64_t v[2] = { 0, 0 };
+    int pos = 0;
+
+    void put(uint32_t bits, int n)
+    {
+        uint64_t b = bits & ((1ull << n) - 1);
+        int i = pos >> 6, s = pos & 63;
+        v[i] |= b << s;
+        if (s + n > 64)
+            v[i + 1] |= b >> (64 - s);
+        pos += n;
+    }
+
+    uint32_t get(int n)
+    {
+        int i = pos >> 6, s = pos & 63;
+        uint64_t b = v[i] >> s;
+        if (s + n > 64)
+            b |= v[i + 1] << (64 - s);
+        pos += n;
+        return (uint32_t)(b & ((1ull << n) - 1));
+    }
+};
+
+template<class T, int N>
+static inline void bc_load_block(T (&dst)[16][N], const T* src, int width, int height, int bx, int by)
+{
+    for (int y = 0; y < 4; ++y) {
+        int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; ++x) {
+            int sx = std::min(bx * 4 + x, width - 1);
+            const T* s = src + ((size_t)sy * width + sx) * N;
+            for (int c = 0; c < N; ++c)
+                dst[y * 4 + x][c] = s[c];
+        }
+    }
+}
+
+template<class T, int N>
+static inline void bc_store_block(T* dst, const T (&src)[16][N], int width, int height, int bx, int by)
+{
+    int w = std::min(4, width - bx * 4);
+    int h = std::min(4, height - by * 4);
+    for (int y = 0; y < h; ++y) {
+        T* d = dst + ((size_t)(by * 4 + y) * width + bx * 4) * N;
+        for (int x = 0; x < w; ++x)
+            for (int c = 0; c < N; ++c)
+                d[x * N + c] = src[y * 4 + x][c];
+    }
+}
+
+// endpoints at the extremes of the principal axis of the first N channels of px
+template<int N>
+static void bc_fit_axis(const float (&px)[16][4], int n, float (&e0)[4], float (&e1)[4])
+{
+    float mean[4] = {}, mn[4], mx[4];
+    for (int c = 0; c < N; ++c) {
+        mn[c] = mx[c] = px[0][c];
+    }
+    for (int i = 0; i < n; ++i) {
+        for (int c = 0; c < N; ++c) {
+            mean[c] += px[i][c];
+            mn[c] = std::min(mn[c], px[i][c]);
+            mx[c] = std::max(mx[c], px[i][c]);
+        }
+    }
+    for (int c = 0; c < N; ++c)
+        mean[c] /= (float)n;
+
+    float cov[4][4] = {};
+    for (int i = 0; i < n; ++i) {
+        float d[4];
+        for (int c = 0; c < N; ++c)
+            d[c] = px[i][c] - mean[c];
+        for (int a = 0; a < N; ++a)
+            for (int b = 0; b < N; ++b)
+                cov[a][b] += d[a] * d[b];
+    }
+
+    // power iteration starting from the bounding box diagonal
+    float axis[4] = {};
+    for (int c = 0; c < N; ++c)
+        axis[c] = mx[c] - mn[c];
+    for (int it = 0; it < 4; ++it) {
+        float t[4] = {}, m = 0.0f;
+        for (int a = 0; a < N; ++a) {
+            for (int b = 0; b < N; ++b)
+                t[a] += cov[a][b] * axis[b];
+            m = std::max(m, std::abs(t[a]));
+        }
+        if (m < 1e-8f)
+            break;
+        for (int c = 0; c < N; ++c)
+            axis[c] = t[c] / m;
+    }
+
+    float len2 = 0.0f;
+    for (int c = 0; c < N; ++c)
+        len2 += axis[c] * axis[c];
+    if (len2 < 1e-12f) {
+        for (int c = 0; c < N; ++c)
+            e0[c] = e1[c] = mean[c];
+        return;
+    }
+    float rlen = 1.0f / std::sqrt(len2);
+    for (int c = 0; c < N; ++c)
+        axis[c] *= rlen;
+
+    float tmin = FLT_MAX, tmax = -FLT_MAX;
+    for (int i = 0; i < n; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < N; ++c)
+            t += (px[i][c] - mean[c]) * axis[c];
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t);
+    }
+    for (int c = 0; c < N; ++c) {
+        e0[c] = mean[c] + axis[c] * tmin;
+        e1[c] = mean[c] + axis[c] * tmax;
+    }
+}
+
+// least squares endpoints for fixed interpolation weights (0: e0, 1: e1)
+template<int N>
+static bool bc_refine(const float (&px)[16][4], int n, const float (&w)[16], float (&e0)[4], float (&e1)[4])
+{
+    float a = 0.0f, b = 0.0f, c = 0.0f, x[4] = {}, y[4] = {};
+    for (int i = 0; i < n; ++i) {
+        float t = w[i], s = 1.0f - t;
+        a += s * s;
+        b += s * t;
+        c += t * t;
+        for (int ch = 0; ch < N; ++ch) {
+            x[ch] += s * px[i][ch];
+            y[ch] += t * px[i][ch];
+        }
+    }
+    float det = a * c - b * b;
+    if (std::abs(det) < 1e-6f)
+        return false;
+    float rdet = 1.0f / det;
+    for (int ch = 0; ch < N; ++ch) {
+        e0[ch] = (c * x[ch] - b * y[ch]) * rdet;
+        e1[ch] = (a * y[ch] - b * x[ch]) * rdet;
+    }
+    return true;
+}
+
+static inline int bc_interpolate(int e0, int e1, int w)
+{
+    return ((64 - w) * e0 + w * e1 + 32) >> 6;
+}
+
+static inline int bc_quantize(float v, int bits)
+{
+    int m = (1 << bits) - 1;
+    return clamp((int)(clamp(v, 0.0f, 255.0f) * m / 255.0f + 0.5f), 0, m);
+}
+
+
+// BC1
+
+static inline uint16_t bc1_pack565(const float (&c)[4])
+{
+    return (uint16_t)((bc_quantize(c[0], 5) << 11) | (bc_quantize(c[1], 6) << 5) | bc_quantize(c[2], 5));
+}
+
+static inline void bc1_palette(uint16_t c0, uint16_t c1, int (&pal)[4][4])
+{
+    auto unpack = [](uint16_t v, int (&d)[4]) {
+        int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+        d[0] = (r << 3) | (r >> 2);
+        d[1] = (g << 2) | (g >> 4);
+        d[2] = (b << 3) | (b >> 2);
+        d[3] = 255;
+    };
+    unpack(c0, pal[0]);
+    unpack(c1, pal[1]);
+    if (c0 > c1) {
+        for (int c = 0; c < 3; ++c) {
+            pal[2][c] = (2 * pal[0][c] + pal[1][c]) / 3;
+            pal[3][c] = (pal[0][c] + 2 * pal[1][c]) / 3;
+        }
+        pal[2][3] = pal[3][3] = 255;
+    }
+    else {
+        for (int c = 0; c < 3; ++c)
+            pal[2][c] = (pal[0][c] + pal[1][c]) / 2;
+        pal[2][3] = 255;
+        pal[3][0] = pal[3][1] = pal[3][2] = pal[3][3] = 0;
+    }
+}
+
+static void bc1_encode_block(uint8_t* dst, const uint8_t (&block)[16][4], BlockQuality quality)
+{
+    // texels with alpha < 128 become transparent, which requires the 3 color mode
+    float px[16][4];
+    int n = 0;
+    bool transparent = false;
+    for (int i = 0; i < 16; ++i) {
+        if (block[i][3] < 128) {
+            transparent = true;
+            continue;
+        }
+        for (int c = 0; c < 3; ++c)
+            px[n][c] = block[i][c];
+        ++n;
+    }
+
+    uint16_t best_c0 = 0, best_c1 = 0;
+    uint32_t best_indices = 0xffffffff;
+    if (n > 0) {
+        float e0[4], e1[4];
+        bc_fit_axis<3>(px, n, e0, e1);
+
+        static const float kWeights4[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+        static const float kWeights3[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+
+        int iterations = quality == BlockQuality::High ? 2 : 0;
+        int best_err = INT_MAX;
+        for (int it = 0; it <= iterations; ++it) {
+            uint16_t c0 = bc1_pack565(e0), c1 = bc1_pack565(e1);
+            if (transparent ? c0 > c1 : c0 < c1) {
+                std::swap(c0, c1);
+                std::swap(e0, e1);
+            }
+            bool three = c0 <= c1;
+            int num_colors = three ? 3 : 4;
+
+            int pal[4][4];
+            bc1_palette(c0, c1, pal);
+
+            uint32_t indices = 0;
+            int err = 0;
+            float w[16];
+            for (int i = 0, pi = 0; i < 16; ++i) {
+                if (block[i][3] < 128) {
+                    indices |= 3u << (i * 2);
+                    continue;
+                }
+                int bi = 0, be = INT_MAX;
+                for (int k = 0; k < num_colors; ++k) {
+                    int dr = block[i][0] - pal[k][0], dg = block[i][1] - pal[k][1], db = block[i][2] - pal[k][2];
+                    int e = dr * dr + dg * dg + db * db;
+                    if (e < be) {
+                        be = e;
+                        bi = k;
+                    }
+                }
+                indices |= (uint32_t)bi << (i * 2);
+                err += be;
+                w[pi++] = three ? kWeights3[bi] : kWeights4[bi];
+            }
+            if (err < best_err) {
+                best_err = err;
+                best_c0 = c0;
+                best_c1 = c1;
+                best_indices = indices;
+            }
+            if (err == 0 || it == iterations || !bc_refine<3>(px, n, w, e0, e1))
+                break;
+        }
+    }
+
+    dst[0] = (uint8_t)best_c0;
+    dst[1] = (uint8_t)(best_c0 >> 8);
+    dst[2] = (uint8_t)best_c1;
+    dst[3] = (uint8_t)(best_c1 >> 8);
+    memcpy(dst + 4, &best_indices, 4);
+}
+
+static void bc1_decode_block(uint8_t (&dst)[16][4], const uint8_t* src)
+{
+    uint16_t c0 = (uint16_t)(src[0] | (src[1] << 8));
+    uint16_t c1 = (uint16_t)(src[2] | (src[3] << 8));
+    uint32_t indices;
+    memcpy(&indices, src + 4, 4);
+
+    int pal[4][4];
+    bc1_palette(c0, c1, pal);
+    for (int i = 0; i < 16; ++i) {
+        int k = (indices >> (i * 2)) & 3;
+        for (int c = 0; c < 4; ++c)
+            dst[i][c] = (uint8_t)pal[k][c];
+    }
+}
+
+
+// BC4
+
+static inline void bc4_palette(int r0, int r1, int (&pal)[8])
+{
+    pal[0] = r0;
+    pal[1] = r1;
+    if (r0 > r1) {
+        for (int i = 2; i < 8; ++i)
+            pal[i] = ((8 - i) * r0 + (i - 1) * r1 + 3) / 7;
+    }
+    else {
+        for (int i = 2; i < 6; ++i)
+            pal[i] = ((6 - i) * r0 + (i - 1) * r1 + 2) / 5;
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+}
+
+static int bc4_try(const uint8_t (&v)[16], int r0, int r1, uint64_t& indices)
+{
+    int pal[8];
+    bc4_palette(r0, r1, pal);
+    int err = 0;
+    indices = 0;
+    for (int i = 0; i < 16; ++i) {
+        int bi = 0, be = INT_MAX;
+        for (int k = 0; k < 8; ++k) {
+            int d = v[i] - pal[k];
+            if (d * d < be) {
+                be = d * d;
+                bi = k;
+            }
+        }
+        indices |= (uint64_t)bi << (i * 3);
+        err += be;
+    }
+    return err;
+}
+
+static void bc4_encode_block(uint8_t* dst, const uint8_t (&v)[16], BlockQuality quality)
+{
+    int mn = 255, mx = 0;
+    for (int i = 0; i < 16; ++i) {
+        mn = std::min<int>(mn, v[i]);
+        mx = std::max<int>(mx, v[i]);
+    }
+
+    int r0 = mx, r1 = mn;
+    uint64_t indices;
+    int err = bc4_try(v, r0, r1, indices);
+
+    // the 6 value mode has exact 0 and 255, which helps blocks that have both extremes and mid values
+    if (quality == BlockQuality::High && err > 0 && (mn == 0 || mx == 255)) {
+        int mn2 = 255, mx2 = 0;
+        for (int i = 0; i < 16; ++i) {
+            if (v[i] != 0 && v[i] != 255) {
+                mn2 = std::min<int>(mn2, v[i]);
+                mx2 = std::max<int>(mx2, v[i]);
+            }
+        }
+        if (mn2 > mx2)
+            mn2 = mx2 = 0;
+        uint64_t indices2;
+        int err2 = bc4_try(v, mn2, mx2, indices2);
+        if (err2 < err) {
+            r0 = mn2;
+            r1 = mx2;
+            indices = indices2;
+        }
+    }
+
+    dst[0] = (uint8_t)r0;
+    dst[1] = (uint8_t)r1;
+    for (int i = 0; i < 6; ++i)
+        dst[2 + i] = (uint8_t)(indices >> (i * 8));
+}
+
+static void bc4_decode_block(uint8_t (&dst)[16], const uint8_t* src)
+{
+    int pal[8];
+    bc4_palette(src[0], src[1], pal);
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i)
+        indices |= (uint64_t)src[2 + i] << (i * 8);
+    for (int i = 0; i < 16; ++i)
+        dst[i] = (uint8_t)pal[(indices >> (i * 3)) & 7];
+}
+
+
+// BC7
+
+static void bc7_encode_block(uint8_t* dst, const uint8_t (&block)[16][4], BlockQuality quality)
+{
+    // mode 6: one subset, RGBA 7 bit endpoints + per endpoint p-bit, 4 bit indices
+    float px[16][4];
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 4; ++c)
+            px[i][c] = block[i][c];
+
+    float e0[4], e1[4];
+    bc_fit_axis<4>(px, 16, e0, e1);
+
+    // quantized endpoints for p-bit p
+    auto quantize = [](const float (&e)[4], int p, int (&q)[4]) {
+        int err = 0;
+        for (int c = 0; c < 4; ++c) {
+            q[c] = clamp((int)((clamp(e[c], 0.0f, 255.0f) - p) * 0.5f + 0.5f), 0, 127);
+            float d = e[c] - (float)((q[c] << 1) | p);
+            err += (int)(d * d);
+        }
+        return err;
+    };
+
+    // returns total error. fills indices and interpolation weights
+    auto evaluate = [&](const int (&q0)[4], int p0, const int (&q1)[4], int p1, uint8_t (&idx)[16]) {
+        int pal[16][4];
+        for (int c = 0; c < 4; ++c) {
+            int a = (q0[c] << 1) | p0, b = (q1[c] << 1) | p1;
+            for (int k = 0; k < 16; ++k)
+                pal[k][c] = bc_interpolate(a, b, kBCWeights4[k]);
+        }
+        int err = 0;
+        for (int i = 0; i < 16; ++i) {
+            int bi = 0, be = INT_MAX;
+            for (int k = 0; k < 16; ++k) {
+                int e = 0;
+                for (int c = 0; c < 4; ++c) {
+                    int d = block[i][c] - pal[k][c];
+                    e += d * d;
+                }
+                if (e < be) {
+                    be = e;
+                    bi = k;
+                }
+            }
+            idx[i] = (uint8_t)bi;
+            err += be;
+        }
+        return err;
+    };
+
+    int best_err = INT_MAX, best_q0[4], best_q1[4], best_p0 = 0, best_p1 = 0;
+    uint8_t best_idx[16];
+
+    int iterations = quality == BlockQuality::High ? 2 : 0;
+    for (int it = 0; it <= iterations; ++it) {
+        int q[2][2][4], qe[2][2];
+        for (int p = 0; p < 2; ++p) {
+            qe[0][p] = quantize(e0, p, q[0][p]);
+            qe[1][p] = quantize(e1, p, q[1][p]);
+        }
+
+        int err = INT_MAX;
+        uint8_t idx[16];
+        int p0 = 0, p1 = 0;
+        if (quality == BlockQuality::High) {
+            // p-bits by the resulting palette error
+            for (int a = 0; a < 2; ++a) {
+                for (int b = 0; b < 2; ++b) {
+                    uint8_t tidx[16];
+                    int e = evaluate(q[0][a], a, q[1][b], b, tidx);
+                    if (e < err) {
+                        err = e;
+                        p0 = a;
+                        p1 = b;
+                        memcpy(idx, tidx, sizeof(idx));
+                    }
+                }
+            }
+        }
+        else {
+            // p-bits by the endpoint quantization error
+            p0 = qe[0][1] < qe[0][0] ? 1 : 0;
+            p1 = qe[1][1] < qe[1][0] ? 1 : 0;
+            err = evaluate(q[0][p0], p0, q[1][p1], p1, idx);
+        }
+
+        if (err < best_err) {
+            best_err = err;
+            memcpy(best_q0, q[0][p0], sizeof(best_q0));
+            memcpy(best_q1, q[1][p1], sizeof(best_q1));
+            best_p0 = p0;
+            best_p1 = p1;
+            memcpy(best_idx, idx, sizeof(idx));
+        }
+
+        if (err == 0 || it == iterations)
+            break;
+        float w[16];
+        for (int i = 0; i < 16; ++i)
+            w[i] = kBCWeights4[idx[i]] / 64.0f;
+        if (!bc_refine<4>(px, 16, w, e0, e1))
+            break;
+    }
+
+    // the MSB of the anchor index is implicitly 0
+    if (best_idx[0] & 8) {
+        std::swap(best_q0, best_q1);
+        std::swap(best_p0, best_p1);
+        for (auto& i : best_idx)
+            i = (uint8_t)(15 - i);
+    }
+
+    bc_bits bits;
+    bits.put(1 << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        bits.put(best_q0[c], 7);
+        bits.put(best_q1[c], 7);
+    }
+    bits.put(best_p0, 1);
+    bits.put(best_p1, 1);
+    bits.put(best_idx[0], 3);
+    for (int i = 1; i < 16; ++i)
+        bits.put(best_idx[i], 4);
+    memcpy(dst, bits.v, 16);
+}
+
+static bool bc7_decode_block(uint8_t (&dst)[16][4], const uint8_t* src)
+{
+    struct mode_desc
+    {
+        int subsets, partition_bits, rotation_bits, index_mode_bits;
+        int color_bits, alpha_bits; // alpha_bits == 0: opaque
+        int endpoint_pbits, shared_pbits; // p-bit per endpoint or per subset
+        int index_bits, index_bits2; // index_bits2 != 0: separate color and alpha indices
+    };
+    static const mode_desc kModes[8] = {
+        { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+        { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+        { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+        { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+        { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+        { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+        { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+        { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+    };
+
+    bc_bits bits;
+    memcpy(bits.v, src, 16);
+
+    int mode = 0;
+    while (mode < 8 && bits.get(1) == 0)
+        ++mode;
+    if (mode == 8) {
+        // reserved. decodes as transparent black
+        memset(dst, 0, sizeof(dst));
+        return false;
+    }
+    auto& m = kModes[mode];
+    int partition = bits.get(m.partition_bits);
+    int rotation = bits.get(m.rotation_bits);
+    int index_mode = bits.get(m.index_mode_bits);
+
+    // endpoints are stored channel by channel, subset by subset
+    int e[3][2][4];
+    int num_channels = m.alpha_bits ? 4 : 3;
+    for (int c = 0; c < num_channels; ++c)
+        for (int s = 0; s < m.subsets; ++s)
+            for (int j = 0; j < 2; ++j)
+                e[s][j][c] = bits.get(c < 3 ? m.color_bits : m.alpha_bits);
+
+    int pbits = m.endpoint_pbits | m.shared_pbits;
+    for (int s = 0; s < m.subsets; ++s) {
+        int p[2] = {};
+        if (m.endpoint_pbits) {
+            p[0] = bits.get(1);
+            p[1] = bits.get(1);
+        }
+        else if (m.shared_pbits)
+            p[0] = p[1] = bits.get(1);
+        for (int j = 0; j < 2; ++j) {
+            for (int c = 0; c < num_channels; ++c) {
+                int nb = (c < 3 ? m.color_bits : m.alpha_bits) + pbits;
+                int v = (e[s][j][c] << pbits) | p[j];
+                e[s][j][c] = (v << (8 - nb)) | (v >> (2 * nb - 8));
+            }
+            if (num_channels == 3)
+                e[s][j][3] = 255;
+        }
+    }
+
+    int subset[16];
+    bool anchor[16];
+    for (int i = 0; i < 16; ++i) {
+        if (m.subsets == 2) {
+            subset[i] = (kBCPartition2[partition] >> i) & 1;
+            anchor[i] = i == 0 || i == kBCAnchor2[partition];
+        }
+        else if (m.subsets == 3) {
+            subset[i] = (kBCPartition3[partition] >> (i * 2)) & 3;
+            anchor[i] = i == 0 || i == kBCAnchor3[0][partition] || i == kBCAnchor3[1][partition];
+        }
+        else {
+            subset[i] = 0;
+            anchor[i] = i == 0;
+        }
+    }
+
+    auto get_weights = [](int n) {
+        return n == 2 ? kBCWeights2 : n == 3 ? kBCWeights3 : kBCWeights4;
+    };
+    int idx[2][16] = {};
+    for (int i = 0; i < 16; ++i)
+        idx[0][i] = bits.get(anchor[i] ? m.index_bits - 1 : m.index_bits);
+    if (m.index_bits2) {
+        for (int i = 0; i < 16; ++i)
+            idx[1][i] = bits.get(i == 0 ? m.index_bits2 - 1 : m.index_bits2);
+    }
+
+    // with two index sets index_mode selects the one for color. the other goes to alpha
+    int cs = m.index_bits2 ? index_mode : 0;
+    int as = m.index_bits2 ? 1 - index_mode : 0;
+    const int* cw = get_weights(cs ? m.index_bits2 : m.index_bits);
+    const int* aw = get_weights(as ? m.index_bits2 : m.index_bits);
+    for (int i = 0; i < 16; ++i) {
+        auto& ep = e[subset[i]];
+        int v[4];
+        for (int c = 0; c < 3; ++c)
+            v[c] = bc_interpolate(ep[0][c], ep[1][c], cw[idx[cs][i]]);
+        v[3] = bc_interpolate(ep[0][3], ep[1][3], aw[idx[as][i]]);
+        if (rotation > 0)
+            std::swap(v[3], v[rotation - 1]);
+        for (int c = 0; c < 4; ++c)
+            dst[i][c] = (uint8_t)v[c];
+    }
+    return true;
+}
+
+// BC6H
+
+// unsigned half bits are interpolated in a 16 bit domain and scaled by 31/64 at the end
+
+static inline float bc6h_to_domain(uint16_t h)
+{
+    if (h & 0x8000)
+        return 0.0f;
+    return (float)std::min<int>(h, 0x7bff) * (64.0f / 31.0f);
+}
+
+static inline int bc6h_unquantize(int q, int bits = 10)
+{
+    if (bits >= 15)
+        return q;
+    if (q == 0)
+        return 0;
+    if (q == (1 << bits) - 1)
+        return 0xffff;
+    return ((q << 16) + 0x8000) >> bits;
+}
+
+static inline int bc6h_finish(int v)
+{
+    return (v * 31) >> 6;
+}
+
+static inline int bc6h_quantize(float v)
+{
+    int q = clamp((int)((v - 32.0f) / 64.0f + 0.5f), 0, 1023);
+    int best = q;
+    float be = std::abs(v - bc6h_unquantize(q));
+    for (int c : { q - 1, q + 1 }) {
+        if (c < 0 || c > 1023)
+            continue;
+        float e = std::abs(v - bc6h_unquantize(c));
+        if (e < be) {
+            be = e;
+            best = c;
+        }
+    }
+    return best;
+}
+
+static void bc6h_encode_block(uint8_t* dst, const uint16_t (&block)[16][4], BlockQuality quality)
+{
+    // mode 11: one subset, 10 bit endpoints, 4 bit indices
+    float px[16][4];
+    int target[16][3];
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            px[i][c] = bc6h_to_domain(block[i][c]);
+            target[i][c] = (block[i][c] & 0x8000) ? 0 : std::min<int>(block[i][c], 0x7bff);
+        }
+    }
+
+    float e0[4], e1[4];
+    bc_fit_axis<3>(px, 16, e0, e1);
+
+    int best_q[2][3];
+    uint8_t best_idx[16];
+    int64_t best_err = INT64_MAX;
+
+    int iterations = quality == BlockQuality::High ? 2 : 0;
+    for (int it = 0; it <= iterations; ++it) {
+        int q[2][3], pal[16][3];
+        for (int c = 0; c < 3; ++c) {
+            q[0][c] = bc6h_quantize(e0[c]);
+            q[1][c] = bc6h_quantize(e1[c]);
+            int a = bc6h_unquantize(q[0][c]), b = bc6h_unquantize(q[1][c]);
+            for (int k = 0; k < 16; ++k)
+                pal[k][c] = bc6h_finish(bc_interpolate(a, b, kBCWeights4[k]));
+        }
+
+        uint8_t idx[16];
+        int64_t err = 0;
+        for (int i = 0; i < 16; ++i) {
+            int bi = 0;
+            int64_t be = INT64_MAX;
+            for (int k = 0; k < 16; ++k) {
+                int64_t e = 0;
+                for (int c = 0; c < 3; ++c) {
+                    int64_t d = target[i][c] - pal[k][c];
+                    e += d * d;
+                }
+                if (e < be) {
+                    be = e;
+                    bi = k;
+                }
+            }
+            idx[i] = (uint8_t)bi;
+            err += be;
+        }
+
+        if (err < best_err) {
+            best_err = err;
+            memcpy(best_q, q, sizeof(q));
+            memcpy(best_idx, idx, sizeof(idx));
+        }
+
+        if (err == 0 || it == iterations)
+            break;
+        float w[16];
+        for (int i = 0; i < 16; ++i)
+            w[i] = kBCWeights4[idx[i]] / 64.0f;
+        if (!bc_refine<3>(px, 16, w, e0, e1))
+            break;
+    }
+
+    if (best_idx[0] & 8) {
+        std::swap(best_q[0], best_q[1]);
+        for (auto& i : best_idx)
+            i = (uint8_t)(15 - i);
+    }
+
+    bc_bits bits;
+    bits.put(0x03, 5);
+    for (int j = 0; j < 2; ++j)
+        for (int c = 0; c < 3; ++c)
+            bits.put(best_q[j][c], 10);
+    bits.put(best_idx[0], 3);
+    for (int i = 1; i < 16; ++i)
+        bits.put(best_idx[i], 4);
+    memcpy(dst, bits.v, 16);
+}
+
+static bool bc6h_decode_block(uint16_t (&dst)[16][4], const uint8_t* src)
+{
+    // w and x are the endpoints of subset 0, y and z the ones of subset 1. d is the partition
+    enum : uint8_t { RW, GW, BW, RX, GX, BX, RY, GY, BY, RZ, GZ, BZ, D, NumFields };
+    struct field_bits
+    {
+        uint8_t field, shift, count;
+    };
+    struct mode_desc
+    {
+        uint8_t mode, subsets;
+        bool transformed; // x, y and z are signed deltas from w
+        uint8_t endpoint_bits, delta_bits[3];
+        field_bits layout[24]; // in stream order. terminated by count == 0
+    };
+    static const mode_desc kModes[14] = {
+        { 0x00, 2, true, 10, { 5, 5, 5 }, {
+            { GY, 4, 1 }, { BY, 4, 1 }, { BZ, 4, 1 }, { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 },
+            { RX, 0, 5 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 5 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 5 },
+            { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 }, { D, 0, 5 }
+        } }, // mode 1
+        { 0x01, 2, true, 7, { 6, 6, 6 }, {
+            { GY, 5, 1 }, { GZ, 4, 1 }, { GZ, 5, 1 }, { RW, 0, 7 }, { BZ, 0, 1 }, { BZ, 1, 1 }, { BY, 4, 1 },
+            { GW, 0, 7 }, { BY, 5, 1 }, { BZ, 2, 1 }, { GY, 4, 1 }, { BW, 0, 7 }, { BZ, 3, 1 }, { BZ, 5, 1 },
+            { BZ, 4, 1 }, { RX, 0, 6 }, { GY, 0, 4 }, { GX, 0, 6 }, { GZ, 0, 4 }, { BX, 0, 6 }, { BY, 0, 4 },
+            { RY, 0, 6 }, { RZ, 0, 6 }, { D, 0, 5 }
+        } }, // mode 2
+        { 0x02, 2, true, 11, { 5, 4, 4 }, {
+            { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 5 }, { RW, 10, 1 }, { GY, 0, 4 },
+            { GX, 0, 4 }, { GW, 10, 1 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 4 }, { BW, 10, 1 },
+            { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 }, { D, 0, 5 }
+        } }, // mode 3
+        { 0x06, 2, true, 11, { 4, 5, 4 }, {
+            { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 4 }, { RW, 10, 1 }, { GZ, 4, 1 },
+            { GY, 0, 4 }, { GX, 0, 5 }, { GW, 10, 1 }, { GZ, 0, 4 }, { BX, 0, 4 }, { BW, 10, 1 },
+            { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 4 }, { BZ, 0, 1 }, { BZ, 2, 1 }, { RZ, 0, 4 }, { GY, 4, 1 },
+            { BZ, 3, 1 }, { D, 0, 5 }
+        } }, // mode 4
+        { 0x0a, 2, true, 11, { 4, 4, 5 }, {
+            { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 4 }, { RW, 10, 1 }, { BY, 4, 1 },
+            { GY, 0, 4 }, { GX, 0, 4 }, { GW, 10, 1 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 5 },
+            { BW, 10, 1 }, { BY, 0, 4 }, { RY, 0, 4 }, { BZ, 1, 1 }, { BZ, 2, 1 }, { RZ, 0, 4 },
+            { BZ, 4, 1 }, { BZ, 3, 1 }, { D, 0, 5 }
+        } }, // mode 5
+        { 0x0e, 2, true, 9, { 5, 5, 5 }, {
+            { RW, 0, 9 }, { BY, 4, 1 }, { GW, 0, 9 }, { GY, 4, 1 }, { BW, 0, 9 }, { BZ, 4, 1 }, { RX, 0, 5 },
+            { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 5 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 5 }, { BZ, 1, 1 },
+            { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 }, { D, 0, 5 }
+        } }, // mode 6
+        { 0x12, 2, true, 8, { 6, 5, 5 }, {
+            { RW, 0, 8 }, { GZ, 4, 1 }, { BY, 4, 1 }, { GW, 0, 8 }, { BZ, 2, 1 }, { GY, 4, 1 }, { BW, 0, 8 },
+            { BZ, 3, 1 }, { BZ, 4, 1 }, { RX, 0, 6 }, { GY, 0, 4 }, { GX, 0, 5 }, { BZ, 0, 1 }, { GZ, 0, 4 },
+            { BX, 0, 5 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 6 }, { RZ, 0, 6 }, { D, 0, 5 }
+        } }, // mode 7
+        { 0x16, 2, true, 8, { 5, 6, 5 }, {
+            { RW, 0, 8 }, { BZ, 0, 1 }, { BY, 4, 1 }, { GW, 0, 8 }, { GY, 5, 1 }, { GY, 4, 1 }, { BW, 0, 8 },
+            { GZ, 5, 1 }, { BZ, 4, 1 }, { RX, 0, 5 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 6 }, { GZ, 0, 4 },
+            { BX, 0, 5 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 },
+            { D, 0, 5 }
+        } }, // mode 8
+        { 0x1a, 2, true, 8, { 5, 5, 6 }, {
+            { RW, 0, 8 }, { BZ, 1, 1 }, { BY, 4, 1 }, { GW, 0, 8 }, { BY, 5, 1 }, { GY, 4, 1 }, { BW, 0, 8 },
+            { BZ, 5, 1 }, { BZ, 4, 1 }, { RX, 0, 5 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 5 }, { BZ, 0, 1 },
+            { GZ, 0, 4 }, { BX, 0, 6 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 },
+            { D, 0, 5 }
+        } }, // mode 9
+        { 0x1e, 2, false, 6, { 6, 6, 6 }, {
+            { RW, 0, 6 }, { GZ, 4, 1 }, { BZ, 0, 1 }, { BZ, 1, 1 }, { BY, 4, 1 }, { GW, 0, 6 }, { GY, 5, 1 },
+            { BY, 5, 1 }, { BZ, 2, 1 }, { GY, 4, 1 }, { BW, 0, 6 }, { GZ, 5, 1 }, { BZ, 3, 1 }, { BZ, 5, 1 },
+            { BZ, 4, 1 }, { RX, 0, 6 }, { GY, 0, 4 }, { GX, 0, 6 }, { GZ, 0, 4 }, { BX, 0, 6 }, { BY, 0, 4 },
+            { RY, 0, 6 }, { RZ, 0, 6 }, { D, 0, 5 }
+        } }, // mode 10
+        { 0x03, 1, false, 10, { 10, 10, 10 }, {
+            { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 10 }, { GX, 0, 10 }, { BX, 0, 10 }
+        } }, // mode 11
+        { 0x07, 1, true, 11, { 9, 9, 9 }, {
+            { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 9 }, { RW, 10, 1 }, { GX, 0, 9 },
+            { GW, 10, 1 }, { BX, 0, 9 }, { BW, 10, 1 }
+        } }, // mode 12
+        { 0x0b, 1, true, 12, { 8, 8, 8 }, {
+            { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 8 }, { RW, 11, 1 }, { RW, 10, 1 },
+            { GX, 0, 8 }, { GW, 11, 1 }, { GW, 10, 1 }, { BX, 0, 8 }, { BW, 11, 1 }, { BW, 10, 1 }
+        } }, // mode 13
+        { 0x0f, 1, true, 16, { 4, 4, 4 }, {
+            { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 4 }, { RW, 15, 1 }, { RW, 14, 1 },
+            { RW, 13, 1 }, { RW, 12, 1 }, { RW, 11, 1 }, { RW, 10, 1 }, { GX, 0, 4 }, { GW, 15, 1 },
+            { GW, 14, 1 }, { GW, 13, 1 }, { GW, 12, 1 }, { GW, 11, 1 }, { GW, 10, 1 }, { BX, 0, 4 },
+            { BW, 15, 1 }, { BW, 14, 1 }, { BW, 13, 1 }, { BW, 12, 1 }, { BW, 11, 1 }, { BW, 10, 1 }
+        } }, // mode 14
+    };
+
+    bc_bits bits;
+    memcpy(bits.v, src, 16);
+
+    // modes 1 and 2 have 2 mode bits, the others 5
+    int mode = bits.get(2);
+    if (mode >= 2)
+        mode |= bits.get(3) << 2;
+    const mode_desc* m = nullptr;
+    for (auto& d : kModes) {
+        if (d.mode == mode) {
+            m = &d;
+            break;
+        }
+    }
+    if (!m) {
+        // reserved. decodes as 0
+        memset(dst, 0, sizeof(dst));
+        return false;
+    }
+
+    int v[NumFields] = {};
+    for (auto& f : m->layout) {
+        if (f.count == 0)
+            break;
+        v[f.field] |= bits.get(f.count) << f.shift;
+    }
+
+    int e[2][2][3]; // [subset][endpoint][channel]
+    int num_endpoints = m->subsets * 2;
+    int mask = (1 << m->endpoint_bits) - 1;
+    for (int c = 0; c < 3; ++c) {
+        int w = v[RW + c];
+        for (int k = 0; k < num_endpoints; ++k) {
+            int q = v[RW + k * 3 + c];
+            if (k > 0 && m->transformed) {
+                int sign = 1 << (m->delta_bits[c] - 1);
+                q = (w + ((q ^ sign) - sign)) & mask;
+            }
+            e[k / 2][k % 2][c] = bc6h_unquantize(q, m->endpoint_bits);
+        }
+    }
+
+    int partition = v[D];
+    int index_bits = m->subsets == 2 ? 3 : 4;
+    const int* weights = m->subsets == 2 ? kBCWeights3 : kBCWeights4;
+    for (int i = 0; i < 16; ++i) {
+        int s = m->subsets == 2 ? (kBCPartition2[partition] >> i) & 1 : 0;
+        bool anchor = i == 0 || (m->subsets == 2 && i == kBCAnchor2[partition]);
+        int k = bits.get(anchor ? index_bits - 1 : index_bits);
+        for (int c = 0; c < 3; ++c)
+            dst[i][c] = (uint16_t)bc6h_finish(bc_interpolate(e[s][0][c], e[s][1][c], weights[k]));
+        dst[i][3] = 0x3c00; // 1.0
+    }
+    return true;
+}
+
+// entry points
+
+// Body: [](int bx, int by, uint8_t *block_data) -> bool
+template<class Body>
+static bool bc_each_block(void* data, int width, int height, BlockFormat format, const Body& body)
+{
+    auto n = GetBlockCount(width, height);
+    int block_size = GetBlockSize(format);
+    std::atomic_bool ok{ true };
+    parallel_for(0, n.y, [&](int by) {
+        auto* d = (uint8_t*)data + (size_t)by * n.x * block_size;
+        for (int bx = 0; bx < n.x; ++bx, d += block_size) {
+            if (!body(bx, by, d))
+                ok = false;
+        }
+    });
+    return ok;
+}
+
+bool EncodeBlocks(void* dst, const void* src, int width, int height, BlockFormat format, BlockQuality quality)
+{
+    if (!dst || !src || width <= 0 || height <= 0)
+        return false;
+
+    switch (format) {
+    case BlockFormat::BC1:
+        return bc_each_block(dst, width, height, format, [&](int bx, int by, uint8_t* d) {
+            uint8_t block[16][4];
+            bc_load_block(block, (const uint8_t*)src, width, height, bx, by);
+            bc1_encode_block(d, block, quality);
+            return true;
+        });
+    case BlockFormat::BC4:
+        return bc_each_block(dst, width, height, format, [&](int bx, int by, uint8_t* d) {
+            uint8_t block[16][1];
+            bc_load_block(block, (const uint8_t*)src, width, height, bx, by);
+            bc4_encode_block(d, (const uint8_t (&)[16])block, quality);
+            return true;
+        });
+    case BlockFormat::BC5:
+        return bc_each_block(dst, width, height, format, [&](int bx, int by, uint8_t* d) {
+            uint8_t block[16][2], r[16], g[16];
+            bc_load_block(block, (const uint8_t*)src, width, height, bx, by);
+            for (int i = 0; i < 16; ++i) {
+                r[i] = block[i][0];
+                g[i] = block[i][1];
+            }
+            bc4_encode_block(d, r, quality);
+            bc4_encode_block(d + 8, g, quality);
+            return true;
+        });
+    case BlockFormat::BC6H:
+        return bc_each_block(dst, width, height, format, [&](int bx, int by, uint8_t* d) {
+            uint16_t block[16][4];
+            bc_load_block(block, (const uint16_t*)src, width, height, bx, by);
+            bc6h_encode_block(d, block, quality);
+            return true;
+        });
+    case BlockFormat::BC7:
+        return bc_each_block(dst, width, height, format, [&](int bx, int by, uint8_t* d) {
+            uint8_t block[16][4];
+            bc_load_block(block, (const uint8_t*)src, width, height, bx, by);
+            bc7_encode_block(d, block, quality);
+            return true;
+        });
+    default:
+        return false;
+    }
+}
+
+bool EncodeMipChain(void* dst, const void* src, int width, int height, BlockFormat format, int num_levels, BlockQuality quality)
+{
+    if (!dst || !src || num_levels <= 0)
+        return false;
+
+    auto src_format = GetBlockSourceFormat(format);
+    auto* s = (const char*)src;
+    auto* d = (char*)dst;
+    for (int i = 0; i < num_levels; ++i) {
+        auto size = GetMipSize(width, height, i);
+        if (!EncodeBlocks(d, s, size.x, size.y, format, quality))
+            return false;
+        s += (size_t)size.x * size.y * GetPixelSize(src_format);
+        d += GetBlockCompressedSize(size.x, size.y, format);
+    }
+    return true;
+}
+
+bool DecodeBlocks(void* dst, const void* src, int width, int height, BlockFormat format)
+{
+    if (!dst || !src || width <= 0 || height <= 0)
+        return false;
+
+    // bc_each_block() walks src here. the blocks are only read
+    void* blocks = const_cast<void*>(src);
+    switch (format) {
+    case BlockFormat::BC1:
+        return bc_each_block(blocks, width, height, format, [&](int bx, int by, uint8_t* s) {
+            uint8_t block[16][4];
+            bc1_decode_block(block, s);
+            bc_store_block((uint8_t*)dst, block, width, height, bx, by);
+            return true;
+        });
+    case BlockFormat::BC4:
+        return bc_each_block(blocks, width, height, format, [&](int bx, int by, uint8_t* s) {
+            uint8_t block[16][1];
+            bc4_decode_block((uint8_t (&)[16])block, s);
+            bc_store_block((uint8_t*)dst, block, width, height, bx, by);
+            return true;
+        });
+    case BlockFormat::BC5:
+        return bc_each_block(blocks, width, height, format, [&](int bx, int by, uint8_t* s) {
+            uint8_t block[16][2], r[16], g[16];
+            bc4_decode_block(r, s);
+            bc4_decode_block(g, s + 8);
+            for (int i = 0; i < 16; ++i) {
+                block[i][0] = r[i];
+                block[i][1] = g[i];
+            }
+            bc_store_block((uint8_t*)dst, block, width, height, bx, by);
+            return true;
+        });
+    case BlockFormat::BC6H:
+        return bc_each_block(blocks, width, height, format, [&](int bx, int by, uint8_t* s) {
+            uint16_t block[16][4];
+            bool ret = bc6h_decode_block(block, s);
+            bc_store_block((uint16_t*)dst, block, width, height, bx, by);
+            return ret;
+        });
+    case BlockFormat::BC7:
+        return bc_each_block(blocks, width, height, format, [&](int bx, int by, uint8_t* s) {
+            uint8_t block[16][4];
+            bool ret = bc7_decode_block(block, s);
+            bc_store_block((uint8_t*)dst, block, width, height, bx, by);
+            return ret;
+        });
+    default:
+        return false;
+    }
+}
+
+} // namespace mu
@@ -0,0 +1,42 @@
+#pragma once
+#include "muMath.h"
+#include "muImage.h"
+
+namespace mu {
+
+// GPU block compressed formats. each 4x4 texel block is stored in 8 (BC1, BC4) or 16 bytes (others).
+enum class BlockFormat : int
+{
+    Unknown,
+    BC1,  // RGB + 1 bit alpha. source: RGBAu8
+    BC4,  // R. source: Ru8
+    BC5,  // RG. source: RGu8
+    BC6H, // unsigned HDR RGB. source: RGBAf16 (alpha is ignored, negative values become 0)
+    BC7,  // RGBA. source: RGBAu8
+};
+
+enum class BlockQuality : int
+{
+    Fast, // endpoints from the principal axis only. for real-time use
+    High, // + least squares endpoint refinement and p-bit search
+};
+
+int GetBlockSize(BlockFormat f);
+ImageFormat GetBlockSourceFormat(BlockFormat f);
+int2 GetBlockCount(int width, int height);
+size_t GetBlockCompressedSize(int width, int height, BlockFormat f);
+// levels [0, num_levels) packed without padding
+size_t GetBlockCompressedMipChainSize(int width, int height, BlockFormat f, int num_levels);
+
+// src is an image of GetBlockSourceFormat(format). blocks are encoded in parallel.
+// partial blocks on the right and bottom edges replicate the edge texels.
+// BC7 and BC6H are encoded with their single subset modes (BC7 mode 6, BC6H mode 11).
+bool EncodeBlocks(void* dst, const void* src, int width, int height, BlockFormat format, BlockQuality quality = BlockQuality::High);
+// src is a mip chain of GetBlockSourceFormat(format) as GenerateMipChain() makes. each level is encoded and packed into dst.
+bool EncodeMipChain(void* dst, const void* src, int width, int height, BlockFormat format, int num_levels, BlockQuality quality = BlockQuality::High);
+
+// dst receives an image of GetBlockSourceFormat(format).
+// all BC7 modes and the unsigned BC6H modes are decoded. blocks in reserved modes are decoded as 0 and make this return false.
+bool DecodeBlocks(void* dst, const void* src, int width, int height, BlockFormat format);
+
+} // namespace mu
@@ -2,6 +2,7 @@
 #include "muCompression.h"
 #include "muSIMD.h"
 #include "muAlgorithm.h"
+#include "muConcurrency.h"
 
 namespace mu {
 
@@ -15,12 +16,54 @@ static_assert(sizeof(quat32) == 4, "");
 static_assert(sizeof(snormx3_32) == 4, "");
 
 
-template<class DstType, class SrcType>
-static inline void convert(RawVector<DstType>& dst, const RawVector<SrcType>& src)
+// elements per task of parallel encode / decode. large enough to hide the scheduling cost
+static const int kConvertBlockSize = 1024 * 32;
+
+template<class Body>
+static inline void EachBlock(size_t num, const Body& body)
+{
+    if (num <= (size_t)kConvertBlockSize)
+        body(0, (int)num);
+    else
+        parallel_for_blocked(0, (int)num, kConvertBlockSize, body);
+}
+
+template<class T>
+static inline void ParallelMinMax(const T* src, size_t num, T& dst_min, T& dst_max)
 {
-    each(dst, src, [](auto& d, const auto& s) { d = to<DstType>(s); });
+    int num_blocks = ceildiv((int)num, kConvertBlockSize);
+    if (num_blocks <= 1) {
+        MinMax(src, num, dst_min, dst_max);
+        return;
+    }
+
+    RawVector<T> mins, maxs;
+    mins.resize_discard(num_blocks);
+    maxs.resize_discard(num_blocks);
+    parallel_for(0, num_blocks, [&](int bi) {
+        size_t begin = (size_t)kConvertBlockSize * bi;
+        size_t n = std::min<size_t>(kConvertBlockSize, num - begin);
+        MinMax(src + begin, n, mins[bi], maxs[bi]);
+    });
+    T tmp;
+    MinMax(mins.cdata(), mins.size(), dst_min, tmp);
+    MinMax(maxs.cdata(), maxs.size(), tmp, dst_max);
 }
 
+
+// PackedArray
+static inline void Pack(snorm8* dst, const float* src, size_t n) { F32ToS8(dst, src, n); }
+static inline void Pack(snorm8x2* dst, const float2* src, size_t n) { F32ToS8((snorm8*)dst, (const float*)src, n * 2); }
+static inline void Pack(snorm16x3* dst, const float3* src, size_t n) { F32ToS16((snorm16*)dst, (const float*)src, n * 3); }
+static inline void Pack(snormx3_32* dst, const float3* src, size_t n) { F32ToSNormX3_32((uint32_t*)dst, (const float*)src, n, 3); }
+static inline void Pack(snormx3_32* dst, const float4* src, size_t n) { F32ToSNormX3_32((uint32_t*)dst, (const float*)src, n, 4); }
+
+static inline void Unpack(float* dst, const snorm8* src, size_t n) { S8ToF32(dst, src, n); }
+static inline void Unpack(float2* dst, const snorm8x2* src, size_t n) { S8ToF32((float*)dst, (const snorm8*)src, n * 2); }
+static inline void Unpack(float3* dst, const snorm16x3* src, size_t n) { S16ToF32((float*)dst, (const snorm16*)src, n * 3); }
+static inline void Unpack(float3* dst, const snormx3_32* src, size_t n) { SNormX3_32ToF32((float*)dst, (const uint32_t*)src, n, 3); }
+static inline void Unpack(float4* dst, const snormx3_32* src, size_t n) { SNormX3_32ToF32((float*)dst, (const uint32_t*)src, n, 4); }
+
 template<class PackedType, class PlainType>
 void encode(PackedArray<PackedType>& dst, const RawVector<PlainType>& src)
 {
@@ -28,7 +71,11 @@ void encode(PackedArray<PackedType>& dst, const RawVector<PlainType>& src)
     if (dst.packed.empty())
         return;
 
-    convert(dst.packed, src);
+    auto* d = dst.packed.data();
+    auto* s = src.cdata();
+    EachBlock(src.size(), [d, s](int begin, int end) {
+        Pack(d + begin, s + begin, end - begin);
+    });
 }
 
 template<class PackedType, class PlainType>
@@ -38,7 +85,11 @@ void decode(RawVector<PlainType>& dst, const PackedArray<PackedType>& src)
     if (src.packed.empty())
         return;
 
-    convert(dst, src.packed);
+    auto* d = dst.data();
+    auto* s = src.packed.cdata();
+    EachBlock(dst.size(), [d, s](int begin, int end) {
+        Unpack(d + begin, s + begin, end - begin);
+    });
 }
 
 template void encode(PackedArray<snorm8>& src, const RawVector<float>& dst);
@@ -54,10 +105,20 @@ template void decode(RawVector<float3>& dst, const PackedArray<snormx3_32>& src)
 template void decode(RawVector<float4>& dst, const PackedArray<snormx3_32>& src);
 
 
+// BoundedArray
 template<class T> static void zeroclear(T& v) { v = T::zero(); }
 template<> void zeroclear(int& v) { v = 0; }
 template<> void zeroclear(float& v) { v = 0.0f; }
 
+static inline void PackBounded(unorm8* dst, const float* src, size_t n, int nc, const float* bmin, const float* rsize) { F32ToU8B(dst, src, n, nc, bmin, rsize); }
+static inline void PackBounded(unorm16* dst, const float* src, size_t n, int nc, const float* bmin, const float* rsize) { F32ToU16B(dst, src, n, nc, bmin, rsize); }
+static inline void UnpackBounded(float* dst, const unorm8* src, size_t n, int nc, const float* bmin, const float* size) { U8BToF32(dst, src, n, nc, bmin, size); }
+static inline void UnpackBounded(float* dst, const unorm16* src, size_t n, int nc, const float* bmin, const float* size) { U16BToF32(dst, src, n, nc, bmin, size); }
+static inline void PackBounded(uint8_t* dst, const int* src, size_t n, int bmin) { I32ToU8B(dst, src, n, bmin); }
+static inline void PackBounded(uint16_t* dst, const int* src, size_t n, int bmin) { I32ToU16B(dst, src, n, bmin); }
+static inline void UnpackBounded(int* dst, const uint8_t* src, size_t n, int bmin) { U8BToI32(dst, src, n, bmin); }
+static inline void UnpackBounded(int* dst, const uint16_t* src, size_t n, int bmin) { U16BToI32(dst, src, n, bmin); }
+
 
 template<class PackedType, class PlainType, bool IsFloat = std::is_floating_point<get_scalar_type<PlainType>>::value >
 struct EncodeImpl;
@@ -65,6 +126,9 @@ struct EncodeImpl;
 template<class PackedType, class PlainType>
 struct EncodeImpl<PackedType, PlainType, true>
 {
+    using packed_scalar_t = get_scalar_type<PackedType>;
+    static const int num_components = sizeof(PlainType) / sizeof(float);
+
     static inline void encode(BoundedArray<PackedType, PlainType>& dst, const RawVector<PlainType>& src)
     {
         zeroclear(dst.bound_min);
@@ -73,12 +137,15 @@ struct EncodeImpl<PackedType, PlainType, true>
         if (dst.packed.empty())
             return;
 
-        MinMax(src.data(), src.size(), dst.bound_min, dst.bound_max);
+        ParallelMinMax(src.cdata(), src.size(), dst.bound_min, dst.bound_max);
 
         auto bmin = dst.bound_min;
         auto rsize = rcp(dst.bound_max - dst.bound_min);
-        each(dst.packed, src, [bmin, rsize](auto& d, const auto& s) {
-            d = to<PackedType>((s - bmin) * rsize);
+        auto* d = (packed_scalar_t*)dst.packed.data();
+        auto* s = (const float*)src.cdata();
+        EachBlock(src.size(), [&](int begin, int end) {
+            PackBounded(d + (size_t)begin * num_components, s + (size_t)begin * num_components, end - begin, num_components,
+                (const float*)&bmin, (const float*)&rsize);
         });
     }
 
@@ -90,8 +157,11 @@ struct EncodeImpl<PackedType, PlainType, true>
 
         auto bmin = src.bound_min;
         auto size = (src.bound_max - src.bound_min);
-        each(dst, src.packed, [bmin, size](auto& d, const auto& s) {
-            d = to<PlainType>(s) * size + bmin;
+        auto* d = (float*)dst.data();
+        auto* s = (const packed_scalar_t*)src.packed.cdata();
+        EachBlock(dst.size(), [&](int begin, int end) {
+            UnpackBounded(d + (size_t)begin * num_components, s + (size_t)begin * num_components, end - begin, num_components,
+                (const float*)&bmin, (const float*)&size);
         });
     }
 };
@@ -107,11 +177,13 @@ struct EncodeImpl<PackedType, PlainType, false>
         if (dst.packed.empty())
             return;
 
-        MinMax(src.data(), src.size(), dst.bound_min, dst.bound_max);
+        ParallelMinMax(src.cdata(), src.size(), dst.bound_min, dst.bound_max);
 
         auto bmin = dst.bound_min;
-        each(dst.packed, src, [bmin](auto& d, const auto& s) {
-            d = (PackedType)(s - bmin);
+        auto* d = dst.packed.data();
+        auto* s = src.cdata();
+        EachBlock(src.size(), [&](int begin, int end) {
+            PackBounded(d + begin, s + begin, end - begin, bmin);
         });
     }
 
@@ -122,8 +194,10 @@ struct EncodeImpl<PackedType, PlainType, false>
             return;
 
         auto bmin = src.bound_min;
-        each(dst, src.packed, [bmin](auto& d, const auto& s) {
-            d = (PlainType)(s) + bmin;
+        auto* d = dst.data();
+        auto* s = src.packed.cdata();
+        EachBlock(dst.size(), [&](int begin, int end) {
+            UnpackBounded(d + begin, s + begin, end - begin, bmin);
         });
     }
 };
@@ -162,4 +236,1122 @@ template void decode(RawVector<float3>& dst, const BoundedArray<unorm16x3, float
 template void decode(RawVector<float4>& dst, const BoundedArray<unorm8x4, float4>& src);
 template void decode(RawVector<float4>& dst, const BoundedArray<unorm16x4, float4>& src);
 
+// delta pack
+
+// block layout: [base value][bit width][packed zigzag deltas...]
+static const size_t kDeltaPackBlockSize = 2048;
+
+static inline uint32_t zigzag_encode(uint32_t v) { return (v << 1) ^ (uint32_t)((int)v >> 31); }
+static inline uint32_t zigzag_decode(uint32_t v) { return (v >> 1) ^ (0u - (v & 1)); }
+
+static inline uint32_t bit_width(uint32_t v)
+{
+    uint32_t r = 0;
+    for (; v; v >>= 1)
+        ++r;
+    return r;
+}
+
+static inline size_t delta_block_words(size_t n, uint32_t bits)
+{
+    return 2 + ((n - 1) * bits + 31) / 32;
+}
+
+size_t DeltaPackBound(size_t size)
+{
+    size_t num_blocks = (size + kDeltaPackBlockSize - 1) / kDeltaPackBlockSize;
+    return num_blocks * 2 + size;
+}
+
+size_t DeltaPack(uint32_t* dst, const int* src_, size_t size)
+{
+    if (size == 0)
+        return 0;
+
+    // deltas are computed in uint32 to make overflow well-defined
+    auto* src = (const uint32_t*)src_;
+    int num_blocks = (int)((size + kDeltaPackBlockSize - 1) / kDeltaPackBlockSize);
+    auto block_range = [size](int bi, size_t& begin, size_t& end) {
+        begin = kDeltaPackBlockSize * bi;
+        end = std::min(begin + kDeltaPackBlockSize, size);
+    };
+
+    RawVector<uint32_t> bits(num_blocks);
+    parallel_for(0, num_blocks, [&](int bi) {
+        size_t begin, end;
+        block_range(bi, begin, end);
+        uint32_t m = 0;
+        for (size_t i = begin + 1; i < end; ++i)
+            m |= zigzag_encode(src[i] - src[i - 1]);
+        bits[bi] = bit_width(m);
+    });
+
+    RawVector<size_t> offsets(num_blocks + 1);
+    offsets[0] = 0;
+    for (int bi = 0; bi < num_blocks; ++bi) {
+        size_t begin, end;
+        block_range(bi, begin, end);
+        offsets[bi + 1] = offsets[bi] + delta_block_words(end - begin, bits[bi]);
+    }
+
+    parallel_for(0, num_blocks, [&](int bi) {
+        size_t begin, end;
+        block_range(bi, begin, end);
+        uint32_t b = bits[bi];
+        uint32_t* d = dst + offsets[bi];
+        *d++ = src[begin];
+        *d++ = b;
+        if (b == 0)
+            return;
+
+        uint64_t acc = 0;
+        uint32_t nacc = 0;
+        for (size_t i = begin + 1; i < end; ++i) {
+            acc |= (uint64_t)zigzag_encode(src[i] - src[i - 1]) << nacc;
+            nacc += b;
+            if (nacc >= 32) {
+                *d++ = (uint32_t)acc;
+                acc >>= 32;
+                nacc -= 32;
+            }
+        }
+        if (nacc > 0)
+            *d++ = (uint32_t)acc;
+    });
+    return offsets[num_blocks];
+}
+
+bool DeltaUnpack(int* dst_, size_t size, const uint32_t* src, size_t src_words)
+{
+    if (size == 0)
+        return true;
+
+    auto* dst = (uint32_t*)dst_;
+    int num_blocks = (int)((size + kDeltaPackBlockSize - 1) / kDeltaPackBlockSize);
+    auto block_range = [size](int bi, size_t& begin, size_t& end) {
+        begin = kDeltaPackBlockSize * bi;
+        end = std::min(begin + kDeltaPackBlockSize, size);
+    };
+
+    // block sizes depend on their bit width. scan headers to locate blocks.
+    RawVector<size_t> offsets(num_blocks);
+    size_t pos = 0;
+    for (int bi = 0; bi < num_blocks; ++bi) {
+        if (pos + 2 > src_words || src[pos + 1] > 32)
+            return false;
+        size_t begin, end;
+        block_range(bi, begin, end);
+        offsets[bi] = pos;
+        pos += delta_block_words(end - begin, src[pos + 1]);
+    }
+    if (pos > src_words)
+        return false;
+
+    parallel_for(0, num_blocks, [&](int bi) {
+        size_t begin, end;
+        block_range(bi, begin, end);
+        const uint32_t* s = src + offsets[bi];
+        uint32_t prev = *s++;
+        uint32_t b = *s++;
+        dst[begin] = prev;
+        if (b == 0) {
+            for (size_t i = begin + 1; i < end; ++i)
+                dst[i] = prev;
+            return;
+        }
+
+        uint64_t mask = (uint64_t(1) << b) - 1;
+        uint64_t acc = 0;
+        uint32_t nacc = 0;
+        for (size_t i = begin + 1; i < end; ++i) {
+            if (nacc < b) {
+                acc |= (uint64_t)(*s++) << nacc;
+                nacc += 32;
+            }
+            prev += zigzag_decode((uint32_t)(acc & mask));
+            dst[i] = prev;
+            acc >>= b;
+            nacc -= b;
+        }
+    });
+    return true;
+}
+
+
+// LZ
+
+// sequence: [token (literal length:4 | match length:4)][literal length ext][literals][offset:16][match length ext]
+// the last sequence has only literals.
+static const int kLZHashBits = 12;
+static const size_t kLZMinMatch = 4;
+static const size_t kLZLastLiterals = 5;
+static const size_t kLZMFLimit = 12;
+static const size_t kLZMaxOffset = 65535;
+
+static inline uint32_t lz_read32(const uint8_t* p)
+{
+    uint32_t r;
+    memcpy(&r, p, sizeof(r));
+    return r;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - kLZHashBits);
+}
+
+// copy in 16 (8) byte steps. may read and write up to 15 (7) bytes past the end; the caller ensures the room.
+// src must be at least 16 (8) bytes behind dst if they overlap.
+static inline void lz_wildcopy16(uint8_t* dst, const uint8_t* src, size_t size)
+{
+    uint8_t* const end = dst + size;
+    do {
+        memcpy(dst, src, 16);
+        dst += 16;
+        src += 16;
+    } while (dst < end);
+}
+
+static inline void lz_wildcopy8(uint8_t* dst, const uint8_t* src, size_t size)
+{
+    uint8_t* const end = dst + size;
+    do {
+        memcpy(dst, src, 8);
+        dst += 8;
+        src += 8;
+    } while (dst < end);
+}
+
+static inline uint8_t* lz_write_length(uint8_t* dst, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *dst++ = 255;
+    *dst++ = (uint8_t)len;
+    return dst;
+}
+
+size_t LZCompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t LZCompress(void* dst_, size_t dst_size, const void* src_, size_t src_size)
+{
+    auto* src = (const uint8_t*)src_;
+    auto* dst = (uint8_t*)dst_;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dst_size;
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* const iend = src + src_size;
+
+    auto emit = [&](size_t match_len, size_t offset) -> bool {
+        size_t lit_len = ip - anchor;
+        size_t required = 1 + lit_len + (lit_len / 255 + 1) + 2 + (match_len / 255 + 1);
+        if (required > size_t(oend - op))
+            return false;
+
+        uint8_t* token = op++;
+        uint8_t t = 0;
+        if (lit_len >= 15) {
+            t = 15 << 4;
+            op = lz_write_length(op, lit_len - 15);
+        }
+        else {
+            t = uint8_t(lit_len << 4);
+        }
+        memcpy(op, anchor, lit_len);
+        op += lit_len;
+
+        if (match_len > 0) {
+            *op++ = uint8_t(offset);
+            *op++ = uint8_t(offset >> 8);
+            size_t ml = match_len - kLZMinMatch;
+            if (ml >= 15) {
+                t |= 15;
+                op = lz_write_length(op, ml - 15);
+            }
+            else {
+                t |= uint8_t(ml);
+            }
+        }
+        *token = t;
+        return true;
+    };
+
+    if (src_size > kLZMFLimit) {
+        uint32_t table[1 << kLZHashBits] = {};
+        const uint8_t* const mflimit = iend - kLZMFLimit;
+        const uint8_t* const matchlimit = iend - kLZLastLiterals;
+        int misses = 0;
+
+        while (ip < mflimit) {
+            uint32_t seq = lz_read32(ip);
+            uint32_t h = lz_hash(seq);
+            const uint8_t* ref = src + table[h];
+            table[h] = uint32_t(ip - src);
+
+            if (ref >= ip || size_t(ip - ref) > kLZMaxOffset || lz_read32(ref) != seq) {
+                // skip faster on incompressible data
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            // extend forward
+            const uint8_t* mp = ip + kLZMinMatch;
+            const uint8_t* rp = ref + kLZMinMatch;
+            while (mp + 8 <= matchlimit) {
+                uint64_t a, b;
+                memcpy(&a, mp, 8);
+                memcpy(&b, rp, 8);
+                if (a != b)
+                    break;
+                mp += 8;
+                rp += 8;
+            }
+            while (mp < matchlimit && *mp == *rp) {
+                ++mp;
+                ++rp;
+            }
+            // extend backward
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+            }
+
+            if (!emit(mp - ip, ip - ref))
+                return 0;
+            ip = anchor = mp;
+        }
+    }
+
+    // last literals
+    ip = iend;
+    if (!emit(0, 0))
+        return 0;
+    return op - dst;
+}
+
+size_t LZDecompress(void* dst_, size_t dst_size, const void* src_, size_t src_size)
+{
+    auto* src = (const uint8_t*)src_;
+    auto* dst = (uint8_t*)dst_;
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dst_size;
+
+    auto read_length = [&](size_t& len) -> bool {
+        uint8_t b;
+        do {
+            if (ip >= iend)
+                return false;
+            b = *ip++;
+            len += b;
+        } while (b == 255);
+        return true;
+    };
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && !read_length(lit_len))
+            return 0;
+        if (lit_len > size_t(iend - ip) || lit_len > size_t(oend - op))
+            return 0;
+        if (size_t(iend - ip) >= lit_len + 16 && size_t(oend - op) >= lit_len + 16)
+            lz_wildcopy16(op, ip, lit_len);
+        else
+            memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+        if (ip == iend)
+            break; // last sequence
+
+        if (iend - ip < 2)
+            return 0;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > size_t(op - dst))
+            return 0;
+
+        size_t match_len = token & 15;
+        if (match_len == 15 && !read_length(match_len))
+            return 0;
+        match_len += kLZMinMatch;
+        if (match_len > size_t(oend - op))
+            return 0;
+
+        const uint8_t* match = op - offset;
+        if (offset >= 16 && size_t(oend - op) >= match_len + 16) {
+            lz_wildcopy16(op, match, match_len);
+        }
+        else if (offset >= 8 && size_t(oend - op) >= match_len + 8) {
+            lz_wildcopy8(op, match, match_len);
+        }
+        else {
+            // overlapped copy (repeating pattern) or near the end
+            for (size_t i = 0; i < match_len; ++i)
+                op[i] = match[i];
+        }
+        op += match_len;
+    }
+    return op - dst;
+}
+
+
+// LZ frame
+
+// [header][compressed size of each block][blocks]
+// the most significant bit of the block size indicates the block is stored as is.
+static const char kLZFrameMagic[4] = { 'M', 'U', 'L', 'Z' };
+static const uint32_t kLZStoredBit = 0x80000000u;
+
+struct LZFrameHeader
+{
+    char magic[4];
+    uint32_t block_size;
+    uint64_t raw_size;
+    uint64_t frame_size; // including the header
+};
+static_assert(sizeof(LZFrameHeader) == LZFrameHeaderSize, "");
+
+static inline size_t lz_block_count(uint64_t raw_size, size_t block_size)
+{
+    return size_t((raw_size + block_size - 1) / block_size);
+}
+
+static inline size_t lz_block_size(size_t block_size)
+{
+    return std::min(std::max(block_size, (size_t)1024), (size_t)(kLZStoredBit - 1));
+}
+
+size_t CompressBound(size_t size, size_t block_size)
+{
+    // blocks that don't shrink are stored, so the worst case is the size table
+    return LZFrameHeaderSize + lz_block_count(size, lz_block_size(block_size)) * sizeof(uint32_t) + size;
+}
+
+size_t Compress(void* dst_, size_t dst_size, const void* src_, size_t src_size, size_t block_size)
+{
+    auto* src = (const uint8_t*)src_;
+    auto* dst = (uint8_t*)dst_;
+    block_size = lz_block_size(block_size);
+
+    int num_blocks = (int)lz_block_count(src_size, block_size);
+    std::vector<RawVector<uint8_t>> blocks(num_blocks);
+    RawVector<uint32_t> sizes(num_blocks);
+    parallel_for(0, num_blocks, [&](int bi) {
+        size_t begin = block_size * bi;
+        size_t size = std::min(block_size, src_size - begin);
+        auto& b = blocks[bi];
+        b.resize_discard(LZCompressBound(size));
+        size_t packed = LZCompress(b.data(), b.size(), src + begin, size);
+        if (packed == 0 || packed >= size) {
+            b.clear();
+            sizes[bi] = uint32_t(size) | kLZStoredBit;
+        }
+        else {
+            b.resize(packed);
+            sizes[bi] = uint32_t(packed);
+        }
+    });
+
+    RawVector<size_t> offsets(num_blocks);
+    size_t total = LZFrameHeaderSize + sizeof(uint32_t) * num_blocks;
+    for (int bi = 0; bi < num_blocks; ++bi) {
+        offsets[bi] = total;
+        total += sizes[bi] & ~kLZStoredBit;
+    }
+    if (total > dst_size)
+        return 0;
+
+    LZFrameHeader header{};
+    memcpy(header.magic, kLZFrameMagic, sizeof(header.magic));
+    header.block_size = uint32_t(block_size);
+    header.raw_size = src_size;
+    header.frame_size = total;
+    memcpy(dst, &header, sizeof(header));
+    memcpy(dst + sizeof(header), sizes.cdata(), sizeof(uint32_t) * num_blocks);
+
+    parallel_for(0, num_blocks, [&](int bi) {
+        if (sizes[bi] & kLZStoredBit)
+            memcpy(dst + offsets[bi], src + block_size * bi, sizes[bi] & ~kLZStoredBit);
+        else
+            memcpy(dst + offsets[bi], blocks[bi].cdata(), blocks[bi].size());
+    });
+    return total;
+}
+
+bool GetFrameInfo(const void* src, size_t src_size, uint64_t& raw_size, uint64_t& frame_size)
+{
+    LZFrameHeader header;
+    if (src_size < sizeof(header))
+        return false;
+    memcpy(&header, src, sizeof(header));
+    if (memcmp(header.magic, kLZFrameMagic, sizeof(header.magic)) != 0 || header.block_size == 0 || header.block_size >= kLZStoredBit)
+        return false;
+    uint64_t num_blocks = (header.raw_size + header.block_size - 1) / header.block_size;
+    if (header.frame_size < sizeof(header) + sizeof(uint32_t) * num_blocks)
+        return false;
+    raw_size = header.raw_size;
+    frame_size = header.frame_size;
+    return true;
+}
+
+size_t Decompress(void* dst_, size_t dst_size, const void* src_, size_t src_size)
+{
+    auto* src = (const uint8_t*)src_;
+    auto* dst = (uint8_t*)dst_;
+    uint64_t raw_size, frame_size;
+    if (!GetFrameInfo(src, src_size, raw_size, frame_size) || frame_size > src_size || raw_size > dst_size)
+        return 0;
+
+    LZFrameHeader header;
+    memcpy(&header, src, sizeof(header));
+    size_t block_size = header.block_size;
+    int num_blocks = (int)lz_block_count(raw_size, block_size);
+
+    RawVector<uint32_t> sizes(num_blocks);
+    RawVector<size_t> offsets(num_blocks);
+    memcpy(sizes.data(), src + sizeof(header), sizeof(uint32_t) * num_blocks);
+    size_t pos = LZFrameHeaderSize + sizeof(uint32_t) * num_blocks;
+    for (int bi = 0; bi < num_blocks; ++bi) {
+        offsets[bi] = pos;
+        pos += sizes[bi] & ~kLZStoredBit;
+    }
+    if (pos != frame_size)
+        return 0;
+
+    std::atomic_bool ok{ true };
+    parallel_for(0, num_blocks, [&](int bi) {
+        size_t begin = block_size * bi;
+        size_t size = std::min(block_size, size_t(raw_size - begin));
+        size_t packed = sizes[bi] & ~kLZStoredBit;
+        if (sizes[bi] & kLZStoredBit) {
+            if (packed == size)
+                memcpy(dst + begin, src + offsets[bi], size);
+            else
+                ok = false;
+        }
+        else if (LZDecompress(dst + begin, size, src + offsets[bi], packed) != size) {
+            ok = false;
+        }
+    });
+    return ok ? size_t(raw_size) : 0;
+}
+
+void Compress(RawVector<char>& dst, const void* src, size_t src_size, size_t block_size)
+{
+    dst.resize_discard(CompressBound(src_size, block_size));
+    dst.resize(Compress(dst.data(), dst.size(), src, src_size, block_size));
+}
+
+bool Decompress(RawVector<char>& dst, const void* src, size_t src_size)
+{
+    // a truncated or corrupted header must not make dst allocate raw_size
+    uint64_t raw_size, frame_size;
+    if (!GetFrameInfo(src, src_size, raw_size, frame_size) || frame_size > src_size)
+        return false;
+    dst.resize_discard((size_t)raw_size);
+    return Decompress(dst.data(), dst.size(), src, src_size) == raw_size;
+}
+
+
+// zlib
+
+static const size_t kDeflateChunkSize = 256 * 1024;
+static const size_t kDeflateWindowSize = 32768;
+static const int kDeflateHashBits = 15;
+static const size_t kDeflateMinMatch = 3;
+static const size_t kDeflateMaxMatch = 258;
+static const size_t kDeflateTooFar = 4096; // 3 byte matches farther than this are not worth it
+static const size_t kDeflateBlockTokens = 16384;
+static const size_t kDeflateMaxStored = 65535;
+
+static const uint16_t kDeflateLengthBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const uint8_t kDeflateLengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const uint16_t kDeflateDistBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const uint8_t kDeflateDistExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+static const uint8_t kDeflateCodeLengthOrder[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+
+struct DeflateLevel
+{
+    int max_chain;
+    size_t nice_len;   // stop searching when a match this long is found
+    size_t lazy_limit; // try the next position if the match is shorter than this
+};
+static const DeflateLevel kDeflateLevels[10] = {
+    { 0, 0, 0 },
+    { 4, 8, 0 },
+    { 8, 16, 0 },
+    { 16, 32, 0 },
+    { 16, 32, 16 },
+    { 32, 64, 32 },
+    { 64, 128, 64 },
+    { 128, 128, 128 },
+    { 256, 258, 258 },
+    { 1024, 258, 258 },
+};
+
+// match token: [1:flag][7:unused][8:length - 3][16:distance - 1]. literal token: byte value
+static const uint32_t kDeflateMatchFlag = 0x80000000u;
+
+struct DeflateTables
+{
+    uint8_t length_code[kDeflateMaxMatch + 1];
+    uint8_t dist_code[512]; // see deflate_dist_code()
+    uint8_t fixed_lit_len[288];
+    uint8_t fixed_dist_len[30];
+
+    DeflateTables()
+    {
+        for (int c = 0; c < 29; ++c)
+            for (int l = kDeflateLengthBase[c]; l < kDeflateLengthBase[c] + (1 << kDeflateLengthExtra[c]) && l <= (int)kDeflateMaxMatch; ++l)
+                length_code[l] = uint8_t(c);
+        length_code[kDeflateMaxMatch] = 28;
+
+        for (int c = 0; c < 30; ++c) {
+            for (int d = kDeflateDistBase[c]; d < kDeflateDistBase[c] + (1 << kDeflateDistExtra[c]); ++d) {
+                if (d - 1 < 256)
+                    dist_code[d - 1] = uint8_t(c);
+                else
+                    dist_code[256 + ((d - 1) >> 7)] = uint8_t(c);
+            }
+        }
+
+        for (int i = 0; i < 288; ++i)
+            fixed_lit_len[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        for (int i = 0; i < 30; ++i)
+            fixed_dist_len[i] = 5;
+    }
+};
+
+static const DeflateTables& deflate_tables()
+{
+    static const DeflateTables s_tables;
+    return s_tables;
+}
+
+static inline int deflate_dist_code(const DeflateTables& tab, size_t dist)
+{
+    return dist <= 256 ? tab.dist_code[dist - 1] : tab.dist_code[256 + ((dist - 1) >> 7)];
+}
+
+struct DeflateBitWriter
+{
+    RawVector<uint8_t>& dst;
+    uint64_t bits = 0;
+    int count = 0;
+
+    void put(uint32_t v, int n)
+    {
+        bits |= uint64_t(v) << count;
+        count += n;
+        while (count >= 8) {
+            dst.push_back(uint8_t(bits));
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    void align()
+    {
+        if (count > 0)
+            put(0, 8 - count);
+    }
+};
+
+// length limited huffman code lengths. at least 2 codes are assigned even if fewer symbols are used,
+// as some inflaters reject single-code trees.
+static void deflate_build_lengths(uint8_t* lengths, const uint32_t* freq, int n, int max_bits)
+{
+    std::pair<uint32_t, int> syms[288];
+    int m = 0;
+    for (int i = 0; i < n; ++i) {
+        if (freq[i])
+            syms[m++] = { freq[i], i };
+    }
+    for (int i = 0; i < n && m < 2; ++i) {
+        if (!freq[i])
+            syms[m++] = { 1, i };
+    }
+    std::sort(syms, syms + m);
+    memset(lengths, 0, n);
+
+    // two-queue huffman: leaves are sorted and internal nodes are created in non-decreasing weight order
+    uint64_t weight[288 * 2];
+    int parent[288 * 2];
+    int depth[288 * 2];
+    for (int i = 0; i < m; ++i)
+        weight[i] = syms[i].first;
+    int leaf = 0, node = m, next = m;
+    auto pick = [&]() {
+        if (leaf < m && (node >= next || weight[leaf] <= weight[node]))
+            return leaf++;
+        return node++;
+    };
+    while (next < m * 2 - 1) {
+        int a = pick();
+        int b = pick();
+        weight[next] = weight[a] + weight[b];
+        parent[a] = parent[b] = next;
+        ++next;
+    }
+    depth[m * 2 - 2] = 0;
+    for (int i = m * 2 - 3; i >= 0; --i)
+        depth[i] = depth[parent[i]] + 1;
+
+    // clamp to max_bits and rebalance until the code is complete again
+    int bl_count[16] = {};
+    for (int i = 0; i < m; ++i)
+        bl_count[std::min(depth[i], max_bits)]++;
+    uint32_t total = 0;
+    for (int l = 1; l <= max_bits; ++l)
+        total += uint32_t(bl_count[l]) << (max_bits - l);
+    while (total > (1u << max_bits)) {
+        bl_count[max_bits]--;
+        for (int l = max_bits - 1; l > 0; --l) {
+            if (bl_count[l]) {
+                bl_count[l]--;
+                bl_count[l + 1] += 2;
+                break;
+            }
+        }
+        --total;
+    }
+
+    // least frequent symbols get the longest codes
+    int si = 0;
+    for (int l = max_bits; l > 0; --l)
+        for (int k = 0; k < bl_count[l]; ++k)
+            lengths[syms[si++].second] = uint8_t(l);
+}
+
+// canonical codes, bit-reversed as deflate writes huffman codes from the MSB
+static void deflate_build_codes(uint16_t* codes, const uint8_t* lengths, int n)
+{
+    int bl_count[16] = {};
+    for (int i = 0; i < n; ++i)
+        bl_count[lengths[i]]++;
+    bl_count[0] = 0;
+
+    int next_code[16] = {};
+    int code = 0;
+    for (int b = 1; b < 16; ++b) {
+        code = (code + bl_count[b - 1]) << 1;
+        next_code[b] = code;
+    }
+    for (int i = 0; i < n; ++i) {
+        int len = lengths[i];
+        if (len == 0)
+            continue;
+        int c = next_code[len]++;
+        int r = 0;
+        for (int b = 0; b < len; ++b, c >>= 1)
+            r = (r << 1) | (c & 1);
+        codes[i] = uint16_t(r);
+    }
+}
+
+static void deflate_write_stored(DeflateBitWriter& bw, const uint8_t* src, size_t size, bool final)
+{
+    size_t pos = 0;
+    do {
+        size_t n = std::min(size - pos, kDeflateMaxStored);
+        bool last = final && pos + n == size;
+        bw.put(last ? 1 : 0, 1);
+        bw.put(0, 2);
+        bw.align();
+        bw.put(uint32_t(n), 16);
+        bw.put(uint32_t(~n & 0xffff), 16);
+        bw.dst.push_back(src + pos, n);
+        pos += n;
+    } while (pos < size);
+}
+
+// emits tokens as a fixed, dynamic or stored block, whichever is the smallest.
+// src / size is the input the tokens represent, used for the stored block.
+static void deflate_write_block(DeflateBitWriter& bw, const uint32_t* tokens, size_t num_tokens, const uint8_t* src, size_t size, bool final)
+{
+    auto& tab = deflate_tables();
+
+    uint32_t lit_freq[286] = {};
+    uint32_t dist_freq[30] = {};
+    for (size_t i = 0; i < num_tokens; ++i) {
+        uint32_t t = tokens[i];
+        if (t & kDeflateMatchFlag) {
+            lit_freq[257 + tab.length_code[((t >> 16) & 0xff) + kDeflateMinMatch]]++;
+            dist_freq[deflate_dist_code(tab, (t & 0xffff) + 1)]++;
+        }
+        else {
+            lit_freq[t]++;
+        }
+    }
+    lit_freq[256] = 1;
+
+    uint8_t lit_len[286], dist_len[30];
+    deflate_build_lengths(lit_len, lit_freq, 286, 15);
+    deflate_build_lengths(dist_len, dist_freq, 30, 15);
+    int hlit = 286;
+    while (hlit > 257 && lit_len[hlit - 1] == 0)
+        --hlit;
+    int hdist = 30;
+    while (hdist > 1 && dist_len[hdist - 1] == 0)
+        --hdist;
+
+    // run length encode code lengths of both trees
+    uint8_t all_len[286 + 30];
+    memcpy(all_len, lit_len, hlit);
+    memcpy(all_len + hlit, dist_len, hdist);
+    uint8_t cl_sym[286 + 30], cl_extra[286 + 30];
+    int num_cl = 0;
+    uint32_t cl_freq[19] = {};
+    auto emit_cl = [&](int sym, int extra) {
+        cl_sym[num_cl] = uint8_t(sym);
+        cl_extra[num_cl] = uint8_t(extra);
+        ++num_cl;
+        cl_freq[sym]++;
+    };
+    for (int i = 0, total = hlit + hdist; i < total;) {
+        int l = all_len[i];
+        int run = 1;
+        while (i + run < total && all_len[i + run] == l)
+            ++run;
+        i += run;
+        if (l == 0) {
+            for (; run >= 11; ) {
+                int r = std::min(run, 138);
+                emit_cl(18, r - 11);
+                run -= r;
+            }
+            if (run >= 3) {
+                emit_cl(17, run - 3);
+                run = 0;
+            }
+        }
+        else {
+            emit_cl(l, 0);
+            --run;
+            for (; run >= 3; ) {
+                int r = std::min(run, 6);
+                emit_cl(16, r - 3);
+                run -= r;
+            }
+        }
+        for (; run > 0; --run)
+            emit_cl(l, 0);
+    }
+    uint8_t cl_len[19];
+    deflate_build_lengths(cl_len, cl_freq, 19, 7);
+    int hclen = 19;
+    while (hclen > 4 && cl_len[kDeflateCodeLengthOrder[hclen - 1]] == 0)
+        --hclen;
+
+    // estimate sizes in bits
+    uint64_t extra_bits = 0;
+    for (int c = 0; c < 29; ++c)
+        extra_bits += uint64_t(lit_freq[257 + c]) * kDeflateLengthExtra[c];
+    for (int c = 0; c < 30; ++c)
+        extra_bits += uint64_t(dist_freq[c]) * kDeflateDistExtra[c];
+
+    uint64_t dynamic_bits = 3 + 14 + 3 * hclen + extra_bits;
+    uint64_t fixed_bits = 3 + extra_bits;
+    for (int i = 0; i < 19; ++i)
+        dynamic_bits += uint64_t(cl_freq[i]) * cl_len[i];
+    dynamic_bits += cl_freq[16] * 2 + cl_freq[17] * 3 + cl_freq[18] * 7;
+    for (int i = 0; i < 286; ++i) {
+        dynamic_bits += uint64_t(lit_freq[i]) * lit_len[i];
+        fixed_bits += uint64_t(lit_freq[i]) * tab.fixed_lit_len[i];
+    }
+    for (int i = 0; i < 30; ++i) {
+        dynamic_bits += uint64_t(dist_freq[i]) * dist_len[i];
+        fixed_bits += uint64_t(dist_freq[i]) * 5;
+    }
+    uint64_t stored_bits = (size / kDeflateMaxStored + 1) * 48 + uint64_t(size) * 8;
+
+    if (stored_bits <= dynamic_bits && stored_bits <= fixed_bits) {
+        deflate_write_stored(bw, src, size, final);
+        return;
+    }
+
+    bool use_fixed = fixed_bits <= dynamic_bits;
+    const uint8_t* lit_lengths = use_fixed ? tab.fixed_lit_len : lit_len;
+    const uint8_t* dist_lengths = use_fixed ? tab.fixed_dist_len : dist_len;
+    uint16_t lit_codes[288], dist_codes[30];
+    deflate_build_codes(lit_codes, lit_lengths, use_fixed ? 288 : 286);
+    deflate_build_codes(dist_codes, dist_lengths, 30);
+
+    bw.put(final ? 1 : 0, 1);
+    if (use_fixed) {
+        bw.put(1, 2);
+    }
+    else {
+        bw.put(2, 2);
+        bw.put(hlit - 257, 5);
+        bw.put(hdist - 1, 5);
+        bw.put(hclen - 4, 4);
+        for (int i = 0; i < hclen; ++i)
+            bw.put(cl_len[kDeflateCodeLengthOrder[i]], 3);
+
+        uint16_t cl_codes[19];
+        deflate_build_codes(cl_codes, cl_len, 19);
+        for (int i = 0; i < num_cl; ++i) {
+            int s = cl_sym[i];
+            bw.put(cl_codes[s], cl_len[s]);
+            if (s == 16)
+                bw.put(cl_extra[i], 2);
+            else if (s == 17)
+                bw.put(cl_extra[i], 3);
+            else if (s == 18)
+                bw.put(cl_extra[i], 7);
+        }
+    }
+
+    for (size_t i = 0; i < num_tokens; ++i) {
+        uint32_t t = tokens[i];
+        if (t & kDeflateMatchFlag) {
+            size_t len = ((t >> 16) & 0xff) + kDeflateMinMatch;
+            size_t dist = (t & 0xffff) + 1;
+            int lc = tab.length_code[len];
+            bw.put(lit_codes[257 + lc], lit_lengths[257 + lc]);
+            if (kDeflateLengthExtra[lc])
+                bw.put(uint32_t(len - kDeflateLengthBase[lc]), kDeflateLengthExtra[lc]);
+            int dc = deflate_dist_code(tab, dist);
+            bw.put(dist_codes[dc], dist_lengths[dc]);
+            if (kDeflateDistExtra[dc])
+                bw.put(uint32_t(dist - kDeflateDistBase[dc]), kDeflateDistExtra[dc]);
+        }
+        else {
+            bw.put(lit_codes[t], lit_lengths[t]);
+        }
+    }
+    bw.put(lit_codes[256], lit_lengths[256]);
+}
+
+static inline size_t deflate_match_length(const uint8_t* a, const uint8_t* b, size_t max_len)
+{
+    size_t len = 0;
+    while (len + 8 <= max_len) {
+        uint64_t x, y;
+        memcpy(&x, a + len, 8);
+        memcpy(&y, b + len, 8);
+        if (x != y) {
+            for (; a[len] == b[len]; ++len) {}
+            return len;
+        }
+        len += 8;
+    }
+    while (len < max_len && a[len] == b[len])
+        ++len;
+    return len;
+}
+
+// compresses src[dict_size, dict_size + size). src[0, dict_size) is the dictionary (the preceding input).
+// non-final chunks end with a sync flush (empty stored block) so that the next chunk starts at a byte boundary.
+static void deflate_compress_chunk(RawVector<uint8_t>& dst, const uint8_t* src, size_t dict_size, size_t size, int level, bool final)
+{
+    DeflateBitWriter bw{ dst };
+    const size_t begin = dict_size;
+    const size_t end = dict_size + size;
+
+    if (level == 0) {
+        deflate_write_stored(bw, src + begin, size, final);
+    }
+    else {
+        const auto& params = kDeflateLevels[level];
+        const size_t window_mask = kDeflateWindowSize - 1;
+        RawVector<int32_t> head(size_t(1) << kDeflateHashBits);
+        RawVector<int32_t> prev(kDeflateWindowSize);
+        std::fill(head.begin(), head.end(), -1);
+
+        auto hash = [&](size_t p) {
+            uint32_t v = src[p] | (src[p + 1] << 8) | (src[p + 2] << 16);
+            return (v * 2654435761u) >> (32 - kDeflateHashBits);
+        };
+        auto insert = [&](size_t p) {
+            uint32_t h = hash(p);
+            prev[p & window_mask] = head[h];
+            head[h] = int32_t(p);
+        };
+        auto find = [&](size_t p, size_t& best_len, size_t& best_dist) {
+            best_len = best_dist = 0;
+            size_t max_len = std::min(kDeflateMaxMatch, end - p);
+            int32_t cand = head[hash(p)];
+            for (int chain = params.max_chain; cand >= 0 && chain > 0; --chain) {
+                size_t dist = p - cand;
+                if (dist > kDeflateWindowSize)
+                    break;
+                if (src[cand + best_len] == src[p + best_len]) {
+                    size_t len = deflate_match_length(src + cand, src + p, max_len);
+                    if (len > best_len) {
+                        best_len = len;
+                        best_dist = dist;
+                        if (len >= params.nice_len || len >= max_len)
+                            break;
+                    }
+                }
+                int32_t next = prev[cand & window_mask];
+                if (next >= cand)
+                    break; // stale entry
+                cand = next;
+            }
+            if (best_len == kDeflateMinMatch && best_dist > kDeflateTooFar)
+                best_len = 0;
+        };
+
+        for (size_t p = 0; p < begin && p + kDeflateMinMatch <= end; ++p)
+            insert(p);
+
+        RawVector<uint32_t> tokens;
+        tokens.reserve(kDeflateBlockTokens);
+        size_t block_begin = begin;
+        size_t cached_pos = ~size_t(0), cached_len = 0, cached_dist = 0;
+        size_t p = begin;
+        while (p < end) {
+            if (tokens.size() >= kDeflateBlockTokens) {
+                deflate_write_block(bw, tokens.data(), tokens.size(), src + block_begin, p - block_begin, false);
+                tokens.clear();
+                block_begin = p;
+            }
+
+            if (p + kDeflateMinMatch > end) {
+                tokens.push_back(src[p++]);
+                continue;
+            }
+
+            size_t len, dist;
+            if (cached_pos == p) {
+                len = cached_len;
+                dist = cached_dist;
+            }
+            else {
+                find(p, len, dist);
+            }
+            insert(p);
+
+            // lazy matching: emit a literal if the next position has a longer match
+            if (len >= kDeflateMinMatch && len < params.lazy_limit && p + 1 + kDeflateMinMatch <= end) {
+                find(p + 1, cached_len, cached_dist);
+                cached_pos = p + 1;
+                if (cached_len > len) {
+                    tokens.push_back(src[p++]);
+                    continue;
+                }
+            }
+
+            if (len >= kDeflateMinMatch) {
+                tokens.push_back(kDeflateMatchFlag | uint32_t(len - kDeflateMinMatch) << 16 | uint32_t(dist - 1));
+                if (level >= 3) {
+                    for (size_t q = p + 1; q < p + len && q + kDeflateMinMatch <= end; ++q)
+                        insert(q);
+                }
+                p += len;
+            }
+            else {
+                tokens.push_back(src[p++]);
+            }
+        }
+        deflate_write_block(bw, tokens.data(), tokens.size(), src + block_begin, end - block_begin, final);
+    }
+
+    if (final) {
+        bw.align();
+    }
+    else {
+        bw.put(0, 3);
+        bw.align();
+        bw.put(0x0000, 16);
+        bw.put(0xffff, 16);
+    }
+}
+
+static const uint32_t kAdlerBase = 65521;
+
+static uint32_t adler32(const uint8_t* src, size_t size)
+{
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t n = std::min<size_t>(size, 5552); // largest n that can't overflow b
+        size -= n;
+        for (; n > 0; --n) {
+            a += *src++;
+            b += a;
+        }
+        a %= kAdlerBase;
+        b %= kAdlerBase;
+    }
+    return a | (b << 16);
+}
+
+// adler32 of a + b from adler32 of a and b
+static uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2)
+{
+    uint32_t rem = uint32_t(size2 % kAdlerBase);
+    uint32_t sum1 = adler1 & 0xffff;
+    uint32_t sum2 = uint32_t((uint64_t(rem) * sum1) % kAdlerBase);
+    sum1 += (adler2 & 0xffff) + kAdlerBase - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + kAdlerBase - rem;
+    if (sum1 >= kAdlerBase) sum1 -= kAdlerBase;
+    if (sum1 >= kAdlerBase) sum1 -= kAdlerBase;
+    if (sum2 >= kAdlerBase * 2) sum2 -= kAdlerBase * 2;
+    if (sum2 >= kAdlerBase) sum2 -= kAdlerBase;
+    return sum1 | (sum2 << 16);
+}
+
+size_t ZlibCompressBound(size_t size)
+{
+    // stored blocks + per-block and per-chunk headers
+    return size + size / 2048 + 64;
+}
+
+size_t ZlibCompress(void* dst_, size_t dst_size, const void* src_, size_t src_size, int level)
+{
+    auto* src = (const uint8_t*)src_;
+    auto* dst = (uint8_t*)dst_;
+    level = clamp(level, 0, 9);
+
+    int num_chunks = std::max((int)((src_size + kDeflateChunkSize - 1) / kDeflateChunkSize), 1);
+    std::vector<RawVector<uint8_t>> chunks(num_chunks);
+    RawVector<uint32_t> adlers(num_chunks);
+    parallel_for(0, num_chunks, [&](int ci) {
+        size_t begin = kDeflateChunkSize * ci;
+        size_t end = std::min(begin + kDeflateChunkSize, src_size);
+        size_t dict_size = std::min(begin, kDeflateWindowSize);
+        chunks[ci].reserve(ZlibCompressBound(end - begin));
+        deflate_compress_chunk(chunks[ci], src + begin - dict_size, dict_size, end - begin, level, ci == num_chunks - 1);
+        adlers[ci] = adler32(src + begin, end - begin);
+    });
+
+    size_t total = 2 + 4;
+    for (auto& c : chunks)
+        total += c.size();
+    if (total > dst_size)
+        return 0;
+
+    // header: deflate with 32KB window, compression level hint and check bits
+    uint8_t* op = dst;
+    uint32_t cmf = 0x78;
+    uint32_t flg = (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6;
+    flg += 31 - (cmf * 256 + flg) % 31;
+    *op++ = uint8_t(cmf);
+    *op++ = uint8_t(flg);
+
+    uint32_t adler = 1;
+    for (int ci = 0; ci < num_chunks; ++ci) {
+        auto& c = chunks[ci];
+        memcpy(op, c.data(), c.size());
+        op += c.size();
+        size_t begin = kDeflateChunkSize * ci;
+        adler = adler32_combine(adler, adlers[ci], std::min(kDeflateChunkSize, src_size - begin));
+    }
+    *op++ = uint8_t(adler >> 24);
+    *op++ = uint8_t(adler >> 16);
+    *op++ = uint8_t(adler >> 8);
+    *op++ = uint8_t(adler);
+    return op - dst;
+}
+
 } // namespace mu
\ No newline at end of file
@@ -45,4 +45,43 @@ using BoundedArrayU16x3 = BoundedArray<unorm16x3, float3>;
 using BoundedArrayU8x4  = BoundedArray<unorm8x4, float4>;
 using BoundedArrayU16x4 = BoundedArray<unorm16x4, float4>;
 
+
+// delta + zigzag + bit-packing for int arrays (indices etc). lossless.
+// data is split into fixed size blocks that have own base value and bit width, so blocks are encoded / decoded in parallel.
+// DeltaPack() returns the number of uint32 written. DeltaUnpack() returns false if src is corrupted.
+size_t DeltaPackBound(size_t size);
+size_t DeltaPack(uint32_t* dst, const int* src, size_t size);
+bool DeltaUnpack(int* dst, size_t size, const uint32_t* src, size_t src_words);
+
+
+// LZ4-style byte oriented codec. fast but modest ratio.
+// LZCompress() returns compressed size, or 0 if dst_size is not enough.
+// LZDecompress() returns decompressed size, or 0 if src is corrupted or dst_size is not enough.
+size_t LZCompressBound(size_t size);
+size_t LZCompress(void* dst, size_t dst_size, const void* src, size_t src_size);
+size_t LZDecompress(void* dst, size_t dst_size, const void* src, size_t src_size);
+
+// framed LZ. input is split into independent blocks that are compressed / decompressed in parallel.
+// blocks that don't shrink are stored as is. frames are self-contained, so they can be concatenated (see LZOStream).
+// Compress() returns frame size, or 0 if dst_size is not enough. CompressBound() is always enough.
+// Decompress() returns decompressed size, or 0 if src is corrupted or dst_size is not enough.
+// GetFrameInfo() reads the header (first LZFrameHeaderSize bytes) to know the sizes before decompressing.
+static const size_t LZFrameHeaderSize = 24;
+static const size_t LZDefaultBlockSize = 1024 * 256;
+
+size_t CompressBound(size_t size, size_t block_size = LZDefaultBlockSize);
+size_t Compress(void* dst, size_t dst_size, const void* src, size_t src_size, size_t block_size = LZDefaultBlockSize);
+size_t Decompress(void* dst, size_t dst_size, const void* src, size_t src_size);
+bool GetFrameInfo(const void* src, size_t src_size, uint64_t& raw_size, uint64_t& frame_size);
+void Compress(RawVector<char>& dst, const void* src, size_t src_size, size_t block_size = LZDefaultBlockSize);
+bool Decompress(RawVector<char>& dst, const void* src, size_t src_size);
+
+
+// zlib (deflate) stream. input is split into chunks that are compressed in parallel with the preceding 32KB as dictionary,
+// and joined with sync flushes into one standard stream that any inflater can read (pigz-style).
+// level: 0 (store) - 9 (smallest). 1 is the fastest that still compresses.
+// ZlibCompress() returns compressed size, or 0 if dst_size is not enough.
+size_t ZlibCompressBound(size_t size);
+size_t ZlibCompress(void* dst, size_t dst_size, const void* src, size_t src_size, int level = 6);
+
 } // namespace mu
@@ -0,0 +1,120 @@
+#include "pch.h"
+#include "muMath.h"
+#include "muConcurrency.h"
+
+namespace mu {
+
+ThreadPool::ThreadPool(int num_threads)
+{
+    if (num_threads <= 0)
+        num_threads = std::max<int>(std::thread::hardware_concurrency(), 1);
+    m_threads.reserve(num_threads);
+    for (int i = 0; i < num_threads; ++i)
+        m_threads.emplace_back([this]() { process(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_queue.clear();
+        m_priorities.clear();
+    }
+    m_cond_task.notify_all();
+    for (auto& t : m_threads)
+        t.join();
+}
+
+ThreadPool::TaskID ThreadPool::enqueue(const Task& task, int priority)
+{
+    TaskID id;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        id = m_next_id++;
+        m_queue.emplace(key_t{ -priority, id }, task);
+        m_priorities[id] = priority;
+    }
+    m_cond_task.notify_one();
+    return id;
+}
+
+bool ThreadPool::cancel(TaskID id)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_priorities.find(id);
+    if (it == m_priorities.end())
+        return false;
+    m_queue.erase(key_t{ -it->second, id });
+    m_priorities.erase(it);
+    if (m_queue.empty() && m_running == 0)
+        m_cond_idle.notify_all();
+    return true;
+}
+
+bool ThreadPool::setPriority(TaskID id, int priority)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_priorities.find(id);
+    if (it == m_priorities.end())
+        return false;
+    if (it->second != priority) {
+        auto q = m_queue.find(key_t{ -it->second, id });
+        auto task = std::move(q->second);
+        m_queue.erase(q);
+        m_queue.emplace(key_t{ -priority, id }, std::move(task));
+        it->second = priority;
+    }
+    return true;
+}
+
+void ThreadPool::cancelAll()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queue.clear();
+    m_priorities.clear();
+    if (m_running == 0)
+        m_cond_idle.notify_all();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond_idle.wait(lock, [this]() { return m_queue.empty() && m_running == 0; });
+}
+
+int ThreadPool::getThreadCount() const
+{
+    return (int)m_threads.size();
+}
+
+size_t ThreadPool::getPendingCount() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_queue.size();
+}
+
+void ThreadPool::process()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_cond_task.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        if (m_stop)
+            break;
+
+        auto it = m_queue.begin();
+        auto task = std::move(it->second);
+        m_priorities.erase(it->first.second);
+        m_queue.erase(it);
+        ++m_running;
+
+        lock.unlock();
+        task();
+        lock.lock();
+
+        if (--m_running == 0 && m_queue.empty())
+            m_cond_idle.notify_all();
+    }
+}
+
+} // namespace mu
@@ -2,6 +2,12 @@
 
 #include "muConfig.h"
 #include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
 #if defined(muEnablePPL)
     #include <ppl.h>
 #elif defined(muEnableTBB)
@@ -128,5 +134,47 @@ private:
     std::atomic_flag lck = ATOMIC_FLAG_INIT;
 };
 
+
+// fixed number of worker threads that run queued tasks in order of priority (higher first, FIFO among the same priority).
+// unlike parallel_for, this is for long-running or blocking tasks (file I/O, decoding, etc) that should not occupy
+// the TBB/PPL workers.
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+    using TaskID = uint64_t;
+
+    // num_threads <= 0: std::thread::hardware_concurrency()
+    explicit ThreadPool(int num_threads = 0);
+    // pending tasks are discarded. running tasks are waited.
+    ~ThreadPool();
+
+    TaskID enqueue(const Task& task, int priority = 0);
+    // returns false if the task is already started or finished
+    bool cancel(TaskID id);
+    bool setPriority(TaskID id, int priority);
+    void cancelAll();
+    // wait until all queued tasks are finished
+    void wait();
+
+    int getThreadCount() const;
+    size_t getPendingCount() const;
+
+private:
+    using key_t = std::pair<int, TaskID>; // (-priority, id)
+
+    void process();
+
+    std::vector<std::thread> m_threads;
+    std::map<key_t, Task> m_queue;
+    std::map<TaskID, int> m_priorities;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond_task;
+    std::condition_variable m_cond_idle;
+    TaskID m_next_id = 0;
+    int m_running = 0;
+    bool m_stop = false;
+};
+
 } // namespace ms
 
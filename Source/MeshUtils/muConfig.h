@@ -5,6 +5,7 @@
 //   muEnableTBB
 //   muEnableISPC
 //   muEnableAMP
+//   muEnableIOUring (Linux only)
 //   muEnableSymbol
 
 #ifdef _WIN32
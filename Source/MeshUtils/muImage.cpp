@@ -1,6 +1,10 @@
 #include "pch.h"
 #include "muAlgorithm.h"
 #include "muImage.h"
+#include "muCompression.h"
+#include "muSIMD.h"
+#include "muConcurrency.h"
+#include <climits>
 
 #define STBI_NO_STDIO
 #define STB_IMAGE_IMPLEMENTATION
@@ -57,7 +61,7 @@ void Image::resize(int width, int height, ImageFormat format)
     m_size = { width, height };
     m_format = format;
 
-    size_t size = width * height * GetPixelSize(format);
+    size_t size = (size_t)width * height * GetPixelSize(format);
     m_data.resize_zeroclear(size);
 }
 
@@ -66,6 +70,1127 @@ ImageFormat Image::getFormat() const { return m_format; }
 size_t Image::getSizeInByte() const { return m_data.size(); }
 
 
+// mipmap impl
+
+int GetMipCount(int width, int height)
+{
+    int ret = 1;
+    for (int s = std::max(width, height); s > 1; s /= 2)
+        ++ret;
+    return ret;
+}
+
+int2 GetMipSize(int width, int height, int level)
+{
+    return { std::max(width >> level, 1), std::max(height >> level, 1) };
+}
+
+size_t GetMipChainSize(int width, int height, ImageFormat format, int num_levels)
+{
+    size_t ret = 0;
+    for (int i = 0; i < num_levels; ++i) {
+        auto size = GetMipSize(width, height, i);
+        ret += size_t(size.x) * size_t(size.y) * GetPixelSize(format);
+    }
+    return ret;
+}
+
+// taps of a separable filter: dst texel i = sum(src[indices[i * num_taps + t]] * weights[i * num_taps + t])
+struct MipTaps
+{
+    int num_taps = 0;
+    RawVector<int> indices;
+    RawVector<float> weights;
+};
+
+static inline float Sinc(float x)
+{
+    if (std::abs(x) < 1e-6f)
+        return 1.0f;
+    x *= PI;
+    return std::sin(x) / x;
+}
+
+// zeroth order modified Bessel function of the first kind
+static inline float BesselI0(float x)
+{
+    float sum = 1.0f, term = 1.0f;
+    float hx2 = x * x * 0.25f;
+    for (int k = 1; k < 16; ++k) {
+        term *= hx2 / float(k * k);
+        sum += term;
+    }
+    return sum;
+}
+
+static void BuildMipTaps(MipTaps& dst, int src_size, int dst_size, MipFilter filter)
+{
+    const float kaiser_width = 3.0f; // in dst texels
+    const float kaiser_alpha = 4.0f;
+
+    float scale = float(src_size) / float(dst_size);
+    float radius = filter == MipFilter::Kaiser ? kaiser_width * scale : scale * 0.5f;
+    int num_taps = int(std::ceil(radius * 2.0f)) + 1;
+    dst.num_taps = num_taps;
+    dst.indices.resize_discard(dst_size * num_taps);
+    dst.weights.resize_discard(dst_size * num_taps);
+
+    float inv_i0 = 1.0f / BesselI0(kaiser_alpha);
+    for (int i = 0; i < dst_size; ++i) {
+        float center = (float(i) + 0.5f) * scale;
+        int first = int(std::floor(center - radius));
+        int* indices = &dst.indices[i * num_taps];
+        float* weights = &dst.weights[i * num_taps];
+        float total = 0.0f;
+        for (int t = 0; t < num_taps; ++t) {
+            int j = first + t;
+            float w = 0.0f;
+            if (filter == MipFilter::Kaiser) {
+                // distance in dst texels
+                float x = (float(j) + 0.5f - center) / scale;
+                if (std::abs(x) < kaiser_width) {
+                    float r = x / kaiser_width;
+                    w = Sinc(x) * BesselI0(kaiser_alpha * std::sqrt(1.0f - r * r)) * inv_i0;
+                }
+            }
+            else {
+                // coverage of src texel [j, j+1] by [center - radius, center + radius]
+                w = std::max(std::min(float(j + 1), center + radius) - std::max(float(j), center - radius), 0.0f);
+            }
+            indices[t] = clamp(j, 0, src_size - 1);
+            weights[t] = w;
+            total += w;
+        }
+        float rcp = total != 0.0f ? 1.0f / total : 0.0f;
+        for (int t = 0; t < num_taps; ++t)
+            weights[t] *= rcp;
+    }
+}
+
+static inline float MipLoad(uint8_t v) { return float(v) * (1.0f / 255.0f); }
+static inline float MipLoad(half v) { return v.to_float(); }
+static inline float MipLoad(float v) { return v; }
+static inline void MipStore(uint8_t& d, float v) { d = uint8_t(clamp01(v) * 255.0f + 0.5f); }
+static inline void MipStore(half& d, float v) { d = half(v); }
+static inline void MipStore(float& d, float v) { d = v; }
+
+// separable: horizontal pass into a float buffer, then vertical pass. rows are processed in parallel and
+// the inner loops run over contiguous texels * channels so that they are vectorized.
+template<class T>
+static void GenerateMipImpl(T* dst, const T* src, int sw, int sh, int ch, MipFilter filter)
+{
+    int dw = std::max(sw / 2, 1);
+    int dh = std::max(sh / 2, 1);
+
+    MipTaps htaps, vtaps;
+    BuildMipTaps(htaps, sw, dw, filter);
+    BuildMipTaps(vtaps, sh, dh, filter);
+
+    const int grain = 32;
+    int drow = dw * ch;
+    RawVector<float> tmp;
+    tmp.resize_discard(size_t(drow) * sh);
+    parallel_for_blocked(0, sh, grain, [&](int begin, int end) {
+        int nt = htaps.num_taps;
+        for (int y = begin; y < end; ++y) {
+            const T* s = src + size_t(sw) * ch * y;
+            float* d = tmp.data() + size_t(drow) * y;
+            for (int x = 0; x < dw; ++x) {
+                const int* ti = &htaps.indices[x * nt];
+                const float* tw = &htaps.weights[x * nt];
+                for (int c = 0; c < ch; ++c) {
+                    float sum = 0.0f;
+                    for (int t = 0; t < nt; ++t)
+                        sum += MipLoad(s[ti[t] * ch + c]) * tw[t];
+                    d[x * ch + c] = sum;
+                }
+            }
+        }
+    });
+
+    parallel_for_blocked(0, dh, grain, [&](int begin, int end) {
+        int nt = vtaps.num_taps;
+        RawVector<float> row;
+        row.resize_discard(drow);
+        for (int y = begin; y < end; ++y) {
+            const int* ti = &vtaps.indices[y * nt];
+            const float* tw = &vtaps.weights[y * nt];
+            row.zeroclear();
+            for (int t = 0; t < nt; ++t) {
+                const float* s = tmp.cdata() + size_t(drow) * ti[t];
+                float w = tw[t];
+                for (int i = 0; i < drow; ++i)
+                    row[i] += s[i] * w;
+            }
+            T* d = dst + size_t(drow) * y;
+            for (int i = 0; i < drow; ++i)
+                MipStore(d[i], row[i]);
+        }
+    });
+}
+
+// fast path of Box for even sizes: plain 2x2 average
+static inline void Average4(uint8_t& d, uint8_t a, uint8_t b, uint8_t c, uint8_t e) { d = uint8_t((a + b + c + e + 2) >> 2); }
+static inline void Average4(half& d, half a, half b, half c, half e) { d = half((a.to_float() + b.to_float() + c.to_float() + e.to_float()) * 0.25f); }
+static inline void Average4(float& d, float a, float b, float c, float e) { d = (a + b + c + e) * 0.25f; }
+
+template<class T>
+static void GenerateMipBox2x2(T* dst, const T* src, int sw, int sh, int ch)
+{
+    int dw = sw / 2;
+    int dh = sh / 2;
+    parallel_for_blocked(0, dh, 32, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            const T* s0 = src + size_t(sw) * ch * (y * 2);
+            const T* s1 = s0 + size_t(sw) * ch;
+            T* d = dst + size_t(dw) * ch * y;
+            for (int x = 0; x < dw; ++x) {
+                for (int c = 0; c < ch; ++c) {
+                    int i = x * 2 * ch + c;
+                    Average4(d[x * ch + c], s0[i], s0[i + ch], s1[i], s1[i + ch]);
+                }
+            }
+        }
+    });
+}
+
+bool GenerateMip(void* dst, const void* src, int src_width, int src_height, ImageFormat format, MipFilter filter)
+{
+    int ch = GetChannelCount(format);
+    if (ch < 1 || ch > 4 || src_width <= 0 || src_height <= 0)
+        return false;
+
+    if (filter == MipFilter::Box && src_width % 2 == 0 && src_height % 2 == 0) {
+        switch (format & ImageFormat::TypeMask) {
+        case ImageFormat::U8: GenerateMipBox2x2((uint8_t*)dst, (const uint8_t*)src, src_width, src_height, ch); return true;
+        case ImageFormat::F16: GenerateMipBox2x2((half*)dst, (const half*)src, src_width, src_height, ch); return true;
+        case ImageFormat::F32: GenerateMipBox2x2((float*)dst, (const float*)src, src_width, src_height, ch); return true;
+        default: return false;
+        }
+    }
+
+    switch (format & ImageFormat::TypeMask) {
+    case ImageFormat::U8: GenerateMipImpl((uint8_t*)dst, (const uint8_t*)src, src_width, src_height, ch, filter); return true;
+    case ImageFormat::F16: GenerateMipImpl((half*)dst, (const half*)src, src_width, src_height, ch, filter); return true;
+    case ImageFormat::F32: GenerateMipImpl((float*)dst, (const float*)src, src_width, src_height, ch, filter); return true;
+    default: return false;
+    }
+}
+
+bool GenerateMipChain(void* dst, const void* src, int width, int height, ImageFormat format, int num_levels, MipFilter filter)
+{
+    int max_levels = GetMipCount(width, height);
+    if (num_levels <= 0 || num_levels > max_levels)
+        num_levels = max_levels;
+
+    size_t psize = GetPixelSize(format);
+    char* d = (char*)dst;
+    memcpy(d, src, size_t(width) * size_t(height) * psize);
+    for (int i = 1; i < num_levels; ++i) {
+        auto ssize = GetMipSize(width, height, i - 1);
+        char* next = d + size_t(ssize.x) * size_t(ssize.y) * psize;
+        if (!GenerateMip(next, d, ssize.x, ssize.y, format, filter))
+            return false;
+        d = next;
+    }
+    return true;
+}
+
+
+// EXR impl
+// https://openexr.com/en/latest/OpenEXRFileLayout.html
+// pixel data and header values are little endian, same as all platforms we support.
+
+enum class EXRPixelType : int
+{
+    UInt = 0,
+    Half = 1,
+    Float = 2,
+};
+
+enum EXRFlags : uint32_t
+{
+    EXRFlag_Tiled = 0x200,
+    EXRFlag_LongNames = 0x400,
+    EXRFlag_NonImage = 0x800,
+    EXRFlag_MultiPart = 0x1000,
+};
+
+static const int EXRMagic = 20000630;
+static const int EXRDeflateLevel = 6;
+
+struct EXRChannel
+{
+    std::string name;
+    EXRPixelType type = EXRPixelType::Half;
+    int layer = -1;     // -1: not read
+    int component = 0;  // channel index in the layer image
+};
+
+struct EXRBlock
+{
+    int x0, y0, x1, y1; // relative to the data window
+};
+
+static int EXRTypeSize(EXRPixelType t)
+{
+    return t == EXRPixelType::Half ? 2 : 4;
+}
+
+static int EXRLinesPerBlock(int compression)
+{
+    switch (compression) {
+    case 0: // none
+    case 1: // rle
+    case 2: // zips
+        return 1;
+    case 3: // zip
+        return 16;
+    default: // piz, pxr24, b44, dwa: not supported
+        return 0;
+    }
+}
+
+static size_t EXRBlockSize(const EXRBlock& b, const std::vector<EXRChannel>& channels)
+{
+    size_t pixel_size = 0;
+    for (auto& c : channels)
+        pixel_size += EXRTypeSize(c.type);
+    return size_t(b.x1 - b.x0) * size_t(b.y1 - b.y0) * pixel_size;
+}
+
+static void EXRGetBlocks(std::vector<EXRBlock>& dst, int width, int height, int lines_per_block, int tile_w, int tile_h)
+{
+    // steps are clamped to the remaining size so that coordinates never go past width / height
+    dst.clear();
+    if (tile_w > 0) {
+        for (int y = 0; y < height; y += std::min(tile_h, height - y))
+            for (int x = 0; x < width; x += std::min(tile_w, width - x))
+                dst.push_back({ x, y, x + std::min(tile_w, width - x), y + std::min(tile_h, height - y) });
+    }
+    else {
+        for (int y = 0; y < height; y += std::min(lines_per_block, height - y))
+            dst.push_back({ 0, y, width, y + std::min(lines_per_block, height - y) });
+    }
+}
+
+// split even and odd bytes and delta encode. applied before RLE and deflate.
+static void EXRPredictEncode(char* dst, const char* src, size_t size)
+{
+    char* t1 = dst;
+    char* t2 = dst + (size + 1) / 2;
+    for (size_t i = 0; i < size; i += 2) {
+        *t1++ = src[i];
+        if (i + 1 < size)
+            *t2++ = src[i + 1];
+    }
+
+    auto* t = (uint8_t*)dst;
+    int p = size > 0 ? t[0] : 0;
+    for (size_t i = 1; i < size; ++i) {
+        int d = int(t[i]) - p + (128 + 256);
+        p = t[i];
+        t[i] = uint8_t(d);
+    }
+}
+
+// src is modified
+static void EXRPredictDecode(char* dst, char* src, size_t size)
+{
+    auto* t = (uint8_t*)src;
+    for (size_t i = 1; i < size; ++i)
+        t[i] = uint8_t(int(t[i - 1]) + int(t[i]) - 128);
+
+    const char* t1 = src;
+    const char* t2 = src + (size + 1) / 2;
+    for (size_t i = 0; i < size; i += 2) {
+        dst[i] = *t1++;
+        if (i + 1 < size)
+            dst[i + 1] = *t2++;
+    }
+}
+
+// dst must have room for size * 129 / 128 + 1 bytes
+static size_t EXRRLECompress(char* dst, const char* src, size_t size)
+{
+    const int min_run = 3;
+    const int max_run = 127;
+
+    const char* end = src + size;
+    const char* run_start = src;
+    const char* run_end = src + 1;
+    char* out = dst;
+    while (run_start < end) {
+        while (run_end < end && *run_start == *run_end && run_end - run_start - 1 < max_run)
+            ++run_end;
+        if (run_end - run_start >= min_run) {
+            *out++ = char((run_end - run_start) - 1);
+            *out++ = *run_start;
+            run_start = run_end;
+        }
+        else {
+            while (run_end < end &&
+                ((run_end + 1 >= end || *run_end != *(run_end + 1)) || (run_end + 2 >= end || *(run_end + 1) != *(run_end + 2))) &&
+                run_end - run_start < max_run)
+                ++run_end;
+            *out++ = char(run_start - run_end);
+            while (run_start < run_end)
+                *out++ = *run_start++;
+        }
+        ++run_end;
+    }
+    return out - dst;
+}
+
+static bool EXRRLEDecompress(char* dst, size_t dst_size, const char* src, size_t src_size)
+{
+    const char* src_end = src + src_size;
+    char* dst_end = dst + dst_size;
+    while (src < src_end) {
+        int count = (signed char)*src++;
+        if (count < 0) {
+            count = -count;
+            if (src_end - src < count || dst_end - dst < count)
+                return false;
+            memcpy(dst, src, count);
+            src += count;
+        }
+        else {
+            ++count;
+            if (src == src_end || dst_end - dst < count)
+                return false;
+            memset(dst, *src++, count);
+        }
+        dst += count;
+    }
+    return dst == dst_end;
+}
+
+// returns compressed data, or raw data if compression doesn't reduce the size as the format requires
+static void EXRCompressBlock(RawVector<char>& dst, RawVector<char>& raw, RawVector<char>& tmp, EXRCompression compression)
+{
+    size_t size = raw.size();
+    if (compression == EXRCompression::None || size == 0) {
+        dst.swap(raw);
+        return;
+    }
+
+    tmp.resize_discard(size);
+    EXRPredictEncode(tmp.data(), raw.data(), size);
+    if (compression == EXRCompression::RLE) {
+        dst.resize_discard(size * 129 / 128 + 1);
+        dst.resize_discard(EXRRLECompress(dst.data(), tmp.data(), size));
+    }
+    else {
+        int zsize = 0;
+        auto* zdata = stbi_zlib_compress((unsigned char*)tmp.data(), (int)size, &zsize, EXRDeflateLevel);
+        if (zdata) {
+            dst.assign((char*)zdata, zsize);
+            free(zdata);
+        }
+        else
+            dst.clear();
+    }
+    if (dst.empty() || dst.size() >= size)
+        dst.swap(raw);
+}
+
+static bool EXRDecompressBlock(RawVector<char>& dst, RawVector<char>& tmp, const char* src, size_t src_size, int compression)
+{
+    size_t size = dst.size();
+    if (src_size == size) {
+        memcpy(dst.data(), src, size);
+        return true;
+    }
+
+    tmp.resize_discard(size);
+    if (compression == 1) {
+        if (!EXRRLEDecompress(tmp.data(), size, src, src_size))
+            return false;
+    }
+    else if (compression == 2 || compression == 3) {
+        if (stbi_zlib_decode_buffer(tmp.data(), (int)size, src, (int)src_size) != (int)size)
+            return false;
+    }
+    else
+        return false;
+    EXRPredictDecode(dst.data(), tmp.data(), size);
+    return true;
+}
+
+// block layout: for each line, for each channel, (x1 - x0) values
+static void EXRPackBlock(char* dst, const EXRBlock& b, const std::vector<EXRChannel>& channels, const Image* const* images, int width)
+{
+    for (int y = b.y0; y < b.y1; ++y) {
+        for (auto& c : channels) {
+            auto& img = *images[c.layer];
+            int ch = GetChannelCount(img.getFormat());
+            size_t first = (size_t(y) * width + b.x0) * ch + c.component;
+            int n = b.x1 - b.x0;
+            if (c.type == EXRPixelType::Half) {
+                auto* s = img.data<half>() + first;
+                for (int x = 0; x < n; ++x, s += ch, dst += 2)
+                    memcpy(dst, s, 2);
+            }
+            else {
+                auto* s = img.data<float>() + first;
+                for (int x = 0; x < n; ++x, s += ch, dst += 4)
+                    memcpy(dst, s, 4);
+            }
+        }
+    }
+}
+
+static void EXRUnpackBlock(std::vector<EXRLayer>& layers, const EXRBlock& b, const std::vector<EXRChannel>& channels, const char* src, int width)
+{
+    for (int y = b.y0; y < b.y1; ++y) {
+        for (auto& c : channels) {
+            int n = b.x1 - b.x0;
+            if (c.layer < 0) {
+                src += size_t(n) * EXRTypeSize(c.type);
+                continue;
+            }
+
+            auto& img = layers[c.layer].image;
+            int ch = GetChannelCount(img.getFormat());
+            size_t first = (size_t(y) * width + b.x0) * ch + c.component;
+            if ((img.getFormat() & ImageFormat::TypeMask) == ImageFormat::F16) {
+                // all channels of f16 layers are half
+                auto* d = img.data<half>() + first;
+                for (int x = 0; x < n; ++x, d += ch, src += 2)
+                    memcpy(d, src, 2);
+            }
+            else {
+                auto* d = img.data<float>() + first;
+                for (int x = 0; x < n; ++x, d += ch) {
+                    switch (c.type) {
+                    case EXRPixelType::Half: { half v; memcpy(&v, src, 2); *d = v.to_float(); src += 2; break; }
+                    case EXRPixelType::Float: memcpy(d, src, 4); src += 4; break;
+                    case EXRPixelType::UInt: { uint32_t v; memcpy(&v, src, 4); *d = float(v); src += 4; break; }
+                    }
+                }
+            }
+        }
+    }
+}
+
+template<class T>
+static inline void EXRPut(RawVector<char>& dst, const T& v)
+{
+    dst.push_back((const char*)&v, sizeof(T));
+}
+
+static inline void EXRPutString(RawVector<char>& dst, const std::string& v)
+{
+    dst.push_back(v.c_str(), v.size() + 1);
+}
+
+static void EXRPutAttribute(RawVector<char>& dst, const char* name, const char* type, const RawVector<char>& value)
+{
+    EXRPutString(dst, name);
+    EXRPutString(dst, type);
+    EXRPut(dst, (int)value.size());
+    dst.push_back(value.data(), value.size());
+}
+
+template<class T>
+static void EXRPutAttribute(RawVector<char>& dst, const char* name, const char* type, const T& value)
+{
+    RawVector<char> tmp;
+    EXRPut(tmp, value);
+    EXRPutAttribute(dst, name, type, tmp);
+}
+
+static const char* EXRComponentName(int num_channels, int component)
+{
+    static const char* s_rgba[] = { "R", "G", "B", "A" };
+    return num_channels == 1 ? "Y" : s_rgba[component];
+}
+
+static bool WriteEXRImpl(std::ostream& os, const std::string* names, const Image* const* src_images, size_t num_layers, const EXRWriteOptions& opt)
+{
+    if (!os || num_layers == 0 || opt.tile_size < 0)
+        return false;
+
+    int2 size = src_images[0]->getSize();
+    if (size.x <= 0 || size.y <= 0)
+        return false;
+
+    // u8 is not representable in EXR. store as half
+    std::vector<Image> converted(num_layers);
+    std::vector<const Image*> images(num_layers);
+    std::vector<EXRChannel> channels;
+    for (size_t li = 0; li < num_layers; ++li) {
+        auto& img = *src_images[li];
+        int ch = GetChannelCount(img.getFormat());
+        if (img.getSize() != size || img.empty() || ch < 1 || ch > 4)
+            return false;
+
+        images[li] = &img;
+        auto type = img.getFormat() & ImageFormat::TypeMask;
+        if (type == ImageFormat::U8) {
+            converted[li] = img.convert(ImageFormat::F16 | (img.getFormat() & ImageFormat::ChannelMask));
+            images[li] = &converted[li];
+            type = ImageFormat::F16;
+        }
+
+        std::string prefix = names[li].empty() ? std::string() : names[li] + ".";
+        for (int ci = 0; ci < ch; ++ci) {
+            EXRChannel c;
+            c.name = prefix + EXRComponentName(ch, ci);
+            c.type = type == ImageFormat::F16 ? EXRPixelType::Half : EXRPixelType::Float;
+            c.layer = (int)li;
+            c.component = ci;
+            channels.push_back(c);
+        }
+    }
+    std::sort(channels.begin(), channels.end(), [](auto& a, auto& b) { return a.name < b.name; });
+    for (size_t ci = 1; ci < channels.size(); ++ci) {
+        if (channels[ci - 1].name == channels[ci].name)
+            return false;
+    }
+
+    uint32_t flags = 0;
+    if (opt.tile_size > 0)
+        flags |= EXRFlag_Tiled;
+    for (auto& c : channels) {
+        if (c.name.size() > 31)
+            flags |= EXRFlag_LongNames;
+    }
+
+    // header
+    RawVector<char> header;
+    EXRPut(header, EXRMagic);
+    EXRPut(header, 2u | flags);
+    {
+        RawVector<char> chlist;
+        for (auto& c : channels) {
+            EXRPutString(chlist, c.name);
+            EXRPut(chlist, (int)c.type);
+            EXRPut(chlist, 0u); // pLinear + reserved
+            EXRPut(chlist, 1);  // xSampling
+            EXRPut(chlist, 1);  // ySampling
+        }
+        chlist.push_back('\0');
+        EXRPutAttribute(header, "channels", "chlist", chlist);
+    }
+    EXRPutAttribute(header, "compression", "compression", (uint8_t)opt.compression);
+    EXRPutAttribute(header, "dataWindow", "box2i", int4{ 0, 0, size.x - 1, size.y - 1 });
+    EXRPutAttribute(header, "displayWindow", "box2i", int4{ 0, 0, size.x - 1, size.y - 1 });
+    EXRPutAttribute(header, "lineOrder", "lineOrder", (uint8_t)0); // increasing y
+    EXRPutAttribute(header, "pixelAspectRatio", "float", 1.0f);
+    EXRPutAttribute(header, "screenWindowCenter", "v2f", float2::zero());
+    EXRPutAttribute(header, "screenWindowWidth", "float", 1.0f);
+    if (opt.tile_size > 0) {
+        RawVector<char> tiledesc;
+        EXRPut(tiledesc, (uint32_t)opt.tile_size);
+        EXRPut(tiledesc, (uint32_t)opt.tile_size);
+        tiledesc.push_back('\0'); // one level, round down
+        EXRPutAttribute(header, "tiles", "tiledesc", tiledesc);
+    }
+    header.push_back('\0');
+
+    // blocks
+    std::vector<EXRBlock> blocks;
+    EXRGetBlocks(blocks, size.x, size.y, EXRLinesPerBlock((int)opt.compression), opt.tile_size, opt.tile_size);
+
+    int num_blocks = (int)blocks.size();
+    std::vector<RawVector<char>> chunks(num_blocks);
+    parallel_for(0, num_blocks, [&](int bi) {
+        auto& b = blocks[bi];
+        RawVector<char> raw, tmp, data;
+        raw.resize_discard(EXRBlockSize(b, channels));
+        EXRPackBlock(raw.data(), b, channels, images.data(), size.x);
+        EXRCompressBlock(data, raw, tmp, opt.compression);
+
+        auto& chunk = chunks[bi];
+        chunk.reserve_discard(data.size() + 20);
+        if (opt.tile_size > 0) {
+            EXRPut(chunk, b.x0 / opt.tile_size);
+            EXRPut(chunk, b.y0 / opt.tile_size);
+            EXRPut(chunk, 0); // level x
+            EXRPut(chunk, 0); // level y
+        }
+        else {
+            EXRPut(chunk, b.y0);
+        }
+        EXRPut(chunk, (int)data.size());
+        chunk.push_back(data.data(), data.size());
+    });
+
+    // offset table. offsets are from the beginning of the file
+    RawVector<uint64_t> offsets(num_blocks);
+    uint64_t pos = header.size() + sizeof(uint64_t) * num_blocks;
+    for (int bi = 0; bi < num_blocks; ++bi) {
+        offsets[bi] = pos;
+        pos += chunks[bi].size();
+    }
+
+    os.write(header.data(), header.size());
+    os.write((const char*)offsets.data(), sizeof(uint64_t) * num_blocks);
+    for (auto& chunk : chunks)
+        os.write(chunk.data(), chunk.size());
+    return os.good();
+}
+
+bool WriteEXR(std::ostream& os, const EXRLayer* layers, size_t num_layers, const EXRWriteOptions& opt)
+{
+    std::vector<std::string> names(num_layers);
+    std::vector<const Image*> images(num_layers);
+    for (size_t li = 0; li < num_layers; ++li) {
+        names[li] = layers[li].name;
+        images[li] = &layers[li].image;
+    }
+    return WriteEXRImpl(os, names.data(), images.data(), num_layers, opt);
+}
+
+
+struct EXRReader
+{
+    const char* pos;
+    const char* end;
+
+    template<class T>
+    bool read(T& v)
+    {
+        if (end - pos < (ptrdiff_t)sizeof(T))
+            return false;
+        memcpy(&v, pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    bool readString(std::string& v)
+    {
+        auto* term = (const char*)memchr(pos, '\0', end - pos);
+        if (!term)
+            return false;
+        v.assign(pos, term);
+        pos = term + 1;
+        return true;
+    }
+};
+
+// R, G, B, A first. Y is treated as R for gray images
+static int EXRComponentRank(const std::string& name)
+{
+    if (name.size() == 1) {
+        switch (std::toupper(name[0])) {
+        case 'R': case 'Y': return 0;
+        case 'G': return 1;
+        case 'B': return 2;
+        case 'A': return 3;
+        }
+    }
+    return 4;
+}
+
+bool ReadEXR(std::istream& is, std::vector<EXRLayer>& layers)
+{
+    layers.clear();
+    if (!is)
+        return false;
+
+    RawVector<char> buf;
+    {
+        const size_t read_size = 1024 * 1024;
+        for (;;) {
+            size_t pos = buf.size();
+            buf.resize(pos + read_size);
+            is.read(buf.data() + pos, read_size);
+            buf.resize(pos + (size_t)is.gcount());
+            if (!is)
+                break;
+        }
+    }
+
+    EXRReader r{ buf.data(), buf.data() + buf.size() };
+    int magic = 0;
+    uint32_t version = 0;
+    if (!r.read(magic) || !r.read(version) || magic != EXRMagic || (version & 0xff) != 2)
+        return false;
+    if (version & (EXRFlag_NonImage | EXRFlag_MultiPart))
+        return false;
+
+    // header
+    std::vector<EXRChannel> channels;
+    int compression = -1;
+    int4 data_window{ 0, 0, -1, -1 };
+    int tile_w = 0, tile_h = 0;
+    for (;;) {
+        std::string name, type;
+        int attr_size = 0;
+        if (!r.readString(name))
+            return false;
+        if (name.empty())
+            break;
+        if (!r.readString(type) || !r.read(attr_size) || attr_size < 0 || r.end - r.pos < attr_size)
+            return false;
+
+        EXRReader attr{ r.pos, r.pos + attr_size };
+        r.pos += attr_size;
+        if (name == "channels" && type == "chlist") {
+            for (;;) {
+                EXRChannel c;
+                int pixel_type;
+                uint32_t linear;
+                int xsampling, ysampling;
+                if (!attr.readString(c.name))
+                    return false;
+                if (c.name.empty())
+                    break;
+                if (!attr.read(pixel_type) || !attr.read(linear) || !attr.read(xsampling) || !attr.read(ysampling))
+                    return false;
+                if (pixel_type < 0 || pixel_type > 2 || xsampling != 1 || ysampling != 1)
+                    return false; // subsampled channels are not supported
+                c.type = (EXRPixelType)pixel_type;
+                channels.push_back(c);
+            }
+        }
+        else if (name == "compression") {
+            uint8_t v;
+            if (!attr.read(v))
+                return false;
+            compression = v;
+        }
+        else if (name == "dataWindow") {
+            if (!attr.read(data_window))
+                return false;
+        }
+        else if (name == "tiles") {
+            uint32_t w, h;
+            uint8_t mode;
+            if (!attr.read(w) || !attr.read(h) || !attr.read(mode) || int(w) <= 0 || int(h) <= 0)
+                return false;
+            tile_w = (int)w;
+            tile_h = (int)h;
+        }
+    }
+
+    // sizes are computed in 64 bit. the window comes from the file and can overflow int.
+    int lines_per_block = EXRLinesPerBlock(compression);
+    int64_t width64 = (int64_t)data_window.z - data_window.x + 1;
+    int64_t height64 = (int64_t)data_window.w - data_window.y + 1;
+    bool tiled = (version & EXRFlag_Tiled) != 0;
+    if (channels.empty() || lines_per_block == 0 || tiled != (tile_w > 0) ||
+        width64 <= 0 || height64 <= 0 || width64 > INT_MAX || height64 > INT_MAX)
+        return false;
+    int width = (int)width64;
+    int height = (int)height64;
+
+    // reject windows the file can't hold before anything is allocated:
+    // every block has an 8 byte entry in the offset table, and a block decodes to at most its compressed size
+    // times the maximum ratio of the codec (1 for none, 64 for RLE, 1032 for deflate).
+    int64_t num_tiles_x = tiled ? (width64 + tile_w - 1) / tile_w : 1;
+    int64_t num_tiles_y = tiled ? (height64 + tile_h - 1) / tile_h : (height64 + lines_per_block - 1) / lines_per_block;
+    {
+        uint64_t pixel_size = 0;
+        for (auto& c : channels)
+            pixel_size += EXRTypeSize(c.type);
+        uint64_t max_ratio = compression == 0 ? 1 : compression == 1 ? 64 : 1032;
+        uint64_t file_size = buf.size();
+        if ((uint64_t)(num_tiles_x * num_tiles_y) > file_size / sizeof(uint64_t) ||
+            (uint64_t)width64 * (uint64_t)height64 > file_size * max_ratio / pixel_size)
+            return false;
+    }
+
+    // group channels into layers
+    {
+        std::map<std::string, std::vector<int>> groups;
+        for (int ci = 0; ci < (int)channels.size(); ++ci) {
+            auto& name = channels[ci].name;
+            auto sep = name.find_last_of('.');
+            groups[sep == std::string::npos ? std::string() : name.substr(0, sep)].push_back(ci);
+        }
+
+        for (auto& kvp : groups) {
+            auto prefix_len = kvp.first.empty() ? 0 : kvp.first.size() + 1;
+            auto& indices = kvp.second;
+            std::stable_sort(indices.begin(), indices.end(), [&](int a, int b) {
+                return EXRComponentRank(channels[a].name.substr(prefix_len)) < EXRComponentRank(channels[b].name.substr(prefix_len));
+            });
+            if (indices.size() > 4)
+                indices.resize(4);
+
+            bool all_half = true;
+            for (int ci : indices)
+                all_half &= channels[ci].type == EXRPixelType::Half;
+
+            int li = (int)layers.size();
+            for (int i = 0; i < (int)indices.size(); ++i) {
+                channels[indices[i]].layer = li;
+                channels[indices[i]].component = i;
+            }
+
+            EXRLayer layer;
+            layer.name = kvp.first;
+            layer.image.resize(width, height, (all_half ? ImageFormat::F16 : ImageFormat::F32) | (ImageFormat)(uint32_t)indices.size());
+            layers.push_back(std::move(layer));
+        }
+    }
+
+    std::vector<EXRBlock> blocks;
+    EXRGetBlocks(blocks, width, height, lines_per_block, tile_w, tile_h);
+
+    // for mipmapped files, level 0 tiles come first in the offset table
+    int num_blocks = (int)blocks.size();
+    RawVector<uint64_t> offsets(num_blocks);
+    for (auto& o : offsets) {
+        if (!r.read(o) || o >= buf.size())
+            return false;
+    }
+
+    std::atomic<bool> ok{ true };
+    parallel_for(0, num_blocks, [&](int bi) {
+        EXRReader c{ buf.data() + offsets[bi], buf.data() + buf.size() };
+        EXRBlock b;
+        int data_size = 0;
+        if (tiled) {
+            int tx, ty, lx, ly;
+            if (!c.read(tx) || !c.read(ty) || !c.read(lx) || !c.read(ly) || !c.read(data_size)) {
+                ok = false;
+                return;
+            }
+            if (lx != 0 || ly != 0)
+                return;
+            if (tx < 0 || ty < 0 || tx >= num_tiles_x || ty >= num_tiles_y) {
+                ok = false;
+                return;
+            }
+            int x0 = tx * tile_w, y0 = ty * tile_h;
+            b = { x0, y0, x0 + std::min(tile_w, width - x0), y0 + std::min(tile_h, height - y0) };
+        }
+        else {
+            int y;
+            if (!c.read(y) || !c.read(data_size)) {
+                ok = false;
+                return;
+            }
+            int64_t y64 = (int64_t)y - data_window.y;
+            if (y64 < 0 || y64 >= height) {
+                ok = false;
+                return;
+            }
+            y = (int)y64;
+            b = { 0, y, width, y + std::min(lines_per_block, height - y) };
+        }
+        if (b.x0 < 0 || b.y0 < 0 || b.x0 >= b.x1 || b.y0 >= b.y1 || data_size < 0 || c.end - c.pos < data_size) {
+            ok = false;
+            return;
+        }
+
+        RawVector<char> raw, tmp;
+        raw.resize_discard(EXRBlockSize(b, channels));
+        if (!EXRDecompressBlock(raw, tmp, c.pos, data_size, compression)) {
+            ok = false;
+            return;
+        }
+        EXRUnpackBlock(layers, b, channels, raw.data(), width);
+    });
+
+    if (!ok)
+        layers.clear();
+    return ok;
+}
+
+
+// PNG impl
+// https://www.w3.org/TR/png/
+
+static const size_t kPNGIDATSize = 1024 * 1024;
+
+struct PNGCRCTable
+{
+    uint32_t table[8][256]; // slicing-by-8
+
+    PNGCRCTable()
+    {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[0][n] = c;
+        }
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = table[0][n];
+            for (int k = 1; k < 8; ++k) {
+                c = table[0][c & 0xff] ^ (c >> 8);
+                table[k][n] = c;
+            }
+        }
+    }
+};
+
+static uint32_t PNGCRC(const uint8_t* data, size_t size, uint32_t crc = 0)
+{
+    static const PNGCRCTable s_crc;
+    auto& t = s_crc.table;
+    crc = ~crc;
+    for (; size >= 8; size -= 8, data += 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, data, 4);
+        memcpy(&hi, data + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    }
+    for (; size > 0; --size)
+        crc = t[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static inline void PNGPutU32(RawVector<uint8_t>& dst, uint32_t v)
+{
+    uint8_t b[4] = { uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v) };
+    dst.push_back(b, 4);
+}
+
+// chunk: [length][type][data][crc of type + data]
+static void PNGPutChunk(RawVector<uint8_t>& dst, const char* type, const uint8_t* data, size_t size)
+{
+    PNGPutU32(dst, uint32_t(size));
+    size_t pos = dst.size();
+    dst.push_back((const uint8_t*)type, 4);
+    dst.push_back(data, size);
+    PNGPutU32(dst, PNGCRC(dst.data() + pos, size + 4));
+}
+
+static inline int PNGPaeth(int a, int b, int c)
+{
+    int pa = std::abs(b - c);
+    int pb = std::abs(a - c);
+    int pc = std::abs(a + b - c * 2);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+// scratch must have room for stride * 4 bytes.
+// picks the filter with the minimum sum of absolute differences, the usual heuristic.
+static void PNGFilterRow(uint8_t* dst, uint8_t* scratch, const uint8_t* row, const uint8_t* prev, size_t stride, int bpp)
+{
+    size_t n = stride;
+    size_t b = std::min<size_t>(bpp, n);
+    uint8_t* sub = scratch;
+    uint8_t* up = scratch + n;
+    uint8_t* avg = scratch + n * 2;
+    uint8_t* paeth = scratch + n * 3;
+    for (size_t i = 0; i < b; ++i) {
+        sub[i] = row[i];
+        up[i] = uint8_t(row[i] - prev[i]);
+        avg[i] = uint8_t(row[i] - (prev[i] >> 1));
+        paeth[i] = uint8_t(row[i] - prev[i]);
+    }
+    for (size_t i = b; i < n; ++i) {
+        sub[i] = uint8_t(row[i] - row[i - bpp]);
+        up[i] = uint8_t(row[i] - prev[i]);
+        avg[i] = uint8_t(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+        paeth[i] = uint8_t(row[i] - PNGPaeth(row[i - bpp], prev[i], prev[i - bpp]));
+    }
+
+    auto sad = [n](const uint8_t* d) {
+        uint64_t r = 0;
+        for (size_t i = 0; i < n; ++i)
+            r += std::abs((int)(int8_t)d[i]);
+        return r;
+    };
+    const uint8_t* candidates[5] = { row, sub, up, avg, paeth };
+    int best = 0;
+    uint64_t best_sum = sad(row);
+    for (int f = 1; f < 5; ++f) {
+        uint64_t sum = sad(candidates[f]);
+        if (sum < best_sum) {
+            best_sum = sum;
+            best = f;
+        }
+    }
+    dst[0] = uint8_t(best);
+    memcpy(dst + 1, candidates[best], n);
+}
+
+bool WritePNG(std::ostream& os, const Image& image, const PNGWriteOptions& opt)
+{
+    int ch = GetChannelCount(image.getFormat());
+    int2 size = image.getSize();
+    if (!os || image.empty() || ch < 1 || ch > 4)
+        return false;
+
+    Image tmp;
+    const Image* src = &image;
+    if ((image.getFormat() & ImageFormat::TypeMask) != ImageFormat::U8) {
+        tmp = image.convert(ImageFormat::U8 | (image.getFormat() & ImageFormat::ChannelMask));
+        src = &tmp;
+    }
+
+    // filter. each row depends only on the unfiltered previous row.
+    size_t stride = size_t(size.x) * ch;
+    RawVector<uint8_t> filtered(size_t(size.y) * (stride + 1));
+    RawVector<uint8_t> zero_row(stride);
+    zero_row.zeroclear();
+    auto* pixels = src->data<uint8_t>();
+    parallel_for_blocked(0, size.y, 64, [&](int begin, int end) {
+        RawVector<uint8_t> scratch(stride * 4);
+        for (int y = begin; y < end; ++y) {
+            const uint8_t* row = pixels + stride * y;
+            const uint8_t* prev = y > 0 ? row - stride : zero_row.data();
+            uint8_t* dst = filtered.data() + (stride + 1) * y;
+            if (opt.compression_level == 0) {
+                dst[0] = 0;
+                memcpy(dst + 1, row, stride);
+            }
+            else {
+                PNGFilterRow(dst, scratch.data(), row, prev, stride, ch);
+            }
+        }
+    });
+
+    RawVector<uint8_t> zdata(ZlibCompressBound(filtered.size()));
+    zdata.resize(ZlibCompress(zdata.data(), zdata.size(), filtered.data(), filtered.size(), opt.compression_level));
+    if (zdata.empty())
+        return false;
+
+    // split into IDAT chunks so that their CRCs are computed in parallel
+    static const uint8_t s_idat[] = { 'I', 'D', 'A', 'T' };
+    int num_idat = (int)((zdata.size() + kPNGIDATSize - 1) / kPNGIDATSize);
+    RawVector<uint32_t> idat_crcs(num_idat);
+    parallel_for(0, num_idat, [&](int i) {
+        size_t begin = kPNGIDATSize * i;
+        size_t n = std::min(kPNGIDATSize, zdata.size() - begin);
+        idat_crcs[i] = PNGCRC(zdata.data() + begin, n, PNGCRC(s_idat, 4));
+    });
+
+    static const uint8_t s_color_types[] = { 0, 0, 4, 2, 6 }; // gray, gray + alpha, rgb, rgba
+    RawVector<uint8_t> header;
+    {
+        static const uint8_t s_signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        header.push_back(s_signature, sizeof(s_signature));
+
+        RawVector<uint8_t> ihdr;
+        PNGPutU32(ihdr, uint32_t(size.x));
+        PNGPutU32(ihdr, uint32_t(size.y));
+        uint8_t params[] = { 8, s_color_types[ch], 0, 0, 0 }; // bit depth, color type, compression, filter, interlace
+        ihdr.push_back(params, sizeof(params));
+        PNGPutChunk(header, "IHDR", ihdr.data(), ihdr.size());
+    }
+    RawVector<uint8_t> footer;
+    PNGPutChunk(footer, "IEND", nullptr, 0);
+
+    os.write((const char*)header.data(), header.size());
+    for (int i = 0; i < num_idat; ++i) {
+        size_t begin = kPNGIDATSize * i;
+        size_t n = std::min(kPNGIDATSize, zdata.size() - begin);
+        RawVector<uint8_t> buf;
+        PNGPutU32(buf, uint32_t(n));
+        buf.push_back(s_idat, 4);
+        os.write((const char*)buf.data(), buf.size());
+        os.write((const char*)zdata.data() + begin, n);
+        buf.clear();
+        PNGPutU32(buf, idat_crcs[i]);
+        os.write((const char*)buf.data(), buf.size());
+    }
+    os.write((const char*)footer.data(), footer.size());
+    return os.good();
+}
+
+
 // IO impl
 
 static int sread(void* user, char* data, int size)
@@ -163,13 +1288,15 @@ bool Image::read(std::istream& is, ImageFileFormat format)
         return false;
     }
     else if (format == ImageFileFormat::EXR) {
-        // todo
-        return false;
+        std::vector<EXRLayer> layers;
+        if (!ReadEXR(is, layers))
+            return false;
+        // the unnamed layer if exists, otherwise the first one
+        *this = std::move(layers.front().image);
+        return true;
     }
     else {
-        stbi__context ctx;
         stbi_io_callbacks cbs{ sread, sskip, seof };
-        stbi__start_callbacks(&ctx, &cbs, &is);
 
         int width = 0;
         int height = 0;
@@ -251,8 +1378,9 @@ bool Image::write(std::ostream& os, ImageFileFormat format) const
         return false;
 
     if (format == ImageFileFormat::EXR) {
-        // todo
-        return false;
+        std::string name;
+        const Image* image = this;
+        return WriteEXRImpl(os, &name, &image, 1, EXRWriteOptions());
     }
     else {
         int ch = GetChannelCount(m_format);
@@ -275,8 +1403,7 @@ bool Image::write(std::ostream& os, ImageFileFormat format) const
             ret = stbi_write_tga_to_func(swrite, &os, m_size.x, m_size.y, ch, tmp.data());
             break;
         case ImageFileFormat::PNG:
-            tmp = convert(ImageFormat::U8 | (m_format & ImageFormat::ChannelMask));
-            ret = stbi_write_png_to_func(swrite, &os, m_size.x, m_size.y, ch, tmp.data(), 0);
+            ret = WritePNG(os, *this);
             break;
         case ImageFileFormat::HDR:
             tmp = convert(ImageFormat::F32 | (m_format & ImageFormat::ChannelMask));
@@ -299,87 +1426,121 @@ bool Image::write(const char* path) const
 
 // convert impl
 
-template<class S, class D>
-static inline Image RGBtoRGBA(const Image& src, ImageFormat dst_format)
+float LinearToSRGB(float v)
 {
-    Image ret(src.getSize().x, src.getSize().y, dst_format);
-    RGBtoRGBA(ret.data<D>(), src.span<S>());
-    return ret;
+    v = clamp01(v);
+    return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
 }
-template<class S, class D>
-static inline Image RGBAtoRGB(const Image& src, ImageFormat dst_format)
+
+float SRGBToLinear(float v)
 {
-    Image ret(src.getSize().x, src.getSize().y, dst_format);
-    RGBAtoRGB(ret.data<D>(), src.span<S>());
-    return ret;
+    v = clamp01(v);
+    return v <= 0.04045f ? v * (1.0f / 12.92f) : std::pow((v + 0.055f) * (1.0f / 1.055f), 2.4f);
 }
 
-template<class D, class S, muEnableIf(S::vector_length == D::vector_length && S::vector_length == 3)>
-static inline void Assign(D& d, const S& s)
+// src row -> float
+static void LoadRow(float* dst, const void* src, ImageFormat type, size_t num)
 {
-    d = { s[0], s[1], s[2] };
+    switch (type) {
+    case ImageFormat::U8: U8ToF32(dst, (const unorm8*)src, num); break;
+    case ImageFormat::F16: F16ToF32(dst, (const half*)src, num); break;
+    case ImageFormat::F32: memcpy(dst, src, num * sizeof(float)); break;
+    default: break;
+    }
 }
-template<class D, class S, muEnableIf(S::vector_length == D::vector_length && S::vector_length == 4)>
-static inline void Assign(D& d, const S& s)
+
+// float -> dst row
+static void StoreRow(void* dst, const float* src, ImageFormat type, size_t num)
 {
-    d = { s[0], s[1], s[2], s[3] };
+    switch (type) {
+    case ImageFormat::U8: F32ToU8((unorm8*)dst, src, num); break;
+    case ImageFormat::F16: F32ToF16((half*)dst, src, num); break;
+    case ImageFormat::F32: memcpy(dst, src, num * sizeof(float)); break;
+    default: break;
+    }
 }
 
-template<class S, class D, muEnableIf(S::vector_length == D::vector_length)>
-static inline Image Convert(const Image& src, ImageFormat dst_format)
+// color channels: 1 channel is gray and replicated to RGB. missing alpha becomes 1, other missing channels 0.
+static void RemapChannels(float* dst, int dst_ch, const float* src, int src_ch, size_t num)
 {
-    Image ret(src.getSize().x, src.getSize().y, dst_format);
-    auto* s = src.data<S>();
-    auto* d = ret.data<D>();
-    size_t n = src.getSize().x * src.getSize().y;
-    for (size_t i = 0; i < n; ++i)
-        Assign(d[i], s[i]);
-    return ret;
+    for (size_t i = 0; i < num; ++i) {
+        const float* s = src + i * src_ch;
+        float* d = dst + i * dst_ch;
+        for (int c = 0; c < dst_ch; ++c) {
+            if (c == 3)
+                d[c] = src_ch == 4 ? s[3] : 1.0f;
+            else if (c < src_ch)
+                d[c] = s[c];
+            else
+                d[c] = src_ch == 1 ? s[0] : 0.0f;
+        }
+    }
 }
 
-Image Image::convert(ImageFormat dst_format) const
+// alpha (4th channel) is always linear
+static void ApplyColorConversion(float* data, int ch, size_t num, ColorConversion cc)
 {
-    if (m_format == dst_format)
+    int ncolor = std::min(ch, 3);
+    if (cc == ColorConversion::LinearToSRGB) {
+        for (size_t i = 0; i < num; ++i)
+            for (int c = 0; c < ncolor; ++c)
+                data[i * ch + c] = LinearToSRGB(data[i * ch + c]);
+    }
+    else if (cc == ColorConversion::SRGBToLinear) {
+        for (size_t i = 0; i < num; ++i)
+            for (int c = 0; c < ncolor; ++c)
+                data[i * ch + c] = SRGBToLinear(data[i * ch + c]);
+    }
+}
+
+Image Image::convert(ImageFormat dst_format, ColorConversion cc) const
+{
+    if (m_format == dst_format && cc == ColorConversion::None)
         return *this;
 
-    // only RGB <-> RGBA for now
-    if (m_format == ImageFormat::RGBu8) {
-        if (dst_format == ImageFormat::RGBAu8)
-            return RGBtoRGBA<unorm8x3, unorm8x4>(*this, dst_format);
-    }
-    else if (m_format == ImageFormat::RGBf16) {
-        if (dst_format == ImageFormat::RGBAf16)
-            return RGBtoRGBA<half3, half4>(*this, dst_format);
-        else if (dst_format == ImageFormat::RGBu8)
-            return Convert<half3, unorm8x3>(*this, dst_format);
-    }
-    else if (m_format == ImageFormat::RGBf32) {
-        if (dst_format == ImageFormat::RGBAf32)
-            return RGBtoRGBA<float3, float4>(*this, dst_format);
-        else if (dst_format == ImageFormat::RGBu8)
-            return Convert<float3, unorm8x3>(*this, dst_format);
-    }
-    else if (m_format == ImageFormat::RGBAu8) {
-        if (dst_format == ImageFormat::RGBu8)
-            return RGBAtoRGB<unorm8x4, unorm8x3>(*this, dst_format);
-    }
-    else if (m_format == ImageFormat::RGBAf16) {
-        if (dst_format == ImageFormat::RGBf16)
-            return RGBAtoRGB<half4, half3>(*this, dst_format);
-        else if (dst_format == ImageFormat::RGBu8)
-            return RGBAtoRGB<half4, unorm8x3>(*this, dst_format);
-        else if (dst_format == ImageFormat::RGBAu8)
-            return Convert<half4, unorm8x4>(*this, dst_format);
-    }
-    else if (m_format == ImageFormat::RGBAf32) {
-        if (dst_format == ImageFormat::RGBf32)
-            return RGBAtoRGB<float4, float3>(*this, dst_format);
-        else if (dst_format == ImageFormat::RGBu8)
-            return RGBAtoRGB<float4, unorm8x3>(*this, dst_format);
-        else if (dst_format == ImageFormat::RGBAu8)
-            return Convert<float4, unorm8x4>(*this, dst_format);
-    }
-    return Image();
+    int src_ch = GetChannelCount(m_format);
+    int dst_ch = GetChannelCount(dst_format);
+    auto src_type = m_format & ImageFormat::TypeMask;
+    auto dst_type = dst_format & ImageFormat::TypeMask;
+    if (empty() || src_ch < 1 || src_ch > 4 || dst_ch < 1 || dst_ch > 4 || GetPixelSize(m_format) == 0 || GetPixelSize(dst_format) == 0)
+        return Image();
+
+    Image ret(m_size.x, m_size.y, dst_format);
+    int width = m_size.x;
+    size_t src_pitch = size_t(width) * GetPixelSize(m_format);
+    size_t dst_pitch = size_t(width) * GetPixelSize(dst_format);
+
+    // each row: load to float, remap channels, convert color space, store. U8ToF32 / F32ToF16 etc are SIMD kernels.
+    // float intermediate is skipped if nothing but the channel type changes between f16 and f32.
+    bool same_layout = src_ch == dst_ch && cc == ColorConversion::None;
+    parallel_for_blocked(0, m_size.y, 64, [&](int begin, int end) {
+        RawVector<float> buf1, buf2;
+        buf1.resize_discard(size_t(width) * src_ch);
+        buf2.resize_discard(size_t(width) * dst_ch);
+        for (int y = begin; y < end; ++y) {
+            const char* src = m_data.cdata() + src_pitch * y;
+            char* dst = ret.m_data.data() + dst_pitch * y;
+            size_t n = size_t(width) * src_ch;
+            if (same_layout && src_type == ImageFormat::F32) {
+                StoreRow(dst, (const float*)src, dst_type, n);
+                continue;
+            }
+            if (same_layout && dst_type == ImageFormat::F32) {
+                LoadRow((float*)dst, src, src_type, n);
+                continue;
+            }
+
+            LoadRow(buf1.data(), src, src_type, n);
+            float* row = buf1.data();
+            if (src_ch != dst_ch) {
+                RemapChannels(buf2.data(), dst_ch, buf1.cdata(), src_ch, width);
+                row = buf2.data();
+            }
+            ApplyColorConversion(row, dst_ch, width, cc);
+            StoreRow(dst, row, dst_type, size_t(width) * dst_ch);
+        }
+    });
+    return ret;
 }
 
 } // namespace mu
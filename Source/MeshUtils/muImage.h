@@ -47,6 +47,17 @@ enum class ImageFileFormat : uint32_t
 int GetPixelSize(ImageFormat f);
 int GetChannelCount(ImageFormat f);
 
+// applied to color channels (all but the 4th) on Image::convert().
+// when channels are added, 1 channel images are treated as gray, missing alpha becomes 1 and other missing channels 0.
+enum class ColorConversion : int
+{
+    None,
+    LinearToSRGB,
+    SRGBToLinear,
+};
+float LinearToSRGB(float v);
+float SRGBToLinear(float v);
+
 inline float4 Color32toFloat4(uint32_t c)
 {
     return{
@@ -146,6 +157,26 @@ inline void RGBAtoRGB(RGB* dst, const Span<RGBA>& src)
 }
 
 
+enum class MipFilter : int
+{
+    Box,    // average of the covered texels. fastest
+    Kaiser, // Kaiser-windowed sinc. keeps more detail than Box at the cost of slight ringing
+};
+
+// number of levels down to 1x1, including the base level
+int GetMipCount(int width, int height);
+int2 GetMipSize(int width, int height, int level);
+// total size of levels [0, num_levels) packed without padding
+size_t GetMipChainSize(int width, int height, ImageFormat format, int num_levels);
+
+// downsample src into dst of max(src_size / 2, 1). odd sizes are handled by weighting texels by their coverage.
+// returns false if format is not u8, f16 or f32 with 1-4 channels.
+bool GenerateMip(void* dst, const void* src, int src_width, int src_height, ImageFormat format, MipFilter filter = MipFilter::Box);
+// dst receives levels [0, num_levels) packed without padding. level 0 is a copy of src.
+// each level is made from the previous one. num_levels <= 0 means the full chain.
+bool GenerateMipChain(void* dst, const void* src, int width, int height, ImageFormat format, int num_levels = 0, MipFilter filter = MipFilter::Box);
+
+
 class Image
 {
 public:
@@ -171,7 +202,8 @@ public:
     bool write(std::ostream& is, ImageFileFormat format) const;
     bool write(const char* path) const;
 
-    Image convert(ImageFormat dst_format) const;
+    // any pair of formats. see ColorConversion for how channels are added or dropped.
+    Image convert(ImageFormat dst_format, ColorConversion cc = ColorConversion::None) const;
 
 private:
     int2 m_size{ 0, 0 };
@@ -179,4 +211,41 @@ private:
     RawVector<char> m_data;
 };
 
+
+enum class EXRCompression : int
+{
+    None,
+    RLE,
+    ZIPS, // deflate, 1 scanline per block
+    ZIP,  // deflate, 16 scanlines per block. best ratio for render output
+};
+
+struct EXRLayer
+{
+    std::string name; // channels are stored as "<name>.R", "<name>.G", ... or just "R", "G", ... if empty
+    Image image;      // 1 channel images are stored as "Y". u8 images are stored as half
+};
+
+struct EXRWriteOptions
+{
+    EXRCompression compression = EXRCompression::ZIP;
+    int tile_size = 0; // > 0 to write a tiled file with tile_size x tile_size tiles
+};
+
+// single part scanline or tiled EXR with any number of layers. all layers must have the same size.
+// blocks are compressed / decompressed in parallel.
+// on read, channels are grouped into layers by the prefix before the last '.' and ordered R, G, B, A (or Y, A).
+// layers with more than 4 channels keep the first 4. only level 0 of mipmapped tiled files is read.
+bool WriteEXR(std::ostream& os, const EXRLayer* layers, size_t num_layers, const EXRWriteOptions& opt = {});
+bool ReadEXR(std::istream& is, std::vector<EXRLayer>& layers);
+
+
+struct PNGWriteOptions
+{
+    int compression_level = 6; // zlib level 0 - 9. 1 is the fastest that still compresses
+};
+
+// rows are filtered and the zlib stream is compressed in parallel. f16 / f32 images are stored as 8 bit.
+bool WritePNG(std::ostream& os, const Image& image, const PNGWriteOptions& opt = {});
+
 } // namespace mu
@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "muMath.h"
 #include "muSIMD.h"
+#include "muQuat32.h"
 #include "muRawVector.h"
 
 namespace mu {
@@ -32,6 +33,59 @@ Def(F32ToS32_Generic, snorm32, float);
 Def(S32ToF32_Generic, float, snorm32);
 #undef Def
 
+template<class Packed>
+static inline void EncodeBounded_GenericImpl(Packed* dst, const float* src, size_t num, int nc, const float* bmin, const float* rsize)
+{
+    for (size_t i = 0; i < num; ++i)
+        for (int c = 0; c < nc; ++c, ++dst, ++src)
+            *dst = Packed((*src - bmin[c]) * rsize[c]);
+}
+template<class Packed>
+static inline void DecodeBounded_GenericImpl(float* dst, const Packed* src, size_t num, int nc, const float* bmin, const float* size)
+{
+    for (size_t i = 0; i < num; ++i)
+        for (int c = 0; c < nc; ++c, ++dst, ++src)
+            *dst = src->to_float() * size[c] + bmin[c];
+}
+void F32ToU8B_Generic(unorm8* dst, const float* src, size_t num, int nc, const float* bmin, const float* rsize) { EncodeBounded_GenericImpl(dst, src, num, nc, bmin, rsize); }
+void U8BToF32_Generic(float* dst, const unorm8* src, size_t num, int nc, const float* bmin, const float* size) { DecodeBounded_GenericImpl(dst, src, num, nc, bmin, size); }
+void F32ToU16B_Generic(unorm16* dst, const float* src, size_t num, int nc, const float* bmin, const float* rsize) { EncodeBounded_GenericImpl(dst, src, num, nc, bmin, rsize); }
+void U16BToF32_Generic(float* dst, const unorm16* src, size_t num, int nc, const float* bmin, const float* size) { DecodeBounded_GenericImpl(dst, src, num, nc, bmin, size); }
+
+#define Def(Name, T1, T2) void Name(T1 *dst, const T2 *src, size_t num, int bmin) { for (size_t i = 0; i < num; ++i) { dst[i] = (T1)(src[i] - bmin); } }
+Def(I32ToU8B_Generic, uint8_t, int);
+Def(I32ToU16B_Generic, uint16_t, int);
+#undef Def
+#define Def(Name, T1, T2) void Name(T1 *dst, const T2 *src, size_t num, int bmin) { for (size_t i = 0; i < num; ++i) { dst[i] = (T1)src[i] + bmin; } }
+Def(U8BToI32_Generic, int, uint8_t);
+Def(U16BToI32_Generic, int, uint16_t);
+#undef Def
+
+void F32ToSNormX3_32_Generic(uint32_t* dst, const float* src, size_t num, int nc)
+{
+    auto* d = (snormx3_32*)dst;
+    if (nc == 4) {
+        for (size_t i = 0; i < num; ++i)
+            d[i] = ((const float4*)src)[i];
+    }
+    else {
+        for (size_t i = 0; i < num; ++i)
+            d[i] = ((const float3*)src)[i];
+    }
+}
+void SNormX3_32ToF32_Generic(float* dst, const uint32_t* src, size_t num, int nc)
+{
+    auto* s = (const snormx3_32*)src;
+    if (nc == 4) {
+        for (size_t i = 0; i < num; ++i)
+            ((float4*)dst)[i] = to<float4>(s[i]);
+    }
+    else {
+        for (size_t i = 0; i < num; ++i)
+            ((float3*)dst)[i] = to<float3>(s[i]);
+    }
+}
+
 
 void InvertX_Generic(float3* dst, size_t num)
 {
@@ -99,6 +153,17 @@ void LerpTangents_Generic(float4* dst, const float4* src1, const float4* src2, s
     }
 }
 
+void MulAdd_Generic(float3* dst, const float3* src, size_t num, float w)
+{
+    for (size_t i = 0; i < num; ++i)
+        dst[i] += src[i] * w;
+}
+void MulAddIndexed_Generic(float3* dst, const float3* src, const int* indices, size_t num, float w)
+{
+    for (size_t i = 0; i < num; ++i)
+        dst[indices[i]] += src[i] * w;
+}
+
 template<class T>
 static inline void MinMax_GenericImpl(const T* src, size_t num, T& dst_min, T& dst_max)
 {
@@ -139,6 +204,60 @@ void MulVectors_Generic(const float4x4& m, const float3* src, float3* dst, size_
         dst[i] = mul_v(m, src[i]);
 }
 
+// blend 3x4 part of joint matrices. r3 is translation.
+static inline void BlendJointMatrices(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    size_t vi, float3& r0, float3& r1, float3& r2, float3& r3)
+{
+    r0 = r1 = r2 = r3 = float3::zero();
+    auto* ji = joint_indices + vi * joints_per_vertex;
+    auto* jw = joint_weights + vi * joints_per_vertex;
+    for (int k = 0; k < joints_per_vertex; ++k) {
+        auto& m = joints[ji[k]];
+        float w = jw[k];
+        r0 += (const float3&)m[0] * w;
+        r1 += (const float3&)m[1] * w;
+        r2 += (const float3&)m[2] * w;
+        r3 += (const float3&)m[3] * w;
+    }
+}
+
+void SkinPoints_Generic(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    const float3 src[], float3 dst[], size_t num, const int vertex_indices[])
+{
+    float3 r0, r1, r2, r3;
+    for (size_t i = 0; i < num; ++i) {
+        size_t vi = vertex_indices ? vertex_indices[i] : i;
+        BlendJointMatrices(joints, joint_indices, joint_weights, joints_per_vertex, vi, r0, r1, r2, r3);
+        auto v = src[i];
+        dst[i] = r0 * v.x + r1 * v.y + r2 * v.z + r3;
+    }
+}
+
+void SkinVectors_Generic(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    const float3 src[], float3 dst[], size_t num, const int vertex_indices[])
+{
+    float3 r0, r1, r2, r3;
+    for (size_t i = 0; i < num; ++i) {
+        size_t vi = vertex_indices ? vertex_indices[i] : i;
+        BlendJointMatrices(joints, joint_indices, joint_weights, joints_per_vertex, vi, r0, r1, r2, r3);
+        auto v = src[i];
+        dst[i] = r0 * v.x + r1 * v.y + r2 * v.z;
+    }
+}
+
+void MulMatrices_Generic(const float4x4 a[], const float4x4 b[], const int b_indices[], float4x4 dst[], size_t num)
+{
+    // row-broadcast form. unlike operator*, this doesn't need transpose and vectorizes well.
+    for (size_t i = 0; i < num; ++i) {
+        auto& ma = a[i];
+        auto& mb = b[b_indices[i]];
+        float4x4 r;
+        for (int ri = 0; ri < 4; ++ri)
+            r[ri] = mb[0] * ma[ri][0] + mb[1] * ma[ri][1] + mb[2] * ma[ri][2] + mb[3] * ma[ri][3];
+        dst[i] = r;
+    }
+}
+
 int RayTrianglesIntersectionIndexed_Generic(float3 pos, float3 dir, const float3* vertices, const int* indices, int num_triangles, int& tindex, float& distance)
 {
     int num_hits = 0;
@@ -120,6 +120,80 @@ bool BufferToFile(const char* path, const Span<char>& buf)
     return false;
 }
 
+
+static const uint64_t kPrime64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t kPrime64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t kPrime64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t kPrime64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl64(uint64_t v, int r) { return (v << r) | (v >> (64 - r)); }
+static inline uint64_t read64(const uint8_t* p) { uint64_t r; memcpy(&r, p, 8); return r; }
+static inline uint32_t read32(const uint8_t* p) { uint32_t r; memcpy(&r, p, 4); return r; }
+
+static inline uint64_t hash64_round(uint64_t acc, uint64_t v)
+{
+    acc += v * kPrime64_2;
+    acc = rotl64(acc, 31);
+    return acc * kPrime64_1;
+}
+
+static inline uint64_t hash64_merge(uint64_t acc, uint64_t v)
+{
+    acc ^= hash64_round(0, v);
+    return acc * kPrime64_1 + kPrime64_4;
+}
+
+uint64_t Hash64(const void* data, size_t size, uint64_t seed)
+{
+    auto* p = (const uint8_t*)data;
+    auto* end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + kPrime64_1 + kPrime64_2;
+        uint64_t v2 = seed + kPrime64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime64_1;
+        for (auto* limit = end - 32; p <= limit; p += 32) {
+            v1 = hash64_round(v1, read64(p));
+            v2 = hash64_round(v2, read64(p + 8));
+            v3 = hash64_round(v3, read64(p + 16));
+            v4 = hash64_round(v4, read64(p + 24));
+        }
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = hash64_merge(h, v1);
+        h = hash64_merge(h, v2);
+        h = hash64_merge(h, v3);
+        h = hash64_merge(h, v4);
+    }
+    else {
+        h = seed + kPrime64_5;
+    }
+    h += (uint64_t)size;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= hash64_round(0, read64(p));
+        h = rotl64(h, 27) * kPrime64_1 + kPrime64_4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32(p) * kPrime64_1;
+        h = rotl64(h, 23) * kPrime64_2 + kPrime64_3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= (*p) * kPrime64_5;
+        h = rotl64(h, 11) * kPrime64_1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime64_2;
+    h ^= h >> 29;
+    h *= kPrime64_3;
+    h ^= h >> 32;
+    return h;
+}
+
 std::string ToUTF8(const char *src)
 {
 #ifdef _WIN32
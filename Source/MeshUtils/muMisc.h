@@ -35,6 +35,9 @@ const char* Format(const char *fmt, ...);
 RawVector<char> FileToBuffer(const char* path);
 bool BufferToFile(const char* path, const Span<char>& buf);
 
+// xxHash64 compatible
+uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0);
+
 std::string ToUTF8(const char* src);
 std::string ToUTF8(const wchar_t* src);
 std::string ToUTF8(const std::string& src);
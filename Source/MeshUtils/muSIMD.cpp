@@ -40,6 +40,19 @@ void F32ToS32_ISPC(snorm32 *dst, const float *src, size_t num) { ispc::F32ToS32(
 void S32ToF32_ISPC(float *dst, const snorm32 *src, size_t num) { ispc::S32ToF32(dst, (int32_t*)src, (int)num); }
 #endif
 
+#ifdef muSIMD_Bounded_Conversion
+void F32ToU8B_ISPC(unorm8 *dst, const float *src, size_t num, int nc, const float *bmin, const float *rsize) { ispc::F32ToU8B((uint8_t*)dst, src, (int)num, nc, bmin, rsize); }
+void U8BToF32_ISPC(float *dst, const unorm8 *src, size_t num, int nc, const float *bmin, const float *size) { ispc::U8BToF32(dst, (uint8_t*)src, (int)num, nc, bmin, size); }
+void F32ToU16B_ISPC(unorm16 *dst, const float *src, size_t num, int nc, const float *bmin, const float *rsize) { ispc::F32ToU16B((uint16_t*)dst, src, (int)num, nc, bmin, rsize); }
+void U16BToF32_ISPC(float *dst, const unorm16 *src, size_t num, int nc, const float *bmin, const float *size) { ispc::U16BToF32(dst, (uint16_t*)src, (int)num, nc, bmin, size); }
+void I32ToU8B_ISPC(uint8_t *dst, const int *src, size_t num, int bmin) { ispc::I32ToU8B(dst, src, (int)num, bmin); }
+void U8BToI32_ISPC(int *dst, const uint8_t *src, size_t num, int bmin) { ispc::U8BToI32(dst, src, (int)num, bmin); }
+void I32ToU16B_ISPC(uint16_t *dst, const int *src, size_t num, int bmin) { ispc::I32ToU16B(dst, src, (int)num, bmin); }
+void U16BToI32_ISPC(int *dst, const uint16_t *src, size_t num, int bmin) { ispc::U16BToI32(dst, src, (int)num, bmin); }
+void F32ToSNormX3_32_ISPC(uint32_t *dst, const float *src, size_t num, int nc) { ispc::F32ToSNormX3_32(dst, src, (int)num, nc); }
+void SNormX3_32ToF32_ISPC(float *dst, const uint32_t *src, size_t num, int nc) { ispc::SNormX3_32ToF32(dst, src, (int)num, nc); }
+#endif
+
 
 #ifdef muSIMD_InvertX3
 void InvertX_ISPC(float3 *dst, size_t num)
@@ -91,6 +104,13 @@ void LerpTangents_ISPC(float4 *dst, const float4 *src1, const float4 *src2, size
 }
 #endif
 
+#ifdef muSIMD_MulAdd
+void MulAdd_ISPC(float3 *dst, const float3 *src, size_t num, float w)
+{
+    ispc::MulAdd((float*)dst, (const float*)src, (int)num * 3, w);
+}
+#endif
+
 #ifdef muSIMD_NearEqual
 bool NearEqual_ISPC(const float *src1, const float *src2, size_t num, float eps)
 {
@@ -134,6 +154,28 @@ void MulVectors_ISPC(const float4x4& m, const float3 src[], float3 dst[], size_t
 }
 #endif
 
+#ifdef muSIMD_Skinning
+void SkinPoints_ISPC(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    const float3 src[], float3 dst[], size_t num, const int vertex_indices[])
+{
+    ispc::SkinPoints((ispc::float4x4*)joints, joint_indices, joint_weights, joints_per_vertex,
+        (ispc::float3*)src, (ispc::float3*)dst, (int)num, vertex_indices);
+}
+void SkinVectors_ISPC(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    const float3 src[], float3 dst[], size_t num, const int vertex_indices[])
+{
+    ispc::SkinVectors((ispc::float4x4*)joints, joint_indices, joint_weights, joints_per_vertex,
+        (ispc::float3*)src, (ispc::float3*)dst, (int)num, vertex_indices);
+}
+#endif
+
+#ifdef muSIMD_MulMatrices
+void MulMatrices_ISPC(const float4x4 a[], const float4x4 b[], const int b_indices[], float4x4 dst[], size_t num)
+{
+    ispc::MulMatrices((ispc::float4x4*)a, (ispc::float4x4*)b, b_indices, (ispc::float4x4*)dst, (int)num);
+}
+#endif
+
 
 #ifdef muSIMD_RayTrianglesIntersectionIndexed
 int RayTrianglesIntersectionIndexed_ISPC(
@@ -313,6 +355,19 @@ void F32ToS32(snorm32 *dst, const float *src, size_t num) { Forward(F32ToS32, ds
 void S32ToF32(float *dst, const snorm32 *src, size_t num) { Forward(S32ToF32, dst, src, num); }
 #endif
 
+#if defined(muSIMD_Bounded_Conversion) || !defined(muEnableISPC)
+void F32ToU8B(unorm8 *dst, const float *src, size_t num, int nc, const float *bmin, const float *rsize) { Forward(F32ToU8B, dst, src, num, nc, bmin, rsize); }
+void U8BToF32(float *dst, const unorm8 *src, size_t num, int nc, const float *bmin, const float *size) { Forward(U8BToF32, dst, src, num, nc, bmin, size); }
+void F32ToU16B(unorm16 *dst, const float *src, size_t num, int nc, const float *bmin, const float *rsize) { Forward(F32ToU16B, dst, src, num, nc, bmin, rsize); }
+void U16BToF32(float *dst, const unorm16 *src, size_t num, int nc, const float *bmin, const float *size) { Forward(U16BToF32, dst, src, num, nc, bmin, size); }
+void I32ToU8B(uint8_t *dst, const int *src, size_t num, int bmin) { Forward(I32ToU8B, dst, src, num, bmin); }
+void U8BToI32(int *dst, const uint8_t *src, size_t num, int bmin) { Forward(U8BToI32, dst, src, num, bmin); }
+void I32ToU16B(uint16_t *dst, const int *src, size_t num, int bmin) { Forward(I32ToU16B, dst, src, num, bmin); }
+void U16BToI32(int *dst, const uint16_t *src, size_t num, int bmin) { Forward(U16BToI32, dst, src, num, bmin); }
+void F32ToSNormX3_32(uint32_t *dst, const float *src, size_t num, int nc) { Forward(F32ToSNormX3_32, dst, src, num, nc); }
+void SNormX3_32ToF32(float *dst, const uint32_t *src, size_t num, int nc) { Forward(SNormX3_32ToF32, dst, src, num, nc); }
+#endif
+
 
 #if defined(muSIMD_InvertX3) || !defined(muEnableISPC)
 void InvertX(float3 *dst, size_t num)
@@ -376,6 +431,19 @@ void LerpTangents(float4 * dst, const float4 * src1, const float4 * src2, size_t
 }
 #endif
 
+#if defined(muSIMD_MulAdd) || !defined(muEnableISPC)
+void MulAdd(float3 *dst, const float3 *src, size_t num, float w)
+{
+    Forward(MulAdd, dst, src, num, w);
+}
+#endif
+
+// no ISPC variant: lanes can share a destination, so the scatter has to go one element at a time anyway
+void MulAddIndexed(float3 *dst, const float3 *src, const int *indices, size_t num, float w)
+{
+    MulAddIndexed_Generic(dst, src, indices, num, w);
+}
+
 #if defined(muSIMD_MinMax) || !defined(muEnableISPC)
 void MinMax(const int *p, size_t num, int& dst_min, int& dst_max) { Forward(MinMax, p, num, dst_min, dst_max); }
 void MinMax(const float *p, size_t num, float& dst_min, float& dst_max) { Forward(MinMax, p, num, dst_min, dst_max); }
@@ -418,6 +486,26 @@ void MulVectors(const float4x4& m, const float3 src[], float3 dst[], size_t num_
 }
 #endif
 
+#if defined(muSIMD_Skinning) || !defined(muEnableISPC)
+void SkinPoints(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    const float3 src[], float3 dst[], size_t num, const int vertex_indices[])
+{
+    Forward(SkinPoints, joints, joint_indices, joint_weights, joints_per_vertex, src, dst, num, vertex_indices);
+}
+void SkinVectors(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    const float3 src[], float3 dst[], size_t num, const int vertex_indices[])
+{
+    Forward(SkinVectors, joints, joint_indices, joint_weights, joints_per_vertex, src, dst, num, vertex_indices);
+}
+#endif
+
+#if defined(muSIMD_MulMatrices) || !defined(muEnableISPC)
+void MulMatrices(const float4x4 a[], const float4x4 b[], const int b_indices[], float4x4 dst[], size_t num)
+{
+    Forward(MulMatrices, a, b, b_indices, dst, num);
+}
+#endif
+
 #if defined(muSIMD_RayTrianglesIntersectionIndexed) || !defined(muEnableISPC)
 int RayTrianglesIntersectionIndexed(float3 pos, float3 dir, const float3 *vertices, const int *indices, int num_triangles, int& tindex, float& result)
 {
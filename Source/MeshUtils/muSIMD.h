@@ -27,6 +27,21 @@ void S24ToF32(float *dst, const snorm24 *src, size_t num);
 void F32ToS32(snorm32 *dst, const float *src, size_t num);
 void S32ToF32(float *dst, const snorm32 *src, size_t num);
 
+// quantization with bounds. num elements of nc (1-4) float components each.
+// encode: clamp01((src - bmin[c]) * rsize[c]) * max, decode: src / max * size[c] + bmin[c], c: component index
+void F32ToU8B(unorm8 *dst, const float *src, size_t num, int nc, const float *bmin, const float *rsize);
+void U8BToF32(float *dst, const unorm8 *src, size_t num, int nc, const float *bmin, const float *size);
+void F32ToU16B(unorm16 *dst, const float *src, size_t num, int nc, const float *bmin, const float *rsize);
+void U16BToF32(float *dst, const unorm16 *src, size_t num, int nc, const float *bmin, const float *size);
+// int offset from bmin
+void I32ToU8B(uint8_t *dst, const int *src, size_t num, int bmin);
+void U8BToI32(int *dst, const uint8_t *src, size_t num, int bmin);
+void I32ToU16B(uint16_t *dst, const int *src, size_t num, int bmin);
+void U16BToI32(int *dst, const uint16_t *src, size_t num, int bmin);
+// float3 (nc == 3) or float4 (nc == 4) <-> snormx3_32
+void F32ToSNormX3_32(uint32_t *dst, const float *src, size_t num, int nc);
+void SNormX3_32ToF32(float *dst, const uint32_t *src, size_t num, int nc);
+
 void InvertX(float3 *dst, size_t num);
 void InvertX(float4 *dst, size_t num);
 void InvertU(float2 *dst, size_t num);
@@ -40,6 +55,10 @@ void Lerp(float3 *dst, const float3 *src1, const float3 *src2, size_t num, float
 void Lerp(float4 *dst, const float4 *src1, const float4 *src2, size_t num, float w);
 void LerpNormals(float3 *dst, const float3 *src1, const float3 *src2, size_t num, float w);
 void LerpTangents(float4 *dst, const float4 *src1, const float4 *src2, size_t num, float w);
+// dst[i] += src[i] * w
+void MulAdd(float3 *dst, const float3 *src, size_t num, float w);
+// dst[indices[i]] += src[i] * w. indices can have duplicates.
+void MulAddIndexed(float3 *dst, const float3 *src, const int *indices, size_t num, float w);
 void MinMax(const int *src, size_t num, int& dst_min, int& dst_max);
 void MinMax(const float *src, size_t num, float& dst_min, float& dst_max);
 void MinMax(const float2 *src, size_t num, float2& dst_min, float2& dst_max);
@@ -53,6 +72,17 @@ bool NearEqual(const float4 *src1, const float4 *src2, size_t num, float eps = m
 void MulPoints(const float4x4& m, const float3 src[], float3 dst[], size_t num_data);
 void MulVectors(const float4x4& m, const float3 src[], float3 dst[], size_t num_data);
 
+// linear blend skinning. blend joint matrices by weights per vertex, then transform once.
+// joint_indices and joint_weights have joints_per_vertex elements per vertex.
+// vertex_indices maps elements to vertices (per-index normals etc). null means elements are per-vertex.
+void SkinPoints(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    const float3 src[], float3 dst[], size_t num, const int vertex_indices[] = nullptr);
+void SkinVectors(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    const float3 src[], float3 dst[], size_t num, const int vertex_indices[] = nullptr);
+
+// dst[i] = a[i] * b[b_indices[i]]. b may be dst itself as long as b_indices don't refer the range being written.
+void MulMatrices(const float4x4 a[], const float4x4 b[], const int b_indices[], float4x4 dst[], size_t num);
+
 int RayTrianglesIntersectionIndexed(float3 pos, float3 dir, const float3 *vertices, const int *indices, int num_triangles, int& tindex, float& distance);
 int RayTrianglesIntersectionFlattened(float3 pos, float3 dir, const float3 *vertices, int num_triangles, int& tindex, float& distance);
 int RayTrianglesIntersectionSoA(float3 pos, float3 dir,
@@ -146,6 +176,27 @@ void F32ToS32_ISPC(snorm32 *dst, const float *src, size_t num);
 void S32ToF32_Generic(float *dst, const snorm32 *src, size_t num);
 void S32ToF32_ISPC(float *dst, const snorm32 *src, size_t num);
 
+void F32ToU8B_Generic(unorm8 *dst, const float *src, size_t num, int nc, const float *bmin, const float *rsize);
+void F32ToU8B_ISPC(unorm8 *dst, const float *src, size_t num, int nc, const float *bmin, const float *rsize);
+void U8BToF32_Generic(float *dst, const unorm8 *src, size_t num, int nc, const float *bmin, const float *size);
+void U8BToF32_ISPC(float *dst, const unorm8 *src, size_t num, int nc, const float *bmin, const float *size);
+void F32ToU16B_Generic(unorm16 *dst, const float *src, size_t num, int nc, const float *bmin, const float *rsize);
+void F32ToU16B_ISPC(unorm16 *dst, const float *src, size_t num, int nc, const float *bmin, const float *rsize);
+void U16BToF32_Generic(float *dst, const unorm16 *src, size_t num, int nc, const float *bmin, const float *size);
+void U16BToF32_ISPC(float *dst, const unorm16 *src, size_t num, int nc, const float *bmin, const float *size);
+void I32ToU8B_Generic(uint8_t *dst, const int *src, size_t num, int bmin);
+void I32ToU8B_ISPC(uint8_t *dst, const int *src, size_t num, int bmin);
+void U8BToI32_Generic(int *dst, const uint8_t *src, size_t num, int bmin);
+void U8BToI32_ISPC(int *dst, const uint8_t *src, size_t num, int bmin);
+void I32ToU16B_Generic(uint16_t *dst, const int *src, size_t num, int bmin);
+void I32ToU16B_ISPC(uint16_t *dst, const int *src, size_t num, int bmin);
+void U16BToI32_Generic(int *dst, const uint16_t *src, size_t num, int bmin);
+void U16BToI32_ISPC(int *dst, const uint16_t *src, size_t num, int bmin);
+void F32ToSNormX3_32_Generic(uint32_t *dst, const float *src, size_t num, int nc);
+void F32ToSNormX3_32_ISPC(uint32_t *dst, const float *src, size_t num, int nc);
+void SNormX3_32ToF32_Generic(float *dst, const uint32_t *src, size_t num, int nc);
+void SNormX3_32ToF32_ISPC(float *dst, const uint32_t *src, size_t num, int nc);
+
 
 void InvertX_Generic(float3 *dst, size_t num);
 void InvertX_ISPC(float3 *dst, size_t num);
@@ -167,6 +218,10 @@ void LerpNormals_ISPC(float3 *dst, const float3 *src1, const float3 *src2, size_
 void LerpTangents_Generic(float4 *dst, const float4 *src1, const float4 *src2, size_t num, float w);
 void LerpTangents_ISPC(float4 *dst, const float4 *src1, const float4 *src2, size_t num, float w);
 
+void MulAdd_Generic(float3 *dst, const float3 *src, size_t num, float w);
+void MulAdd_ISPC(float3 *dst, const float3 *src, size_t num, float w);
+void MulAddIndexed_Generic(float3 *dst, const float3 *src, const int *indices, size_t num, float w);
+
 void MinMax_Generic(const int *src, size_t num, int& dst_min, int& dst_max);
 void MinMax_ISPC(const int *src, size_t num, int& dst_min, int& dst_max);
 void MinMax_Generic(const float *src, size_t num, float& dst_min, float& dst_max);
@@ -186,6 +241,18 @@ void MulPoints_ISPC(const float4x4& m, const float3 src[], float3 dst[], size_t
 void MulVectors_Generic(const float4x4& m, const float3 src[], float3 dst[], size_t num_data);
 void MulVectors_ISPC(const float4x4& m, const float3 src[], float3 dst[], size_t num_data);
 
+void SkinPoints_Generic(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    const float3 src[], float3 dst[], size_t num, const int vertex_indices[]);
+void SkinPoints_ISPC(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    const float3 src[], float3 dst[], size_t num, const int vertex_indices[]);
+void SkinVectors_Generic(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    const float3 src[], float3 dst[], size_t num, const int vertex_indices[]);
+void SkinVectors_ISPC(const float4x4 joints[], const int joint_indices[], const float joint_weights[], int joints_per_vertex,
+    const float3 src[], float3 dst[], size_t num, const int vertex_indices[]);
+
+void MulMatrices_Generic(const float4x4 a[], const float4x4 b[], const int b_indices[], float4x4 dst[], size_t num);
+void MulMatrices_ISPC(const float4x4 a[], const float4x4 b[], const int b_indices[], float4x4 dst[], size_t num);
+
 int RayTrianglesIntersectionIndexed_Generic(float3 pos, float3 dir, const float3 *vertices, const int *indices, int num_triangles, int& tindex, float& distance);
 int RayTrianglesIntersectionIndexed_ISPC(float3 pos, float3 dir, const float3 *vertices, const int *indices, int num_triangles, int& tindex, float& distance);
 int RayTrianglesIntersectionFlattened_Generic(float3 pos, float3 dir, const float3 *vertices, int num_triangles, int& tindex, float& distance);
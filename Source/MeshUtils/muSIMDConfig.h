@@ -4,12 +4,14 @@
 
 #define muSIMD_Float_Half_Conversion
 #define muSIMD_Float_Norm_Conversion
+#define muSIMD_Bounded_Conversion
 
 #define muSIMD_InvertX3
 #define muSIMD_InvertX4
 #define muSIMD_Scale
 #define muSIMD_Normalize
 #define muSIMD_Lerp
+#define muSIMD_MulAdd
 #define muSIMD_NearEqual
 
 #define muSIMD_MinMax
@@ -17,6 +19,9 @@
 #define muSIMD_MulVectors3
 #define muSIMD_MulPoints3
 
+#define muSIMD_Skinning
+#define muSIMD_MulMatrices
+
 //#define muSIMD_RayTrianglesIntersectionIndexed
 //#define muSIMD_RayTrianglesIntersectionFlattened
 //#define muSIMD_RayTrianglesIntersectionSoA
@@ -1,5 +1,12 @@
 #include "pch.h"
 #include "muStream.h"
+#include "muCompression.h"
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
 
 namespace mu {
 
@@ -98,6 +105,247 @@ char* MemoryStream::gskip(size_t n)
 }
 
 
+#ifndef _WIN32
+static const size_t kHugePageSize = 1024 * 1024 * 2;
+
+static int ToMAdvice(MappedFile::Access access)
+{
+    switch (access) {
+    case MappedFile::Access::Sequential: return MADV_SEQUENTIAL;
+    case MappedFile::Access::Random: return MADV_RANDOM;
+    default: return MADV_NORMAL;
+    }
+}
+#endif
+
+MappedFile::MappedFile()
+{
+}
+
+MappedFile::MappedFile(const char* path, Access access)
+{
+    open(path, access);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char* path, Access access)
+{
+    close();
+
+#ifdef _WIN32
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (access == Access::Sequential)
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    else if (access == Access::Random)
+        flags |= FILE_FLAG_RANDOM_ACCESS;
+    HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    m_file = file;
+    m_opened = true;
+
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size)) {
+        close();
+        return false;
+    }
+    m_size = (size_t)size.QuadPart;
+    if (m_size == 0)
+        return true;
+
+    m_mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping)
+        m_data = (char*)::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m_data) {
+        close();
+        return false;
+    }
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    m_opened = true;
+    m_size = (size_t)st.st_size;
+    if (m_size == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    void* addr = nullptr;
+    if (m_size >= kHugePageSize) {
+        // reserve address space with room for alignment, then map the file over the aligned part of it
+        m_reserved_size = m_size + kHugePageSize;
+        m_reserved = ::mmap(nullptr, m_reserved_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m_reserved == MAP_FAILED) {
+            m_reserved = nullptr;
+            m_reserved_size = 0;
+        }
+        else {
+            addr = (void*)(((uintptr_t)m_reserved + kHugePageSize - 1) & ~(uintptr_t)(kHugePageSize - 1));
+        }
+    }
+    void* data = ::mmap(addr, m_size, PROT_READ, MAP_PRIVATE | (addr ? MAP_FIXED : 0), fd, 0);
+    ::close(fd); // the mapping keeps the file
+    if (data == MAP_FAILED) {
+        close();
+        return false;
+    }
+    m_data = (char*)data;
+    if (!m_reserved) {
+        m_reserved = data;
+        m_reserved_size = m_size;
+    }
+#ifdef MADV_HUGEPAGE
+    if (addr)
+        ::madvise(m_data, m_size, MADV_HUGEPAGE);
+#endif
+#endif
+    advise(access);
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (m_data)
+        ::UnmapViewOfFile(m_data);
+    if (m_mapping)
+        ::CloseHandle(m_mapping);
+    if (m_file)
+        ::CloseHandle(m_file);
+    m_mapping = m_file = nullptr;
+#else
+    if (m_reserved)
+        ::munmap(m_reserved, m_reserved_size);
+    m_reserved = nullptr;
+    m_reserved_size = 0;
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_opened = false;
+}
+
+bool MappedFile::valid() const
+{
+    return m_opened;
+}
+
+void MappedFile::advise(Access access)
+{
+    if (!m_data)
+        return;
+#ifdef _WIN32
+    // Windows has no per-view access hint. sequential access at least benefits from prefetching the whole file.
+    if (access == Access::Sequential)
+        prefetch(0, m_size);
+#else
+    ::madvise(m_data, m_size, ToMAdvice(access));
+#endif
+}
+
+void MappedFile::prefetch(size_t offset, size_t size)
+{
+    if (!m_data || offset >= m_size)
+        return;
+    size = std::min(size, m_size - offset);
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range{ m_data + offset, size };
+    ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+#else
+    // madvise() needs a page aligned address
+    size_t page = (size_t)::sysconf(_SC_PAGESIZE);
+    size_t begin = offset & ~(page - 1);
+    ::madvise(m_data + begin, size + (offset - begin), MADV_WILLNEED);
+#endif
+}
+
+const char* MappedFile::data() const { return m_data; }
+size_t MappedFile::size() const { return m_size; }
+
+
+void MappedStreamBuf::reset(const char* data, size_t size)
+{
+    // std::streambuf needs non-const pointers but nothing writes through them
+    auto* p = const_cast<char*>(data);
+    this->setg(p, p, p + size);
+}
+
+std::ios::pos_type MappedStreamBuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode /*mode*/)
+{
+    off_type pos = 0;
+    if (dir == std::ios::beg)
+        pos = off;
+    else if (dir == std::ios::cur)
+        pos = off_type(this->gptr() - this->eback()) + off;
+    else if (dir == std::ios::end)
+        pos = off_type(this->egptr() - this->eback()) + off;
+    if (pos < 0 || pos > off_type(this->egptr() - this->eback()))
+        return pos_type(off_type(-1));
+    this->setg(this->eback(), this->eback() + pos, this->egptr());
+    return pos;
+}
+
+std::ios::pos_type MappedStreamBuf::seekpos(pos_type pos, std::ios_base::openmode mode)
+{
+    return seekoff(off_type(pos), std::ios::beg, mode);
+}
+
+std::streamsize MappedStreamBuf::showmanyc()
+{
+    auto n = std::streamsize(this->egptr() - this->gptr());
+    return n > 0 ? n : -1;
+}
+
+MappedStream::MappedStream()
+    : std::istream(&m_buf)
+{
+}
+
+MappedStream::MappedStream(const char* path, Access access)
+    : std::istream(&m_buf)
+{
+    open(path, access);
+}
+
+bool MappedStream::open(const char* path, Access access)
+{
+    bool ret = m_file.open(path, access);
+    m_buf.reset(m_file.data(), m_file.size());
+    this->clear();
+    if (!ret)
+        this->setstate(std::ios::failbit);
+    return ret;
+}
+
+void MappedStream::close()
+{
+    m_buf.reset(nullptr, 0);
+    m_file.close();
+}
+
+MappedFile& MappedStream::getFile() { return m_file; }
+uint64_t MappedStream::getRCount() const { return uint64_t(m_buf.gptr() - m_buf.eback()); }
+
+const char* MappedStream::gskip(size_t n)
+{
+    auto ret = m_buf.gptr();
+    if (size_t(m_buf.egptr() - ret) < n)
+        return nullptr;
+    m_buf.setg(m_buf.eback(), ret + n, m_buf.egptr());
+    return ret;
+}
+
+
 static RawVector<char> s_dummy_buf;
 
 CounterStreamBuf::CounterStreamBuf()
@@ -133,6 +381,185 @@ void CounterStream::reset() { m_buf.reset(); }
 
 
 
+AsyncWriter::AsyncWriter(const Sink& sink, size_t bufsize, int num_buffers)
+    : m_sink(sink)
+    , m_bufsize(std::max(bufsize, (size_t)1))
+{
+    num_buffers = std::max(num_buffers, 2);
+    m_buffers.resize(num_buffers);
+    for (auto& b : m_buffers) {
+        b.resize_discard(m_bufsize);
+        m_free.push_back(b.data());
+    }
+    m_thread = std::thread([this]() { process(); });
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+char* AsyncWriter::acquire()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this]() { return !m_free.empty(); });
+    char* ret = m_free.back();
+    m_free.pop_back();
+    return ret;
+}
+
+void AsyncWriter::submit(char* buf, size_t size)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (size > 0)
+            m_queue.push_back({ buf, size });
+        else
+            m_free.push_back(buf);
+    }
+    m_cond.notify_all();
+}
+
+void AsyncWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this]() { return m_queue.empty() && !m_writing; });
+}
+
+size_t AsyncWriter::getBufferSize() const
+{
+    return m_bufsize;
+}
+
+bool AsyncWriter::good() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return !m_failed;
+}
+
+uint64_t AsyncWriter::getWrittenSize() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_written;
+}
+
+void AsyncWriter::process()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_cond.wait(lock, [this]() { return !m_queue.empty() || m_stop; });
+        if (m_queue.empty())
+            break; // stopped and drained
+
+        auto item = m_queue.front();
+        m_queue.pop_front();
+        m_writing = true;
+        bool failed = m_failed;
+        lock.unlock();
+
+        // once failed, the rest is discarded so that the producer doesn't block forever
+        bool ok = !failed && m_sink(item.first, item.second);
+
+        lock.lock();
+        if (ok)
+            m_written += item.second;
+        else
+            m_failed = true;
+        m_writing = false;
+        m_free.push_back(item.first);
+        m_cond.notify_all();
+    }
+}
+
+
+AsyncOStreamBuf::AsyncOStreamBuf(const AsyncWriter::Sink& sink, size_t bufsize, int num_buffers)
+    : m_writer(new AsyncWriter(sink, bufsize, num_buffers))
+{
+    char* p = m_writer->acquire();
+    this->setp(p, p + m_writer->getBufferSize());
+}
+
+AsyncOStreamBuf::~AsyncOStreamBuf()
+{
+    close();
+}
+
+void AsyncOStreamBuf::close()
+{
+    if (!m_writer)
+        return;
+    m_writer->submit(this->pbase(), size_t(this->pptr() - this->pbase()));
+    this->setp(nullptr, nullptr);
+    m_writer.reset();
+}
+
+bool AsyncOStreamBuf::submit()
+{
+    if (!m_writer)
+        return false;
+    m_writer->submit(this->pbase(), size_t(this->pptr() - this->pbase()));
+    char* p = m_writer->acquire();
+    this->setp(p, p + m_writer->getBufferSize());
+    return m_writer->good();
+}
+
+int AsyncOStreamBuf::overflow(int c)
+{
+    if (!submit())
+        return traits_type::eof();
+    if (c != traits_type::eof()) {
+        *this->pptr() = (char)c;
+        this->pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int AsyncOStreamBuf::sync()
+{
+    if (this->pptr() == this->pbase())
+        return m_writer && m_writer->good() ? 0 : -1;
+    return submit() ? 0 : -1;
+}
+
+AsyncWriter& AsyncOStreamBuf::getWriter() { return *m_writer; }
+
+AsyncOStream::AsyncOStream(std::ostream& dst, size_t bufsize, int num_buffers)
+    : std::ostream(&m_buf)
+    , m_buf([&dst](const char* data, size_t size) { return dst.write(data, size).good(); }, bufsize, num_buffers)
+{
+}
+
+AsyncOStream::AsyncOStream(const AsyncWriter::Sink& sink, size_t bufsize, int num_buffers)
+    : std::ostream(&m_buf)
+    , m_buf(sink, bufsize, num_buffers)
+{
+}
+
+AsyncOStream::~AsyncOStream()
+{
+    close();
+}
+
+bool AsyncOStream::close()
+{
+    bool ret = false;
+    if (this->rdbuf()) {
+        flush();
+        m_buf.getWriter().flush();
+        ret = m_buf.getWriter().good() && good();
+        m_buf.close();
+        this->rdbuf(nullptr);
+    }
+    return ret;
+}
+
+
+
 PipeStreamBufBase::PipeStreamBufBase()
 {
 }
@@ -198,15 +625,22 @@ PipeStreamBufBuffered::PipeStreamBufBuffered()
 {
 }
 
+PipeStreamBufBuffered::~PipeStreamBufBuffered()
+{
+    close();
+}
+
 bool PipeStreamBufBuffered::open(const char* path, std::ios::openmode mode)
 {
     bool ret = super::open(path, mode);
     if (ret) {
         if (mode & std::ios::out) {
-            m_pbuf.resize(default_bufsize);
-            auto* p = m_pbuf.data();
-            auto* e = p + m_pbuf.size();
-            this->setp(p, e);
+            FILE* pipe = m_pipe;
+            m_writer.reset(new AsyncWriter([pipe](const char* data, size_t size) {
+                return ::fwrite(data, 1, size, pipe) == size && ::fflush(pipe) == 0;
+            }, default_bufsize, default_num_buffers));
+            auto* p = m_writer->acquire();
+            this->setp(p, p + m_writer->getBufferSize());
         }
         else {
             m_gbuf.resize(default_bufsize);
@@ -220,19 +654,29 @@ bool PipeStreamBufBuffered::open(const char* path, std::ios::openmode mode)
 
 int PipeStreamBufBuffered::close()
 {
+    if (m_writer) {
+        // write out everything before the pipe is closed
+        m_writer->submit(this->pbase(), size_t(this->pptr() - this->pbase()));
+        m_writer.reset();
+        this->setp(nullptr, nullptr);
+    }
     int ret = super::close();
     m_gbuf.clear();
-    m_pbuf.clear();
     return ret;
 }
 
 int PipeStreamBufBuffered::overflow(int c)
 {
-    ::fwrite(m_pbuf.data(), 1, m_pbuf.size(), m_pipe);
-    this->pbump(0);
-    *this->pptr() = (char)c;
-    this->pbump(1);
-    return c;
+    if (!m_writer)
+        return traits_type::eof();
+    m_writer->submit(this->pbase(), size_t(this->pptr() - this->pbase()));
+    auto* p = m_writer->acquire();
+    this->setp(p, p + m_writer->getBufferSize());
+    if (c != traits_type::eof()) {
+        *this->pptr() = (char)c;
+        this->pbump(1);
+    }
+    return m_writer->good() ? traits_type::not_eof(c) : traits_type::eof();
 }
 
 int PipeStreamBufBuffered::underflow()
@@ -247,12 +691,13 @@ int PipeStreamBufBuffered::underflow()
 
 int PipeStreamBufBuffered::sync()
 {
-    if (m_mode & std::ios::out) {
-        auto n = size_t(this->pptr() - this->pbase());
-        ::fwrite(m_pbuf.data(), 1, n, m_pipe);
-        this->pbump(0);
+    if (m_writer && this->pptr() != this->pbase()) {
+        // hand the buffer to the writer thread without waiting for it
+        m_writer->submit(this->pbase(), size_t(this->pptr() - this->pbase()));
+        auto* p = m_writer->acquire();
+        this->setp(p, p + m_writer->getBufferSize());
     }
-    return 0;
+    return m_writer && !m_writer->good() ? -1 : 0;
 }
 
 
@@ -275,7 +720,8 @@ PipeStream::~PipeStream()
 bool PipeStream::open(const char* path, std::ios::openmode mode)
 {
     close();
-    if (mode & std::ios::binary)
+    // writes are always buffered so that they are drained to the pipe on a background thread
+    if ((mode & std::ios::binary) && !(mode & std::ios::out))
         m_buf.reset(new PipeStreamBuf());
     else
         m_buf.reset(new PipeStreamBufBuffered());
@@ -294,10 +740,113 @@ int PipeStream::close()
     int ret = 0;
     if (m_buf) {
         ret = m_buf->close();
+        this->rdbuf(nullptr);
         m_buf.reset();
     }
     this->clear();
     return ret;
 }
 
+
+
+LZOStreamBuf::LZOStreamBuf(std::ostream& dst, size_t bufsize)
+    : m_dst(dst)
+{
+    m_pbuf.resize_discard(std::max(bufsize, LZDefaultBlockSize));
+    this->setp(m_pbuf.data(), m_pbuf.data() + m_pbuf.size());
+}
+
+LZOStreamBuf::~LZOStreamBuf()
+{
+    sync();
+}
+
+bool LZOStreamBuf::flushFrame()
+{
+    size_t n = size_t(this->pptr() - this->pbase());
+    if (n > 0) {
+        Compress(m_packed, m_pbuf.cdata(), n);
+        m_dst.write(m_packed.cdata(), m_packed.size());
+        m_raw_size += n;
+    }
+    this->setp(m_pbuf.data(), m_pbuf.data() + m_pbuf.size());
+    return m_dst.good();
+}
+
+int LZOStreamBuf::overflow(int c)
+{
+    if (!flushFrame())
+        return traits_type::eof();
+    if (c != traits_type::eof()) {
+        *this->pptr() = (char)c;
+        this->pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int LZOStreamBuf::sync()
+{
+    if (!flushFrame())
+        return -1;
+    m_dst.flush();
+    return 0;
+}
+
+uint64_t LZOStreamBuf::getRawSize() const
+{
+    return m_raw_size + uint64_t(this->pptr() - this->pbase());
+}
+
+LZOStream::LZOStream(std::ostream& dst, size_t bufsize)
+    : std::ostream(&m_buf), m_buf(dst, bufsize)
+{
+}
+
+LZOStream::~LZOStream()
+{
+    flush();
+}
+
+uint64_t LZOStream::getRawSize() const { return m_buf.getRawSize(); }
+
+
+LZIStreamBuf::LZIStreamBuf(std::istream& src, size_t max_frame_size)
+    : m_src(src)
+    , m_max_frame_size(max_frame_size)
+{
+    this->setg(nullptr, nullptr, nullptr);
+}
+
+int LZIStreamBuf::underflow()
+{
+    // next frame
+    char header[LZFrameHeaderSize];
+    uint64_t raw_size, frame_size;
+    m_src.read(header, sizeof(header));
+    if ((size_t)m_src.gcount() != sizeof(header) || !GetFrameInfo(header, sizeof(header), raw_size, frame_size) || raw_size == 0)
+        return traits_type::eof();
+    if (raw_size > m_max_frame_size || frame_size > m_max_frame_size)
+        return traits_type::eof();
+
+    m_packed.resize_discard((size_t)frame_size);
+    memcpy(m_packed.data(), header, sizeof(header));
+    size_t rest = m_packed.size() - sizeof(header);
+    m_src.read(m_packed.data() + sizeof(header), rest);
+    if ((size_t)m_src.gcount() != rest)
+        return traits_type::eof();
+
+    m_gbuf.resize_discard((size_t)raw_size);
+    if (Decompress(m_gbuf.data(), m_gbuf.size(), m_packed.cdata(), m_packed.size()) != raw_size)
+        return traits_type::eof();
+
+    auto* p = m_gbuf.data();
+    this->setg(p, p, p + m_gbuf.size());
+    return traits_type::to_int_type(*p);
+}
+
+LZIStream::LZIStream(std::istream& src, size_t max_frame_size)
+    : std::istream(&m_buf), m_buf(src, max_frame_size)
+{
+}
+
 } // namespace mu
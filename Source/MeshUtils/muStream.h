@@ -1,5 +1,10 @@
 #pragma once
 #include <iostream>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include "muRawVector.h"
 
 namespace mu {
@@ -44,6 +49,84 @@ private:
 };
 
 
+// read-only memory mapped file.
+// on Linux, mappings of 2MB or more are placed at 2MB aligned addresses so that the kernel can back them with huge
+// pages (needs file THP support; otherwise it is just a hint that costs nothing).
+class MappedFile
+{
+public:
+    enum class Access
+    {
+        Normal,
+        Sequential, // read ahead aggressively and drop pages behind
+        Random,     // no read ahead
+    };
+
+    MappedFile();
+    MappedFile(const char* path, Access access = Access::Normal);
+    ~MappedFile();
+    MappedFile(const MappedFile& v) = delete;
+    MappedFile& operator=(const MappedFile& v) = delete;
+
+    bool open(const char* path, Access access = Access::Normal);
+    void close();
+    bool valid() const;
+
+    // change the access pattern hint of the whole file
+    void advise(Access access);
+    // start reading [offset, offset + size) into the page cache in the background
+    void prefetch(size_t offset, size_t size);
+
+    const char* data() const;
+    size_t size() const;
+
+private:
+    char* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_opened = false;
+#ifdef _WIN32
+    void* m_file = nullptr;    // HANDLE
+    void* m_mapping = nullptr; // HANDLE
+#else
+    void* m_reserved = nullptr; // may be before m_data when aligned
+    size_t m_reserved_size = 0;
+#endif
+};
+
+// read-only stream on a MappedFile. gskip() gives direct pointers to the mapping, so reads need no copy.
+class MappedStreamBuf : public std::streambuf
+{
+friend class MappedStream;
+public:
+    void reset(const char* data, size_t size);
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode mode) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode mode) override;
+    std::streamsize showmanyc() override;
+};
+
+class MappedStream : public std::istream
+{
+public:
+    using Access = MappedFile::Access;
+
+    MappedStream();
+    MappedStream(const char* path, Access access = Access::Sequential);
+    bool open(const char* path, Access access = Access::Sequential);
+    void close();
+
+    MappedFile& getFile();
+    uint64_t getRCount() const;
+
+    // return current read pointer and advance n byte. nullptr if less than n byte remain.
+    const char* gskip(size_t n);
+
+private:
+    MappedFile m_file;
+    MappedStreamBuf m_buf;
+};
+
+
 // counter stream
 class CounterStreamBuf : public std::streambuf
 {
@@ -70,6 +153,84 @@ private:
 };
 
 
+// fixed number of write buffers that a background thread drains into a sink (file, pipe, etc).
+// acquire() blocks only when all buffers are waiting to be written, which bounds the memory and gives backpressure.
+class AsyncWriter
+{
+public:
+    // returns false on error. called on the writer thread
+    using Sink = std::function<bool(const char* data, size_t size)>;
+
+    AsyncWriter(const Sink& sink, size_t bufsize, int num_buffers);
+    // waits until queued buffers are written
+    ~AsyncWriter();
+
+    // returns a free buffer of bufsize bytes
+    char* acquire();
+    // queue the acquired buffer with its first size bytes filled
+    void submit(char* buf, size_t size);
+    // wait until queued buffers are written
+    void flush();
+
+    size_t getBufferSize() const;
+    bool good() const; // false once the sink failed
+    uint64_t getWrittenSize() const;
+
+private:
+    void process();
+
+    Sink m_sink;
+    size_t m_bufsize = 0;
+    std::vector<RawVector<char>> m_buffers;
+    std::vector<char*> m_free;
+    std::deque<std::pair<char*, size_t>> m_queue;
+    bool m_writing = false;
+    bool m_failed = false;
+    bool m_stop = false;
+    uint64_t m_written = 0;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+};
+
+// write-only stream that hands filled buffers to an AsyncWriter, so the producer doesn't wait for the I/O.
+// flush() only queues the buffered data. close() (or the destructor) waits until it is written.
+class AsyncOStreamBuf : public std::streambuf
+{
+public:
+    static const size_t default_bufsize = 1024 * 1024;
+    static const int default_num_buffers = 4;
+
+    AsyncOStreamBuf(const AsyncWriter::Sink& sink, size_t bufsize = default_bufsize, int num_buffers = default_num_buffers);
+    ~AsyncOStreamBuf();
+    void close();
+
+    int overflow(int c) override;
+    int sync() override;
+
+    AsyncWriter& getWriter();
+
+private:
+    bool submit();
+
+    std::unique_ptr<AsyncWriter> m_writer;
+};
+
+class AsyncOStream : public std::ostream
+{
+public:
+    // dst is written from the writer thread. it must not be used until close()
+    AsyncOStream(std::ostream& dst, size_t bufsize = AsyncOStreamBuf::default_bufsize, int num_buffers = AsyncOStreamBuf::default_num_buffers);
+    AsyncOStream(const AsyncWriter::Sink& sink, size_t bufsize = AsyncOStreamBuf::default_bufsize, int num_buffers = AsyncOStreamBuf::default_num_buffers);
+    ~AsyncOStream();
+    // returns false if writing failed
+    bool close();
+
+private:
+    AsyncOStreamBuf m_buf;
+};
+
+
 // pipe stream
 class PipeStreamBufBase : public std::streambuf
 {
@@ -93,13 +254,16 @@ public:
     std::streamsize xsgetn(char_type* s, std::streamsize n) override;
 };
 
+// writes are drained to the pipe by an AsyncWriter, so the writer doesn't stall while the other process is busy.
 class PipeStreamBufBuffered : public PipeStreamBufBase
 {
 using super = PipeStreamBufBase;
 public:
     static const size_t default_bufsize = 1024 * 64;
+    static const int default_num_buffers = 8;
 
     PipeStreamBufBuffered();
+    ~PipeStreamBufBuffered();
     bool open(const char* path, std::ios::openmode mode) override;
     int close() override;
     int overflow(int c) override;
@@ -108,7 +272,7 @@ public:
 
 private:
     std::vector<char> m_gbuf;
-    std::vector<char> m_pbuf;
+    std::unique_ptr<AsyncWriter> m_writer;
 };
 
 class PipeStream : public std::iostream
@@ -124,4 +288,66 @@ private:
     std::unique_ptr<PipeStreamBufBase> m_buf;
 };
 
+
+// LZ compression streams. wrap another stream (MemoryStream, std::fstream, etc.)
+// written data is buffered and compressed into frames (see mu::Compress()) whose blocks are compressed in parallel.
+// the wrapped stream must outlive these.
+class LZOStreamBuf : public std::streambuf
+{
+public:
+    static const size_t default_bufsize = 1024 * 1024 * 4;
+
+    LZOStreamBuf(std::ostream& dst, size_t bufsize = default_bufsize);
+    ~LZOStreamBuf();
+    int overflow(int c) override;
+    int sync() override;
+
+    uint64_t getRawSize() const;
+
+private:
+    bool flushFrame();
+
+    std::ostream& m_dst;
+    RawVector<char> m_pbuf;
+    RawVector<char> m_packed;
+    uint64_t m_raw_size = 0;
+};
+
+class LZOStream : public std::ostream
+{
+public:
+    LZOStream(std::ostream& dst, size_t bufsize = LZOStreamBuf::default_bufsize);
+    ~LZOStream();
+    uint64_t getRawSize() const; // total bytes written to this stream
+
+private:
+    LZOStreamBuf m_buf;
+};
+
+// frames larger than max_frame_size (raw or packed) are treated as corrupted, so that a broken header can't make
+// this allocate huge buffers. it must not be less than the bufsize of the LZOStream that wrote the data.
+class LZIStreamBuf : public std::streambuf
+{
+public:
+    static const size_t default_max_frame_size = 1024 * 1024 * 256;
+
+    LZIStreamBuf(std::istream& src, size_t max_frame_size = default_max_frame_size);
+    int underflow() override;
+
+private:
+    std::istream& m_src;
+    size_t m_max_frame_size = 0;
+    RawVector<char> m_gbuf;
+    RawVector<char> m_packed;
+};
+
+class LZIStream : public std::istream
+{
+public:
+    LZIStream(std::istream& src, size_t max_frame_size = LZIStreamBuf::default_max_frame_size);
+
+private:
+    LZIStreamBuf m_buf;
+};
+
 } // namespace mu
@@ -0,0 +1,353 @@
+#include "pch.h"
+#include "muMath.h"
+#include "muVirtualTexture.h"
+#include "muConcurrency.h"
+
+namespace mu {
+
+static const char kTiledTextureMagic[4] = { 'M', 'U', 'V', 'T' };
+static const uint32_t kTiledTextureVersion = 1;
+
+// followed by the tiles of each tiled level in row major order, then the tail
+struct TiledTextureHeader
+{
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    uint32_t format;
+    int32_t block_format;
+    int32_t tile_size;
+    int32_t border;
+};
+
+
+bool TiledTextureLayout::setup(const TiledTextureDesc& d)
+{
+    *this = {};
+    int pixel_size = GetPixelSize(d.format);
+    if (d.width <= 0 || d.height <= 0 || pixel_size == 0 || d.tile_size <= 0 || d.tile_size % 4 != 0 || d.border < 0)
+        return false;
+    if (d.block_format != BlockFormat::Unknown && (GetBlockSourceFormat(d.block_format) != d.format || d.border % 4 != 0))
+        return false;
+
+    desc = d;
+    level_count = GetMipCount(d.width, d.height);
+    tile_offsets.push_back(0);
+    for (int level = 0; level < level_count; ++level) {
+        auto size = GetMipSize(d.width, d.height, level);
+        if (size.x <= d.tile_size && size.y <= d.tile_size)
+            break;
+        auto n = getTileCount(level);
+        tile_offsets.push_back(tile_offsets.back() + n.x * n.y);
+        ++tiled_level_count;
+    }
+
+    padded_tile_size = d.tile_size + d.border * 2;
+    if (d.block_format != BlockFormat::Unknown)
+        tile_data_size = GetBlockCompressedSize(padded_tile_size, padded_tile_size, d.block_format);
+    else
+        tile_data_size = (size_t)padded_tile_size * padded_tile_size * pixel_size;
+
+    auto tail = getTailSize();
+    tail_data_size = (size_t)tail.x * tail.y * pixel_size;
+    return true;
+}
+
+int2 TiledTextureLayout::getTileCount(int level) const
+{
+    auto size = GetMipSize(desc.width, desc.height, level);
+    return { ceildiv(size.x, desc.tile_size), ceildiv(size.y, desc.tile_size) };
+}
+
+int TiledTextureLayout::getTileIndex(int level, int x, int y) const
+{
+    if (level < 0 || level >= tiled_level_count)
+        return -1;
+    auto n = getTileCount(level);
+    if (x < 0 || y < 0 || x >= n.x || y >= n.y)
+        return -1;
+    return tile_offsets[level] + n.x * y + x;
+}
+
+int2 TiledTextureLayout::getTailSize() const
+{
+    return GetMipSize(desc.width, desc.height, tiled_level_count);
+}
+
+uint32_t EncodeTileKey(int tid, int level, int x, int y)
+{
+    return (uint32_t(tid) << 20) | (uint32_t(level) << 16) | (uint32_t(y) << 8) | uint32_t(x);
+}
+
+void DecodeTileKey(uint32_t key, int& tid, int& level, int& x, int& y)
+{
+    tid = int(key >> 20);
+    level = int((key >> 16) & 0xf);
+    y = int((key >> 8) & 0xff);
+    x = int(key & 0xff);
+}
+
+bool CanEncodeTileKeys(int tid, const TiledTextureLayout& layout)
+{
+    // level 0 has the most tiles
+    auto n = layout.getTileCount(0);
+    return tid >= 0 && tid < (1 << 12) && layout.tiled_level_count <= 16 && n.x <= 256 && n.y <= 256;
+}
+
+
+// copy a padded tile. texels outside the level are clamped to its edges
+static void CopyTile(char* dst, const char* level, int2 size, int pixel_size, int tx, int ty, const TiledTextureLayout& layout)
+{
+    int padded = layout.padded_tile_size;
+    int x0 = tx * layout.desc.tile_size - layout.desc.border;
+    int y0 = ty * layout.desc.tile_size - layout.desc.border;
+
+    // [xb, xe) is inside the level
+    int xb = clamp(x0, 0, size.x), xe = clamp(x0 + padded, 0, size.x);
+    for (int y = 0; y < padded; ++y) {
+        int sy = clamp(y0 + y, 0, size.y - 1);
+        const char* row = level + (size_t)sy * size.x * pixel_size;
+        char* d = dst + (size_t)y * padded * pixel_size;
+        int x = 0;
+        for (; x0 + x < xb; ++x)
+            memcpy(d + x * pixel_size, row, pixel_size);
+        if (xe > xb) {
+            memcpy(d + x * pixel_size, row + (size_t)xb * pixel_size, (size_t)(xe - xb) * pixel_size);
+            x += xe - xb;
+        }
+        for (; x < padded; ++x)
+            memcpy(d + x * pixel_size, row + (size_t)(size.x - 1) * pixel_size, pixel_size);
+    }
+}
+
+bool WriteTiledTexture(std::ostream& os, const void* src, const TiledTextureDesc& desc, MipFilter filter)
+{
+    TiledTextureLayout layout;
+    if (!src || !layout.setup(desc))
+        return false;
+
+    TiledTextureHeader header{};
+    memcpy(header.magic, kTiledTextureMagic, sizeof(header.magic));
+    header.version = kTiledTextureVersion;
+    header.width = desc.width;
+    header.height = desc.height;
+    header.format = (uint32_t)desc.format;
+    header.block_format = (int32_t)desc.block_format;
+    header.tile_size = desc.tile_size;
+    header.border = desc.border;
+    os.write((const char*)&header, sizeof(header));
+
+    int pixel_size = GetPixelSize(desc.format);
+    bool compress = desc.block_format != BlockFormat::Unknown;
+    size_t tile_data_size = layout.tile_data_size;
+
+    RawVector<char> level, next, tiles;
+    level.assign((const char*)src, (size_t)desc.width * desc.height * pixel_size);
+    for (int li = 0; li < layout.tiled_level_count; ++li) {
+        auto size = GetMipSize(desc.width, desc.height, li);
+        auto n = layout.getTileCount(li);
+
+        tiles.resize_discard(tile_data_size * n.x * n.y);
+        parallel_for(0, n.x * n.y, [&](int ti) {
+            char* dst = tiles.data() + tile_data_size * ti;
+            if (compress) {
+                RawVector<char> buf;
+                buf.resize_discard((size_t)layout.padded_tile_size * layout.padded_tile_size * pixel_size);
+                CopyTile(buf.data(), level.cdata(), size, pixel_size, ti % n.x, ti / n.x, layout);
+                EncodeBlocks(dst, buf.cdata(), layout.padded_tile_size, layout.padded_tile_size, desc.block_format);
+            }
+            else {
+                CopyTile(dst, level.cdata(), size, pixel_size, ti % n.x, ti / n.x, layout);
+            }
+        });
+        os.write(tiles.cdata(), tiles.size());
+
+        auto next_size = GetMipSize(desc.width, desc.height, li + 1);
+        next.resize_discard((size_t)next_size.x * next_size.y * pixel_size);
+        GenerateMip(next.data(), level.cdata(), size.x, size.y, desc.format, filter);
+        level.swap(next);
+    }
+    os.write(level.cdata(), layout.tail_data_size);
+    return os.good();
+}
+
+
+bool TiledTextureReader::open(const char* path)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_layout = {};
+    m_file.close();
+    m_file.open(path, std::ios::binary);
+    if (!m_file)
+        return false;
+
+    TiledTextureHeader header{};
+    m_file.read((char*)&header, sizeof(header));
+    if (!m_file || memcmp(header.magic, kTiledTextureMagic, sizeof(header.magic)) != 0 || header.version != kTiledTextureVersion) {
+        m_file.close();
+        return false;
+    }
+
+    TiledTextureDesc desc;
+    desc.width = header.width;
+    desc.height = header.height;
+    desc.format = (ImageFormat)header.format;
+    desc.block_format = (BlockFormat)header.block_format;
+    desc.tile_size = header.tile_size;
+    desc.border = header.border;
+    if (!m_layout.setup(desc)) {
+        m_file.close();
+        return false;
+    }
+    m_data_pos = sizeof(header);
+    return true;
+}
+
+bool TiledTextureReader::valid() const
+{
+    return m_file.is_open();
+}
+
+const TiledTextureLayout& TiledTextureReader::getLayout() const
+{
+    return m_layout;
+}
+
+bool TiledTextureReader::readTile(int level, int x, int y, void* dst)
+{
+    int index = m_layout.getTileIndex(level, x, y);
+    if (index < 0)
+        return false;
+    return read(m_data_pos + m_layout.tile_data_size * index, dst, m_layout.tile_data_size);
+}
+
+bool TiledTextureReader::readTail(void* dst)
+{
+    return read(m_data_pos + m_layout.tile_data_size * m_layout.tile_offsets.back(), dst, m_layout.tail_data_size);
+}
+
+bool TiledTextureReader::read(uint64_t pos, void* dst, size_t size)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_file.is_open())
+        return false;
+    m_file.clear();
+    m_file.seekg(pos);
+    m_file.read((char*)dst, size);
+    return (size_t)m_file.gcount() == size;
+}
+
+
+TileResidency::TileResidency(int num_slots)
+{
+    reset(num_slots);
+}
+
+void TileResidency::reset(int num_slots)
+{
+    m_slots.clear();
+    m_slots.resize(num_slots);
+    m_vacants.resize(num_slots);
+    for (int i = 0; i < num_slots; ++i)
+        m_vacants[i] = num_slots - i - 1;
+    m_map.clear();
+    m_head = m_tail = -1;
+}
+
+int TileResidency::getSlotCount() const
+{
+    return (int)m_slots.size();
+}
+
+int TileResidency::getResidentCount() const
+{
+    return (int)m_map.size();
+}
+
+int TileResidency::find(Key key)
+{
+    auto it = m_map.find(key);
+    if (it == m_map.end())
+        return -1;
+    int slot = it->second;
+    unlink(slot);
+    pushBack(slot);
+    m_slots[slot].frame = m_frame;
+    return slot;
+}
+
+int TileResidency::allocate(Key key, Key* evicted)
+{
+    if (evicted)
+        *evicted = kInvalidKey;
+
+    int slot = find(key);
+    if (slot != -1)
+        return slot;
+
+    if (!m_vacants.empty()) {
+        slot = m_vacants.back();
+        m_vacants.pop_back();
+    }
+    else {
+        slot = m_head;
+        if (slot == -1 || m_slots[slot].frame == m_frame)
+            return -1;
+        unlink(slot);
+        m_map.erase(m_slots[slot].key);
+        if (evicted)
+            *evicted = m_slots[slot].key;
+    }
+
+    m_slots[slot].key = key;
+    m_slots[slot].frame = m_frame;
+    m_map[key] = slot;
+    pushBack(slot);
+    return slot;
+}
+
+void TileResidency::release(Key key)
+{
+    auto it = m_map.find(key);
+    if (it == m_map.end())
+        return;
+    int slot = it->second;
+    m_map.erase(it);
+    unlink(slot);
+    m_slots[slot] = {};
+    m_vacants.push_back(slot);
+}
+
+void TileResidency::nextFrame()
+{
+    ++m_frame;
+}
+
+void TileResidency::unlink(int slot)
+{
+    auto& s = m_slots[slot];
+    if (s.prev != -1)
+        m_slots[s.prev].next = s.next;
+    else
+        m_head = s.next;
+    if (s.next != -1)
+        m_slots[s.next].prev = s.prev;
+    else
+        m_tail = s.prev;
+    s.prev = s.next = -1;
+}
+
+void TileResidency::pushBack(int slot)
+{
+    auto& s = m_slots[slot];
+    s.prev = m_tail;
+    s.next = -1;
+    if (m_tail != -1)
+        m_slots[m_tail].next = slot;
+    else
+        m_head = slot;
+    m_tail = slot;
+}
+
+} // namespace mu
@@ -0,0 +1,112 @@
+#pragma once
+#include <mutex>
+#include <fstream>
+#include <unordered_map>
+#include "muMath.h"
+#include "muImage.h"
+#include "muBlockCompression.h"
+
+namespace mu {
+
+// virtual texture tile file.
+// levels larger than the tile size are split into tiles. each tile has a border of neighbor texels (clamped at the
+// texture edges) so that it can be filtered on its own after it is placed anywhere in an atlas.
+// the first level that fits in a tile is stored as is (the mip tail). its mips are made at load time.
+struct TiledTextureDesc
+{
+    int width = 0;
+    int height = 0;
+    ImageFormat format = ImageFormat::Unknown;       // texel format of the source and the tail
+    BlockFormat block_format = BlockFormat::Unknown; // tiles are block compressed if not Unknown. format must be its source format
+    int tile_size = 128;                             // multiple of 4
+    int border = 4;                                  // multiple of 4 if tiles are block compressed
+};
+
+struct TiledTextureLayout
+{
+    TiledTextureDesc desc;
+    int level_count = 0;        // all levels down to 1x1
+    int tiled_level_count = 0;  // levels split into tiles. the tail is level tiled_level_count
+    int padded_tile_size = 0;   // tile_size + border * 2
+    size_t tile_data_size = 0;  // bytes of a tile including its border
+    size_t tail_data_size = 0;
+    std::vector<int> tile_offsets; // index of the first tile of each tiled level. the last element is the total
+
+    bool setup(const TiledTextureDesc& desc);
+    int2 getTileCount(int level) const;
+    int getTileIndex(int level, int x, int y) const;
+    int2 getTailSize() const;
+};
+
+// keys of tiles in Glimmer's feedback buffer. same as TileKey() in gptPathTracer.hlsl.
+// tid (texture id): 12 bits, level: 4 bits, tile x/y: 8 bits each
+uint32_t EncodeTileKey(int tid, int level, int x, int y);
+void DecodeTileKey(uint32_t key, int& tid, int& level, int& x, int& y);
+// false if tid or any tile of layout is out of the range of keys
+bool CanEncodeTileKeys(int tid, const TiledTextureLayout& layout);
+
+// src is level 0 in desc.format. levels are generated and tiled one at a time, tiles are made in parallel.
+bool WriteTiledTexture(std::ostream& os, const void* src, const TiledTextureDesc& desc, MipFilter filter = MipFilter::Box);
+
+// tiles can be read from any thread
+class TiledTextureReader
+{
+public:
+    bool open(const char* path);
+    bool valid() const;
+    const TiledTextureLayout& getLayout() const;
+
+    bool readTile(int level, int x, int y, void* dst);
+    bool readTail(void* dst);
+
+private:
+    bool read(uint64_t pos, void* dst, size_t size);
+
+    TiledTextureLayout m_layout;
+    uint64_t m_data_pos = 0;
+    std::ifstream m_file;
+    std::mutex m_mutex;
+};
+
+
+// LRU residency of tiles in a fixed number of slots
+class TileResidency
+{
+public:
+    using Key = uint64_t;
+    static const Key kInvalidKey = ~0ull;
+
+    explicit TileResidency(int num_slots = 0);
+    void reset(int num_slots); // drops all tiles
+
+    int getSlotCount() const;
+    int getResidentCount() const;
+
+    // slot of key or -1. a found tile becomes the most recently used
+    int find(Key key);
+    // slot for key. the least recently used tile is evicted if all slots are occupied, but tiles used in the current
+    // frame are kept and -1 is returned instead. *evicted receives the evicted key or kInvalidKey.
+    int allocate(Key key, Key* evicted = nullptr);
+    void release(Key key);
+    void nextFrame();
+
+private:
+    void unlink(int slot);
+    void pushBack(int slot);
+
+    struct Slot
+    {
+        Key key = kInvalidKey;
+        uint64_t frame = 0;
+        int prev = -1;
+        int next = -1;
+    };
+    std::vector<Slot> m_slots;
+    std::vector<int> m_vacants;
+    std::unordered_map<Key, int> m_map;
+    int m_head = -1; // least recently used
+    int m_tail = -1; // most recently used
+    uint64_t m_frame = 1;
+};
+
+} // namespace mu
@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "SceneGraph.h"
 #include "sgSerializationImpl.h"
+#include "sgSampleCache.h"
 
 namespace sg {
 
@@ -25,6 +26,75 @@ bool ConvertOptions::operator!=(const ConvertOptions& v) const
     return !(*this == v);
 }
 
+// bump allocator for nodes. chunks are released when the scene and all nodes allocated from it are gone.
+// memory of deleted nodes is not reused until the scene is closed.
+class NodeArena
+{
+public:
+    static const size_t chunk_size = 256 * 1024;
+
+    void* allocate(size_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_chunks.empty() || m_pos + size > chunk_size) {
+            if (m_chunk_index + 1 < m_chunks.size())
+                ++m_chunk_index;
+            else {
+                m_chunks.push_back(std::unique_ptr<char[]>(new char[chunk_size]));
+                m_chunk_index = m_chunks.size() - 1;
+            }
+            m_pos = 0;
+        }
+        void* ret = m_chunks[m_chunk_index].get() + m_pos;
+        m_pos += size;
+        ++m_ref_count;
+        return ret;
+    }
+
+    void addRef() { ++m_ref_count; }
+
+    void release()
+    {
+        if (--m_ref_count == 0)
+            delete this;
+    }
+
+    // rewind to the first chunk if no nodes are alive. chunks are kept for reuse.
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_ref_count == 1) {
+            m_chunk_index = 0;
+            m_pos = 0;
+        }
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<char[]>> m_chunks;
+    size_t m_chunk_index = 0;
+    size_t m_pos = 0;
+    std::atomic<int> m_ref_count{ 1 }; // 1 for the owner scene + 1 for each live node
+};
+
+// every node allocation is prefixed by this to know where it came from.
+struct alignas(16) node_header
+{
+    NodeArena* arena;
+};
+
+static thread_local NodeArena* g_node_arena;
+
+// nodes allocated in this scope are placed in arena
+struct node_arena_scope
+{
+    NodeArena* prev;
+
+    node_arena_scope(NodeArena* arena) : prev(g_node_arena) { g_node_arena = arena; }
+    ~node_arena_scope() { g_node_arena = prev; }
+};
+
+
 sgRegisterType(Node);
 
 #define EachMember(F)\
@@ -43,25 +113,59 @@ void Node::deserialize(deserializer& d)
 
 Node::Node() {}
 
+static std::string MakeNodePath(const Node* parent, const char* name)
+{
+    std::string ret;
+    if (parent)
+        ret = parent->path;
+    if (ret != "/")
+        ret += "/";
+    if (std::strcmp(name, "/") != 0)
+        ret += name;
+    return ret;
+}
+
 Node::Node(Node* p, const char* name)
     : parent(p)
 {
     if (parent)
         parent->children.push_back(this);
-    if (name) {
-        if (parent)
-            path = parent->path;
-        if (path != "/")
-            path += "/";
-        if (std::strcmp(name, "/") != 0)
-            path += name;
-    }
+    if (name)
+        path = MakeNodePath(parent, name);
 }
 
 Node::~Node()
 {
 }
 
+void* Node::operator new(size_t size)
+{
+    const size_t header_size = sizeof(node_header);
+    size_t alloc_size = header_size + ((size + header_size - 1) & ~(header_size - 1));
+
+    node_header* header;
+    if (g_node_arena && alloc_size <= NodeArena::chunk_size / 8) {
+        header = (node_header*)g_node_arena->allocate(alloc_size);
+        header->arena = g_node_arena;
+    }
+    else {
+        header = (node_header*)::operator new(alloc_size);
+        header->arena = nullptr;
+    }
+    return header + 1;
+}
+
+void Node::operator delete(void* p)
+{
+    if (!p)
+        return;
+    node_header* header = (node_header*)p - 1;
+    if (header->arena)
+        header->arena->release();
+    else
+        ::operator delete(header);
+}
+
 Node::Type Node::getType() const
 {
     return Type::Unknown;
@@ -69,6 +173,20 @@ Node::Type Node::getType() const
 
 void Node::convert(const ConvertOptions& /*opt*/)
 {
+    markDirty();
+}
+
+void Node::markDirty(DirtyFlag v)
+{
+    if (scene)
+        scene->markDirty(this, v);
+    else
+        dirty_flags = dirty_flags | v;
+}
+
+bool Node::isDirty(DirtyFlag v) const
+{
+    return (dirty_flags & v) != DirtyFlag::None;
 }
 
 std::string Node::getName() const
@@ -100,6 +218,183 @@ Node::Type RootNode::getType() const
 }
 
 
+void TransformHierarchy::build(const int parents[], size_t num)
+{
+    m_source.assign(parents, num);
+
+    // depth of each entry. parents usually precede their children but it is not required.
+    RawVector<int> depth;
+    depth.resize(num);
+    fill(depth.data(), num, -1);
+    RawVector<int> stack;
+    int max_depth = -1;
+    for (size_t i = 0; i < num; ++i) {
+        int c = (int)i;
+        while (c >= 0 && depth[c] < 0 && stack.size() <= num) {
+            stack.push_back(c);
+            c = parents[c];
+        }
+        int d = c >= 0 && depth[c] >= 0 ? depth[c] : -1;
+        while (!stack.empty()) {
+            depth[stack.back()] = ++d;
+            stack.pop_back();
+        }
+        max_depth = std::max(max_depth, depth[i]);
+    }
+
+    // counting sort by depth
+    m_levels.resize_zeroclear(max_depth + 2);
+    for (size_t i = 0; i < num; ++i)
+        ++m_levels[depth[i] + 1];
+    m_levels[0] = 1;
+    for (int l = 1; l < (int)m_levels.size(); ++l)
+        m_levels[l] += m_levels[l - 1];
+
+    RawVector<int> pos;
+    pos.assign(m_levels.cdata(), m_levels.size());
+    m_slots.resize(num);
+    for (size_t i = 0; i < num; ++i)
+        m_slots[i] = pos[depth[i]]++;
+
+    m_parents.resize(num + 1);
+    m_parents[0] = 0;
+    for (size_t i = 0; i < num; ++i) {
+        int p = parents[i];
+        m_parents[m_slots[i]] = p >= 0 && depth[p] < depth[i] ? m_slots[p] : 0;
+    }
+
+    m_local.resize(num + 1, float4x4::identity());
+    m_global.resize(num + 1, float4x4::identity());
+    m_dirty.resize(num + 1);
+    m_updated.resize_zeroclear(num + 1);
+    markAllDirty();
+}
+
+void TransformHierarchy::clear()
+{
+    m_source.clear();
+    m_slots.clear();
+    m_parents.clear();
+    m_levels.clear();
+    m_local.clear();
+    m_global.clear();
+    m_dirty.clear();
+    m_updated.clear();
+}
+
+size_t TransformHierarchy::size() const
+{
+    return m_slots.size();
+}
+
+bool TransformHierarchy::isBuiltWith(const int parents[], size_t num) const
+{
+    return m_source.size() == num && (num == 0 || memcmp(m_source.cdata(), parents, sizeof(int) * num) == 0);
+}
+
+int TransformHierarchy::getParent(int i) const
+{
+    return m_source[i];
+}
+
+void TransformHierarchy::setBase(const float4x4& v)
+{
+    if (m_global.empty())
+        return;
+    if (m_global[0] != v) {
+        m_global[0] = v;
+        m_dirty[0] = 1;
+    }
+}
+
+void TransformHierarchy::setLocal(int i, const float4x4& v)
+{
+    int slot = m_slots[i];
+    if (m_local[slot] != v) {
+        m_local[slot] = v;
+        m_dirty[slot] = 1;
+    }
+}
+
+void TransformHierarchy::setGlobal(int i, const float4x4& v)
+{
+    m_global[m_slots[i]] = v;
+}
+
+void TransformHierarchy::markDirty(int i)
+{
+    m_dirty[m_slots[i]] = 1;
+}
+
+void TransformHierarchy::markAllDirty()
+{
+    fill(m_dirty.data(), m_dirty.size(), (uint8_t)1);
+}
+
+void TransformHierarchy::clearDirty()
+{
+    m_dirty.zeroclear();
+}
+
+void TransformHierarchy::update()
+{
+    if (m_slots.empty())
+        return;
+
+    const int granularity = 1024;
+    auto* parents = m_parents.cdata();
+    auto* local = m_local.cdata();
+    auto* global = m_global.data();
+    auto* dirty = m_dirty.data();
+
+    // each depth depends only on the previous ones. entries in the same depth are independent.
+    int nlevels = (int)m_levels.size() - 1;
+    for (int l = 0; l < nlevels; ++l) {
+        int level_begin = m_levels[l];
+        int level_size = m_levels[l + 1] - level_begin;
+        auto body = [&](int begin, int end) {
+            begin += level_begin;
+            end += level_begin;
+            for (int i = begin; i < end; ++i)
+                dirty[i] |= dirty[parents[i]];
+
+            // multiply runs of dirty entries at once
+            for (int i = begin; i < end;) {
+                while (i < end && !dirty[i])
+                    ++i;
+                int run_begin = i;
+                while (i < end && dirty[i])
+                    ++i;
+                if (i > run_begin)
+                    mu::MulMatrices(local + run_begin, global, parents + run_begin, global + run_begin, i - run_begin);
+            }
+        };
+        if (level_size <= granularity)
+            body(0, level_size);
+        else
+            mu::parallel_for_blocked(0, level_size, granularity, body);
+    }
+
+    m_updated.swap(m_dirty);
+    m_dirty.zeroclear();
+}
+
+const float4x4& TransformHierarchy::getLocal(int i) const
+{
+    return m_local[m_slots[i]];
+}
+
+const float4x4& TransformHierarchy::getGlobal(int i) const
+{
+    return m_global[m_slots[i]];
+}
+
+bool TransformHierarchy::isUpdated(int i) const
+{
+    return m_updated[m_slots[i]] != 0;
+}
+
+
 sgRegisterType(XformNode);
 
 #define EachMember(F)\
@@ -255,70 +550,168 @@ Node::Type MeshNode::getType() const
     return Type::Mesh;
 }
 
-void MeshNode::convert(const ConvertOptions& opt)
+// MeshNode::convert() fuses all enabled options into one transform per element.
+// the option set is a template parameter so that each combination compiles to a branchless loop.
+enum convert_flags : uint32_t
 {
-    super::convert(opt);
+    cf_scale   = 0x1,
+    cf_flip_x  = 0x2,
+    cf_flip_yz = 0x4,
+};
 
-    if (opt.scale_factor != 1.0f) {
-        mu::Scale(points.data(), opt.scale_factor, points.size());
-        (float3&)bind_transform[3] *= opt.scale_factor;
+template<uint32_t Flags>
+static inline float3 ConvertVector(float3 v, float scale)
+{
+    if (Flags & cf_scale)
+        v *= scale;
+    if (Flags & cf_flip_x)
+        v.x = -v.x;
+    if (Flags & cf_flip_yz)
+        v = { v.x, v.z, -v.y }; // flip_z(swap_yz(v))
+    return v;
+}
 
-        eachBSTarget([&opt](auto& t) {
-            mu::Scale(t.point_offsets.data(), opt.scale_factor, t.point_offsets.size());
-        });
-    }
+template<uint32_t Flags>
+static void ConvertVectorsImpl(float3* dst, size_t n, float scale)
+{
+    mu::parallel_for_blocked(0, (int)n, 8192, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+            dst[i] = ConvertVector<Flags>(dst[i], scale);
+    });
+}
 
-    if (opt.flip_x) {
-        mu::InvertX(points.data(), points.size());
-        mu::InvertX(normals.data(), normals.size());
-        bind_transform = flip_x(bind_transform);
+static void ConvertVectors(float3* dst, size_t n, uint32_t flags, float scale)
+{
+    static void (*const s_impl[])(float3*, size_t, float) = {
+        ConvertVectorsImpl<0>, ConvertVectorsImpl<1>, ConvertVectorsImpl<2>, ConvertVectorsImpl<3>,
+        ConvertVectorsImpl<4>, ConvertVectorsImpl<5>, ConvertVectorsImpl<6>, ConvertVectorsImpl<7>,
+    };
+    if (flags != 0 && n != 0)
+        s_impl[flags](dst, n, scale);
+}
 
-        eachBSTarget([](auto& t) {
-            mu::InvertX(t.point_offsets.data(), t.point_offsets.size());
-            mu::InvertX(t.normal_offsets.data(), t.normal_offsets.size());
-        });
+// reverse a face and convert its elements at once
+template<class T, class Convert>
+static inline void ReverseConvert(T* data, int count, const Convert& convert)
+{
+    int i = 0, j = count - 1;
+    for (; i < j; ++i, --j) {
+        T t = convert(data[i]);
+        data[i] = convert(data[j]);
+        data[j] = t;
     }
+    if (i == j)
+        data[i] = convert(data[i]);
+}
+
+struct flip_faces_args
+{
+    const int* counts;
+    const int* offsets;
+    int num_faces;
+    int* indices;
+    float2* uvs;          // per-index only
+    float3* normals;      // per-index only
+    float4* colors;       // per-index only
+    std::vector<float3*> normal_offsets; // per-index only
+    bool flip_v;
+};
+
+// Flags: conversion for normals (cf_flip_x / cf_flip_yz)
+template<uint32_t Flags>
+static void FlipFacesImpl(const flip_faces_args& args)
+{
+    auto identity = [](auto v) { return v; };
+    auto convert_uv = [](float2 v) { return float2{ v.x, 1.0f - v.y }; };
+    auto convert_normal = [](float3 v) { return ConvertVector<Flags>(v, 1.0f); };
+
+    mu::parallel_for_blocked(0, args.num_faces, 4096, [&](int begin, int end) {
+        for (int fi = begin; fi < end; ++fi) {
+            int c = args.counts[fi];
+            int o = args.offsets[fi];
+            ReverseConvert(args.indices + o, c, identity);
+            if (args.uvs) {
+                if (args.flip_v)
+                    ReverseConvert(args.uvs + o, c, convert_uv);
+                else
+                    ReverseConvert(args.uvs + o, c, identity);
+            }
+            if (args.normals)
+                ReverseConvert(args.normals + o, c, convert_normal);
+            if (args.colors)
+                ReverseConvert(args.colors + o, c, identity);
+            for (auto* no : args.normal_offsets)
+                ReverseConvert(no + o, c, convert_normal);
+        }
+    });
+}
 
-    if (opt.flip_yz) {
-        auto convert = [this](auto& v) { return flip_z(swap_yz(v)); };
-        for (auto& v : points) v = convert(v);
-        for (auto& v : normals) v = convert(v);
-        bind_transform = convert(bind_transform);
-
-        eachBSTarget([&convert](auto& t) {
-            for (auto& v : t.point_offsets) v = convert(v);
-            for (auto& v : t.normal_offsets) v = convert(v);
-        });
-    }
+static void FlipFaces(const flip_faces_args& args, uint32_t flags)
+{
+    static void (*const s_impl[])(const flip_faces_args&) = {
+        FlipFacesImpl<0>, FlipFacesImpl<cf_flip_x>, FlipFacesImpl<cf_flip_yz>, FlipFacesImpl<cf_flip_x | cf_flip_yz>,
+    };
+    s_impl[(flags & (cf_flip_x | cf_flip_yz)) >> 1](args);
+}
 
-    if (opt.flip_v) {
+void MeshNode::convert(const ConvertOptions& opt)
+{
+    super::convert(opt);
+
+    uint32_t point_flags = 0;
+    if (opt.scale_factor != 1.0f)
+        point_flags |= cf_scale;
+    if (opt.flip_x)
+        point_flags |= cf_flip_x;
+    if (opt.flip_yz)
+        point_flags |= cf_flip_yz;
+    uint32_t normal_flags = point_flags & ~cf_scale;
+    float scale = opt.scale_factor;
+
+    // per-index attributes are converted in the face pass if faces are flipped
+    size_t nindices = indices.size();
+    bool fuse = opt.flip_faces && !counts.empty();
+    bool fuse_normals = fuse && normals.size() == nindices;
+    bool fuse_uvs = fuse && uvs.size() == nindices;
+
+    ConvertVectors(points.data(), points.size(), point_flags, scale);
+    if (!fuse_normals)
+        ConvertVectors(normals.data(), normals.size(), normal_flags, scale);
+    if (opt.flip_v && !fuse_uvs)
         mu::InvertV(uvs.data(), uvs.size());
-    }
 
-    if (opt.flip_faces) {
-        size_t nfaces = counts.size();
-        auto* cdata = counts.cdata();
-
-        auto do_flip = [nfaces, cdata](auto *data) {
-            for (size_t fi = 0; fi < nfaces; ++fi) {
-                int c = cdata[fi];
-                std::reverse(data, data + c);
-                data += c;
-            }
-        };
+    if (opt.scale_factor != 1.0f)
+        (float3&)bind_transform[3] *= opt.scale_factor;
+    if (opt.flip_x)
+        bind_transform = flip_x(bind_transform);
+    if (opt.flip_yz)
+        bind_transform = flip_z(swap_yz(bind_transform));
+
+    std::vector<float3*> fused_normal_offsets;
+    eachBSTarget([&](auto& t) {
+        ConvertVectors(t.point_offsets.data(), t.point_offsets.size(), point_flags, scale);
+        if (fuse && t.normal_offsets.size() == nindices)
+            fused_normal_offsets.push_back(t.normal_offsets.data());
+        else
+            ConvertVectors(t.normal_offsets.data(), t.normal_offsets.size(), normal_flags, scale);
+    });
 
-        do_flip(indices.data());
-        if (uvs.size() == indices.size())
-            do_flip(uvs.data());
-        if (normals.size() == indices.size())
-            do_flip(normals.data());
-        if (colors.size() == indices.size())
-            do_flip(colors.data());
-
-        eachBSTarget([this, &do_flip](auto& t) {
-            if (t.normal_offsets.size() == indices.size())
-                do_flip(t.normal_offsets.data());
-        });
+    if (opt.flip_faces) {
+        RawVector<int> offsets;
+        int num_indices, num_indices_triangulated;
+        mu::CountIndices(counts, offsets, num_indices, num_indices_triangulated);
+
+        flip_faces_args args;
+        args.counts = counts.cdata();
+        args.offsets = offsets.cdata();
+        args.num_faces = (int)counts.size();
+        args.indices = indices.data();
+        args.uvs = fuse_uvs ? uvs.data() : nullptr;
+        args.normals = fuse_normals ? normals.data() : nullptr;
+        args.colors = colors.size() == nindices ? colors.data() : nullptr;
+        args.normal_offsets = std::move(fused_normal_offsets);
+        args.flip_v = opt.flip_v;
+        FlipFaces(args, normal_flags);
     }
 }
 
@@ -352,7 +745,8 @@ void MeshNode::buildFaceSets(bool cleanup)
     }
 
     // setup
-    facesets.resize(materials.size() + 1);
+    int nbins = (int)materials.size() + 1;
+    facesets.resize(nbins);
     each_with_index(facesets, [this](auto& faceset, int i) {
         if (!faceset)
             faceset = std::make_shared<FaceSet>();
@@ -361,10 +755,47 @@ void MeshNode::buildFaceSets(bool cleanup)
             faceset->material = materials[i];
     });
 
-    // select face by material
-    each_with_index(material_ids, [this](int mid, int fi) {
-        if (mid >= 0)
-            facesets[mid]->faces.push_back(fi);
+    // counting sort of faces by material id.
+    // histogram per chunk -> prefix sum -> scatter. faces keep their order in each faceset.
+    const int granularity = 16384;
+    int nfaces = (int)material_ids.size();
+    int nchunks = mu::ceildiv(nfaces, granularity);
+    const int* mids = material_ids.cdata();
+
+    RawVector<int> offsets; // [chunk][bin]
+    offsets.resize_zeroclear(nchunks * nbins);
+    mu::parallel_for(0, nchunks, [&](int ci) {
+        int* hist = offsets.data() + ci * nbins;
+        int end = std::min(nfaces, (ci + 1) * granularity);
+        for (int fi = ci * granularity; fi < end; ++fi) {
+            int mid = mids[fi];
+            if (mid >= 0 && mid < nbins)
+                ++hist[mid];
+        }
+    });
+
+    std::vector<int*> dst(nbins);
+    for (int bi = 0; bi < nbins; ++bi) {
+        int total = 0;
+        for (int ci = 0; ci < nchunks; ++ci) {
+            int& o = offsets[ci * nbins + bi];
+            int n = o;
+            o = total;
+            total += n;
+        }
+        auto& faces = facesets[bi]->faces;
+        faces.resize_discard(total);
+        dst[bi] = faces.data();
+    }
+
+    mu::parallel_for(0, nchunks, [&](int ci) {
+        int* pos = offsets.data() + ci * nbins;
+        int end = std::min(nfaces, (ci + 1) * granularity);
+        for (int fi = ci * granularity; fi < end; ++fi) {
+            int mid = mids[fi];
+            if (mid >= 0 && mid < nbins)
+                dst[mid][pos[mid]++] = fi;
+        }
     });
 
     // erase empty facesets
@@ -383,19 +814,50 @@ void MeshNode::buildMaterialIDs(bool cleanup)
     if (counts.empty() || facesets.empty())
         return;
 
-    material_ids.resize_discard(counts.size());
-    fill(material_ids, -1);
+    int nfaces = (int)counts.size();
+    int nfacesets = (int)facesets.size();
+    material_ids.resize_discard(nfaces);
+
+    materials.resize(nfacesets);
+    RawVector<int> fs_mids;
+    fs_mids.resize_discard(nfacesets);
+    bool sorted = true;
+    for (int i = 0; i < nfacesets; ++i) {
+        auto& faceset = *facesets[i];
+        auto m = faceset.material;
+        materials[i] = m;
+        fs_mids[i] = m ? m->index : -1;
+        auto* fb = faceset.faces.cdata();
+        auto* fe = fb + faceset.faces.size();
+        sorted = sorted && std::adjacent_find(fb, fe, std::greater_equal<int>()) == fe;
+    }
 
-    materials.resize(facesets.size());
     // process by reverse order because of later element maybe dummy.
     // (dummy contains overlapped faces and is overwritten by other valid facesets)
-    each_with_index_r(facesets, [this](auto& faceset, int i) {
-        auto m = faceset->material;
-        materials[i] = m;
-        int mi = m ? m->index : -1;
-        for (int f : faceset->faces)
-            material_ids[f] = mi;
-    });
+    int* mids = material_ids.data();
+    if (sorted) {
+        // faces in facesets are sorted (buildFaceSets() makes so). split the output into face ranges and
+        // write each range independently. the faces of each faceset in the range are found by binary search.
+        mu::parallel_for_blocked(0, nfaces, 16384, [&](int begin, int end) {
+            std::fill(mids + begin, mids + end, -1);
+            for (int i = nfacesets - 1; i >= 0; --i) {
+                auto& faces = facesets[i]->faces;
+                auto* fb = std::lower_bound(faces.cdata(), faces.cdata() + faces.size(), begin);
+                auto* fe = std::lower_bound(fb, faces.cdata() + faces.size(), end);
+                int mid = fs_mids[i];
+                for (auto* f = fb; f != fe; ++f)
+                    mids[*f] = mid;
+            }
+        });
+    }
+    else {
+        fill(material_ids, -1);
+        for (int i = nfacesets - 1; i >= 0; --i) {
+            int mid = fs_mids[i];
+            for (int f : facesets[i]->faces)
+                mids[f] = mid;
+        }
+    }
 
     if (cleanup) {
         facesets.clear();
@@ -417,6 +879,8 @@ void MeshNode::clear()
     skeleton = nullptr;
     joints.clear();
     joint_matrices.clear();
+    joint_bindposes.clear();
+    joint_bindposes_inv.clear();
 
     joints_per_vertex = 0;
     joint_indices.clear();
@@ -510,11 +974,7 @@ void MeshNode::bake(MeshNode& dst, const float4x4& trans)
     float3* dst_normals = normals.empty() ? nullptr : dst.normals.end() - normals.size();
 
     // blendshape
-    if (!blendshapes.empty() && blendshapes.size() == blendshape_weights.size()) {
-        size_t nbs = blendshapes.size();
-        for (size_t bsi = 0; bsi < nbs; ++bsi)
-            blendshapes[bsi]->apply(dst_points, dst_normals, blendshape_weights[bsi]);
-    }
+    applyBlendshapes(dst_points, dst_normals);
 
     // skeleton
     if (isSkinned())
@@ -526,32 +986,167 @@ void MeshNode::bake(MeshNode& dst, const float4x4& trans)
     }
 }
 
+struct blend_term
+{
+    const float3* offsets;
+    const int* indices; // null if dense
+    size_t num;
+    float weight;
+    bool sorted;        // indices are strictly increasing
+};
+
+// dst[] += offsets * weight for all terms.
+// dense terms and terms with sorted indices are applied in one pass over blocks of dst.
+static void ApplyBlendTerms(float3* dst, size_t ndst, const std::vector<blend_term>& terms)
+{
+    if (terms.empty())
+        return;
+
+    const int granularity = 4096;
+    bool blocked = std::any_of(terms.begin(), terms.end(), [](auto& t) { return !t.indices || t.sorted; });
+    if (blocked) {
+        mu::parallel_for_blocked(0, (int)ndst, granularity, [&](int begin, int end) {
+            for (auto& t : terms) {
+                if (!t.indices) {
+                    int e = std::min(end, (int)t.num);
+                    if (begin < e)
+                        mu::MulAdd(dst + begin, t.offsets + begin, e - begin, t.weight);
+                }
+                else if (t.sorted) {
+                    // indices that fall in [begin, end)
+                    auto* ib = std::lower_bound(t.indices, t.indices + t.num, begin);
+                    auto* ie = std::lower_bound(ib, t.indices + t.num, end);
+                    if (ib != ie)
+                        mu::MulAddIndexed(dst, t.offsets + (ib - t.indices), ib, ie - ib, t.weight);
+                }
+            }
+        });
+    }
+
+    // unsorted indices can't be split by destination range
+    for (auto& t : terms) {
+        if (t.indices && !t.sorted)
+            mu::MulAddIndexed(dst, t.offsets, t.indices, t.num, t.weight);
+    }
+}
+
+static void ApplyBlendshapes(const MeshNode& base, float3* dst_points, float3* dst_normals,
+    BlendshapeNode* const* blendshapes, const float* weights, size_t nbs)
+{
+    size_t npoints = base.points.size();
+    size_t nnormals = dst_normals ? base.normals.size() : 0;
+    bool per_index_normals = nnormals != npoints && nnormals == base.indices.size();
+
+    std::vector<blend_term> point_terms, normal_terms, point_normal_terms;
+    for (size_t bsi = 0; bsi < nbs; ++bsi) {
+        BlendshapeTarget* targets[2];
+        float tweights[2];
+        auto* bs = blendshapes[bsi];
+        int ntargets = bs->getTargets(weights[bsi], targets, tweights);
+        if (ntargets == 0)
+            continue;
+
+        const int* bsi_data = bs->indices.empty() ? nullptr : bs->indices.cdata();
+        size_t bsi_size = bs->indices.size();
+        bool sorted = bsi_data && std::adjacent_find(bsi_data, bsi_data + bsi_size, std::greater_equal<int>()) == bsi_data + bsi_size;
+
+        for (int ti = 0; ti < ntargets; ++ti) {
+            auto& t = *targets[ti];
+            float w = tweights[ti];
+
+            auto& po = t.point_offsets;
+            if (!po.empty()) {
+                size_t n = std::min(po.size(), bsi_data ? bsi_size : npoints);
+                point_terms.push_back({ po.cdata(), bsi_data, n, w, sorted });
+            }
+
+            auto& no = t.normal_offsets;
+            if (!no.empty() && nnormals) {
+                if (!bsi_data) {
+                    // same layout as base.normals, or per-vertex offsets for per-index normals
+                    if (no.size() == nnormals)
+                        normal_terms.push_back({ no.cdata(), nullptr, nnormals, w, false });
+                    else if (per_index_normals && no.size() == npoints)
+                        point_normal_terms.push_back({ no.cdata(), nullptr, npoints, w, false });
+                }
+                else {
+                    size_t n = std::min(no.size(), bsi_size);
+                    if (!per_index_normals)
+                        normal_terms.push_back({ no.cdata(), bsi_data, n, w, sorted });
+                    else
+                        point_normal_terms.push_back({ no.cdata(), bsi_data, n, w, sorted });
+                }
+            }
+        }
+    }
+
+    ApplyBlendTerms(dst_points, npoints, point_terms);
+    ApplyBlendTerms(dst_normals, nnormals, normal_terms);
+    if (!point_normal_terms.empty()) {
+        // accumulate per-vertex normal deltas and distribute them to per-index normals
+        RawVector<float3> deltas;
+        deltas.resize_zeroclear(npoints);
+        ApplyBlendTerms(deltas.data(), npoints, point_normal_terms);
+
+        auto* vi = base.indices.cdata();
+        mu::parallel_for_blocked(0, (int)nnormals, 4096, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i)
+                dst_normals[i] += deltas[vi[i]];
+        });
+    }
+}
+
+void MeshNode::applyBlendshapes(float3* dst_points, float3* dst_normals)
+{
+    if (!blendshapes.empty() && blendshapes.size() == blendshape_weights.size())
+        ApplyBlendshapes(*this, dst_points, dst_normals, blendshapes.data(), blendshape_weights.cdata(), blendshapes.size());
+}
+
 void MeshNode::applySkinning(float3* dst_points, float3* dst_normals)
 {
-    transform_container(joint_matrices, joints, [this](auto& m, auto j) {
-        m = mu::invert(j->bindpose) * j->global_matrix;
-    });
+    // update inverted bindposes only if changed
+    size_t njoints = joints.size();
+    if (joint_bindposes.size() != njoints) {
+        joint_bindposes.resize_zeroclear(njoints);
+        joint_bindposes_inv.resize_discard(njoints);
+    }
+    joint_matrices.resize_discard(njoints);
+    for (size_t i = 0; i < njoints; ++i) {
+        auto j = joints[i];
+        if (joint_bindposes[i] != j->bindpose) {
+            joint_bindposes[i] = j->bindpose;
+            joint_bindposes_inv[i] = mu::invert(j->bindpose);
+        }
+        // bind_transform is folded in joint matrices
+        joint_matrices[i] = bind_transform * joint_bindposes_inv[i] * j->global_matrix;
+    }
+
+    const int granularity = 2048;
+    auto* jm = joint_matrices.cdata();
+    auto* jiv = joint_indices.cdata();
+    auto* jwv = joint_weights.cdata();
+    int jpv = joints_per_vertex;
 
     int npoints = (int)points.size();
-    auto* iv = joint_indices.cdata();
-    auto* wv = joint_weights.cdata();
-    for (int pi = 0; pi < npoints; ++pi) {
-        {
-            auto p = mu::mul_p(bind_transform, dst_points[pi]);
-            auto r = float3::zero();
-            for (int ji = 0; ji < joints_per_vertex; ++ji)
-                r += mu::mul_p(joint_matrices[iv[ji]], p) * wv[ji];
-            dst_points[pi] = r;
+    mu::parallel_for_blocked(0, npoints, granularity, [&](int begin, int end) {
+        mu::SkinPoints(jm, jiv + begin * jpv, jwv + begin * jpv, jpv, dst_points + begin, dst_points + begin, end - begin);
+    });
+
+    if (dst_normals) {
+        int nnormals = (int)normals.size();
+        if (nnormals == npoints) {
+            // per-vertex
+            mu::parallel_for_blocked(0, nnormals, granularity, [&](int begin, int end) {
+                mu::SkinVectors(jm, jiv + begin * jpv, jwv + begin * jpv, jpv, dst_normals + begin, dst_normals + begin, end - begin);
+            });
         }
-        if (dst_normals) {
-            auto n = mu::mul_v(bind_transform, dst_normals[pi]);
-            auto r = float3::zero();
-            for (int ji = 0; ji < joints_per_vertex; ++ji)
-                r += mu::mul_v(joint_matrices[iv[ji]], n) * wv[ji];
-            dst_normals[pi] = r;
+        else if (nnormals == (int)indices.size()) {
+            // per-index
+            auto* vertex_indices = indices.cdata();
+            mu::parallel_for_blocked(0, nnormals, granularity, [&](int begin, int end) {
+                mu::SkinVectors(jm, jiv, jwv, jpv, dst_normals + begin, dst_normals + begin, end - begin, vertex_indices + begin);
+            });
         }
-        iv += joints_per_vertex;
-        wv += joints_per_vertex;
     }
 }
 
@@ -657,7 +1252,7 @@ void BlendshapeNode::makeMesh(MeshNode& dst, const MeshNode& base, float weight)
     dst.counts = base.counts;
     dst.indices = base.indices;
 
-    apply(dst.points.data(), dst.normals.data(), weight);
+    apply(base, dst.points.data(), dst.normals.data(), weight);
 }
 
 BlendshapeTarget* BlendshapeNode::addTarget(float weight)
@@ -697,10 +1292,10 @@ BlendshapeTarget* BlendshapeNode::addTarget(const MeshNode& target, const MeshNo
     return &dst;
 }
 
-void BlendshapeNode::apply(float3* dst_points, float3* dst_normals, float weight)
+int BlendshapeNode::getTargets(float weight, BlendshapeTarget* (&dst_targets)[2], float (&dst_weights)[2]) const
 {
     if (weight == 0.0f || targets.empty())
-        return;
+        return 0;
 
     // https://graphics.pixar.com/usd/docs/api/_usd_skel__schemas.html#UsdSkel_BlendShape
 
@@ -730,49 +1325,32 @@ void BlendshapeNode::apply(float3* dst_points, float3* dst_normals, float weight
             next = nullptr;
     }
 
-    auto apply1 = [this, dst_points, dst_normals](BlendshapeTarget *t, float w) {
-        const float3* po = t->point_offsets.cdata();
-        if (!indices.empty()) {
-            size_t nbsi = indices.size();
-            const int* i = indices.cdata();
-            for (size_t oi = 0; oi < nbsi; ++oi)
-                dst_points[i[oi]] += po[oi] * w;
-        }
-        else {
-            size_t npoints = t->point_offsets.size();
-            for (size_t oi = 0; oi < npoints; ++oi)
-                dst_points[oi] += po[oi] * w;
-        }
-        // todo: handle normal offsets
-    };
-
-    auto apply2 = [this, dst_points, dst_normals](BlendshapeTarget* t1, BlendshapeTarget* t2, float w) {
-        const float3* po1 = t1->point_offsets.cdata();
-        const float3* po2 = t2->point_offsets.cdata();
-        if (!indices.empty()) {
-            size_t nbsi = indices.size();
-            const int* i = indices.cdata();
-            for (size_t oi = 0; oi < nbsi; ++oi)
-                dst_points[i[oi]] += mu::lerp(po1[oi], po2[oi], w);
-        }
-        else {
-            size_t npoints = t1->point_offsets.size();
-            for (size_t oi = 0; oi < npoints; ++oi)
-                dst_points[oi] += mu::lerp(po1[oi], po2[oi], w);
-        }
-        // todo: handle normal offsets
-    };
-
     if (next && !prev) {
-        apply1(next, weight / next->weight);
+        dst_targets[0] = next;
+        dst_weights[0] = weight / next->weight;
+        return 1;
     }
     else if (!next && prev) {
-        apply1(prev, weight / prev->weight);
+        dst_targets[0] = prev;
+        dst_weights[0] = weight / prev->weight;
+        return 1;
     }
     else if (next && prev) {
+        // lerp(prev, next, w) == prev * (1 - w) + next * w
         float w = (weight - prev->weight) / (next->weight - prev->weight);
-        apply2(prev, next, w);
+        dst_targets[0] = prev;
+        dst_weights[0] = 1.0f - w;
+        dst_targets[1] = next;
+        dst_weights[1] = w;
+        return 2;
     }
+    return 0;
+}
+
+void BlendshapeNode::apply(const MeshNode& base, float3* dst_points, float3* dst_normals, float weight)
+{
+    BlendshapeNode* bs = this;
+    ApplyBlendshapes(base, dst_points, dst_normals, &bs, &weight, 1);
 }
 
 
@@ -928,6 +1506,7 @@ void SkeletonNode::convert(const ConvertOptions& opt)
 void SkeletonNode::clear()
 {
     joints.clear();
+    transform_hierarchy.clear();
 }
 
 Joint* SkeletonNode::addJoint(const std::string& jpath)
@@ -938,24 +1517,53 @@ Joint* SkeletonNode::addJoint(const std::string& jpath)
     return ret;
 }
 
-static void UpdateGlobalMatricesImpl(Joint& joint, const float4x4& base)
-{
-    if (joint.parent)
-        joint.global_matrix = joint.local_matrix * joint.parent->global_matrix;
-    else
-        joint.global_matrix = joint.local_matrix * base;
-
-    for (auto child : joint.children)
-        UpdateGlobalMatricesImpl(*child, base);
+// pull local matrices into th, update it, and write back global matrices that are changed.
+// a global matrix that differs from th's was set directly since the last update. it is taken as is.
+// get_local / get_global / set_global: [](int i) -> const float4x4& / same / [](int i, const float4x4& v)
+template<class GetLocal, class GetGlobal, class SetGlobal>
+static void UpdateTransformHierarchy(TransformHierarchy& th, const float4x4& base,
+    const GetLocal& get_local, const GetGlobal& get_global, const SetGlobal& set_global)
+{
+    const int granularity = 2048;
+    int n = (int)th.size();
+    th.setBase(base);
+    mu::parallel_for_blocked(0, n, granularity, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            auto& global = get_global(i);
+            if (global != th.getGlobal(i))
+                th.setGlobal(i, global);
+            th.setLocal(i, get_local(i));
+        }
+    });
+    th.update();
+    mu::parallel_for_blocked(0, n, granularity, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            if (th.isUpdated(i))
+                set_global(i, th.getGlobal(i));
+        }
+    });
 }
 
 void SkeletonNode::updateGlobalMatrices(const float4x4& base)
 {
-    // update global matrices from top to down recursively
-    for (auto& joint : joints) {
-        if (!joint->parent)
-            UpdateGlobalMatricesImpl(*joint, base);
+    // joints are reparented by assigning Joint::parent. so parents are compared every time, not only the count.
+    size_t n = joints.size();
+    RawVector<int> parents;
+    parents.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        auto* parent = joints[i]->parent;
+        parents[i] = parent ? parent->index : -1;
     }
+    if (!transform_hierarchy.isBuiltWith(parents.cdata(), n))
+        transform_hierarchy.build(parents.cdata(), n);
+
+    std::atomic_bool updated{ false };
+    UpdateTransformHierarchy(transform_hierarchy, base,
+        [this](int i) -> const float4x4& { return joints[i]->local_matrix; },
+        [this](int i) -> const float4x4& { return joints[i]->global_matrix; },
+        [this, &updated](int i, const float4x4& v) { joints[i]->global_matrix = v; updated = true; });
+    if (updated)
+        markDirty(DirtyFlag::Joints);
 }
 
 Joint* SkeletonNode::findJointByPath(const std::string& jpath)
@@ -1074,40 +1682,207 @@ void InstancerNode::bake(MeshNode& dst, const float4x4& trans)
         }
     }
 
-    size_t vertex_offset = dst.points.size();
-    size_t normal_offset = dst.normals.size();
-
     size_t ninstances = proto_indices.size();
-    if (matrices.size() == ninstances) {
-        // reserve space
-        size_t npoints = 0;
-        size_t nindices = 0;
-        size_t nfaces = 0;
-        for (size_t i = 0; i < ninstances; ++i) {
-            auto& mesh = proto_records[proto_indices[i]].merged_mesh;
-            npoints += mesh.points.size();
-            nindices += mesh.indices.size();
-            nfaces += mesh.counts.size();
+    if (matrices.size() != ninstances || ninstances == 0)
+        return;
+
+    // sizing pass: prefix sum of vertex / index / face counts.
+    // instance i is written to [*_offsets[i], *_offsets[i + 1]) of dst.
+    RawVector<int> vertex_offsets, index_offsets, face_offsets;
+    vertex_offsets.resize_discard(ninstances + 1);
+    index_offsets.resize_discard(ninstances + 1);
+    face_offsets.resize_discard(ninstances + 1);
+    vertex_offsets[0] = (int)dst.points.size();
+    index_offsets[0] = (int)dst.indices.size();
+    face_offsets[0] = (int)dst.counts.size();
+
+    bool has_normals = !dst.normals.empty();
+    bool has_uvs = !dst.uvs.empty();
+    bool has_colors = !dst.colors.empty();
+    bool has_material_ids = !dst.material_ids.empty();
+    for (size_t i = 0; i < ninstances; ++i) {
+        auto& mesh = proto_records[proto_indices[i]].merged_mesh;
+        vertex_offsets[i + 1] = vertex_offsets[i] + (int)mesh.points.size();
+        index_offsets[i + 1] = index_offsets[i] + (int)mesh.indices.size();
+        face_offsets[i + 1] = face_offsets[i] + (int)mesh.counts.size();
+    }
+    for (auto& prec : proto_records) {
+        auto& mesh = prec.merged_mesh;
+        has_normals |= !mesh.normals.empty();
+        has_uvs |= !mesh.uvs.empty();
+        has_colors |= !mesh.colors.empty();
+        has_material_ids |= !mesh.material_ids.empty();
+    }
+
+    // facesets: one output faceset per material. each has its own offset list over instances.
+    // as MeshNode::merge() does, faces go to the first faceset of dst with the same material.
+    // other facesets of dst are kept as they are.
+    struct faceset_slot
+    {
+        FaceSetPtr faceset;
+        RawVector<int> face_offsets, index_offsets, count_offsets;
+    };
+    std::vector<faceset_slot> slots;
+    auto find_slot = [&](MaterialNode* material) {
+        for (int si = 0; si < (int)slots.size(); ++si)
+            if (slots[si].faceset->material == material)
+                return si;
+        return -1;
+    };
+    auto get_slot = [&](MaterialNode* material) {
+        int si = find_slot(material);
+        if (si >= 0)
+            return si;
+        slots.push_back({});
+        auto& slot = slots.back();
+        slot.faceset = std::make_shared<FaceSet>();
+        slot.faceset->material = material;
+        return (int)slots.size() - 1;
+    };
+    for (auto& fs : dst.facesets) {
+        if (find_slot(fs->material) < 0) {
+            slots.push_back({});
+            slots.back().faceset = fs;
+        }
+    }
+    size_t num_dst_slots = slots.size();
+
+    // per proto: (slot, faceset) pairs. merged meshes have at most one faceset per material.
+    std::vector<std::vector<std::pair<int, FaceSet*>>> proto_facesets(proto_records.size());
+    for (size_t pi = 0; pi < proto_records.size(); ++pi) {
+        for (auto& fs : proto_records[pi].merged_mesh.facesets)
+            proto_facesets[pi].push_back({ get_slot(fs->material), fs.get() });
+    }
+    for (auto& slot : slots) {
+        slot.face_offsets.resize_discard(ninstances + 1);
+        slot.index_offsets.resize_discard(ninstances + 1);
+        slot.count_offsets.resize_discard(ninstances + 1);
+        slot.face_offsets[0] = (int)slot.faceset->faces.size();
+        slot.index_offsets[0] = (int)slot.faceset->indices.size();
+        slot.count_offsets[0] = (int)slot.faceset->counts.size();
+    }
+    for (size_t i = 0; i < ninstances; ++i) {
+        for (auto& slot : slots) {
+            slot.face_offsets[i + 1] = slot.face_offsets[i];
+            slot.index_offsets[i + 1] = slot.index_offsets[i];
+            slot.count_offsets[i + 1] = slot.count_offsets[i];
         }
-        dst.points.reserve(npoints);
-        dst.indices.reserve(nindices);
-        dst.counts.reserve(nfaces);
-        dst.normals.reserve(nindices);
-        dst.uvs.reserve(nindices);
-        dst.colors.reserve(nindices);
-        dst.material_ids.reserve(nfaces);
+        for (auto& sf : proto_facesets[proto_indices[i]]) {
+            auto& slot = slots[sf.first];
+            slot.face_offsets[i + 1] += (int)sf.second->faces.size();
+            slot.index_offsets[i + 1] += (int)sf.second->indices.size();
+            slot.count_offsets[i + 1] += (int)sf.second->counts.size();
+        }
+    }
 
-        // do merge
-        for (size_t i = 0; i < ninstances; ++i)
-            dst.merge(proto_records[proto_indices[i]].merged_mesh, matrices[i]);
+    // allocate. existing content of dst is kept and missing attributes are padded.
+    int vertex_end = vertex_offsets[ninstances];
+    int index_begin = index_offsets[0], index_end = index_offsets[ninstances];
+    int face_begin = face_offsets[0], face_end = face_offsets[ninstances];
+    auto expand = [](auto& v, bool enabled, int begin, int end, auto default_value) {
+        if (!enabled)
+            return;
+        if (v.size() < (size_t)begin)
+            v.resize(begin, default_value);
+        v.resize(end); // filled by the fill pass
+    };
+    dst.points.resize(vertex_end);
+    dst.indices.resize(index_end);
+    dst.counts.resize(face_end);
+    expand(dst.normals, has_normals, index_begin, index_end, float3::zero());
+    expand(dst.uvs, has_uvs, index_begin, index_end, float2::zero());
+    expand(dst.colors, has_colors, index_begin, index_end, float4::one());
+    expand(dst.material_ids, has_material_ids, face_begin, face_end, -1);
+    for (auto& slot : slots) {
+        auto& fs = *slot.faceset;
+        fs.faces.resize(slot.face_offsets[ninstances]);
+        fs.indices.resize(slot.index_offsets[ninstances]);
+        fs.counts.resize(slot.count_offsets[ninstances]);
     }
 
-    if (trans != float4x4::identity()) {
-        auto p = dst.points.data() + vertex_offset;
-        auto n = dst.normals.data() + normal_offset;
-        mu::MulPoints(trans, p, p, dst.points.size() - vertex_offset);
-        mu::MulVectors(trans, n, n, dst.normals.size() - normal_offset);
+    // materials
+    for (auto& prec : proto_records) {
+        for (auto* m : prec.merged_mesh.materials)
+            if (std::find(dst.materials.begin(), dst.materials.end(), m) == dst.materials.end())
+                dst.materials.push_back(m);
     }
+    for (size_t si = num_dst_slots; si < slots.size(); ++si)
+        dst.facesets.push_back(slots[si].faceset);
+
+    // remove skinning data for now
+    dst.joints_per_vertex = 0;
+    dst.joint_indices.clear();
+    dst.joint_weights.clear();
+    dst.bind_transform = float4x4::identity();
+    dst.skeleton = nullptr;
+    dst.joints.clear();
+    dst.joint_matrices.clear();
+
+    // fill pass. all destinations are known, so instances are independent.
+    auto* dpoints = dst.points.data();
+    auto* dindices = dst.indices.data();
+    auto* dcounts = dst.counts.data();
+    auto* dnormals = has_normals ? dst.normals.data() : nullptr;
+    auto* duvs = has_uvs ? dst.uvs.data() : nullptr;
+    auto* dcolors = has_colors ? dst.colors.data() : nullptr;
+    auto* dmids = has_material_ids ? dst.material_ids.data() : nullptr;
+    struct faceset_dst { int* faces; int* indices; int* counts; };
+    std::vector<faceset_dst> fsdst;
+    for (auto& slot : slots)
+        fsdst.push_back({ slot.faceset->faces.data(), slot.faceset->indices.data(), slot.faceset->counts.data() });
+
+    auto copy_or_fill = [](auto* d, const auto& src, size_t n, auto default_value) {
+        if (src.size() == n)
+            std::copy(src.cdata(), src.cdata() + n, d);
+        else
+            std::fill(d, d + n, default_value);
+    };
+
+    bool has_trans = trans != float4x4::identity();
+    mu::parallel_for(0, (int)ninstances, 16, [&](int i) {
+        auto& mesh = proto_records[proto_indices[i]].merged_mesh;
+        float4x4 m = has_trans ? matrices[i] * trans : matrices[i];
+        int vo = vertex_offsets[i];
+        int io = index_offsets[i];
+        int fo = face_offsets[i];
+        size_t nindices = mesh.indices.size();
+        size_t nfaces = mesh.counts.size();
+
+        mu::MulPoints(m, mesh.points.cdata(), dpoints + vo, mesh.points.size());
+        std::copy(mesh.counts.cdata(), mesh.counts.cdata() + nfaces, dcounts + fo);
+        {
+            auto* s = mesh.indices.cdata();
+            auto* d = dindices + io;
+            for (size_t ii = 0; ii < nindices; ++ii)
+                d[ii] = s[ii] + vo;
+        }
+        if (dnormals) {
+            if (mesh.normals.size() == nindices)
+                mu::MulVectors(m, mesh.normals.cdata(), dnormals + io, nindices);
+            else
+                std::fill(dnormals + io, dnormals + io + nindices, float3::zero());
+        }
+        if (duvs)
+            copy_or_fill(duvs + io, mesh.uvs, nindices, float2::zero());
+        if (dcolors)
+            copy_or_fill(dcolors + io, mesh.colors, nindices, float4::one());
+        if (dmids)
+            copy_or_fill(dmids + fo, mesh.material_ids, nfaces, -1);
+
+        for (auto& sf : proto_facesets[proto_indices[i]]) {
+            auto& slot = slots[sf.first];
+            auto& fd = fsdst[sf.first];
+            const auto& sfs = *sf.second;
+
+            auto* faces = fd.faces + slot.face_offsets[i];
+            for (size_t fi = 0; fi < sfs.faces.size(); ++fi)
+                faces[fi] = sfs.faces[fi] + fo;
+            auto* indices = fd.indices + slot.index_offsets[i];
+            for (size_t ii = 0; ii < sfs.indices.size(); ++ii)
+                indices[ii] = sfs.indices[ii] + io;
+            std::copy(sfs.counts.cdata(), sfs.counts.cdata() + sfs.counts.size(), fd.counts + slot.count_offsets[i]);
+        }
+    });
 }
 
 
@@ -1178,8 +1953,16 @@ bool MaterialNode::valid() const
 sgRegisterType(Scene);
 
 static thread_local Scene* g_current_scene;
+static std::atomic<uint64_t> g_scene_generation{ 0 };
 static const char sgMagic[] = "sg" sgVersionString;
 
+// hash of path -> node. built lazily by findNodeByPath() and extended as nodes are registered.
+struct NodePathIndex
+{
+    std::unordered_multimap<size_t, Node*> table;
+    size_t num_indexed = 0;
+};
+
 
 Scene* Scene::getCurrent()
 {
@@ -1195,6 +1978,9 @@ void Scene::serialize(serializer& s) const
     // magic code
     sg::write_array(s, sgMagic, 6);
 
+    // most of objects are nodes and their sub-objects
+    s.reserve(nodes.size() * 2);
+
     // add pointer record to make this resolvable
     hptr handle = s.getHandle(this);
     sg::write(s, handle);
@@ -1214,23 +2000,36 @@ bool Scene::deserialize(deserializer& d)
     sg::read(d, handle);
     d.setPointer(handle, this);
 
-    EachMember(sgRead)
+    path_index.reset();
+    transform_nodes.clear();
+    transform_hierarchy.clear();
+    transform_source_size = 0;
+    generation = ++g_scene_generation;
+    dirty_nodes.clear();
+    {
+        node_arena_scope scope(node_arena);
+        EachMember(sgRead)
+    }
 
     if (impl) {
         for (auto& n : nodes)
             impl->wrapNode(n.get());
     }
+    markAllDirty();
     return true;
 }
 #undef EachMember
 
 Scene::Scene()
+    : node_arena(new NodeArena())
+    , generation(++g_scene_generation)
 {
 }
 
 Scene::~Scene()
 {
     close();
+    node_arena->release();
 }
 
 bool Scene::open(const char* path_)
@@ -1268,14 +2067,27 @@ void Scene::close()
     path.clear();
     root_node = nullptr;
     nodes.clear();
+    dirty_nodes.clear();
+    path_index.reset();
+    transform_nodes.clear();
+    transform_hierarchy.clear();
+    transform_source_size = 0;
+    generation = ++g_scene_generation;
+    node_arena->reset();
 }
 
 void Scene::read(double time)
 {
     g_current_scene = this;
     time_current = time;
-    if (impl)
+    if (sample_cache && sample_cache->restore(*this, time))
+        return;
+    if (impl) {
         impl->read();
+        markAllDirty();
+    }
+    if (sample_cache)
+        sample_cache->store(*this, time);
 }
 
 void Scene::write(double time)
@@ -1291,6 +2103,10 @@ Node* Scene::findNodeByID(uint32_t id)
     if (id == 0)
         return nullptr;
 
+    // id is the index in nodes unless nodes are modified outside registerNode()
+    if (id < nodes.size() && nodes[id]->id == id)
+        return nodes[id].get();
+
     auto it = std::find_if(nodes.begin(), nodes.end(), [id](NodePtr& n) { return n->id == id; });
     return it == nodes.end() ? nullptr : it->get();
 }
@@ -1300,8 +2116,92 @@ Node* Scene::findNodeByPath(const std::string& npath)
     if (npath.empty())
         return nullptr;
 
-    auto it = std::find_if(nodes.begin(), nodes.end(), [&npath](NodePtr& n) { return n->path == npath; });
-    return it == nodes.end() ? nullptr : it->get();
+    if (!path_index)
+        path_index.reset(new NodePathIndex());
+    auto& index = *path_index;
+    if (index.num_indexed > nodes.size()) {
+        index.table.clear();
+        index.num_indexed = 0;
+    }
+
+    // first node wins if paths are duplicated
+    auto find = [&index](size_t hash, const std::string& p) -> Node* {
+        auto range = index.table.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second->path == p)
+                return it->second;
+        }
+        return nullptr;
+    };
+    std::hash<std::string> hasher;
+    for (; index.num_indexed < nodes.size(); ++index.num_indexed) {
+        Node* n = nodes[index.num_indexed].get();
+        if (n->removed)
+            continue;
+        size_t hash = hasher(n->path);
+        if (!find(hash, n->path))
+            index.table.emplace(hash, n);
+    }
+    return find(hasher(npath), npath);
+}
+
+void Scene::updateGlobalMatrices()
+{
+    // rebuild the hierarchy when nodes are added or invalidateNodeIndex() is called.
+    // nodes are never erased from nodes except by close().
+    if (transform_source_size != nodes.size()) {
+        transform_source_size = nodes.size();
+        auto prev_nodes = std::move(transform_nodes);
+        auto prev = std::move(transform_hierarchy);
+        transform_nodes.clear();
+        eachNode<XformNode>([this](XformNode* n) {
+            if (!n->removed)
+                transform_nodes.push_back(n);
+        });
+
+        std::unordered_map<XformNode*, int> indices, prev_indices;
+        int n = (int)transform_nodes.size();
+        for (int i = 0; i < n; ++i)
+            indices[transform_nodes[i]] = i;
+        for (int i = 0; i < (int)prev.size(); ++i)
+            prev_indices[prev_nodes[i]] = i;
+
+        RawVector<int> parents;
+        parents.resize(n);
+        for (int i = 0; i < n; ++i) {
+            auto it = indices.find(transform_nodes[i]->parent_xform);
+            parents[i] = it != indices.end() ? it->second : -1;
+        }
+        transform_hierarchy.build(parents.cdata(), n);
+
+        // nodes that keep their parent carry over their state, so that the rebuild doesn't overwrite global matrices
+        // set directly. new and reparented nodes are recomputed.
+        std::vector<int> recompute;
+        for (int i = 0; i < n; ++i) {
+            auto it = prev_indices.find(transform_nodes[i]);
+            if (it != prev_indices.end()) {
+                int pi = it->second;
+                int pp = prev.getParent(pi);
+                if ((pp >= 0 ? prev_nodes[pp] : nullptr) == (parents[i] >= 0 ? transform_nodes[parents[i]] : nullptr)) {
+                    transform_hierarchy.setLocal(i, prev.getLocal(pi));
+                    transform_hierarchy.setGlobal(i, prev.getGlobal(pi));
+                    continue;
+                }
+            }
+            recompute.push_back(i);
+        }
+        transform_hierarchy.clearDirty();
+        for (int i : recompute)
+            transform_hierarchy.markDirty(i);
+    }
+
+    UpdateTransformHierarchy(transform_hierarchy, float4x4::identity(),
+        [this](int i) -> const float4x4& { return transform_nodes[i]->local_matrix; },
+        [this](int i) -> const float4x4& { return transform_nodes[i]->global_matrix; },
+        [this](int i, const float4x4& v) {
+            transform_nodes[i]->global_matrix = v;
+            transform_nodes[i]->markDirty(DirtyFlag::Transform);
+        });
 }
 
 bool Scene::isNodeTypeSupported(Node::Type type) const
@@ -1314,6 +2214,7 @@ bool Scene::isNodeTypeSupported(Node::Type type) const
 Node* Scene::createNode(Node* parent, const char* name, Node::Type type)
 {
     g_current_scene = this;
+    node_arena_scope scope(node_arena);
 
     Node* ret = nullptr;
     if (impl) {
@@ -1326,6 +2227,66 @@ Node* Scene::createNode(Node* parent, const char* name, Node::Type type)
     return ret;
 }
 
+void Scene::renameNode(Node* n, const char* name)
+{
+    if (!n || !name || n == root_node)
+        return;
+
+    n->path = MakeNodePath(n->parent, name);
+    n->eachChildR([](Node* c) { c->path = MakeNodePath(c->parent, c->getName().c_str()); });
+    invalidateNodeIndex();
+}
+
+void Scene::reparentNode(Node* n, Node* parent)
+{
+    if (!n || n == root_node || n->parent == parent)
+        return;
+    for (Node* p = parent; p; p = p->parent) {
+        if (p == n)
+            return; // parent is a descendant of n
+    }
+
+    if (n->parent)
+        erase_if(n->parent->children, [n](Node* c) { return c == n; });
+    n->parent = parent;
+    if (parent)
+        parent->children.push_back(n);
+
+    auto update = [](Node* c) {
+        c->path = MakeNodePath(c->parent, c->getName().c_str());
+        if (auto xform = dynamic_cast<XformNode*>(c))
+            xform->parent_xform = xform->findParent<XformNode>();
+        c->markDirty(DirtyFlag::Transform);
+    };
+    update(n);
+    n->eachChildR(update);
+    invalidateNodeIndex();
+}
+
+void Scene::removeNode(Node* n)
+{
+    if (!n || n->removed || n == root_node)
+        return;
+
+    if (n->parent)
+        erase_if(n->parent->children, [n](Node* c) { return c == n; });
+    n->parent = nullptr;
+
+    auto remove = [](Node* c) {
+        c->removed = true;
+        c->markDirty(DirtyFlag::All);
+    };
+    remove(n);
+    n->eachChildR(remove);
+    invalidateNodeIndex();
+}
+
+void Scene::invalidateNodeIndex()
+{
+    path_index.reset();
+    transform_source_size = ~size_t(0);
+}
+
 double Scene::frameToTime(int frame)
 {
     if (impl)
@@ -1341,9 +2302,36 @@ void Scene::registerNode(Node* n)
         nodes.push_back(NodePtr(n));
         if (n->getType() == Node::Type::Root)
             root_node = static_cast<RootNode*>(n);
+        markDirty(n, DirtyFlag::All);
     }
 }
 
+void Scene::markDirty(Node* n, DirtyFlag v)
+{
+    mu::spin_mutex::lock_t lock(dirty_mutex);
+    if (n->dirty_flags == DirtyFlag::None)
+        dirty_nodes.push_back(n);
+    n->dirty_flags = n->dirty_flags | v;
+}
+
+void Scene::markAllDirty(DirtyFlag v)
+{
+    mu::spin_mutex::lock_t lock(dirty_mutex);
+    for (auto& n : nodes) {
+        if (n->dirty_flags == DirtyFlag::None)
+            dirty_nodes.push_back(n.get());
+        n->dirty_flags = n->dirty_flags | v;
+    }
+}
+
+void Scene::clearDirty()
+{
+    mu::spin_mutex::lock_t lock(dirty_mutex);
+    for (auto n : dirty_nodes)
+        n->dirty_flags = DirtyFlag::None;
+    dirty_nodes.clear();
+}
+
 Node* Scene::createNodeImpl(Node* parent, const char* name, Node::Type type)
 {
     Node* ret = nullptr;
@@ -28,6 +28,9 @@ class MaterialNode;
 
 class SceneInterface;
 class Scene;
+class NodeArena;
+struct NodePathIndex;
+class SampleCache;
 
 extern const double default_time;
 bool IsDefaultTime(double t);
@@ -46,6 +49,23 @@ struct ConvertOptions
 };
 
 
+// what is changed on a node since the last Scene::clearDirty().
+// consumers of the scene (GlimmerSceneSync etc) visit only dirty nodes and push only dirty parts.
+enum class DirtyFlag : uint32_t
+{
+    None        = 0x00,
+    Transform   = 0x01, // local_matrix, global_matrix, visibility
+    Points      = 0x02, // vertex attributes
+    Topology    = 0x04, // counts, indices, facesets, skinning & blendshape setup, instances
+    Joints      = 0x08, // joint matrices
+    Blendshapes = 0x10, // blendshape weights
+    Material    = 0x20, // material parameters
+    All         = 0xffffffff,
+};
+inline DirtyFlag operator|(DirtyFlag a, DirtyFlag b) { return DirtyFlag((uint32_t)a | (uint32_t)b); }
+inline DirtyFlag operator&(DirtyFlag a, DirtyFlag b) { return DirtyFlag((uint32_t)a & (uint32_t)b); }
+
+
 class Node
 {
 public:
@@ -67,6 +87,12 @@ public:
     Node();
     Node(Node* parent, const char *name);
     virtual ~Node();
+
+    // nodes created by Scene::createNode() or deserialized by Scene are placed in the scene's arena.
+    // other allocations go to the heap as usual.
+    static void* operator new(size_t size);
+    static void operator delete(void* p);
+
     virtual Type getType() const;
     virtual void serialize(serializer& s) const;
     virtual void deserialize(deserializer& d);
@@ -76,6 +102,11 @@ public:
     std::string getDisplayName() const;
     const std::string& getPath() const;
 
+    // nodes that modify their own states mark themselves. code that modifies members directly should call this.
+    // thread-safe.
+    void markDirty(DirtyFlag v = DirtyFlag::All);
+    bool isDirty(DirtyFlag v) const;
+
     template<class NodeT>
     NodeT* cast() { return dynamic_cast<NodeT*>(this); }
 
@@ -119,6 +150,7 @@ public:
     void* impl = nullptr;
     void* userdata = nullptr;
     bool removed = false;
+    DirtyFlag dirty_flags = DirtyFlag::None;
 };
 sgSerializable(Node);
 sgDeclPtr(Node);
@@ -136,6 +168,50 @@ public:
 sgSerializable(RootNode);
 
 
+// flattened transform hierarchy. entries are sorted by depth so that parents always precede their children
+// and each depth is a contiguous range of slots that can be updated in parallel.
+// only entries whose local matrix (or one of ancestors') is changed are recomputed by update().
+class TransformHierarchy
+{
+public:
+    // parents[i]: index of the parent of i. -1 if i is a root.
+    void build(const int parents[], size_t num);
+    void clear();
+    size_t size() const;
+    // true if built with the same parents. callers use this to detect reparenting.
+    bool isBuiltWith(const int parents[], size_t num) const;
+    int getParent(int i) const;
+
+    void setBase(const float4x4& v);
+    // marks i dirty only if v differs from the current local matrix
+    void setLocal(int i, const float4x4& v);
+    // overrides the global matrix of i without marking it dirty. descendants that are recomputed use it.
+    void setGlobal(int i, const float4x4& v);
+    void markDirty(int i);
+    void markAllDirty();
+    void clearDirty();
+
+    // propagate dirty flags from top to down and recompute global matrices of dirty entries
+    void update();
+
+    const float4x4& getLocal(int i) const;
+    const float4x4& getGlobal(int i) const;
+    // true if i was recomputed by the last update()
+    bool isUpdated(int i) const;
+
+private:
+    // slot 0 holds the base matrix. entries are in slot 1 and after.
+    RawVector<int> m_source;        // index -> parent index, as given to build()
+    RawVector<int> m_slots;         // index -> slot
+    RawVector<int> m_parents;       // slot -> parent slot (0 for roots)
+    RawVector<int> m_levels;        // begin slot of each depth + end
+    RawVector<float4x4> m_local;    // per slot
+    RawVector<float4x4> m_global;   // per slot
+    RawVector<uint8_t> m_dirty;     // per slot. pending changes
+    RawVector<uint8_t> m_updated;   // per slot. result of the last update()
+};
+
+
 class XformNode : public Node
 {
 using super = Node;
@@ -194,7 +270,10 @@ public:
     void makeMesh(MeshNode& dst, const MeshNode& base, float weight = 1.0f);
     BlendshapeTarget* addTarget(float weight);
     BlendshapeTarget* addTarget(const MeshNode& target, const MeshNode& base, float weight = 1.0f);
-    void apply(float3* dst_points, float3* dst_normals, float weight);
+    // resolve weight to the targets to blend (up to 2) and their weights. returns the number of targets.
+    int getTargets(float weight, BlendshapeTarget* (&dst_targets)[2], float (&dst_weights)[2]) const;
+    // dst_points / dst_normals must have the same layout as base.points / base.normals
+    void apply(const MeshNode& base, float3* dst_points, float3* dst_normals, float weight);
 
 
 public:
@@ -272,6 +351,9 @@ public:
 
     void clear();
     Joint* addJoint(const std::string& path);
+    // only joints whose local matrix (or one of ancestors') is changed since the last call are recomputed.
+    // global matrices set directly since the last call are kept unless their local matrices are changed too.
+    // the hierarchy is rebuilt when joints are added or reparented.
     void updateGlobalMatrices(const float4x4& base);
 
     Joint* findJointByPath(const std::string& path);
@@ -279,6 +361,9 @@ public:
 public:
     // serializable
     std::vector<JointPtr> joints;
+
+    // non-serializable
+    TransformHierarchy transform_hierarchy;
 };
 sgSerializable(SkeletonNode);
 
@@ -331,6 +416,7 @@ public:
     void clear();
     void merge(const MeshNode& other, const float4x4& trans = float4x4::identity());
     void bake(MeshNode& dst, const float4x4& trans = float4x4::identity());
+    void applyBlendshapes(float3* dst_points, float3* dst_normals);
     void applySkinning(float3* dst_points, float3* dst_normals);
     void validate();
 
@@ -371,6 +457,8 @@ public:
     // non-serializable
     RawVector<float> blendshape_weights;
     RawVector<float4x4> joint_matrices;
+    RawVector<float4x4> joint_bindposes;     // to detect changes of bindposes
+    RawVector<float4x4> joint_bindposes_inv; // cached invert(bindpose)
 
 };
 sgSerializable(MeshNode);
@@ -518,6 +606,7 @@ public:
     virtual double frameToTime(int frame) = 0;
 };
 sgDeclPtr(SceneInterface);
+sgDeclPtr(SampleCache);
 
 class Scene
 {
@@ -533,13 +622,27 @@ public:
     bool create(const char* path);
     bool save();
     void close();
+    // if sample_cache is set, samples in the cache are restored instead of reading through impl
     void read(double time);
     void write(double time);
 
     Node* findNodeByID(uint32_t id);
     Node* findNodeByPath(const std::string& path);
+    // recompute global_matrix of XformNodes from local_matrix. only changed subtrees are updated.
+    // opt-in for code that edits local matrices: importers set global_matrix themselves and nothing calls this implicitly.
+    // global matrices set directly (e.g. setGlobalTRS()) are kept unless the local matrix of the node or one of its
+    // ancestors is changed since the last call. reparented and new nodes are recomputed.
+    void updateGlobalMatrices();
     bool isNodeTypeSupported(Node::Type type) const;
     Node* createNode(Node* parent, const char* name, Node::Type type);
+    // these update paths of the descendants, path lookup and the transform hierarchy.
+    // code that modifies path or parent of nodes directly must call invalidateNodeIndex().
+    void renameNode(Node* n, const char* name);
+    void reparentNode(Node* n, Node* parent);
+    // detaches n and marks it and its descendants removed. removed nodes stay in nodes until close()
+    // so that pointers held by others remain valid, but are not found by findNodeByPath().
+    void removeNode(Node* n);
+    void invalidateNodeIndex();
     double frameToTime(int frame);
 
     template<class NodeT>
@@ -589,6 +692,18 @@ public:
         return ret;
     }
 
+    void markDirty(Node* n, DirtyFlag v);
+    void markAllDirty(DirtyFlag v = DirtyFlag::All);
+    // resets dirty_flags of dirty nodes
+    void clearDirty();
+
+    template<class Body>
+    void eachDirtyNode(const Body& body)
+    {
+        for (auto n : dirty_nodes)
+            body(n);
+    }
+
     // internal
     virtual void registerNode(Node* n);
     virtual Node* createNodeImpl(Node* parent, const char* name, Node::Type type);
@@ -607,6 +722,15 @@ public:
 
     // non-serializable
     SceneInterfacePtr impl;
+    SampleCachePtr sample_cache;
+    NodeArena* node_arena = nullptr;
+    std::unique_ptr<NodePathIndex> path_index;
+    std::vector<XformNode*> transform_nodes;
+    TransformHierarchy transform_hierarchy;
+    size_t transform_source_size = 0; // size of nodes when transform_hierarchy was built
+    uint64_t generation = 0;          // unique among scenes. renewed when all nodes are replaced (close(), deserialize())
+    std::vector<Node*> dirty_nodes;
+    mu::spin_mutex dirty_mutex;
 };
 sgSerializable(Scene);
 sgDeclPtr(Scene);
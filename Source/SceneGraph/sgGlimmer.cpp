@@ -0,0 +1,1032 @@
+#include "pch.h"
+#include "sgGlimmer.h"
+
+namespace sg {
+
+struct flattened_mesh
+{
+    RawVector<float3> points;
+    RawVector<float3> normals;
+    RawVector<float2> uvs;
+    RawVector<int> indices;
+    RawVector<int> index_map; // flattened vertex -> index in the source mesh
+
+    void clear()
+    {
+        points.clear();
+        normals.clear();
+        uvs.clear();
+        indices.clear();
+        index_map.clear();
+    }
+};
+
+// expand vertex attributes to per-index and triangulate faces as fans
+static void FlattenFaces(const MeshNode& src, const RawVector<int>& offsets, const int* faces, size_t nfaces, flattened_mesh& dst)
+{
+    size_t npoints = src.points.size();
+    size_t nindices = src.indices.size();
+    auto* counts = src.counts.cdata();
+    auto* indices = src.indices.cdata();
+    auto* points = src.points.cdata();
+    auto* normals = src.normals.empty() ? nullptr : src.normals.cdata();
+    auto* uvs = src.uvs.empty() ? nullptr : src.uvs.cdata();
+    bool per_index_normals = src.normals.size() == nindices;
+    bool per_index_uvs = src.uvs.size() == nindices;
+    if (normals && !per_index_normals && src.normals.size() != npoints)
+        normals = nullptr;
+    if (uvs && !per_index_uvs && src.uvs.size() != npoints)
+        uvs = nullptr;
+
+    dst.clear();
+    for (size_t i = 0; i < nfaces; ++i) {
+        int f = faces ? faces[i] : (int)i;
+        int count = counts[f];
+        int offset = offsets[f];
+        if (count < 3)
+            continue;
+
+        int base = (int)dst.points.size();
+        for (int ci = 0; ci < count; ++ci) {
+            int ii = offset + ci;
+            int vi = indices[ii];
+            dst.index_map.push_back(ii);
+            dst.points.push_back(points[vi]);
+            if (normals)
+                dst.normals.push_back(normals[per_index_normals ? ii : vi]);
+            if (uvs)
+                dst.uvs.push_back(uvs[per_index_uvs ? ii : vi]);
+        }
+        for (int ci = 1; ci < count - 1; ++ci) {
+            dst.indices.push_back(base);
+            dst.indices.push_back(base + ci);
+            dst.indices.push_back(base + ci + 1);
+        }
+    }
+}
+
+// called for each submesh after its vertices are set
+using submesh_callback = std::function<void(size_t, const flattened_mesh&)>;
+
+static void ToGlimmerMeshesImpl(gpt::IContext* ctx, const MeshNode& src, std::vector<GlimmerSubmesh>& dst, const submesh_callback& cb)
+{
+    if (src.counts.empty() || src.points.empty()) {
+        dst.clear();
+        return;
+    }
+
+    RawVector<int> offsets;
+    int num_indices, num_indices_triangulated;
+    mu::CountIndices(src.counts, offsets, num_indices, num_indices_triangulated);
+
+    // materials of submeshes. meshes without facesets become one submesh without material.
+    std::vector<MaterialNode*> materials;
+    if (src.facesets.empty())
+        materials.push_back(nullptr);
+    else
+        for (auto& fs : src.facesets)
+            materials.push_back(fs->material);
+
+    bool reuse = dst.size() == materials.size();
+    for (size_t i = 0; reuse && i < materials.size(); ++i)
+        reuse = dst[i].material == materials[i] && dst[i].mesh;
+    if (!reuse) {
+        dst.clear();
+        dst.resize(materials.size());
+        for (size_t i = 0; i < materials.size(); ++i) {
+            dst[i].material = materials[i];
+            dst[i].mesh = ctx->createMesh();
+            dst[i].mesh->setName(src.getName().c_str());
+        }
+    }
+
+    flattened_mesh tmp;
+    for (size_t i = 0; i < dst.size(); ++i) {
+        if (src.facesets.empty()) {
+            FlattenFaces(src, offsets, nullptr, src.counts.size(), tmp);
+        }
+        else {
+            auto& faces = src.facesets[i]->faces;
+            FlattenFaces(src, offsets, faces.cdata(), faces.size(), tmp);
+        }
+
+        auto& mesh = dst[i].mesh;
+        mesh->setPoints(tmp.points.cdata(), tmp.points.size());
+        mesh->setNormals(tmp.normals.cdata(), tmp.normals.size());
+        mesh->setUV(tmp.uvs.cdata(), tmp.uvs.size());
+        mesh->setIndices(tmp.indices.cdata(), tmp.indices.size());
+        if (cb)
+            cb(i, tmp);
+    }
+}
+
+void ToGlimmerMeshes(gpt::IContext* ctx, const MeshNode& src, std::vector<GlimmerSubmesh>& dst)
+{
+    ToGlimmerMeshesImpl(ctx, src, dst, nullptr);
+}
+
+// GlimmerTextureLoader
+
+static gpt::Format ToGlimmerFormat(mu::ImageFormat f)
+{
+    switch (f) {
+    case mu::ImageFormat::Ru8: return gpt::Format::Ru8;
+    case mu::ImageFormat::RGu8: return gpt::Format::RGu8;
+    case mu::ImageFormat::RGBAu8: return gpt::Format::RGBAu8;
+    case mu::ImageFormat::Rf16: return gpt::Format::Rf16;
+    case mu::ImageFormat::RGf16: return gpt::Format::RGf16;
+    case mu::ImageFormat::RGBAf16: return gpt::Format::RGBAf16;
+    case mu::ImageFormat::Rf32: return gpt::Format::Rf32;
+    case mu::ImageFormat::RGf32: return gpt::Format::RGf32;
+    case mu::ImageFormat::RGBAf32: return gpt::Format::RGBAf32;
+    default: return gpt::Format::Unknown;
+    }
+}
+
+// Glimmer has no 3 channel formats
+static bool ToGlimmerImage(mu::Image& img)
+{
+    switch (img.getFormat()) {
+    case mu::ImageFormat::RGBu8: img = img.convert(mu::ImageFormat::RGBAu8); break;
+    case mu::ImageFormat::RGBf16: img = img.convert(mu::ImageFormat::RGBAf16); break;
+    case mu::ImageFormat::RGBf32: img = img.convert(mu::ImageFormat::RGBAf32); break;
+    default: break;
+    }
+    return !img.empty() && ToGlimmerFormat(img.getFormat()) != gpt::Format::Unknown;
+}
+
+// img must have passed ToGlimmerImage(). converts it to the source format of the returned block format.
+// returns Unknown if the size is not multiples of 4, as Glimmer stores such textures in the source format.
+static mu::BlockFormat ToBlockCompressedImage(mu::Image& img)
+{
+    auto ret = mu::BlockFormat::BC6H;
+    switch (img.getFormat()) {
+    case mu::ImageFormat::Ru8: ret = mu::BlockFormat::BC4; break;
+    case mu::ImageFormat::RGu8: ret = mu::BlockFormat::BC5; break;
+    case mu::ImageFormat::RGBAu8: ret = mu::BlockFormat::BC7; break;
+    case mu::ImageFormat::RGBAf16: break;
+    default: img = img.convert(mu::ImageFormat::RGBAf16); break;
+    }
+    auto size = img.getSize();
+    return size.x % 4 == 0 && size.y % 4 == 0 ? ret : mu::BlockFormat::Unknown;
+}
+
+static gpt::Format ToGlimmerFormat(mu::BlockFormat f)
+{
+    switch (f) {
+    case mu::BlockFormat::BC1: return gpt::Format::BC1;
+    case mu::BlockFormat::BC4: return gpt::Format::BC4;
+    case mu::BlockFormat::BC5: return gpt::Format::BC5;
+    case mu::BlockFormat::BC6H: return gpt::Format::BC6H;
+    case mu::BlockFormat::BC7: return gpt::Format::BC7;
+    default: return gpt::Format::Unknown;
+    }
+}
+
+// all levels in the layout ITexture::uploadMipChain() takes. same as what ITexture::upload() makes on the render thread.
+static void BuildMipChain(const mu::Image& img, mu::BlockFormat bf, RawVector<char>& dst)
+{
+    auto filter = gptGetGlobals()->isKaiserMipFilterEnabled() ? mu::MipFilter::Kaiser : mu::MipFilter::Box;
+    auto size = img.getSize();
+    int num_levels = mu::GetMipCount(size.x, size.y);
+
+    RawVector<char> chain;
+    chain.resize_discard(mu::GetMipChainSize(size.x, size.y, img.getFormat(), num_levels));
+    mu::GenerateMipChain(chain.data(), img.data(), size.x, size.y, img.getFormat(), num_levels, filter);
+    if (bf == mu::BlockFormat::Unknown) {
+        dst.swap(chain);
+    }
+    else {
+        dst.resize_discard(mu::GetBlockCompressedMipChainSize(size.x, size.y, bf, num_levels));
+        mu::EncodeMipChain(dst.data(), chain.cdata(), size.x, size.y, bf, num_levels);
+    }
+}
+
+struct GlimmerTextureLoader::impl
+{
+    enum class State
+    {
+        Queued,
+        Decoded,
+        Ready,
+        Failed,
+        Canceled,
+    };
+
+    struct record
+    {
+        std::string path;
+        gpt::ITexturePtr fallback;
+        gpt::ITexturePtr texture; // valid when Ready
+        RawVector<char> mips;     // valid when Decoded. released on upload
+        mu::int2 size{};
+        gpt::Format format = gpt::Format::Unknown;
+        std::vector<Callback> callbacks;
+        mu::ThreadPool::TaskID task = 0;
+        int priority = 0;
+        State state = State::Queued;
+    };
+    using record_ptr = std::shared_ptr<record>;
+
+    gpt::IContextPtr ctx;
+    std::map<std::string, record_ptr> records;
+    std::map<uint64_t, gpt::ITexturePtr> fallbacks;
+    std::vector<record_ptr> decoded;
+    mutable std::mutex mutex;
+    std::atomic_bool block_compression{ false };
+    mu::ThreadPool pool; // must be the last to stop workers before other members are destroyed
+
+    impl(gpt::IContext* c, int num_threads) : ctx(c), pool(num_threads) {}
+    gpt::ITexture* getFallback(const float4& color);
+    void enqueue(const record_ptr& rec);
+    void decode(const record_ptr& rec);
+};
+
+gpt::ITexture* GlimmerTextureLoader::impl::getFallback(const float4& color)
+{
+    auto& dst = fallbacks[mu::Hash64(&color, sizeof(color))];
+    if (!dst) {
+        dst = ctx->createTexture(1, 1, gpt::Format::RGBAf32);
+        dst->upload(&color);
+    }
+    return dst;
+}
+
+void GlimmerTextureLoader::impl::enqueue(const record_ptr& rec)
+{
+    rec->state = State::Queued;
+    rec->task = pool.enqueue([this, rec]() { decode(rec); }, rec->priority);
+}
+
+void GlimmerTextureLoader::impl::decode(const record_ptr& rec)
+{
+    // mips and block compression are done here so that update() only copies the result
+    mu::Image img;
+    bool ok = img.read(rec->path.c_str()) && ToGlimmerImage(img);
+    auto format = gpt::Format::Unknown;
+    RawVector<char> mips;
+    if (ok) {
+        auto bf = block_compression ? ToBlockCompressedImage(img) : mu::BlockFormat::Unknown;
+        format = bf != mu::BlockFormat::Unknown ? ToGlimmerFormat(bf) : ToGlimmerFormat(img.getFormat());
+        BuildMipChain(img, bf, mips);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (rec->state != State::Queued)
+        return;
+    if (ok) {
+        rec->mips.swap(mips);
+        rec->size = img.getSize();
+        rec->format = format;
+        rec->state = State::Decoded;
+        decoded.push_back(rec);
+    }
+    else {
+        rec->state = State::Failed;
+        rec->callbacks.clear();
+    }
+}
+
+GlimmerTextureLoader::GlimmerTextureLoader(gpt::IContext* ctx, int num_threads)
+    : m_impl(new impl(ctx, num_threads))
+{
+}
+
+GlimmerTextureLoader::~GlimmerTextureLoader()
+{
+}
+
+gpt::ITexture* GlimmerTextureLoader::getTexture(const Texture& src, int priority, const Callback& on_loaded)
+{
+    if (!src)
+        return nullptr;
+
+    auto& m = *m_impl;
+    std::unique_lock<std::mutex> lock(m.mutex);
+    auto& rec = m.records[src.file_path];
+    if (!rec) {
+        rec = std::make_shared<impl::record>();
+        rec->path = src.file_path;
+        rec->fallback = m.getFallback(src.fallback);
+        rec->priority = priority;
+        m.enqueue(rec);
+    }
+
+    switch (rec->state) {
+    case impl::State::Ready:
+        return rec->texture;
+    case impl::State::Canceled:
+        rec->priority = priority;
+        m.enqueue(rec);
+        break;
+    case impl::State::Queued:
+        if (priority > rec->priority) {
+            rec->priority = priority;
+            m.pool.setPriority(rec->task, priority);
+        }
+        break;
+    default:
+        break;
+    }
+    if (on_loaded && rec->state != impl::State::Failed)
+        rec->callbacks.push_back(on_loaded);
+    return rec->fallback;
+}
+
+void GlimmerTextureLoader::enableBlockCompression(bool v)
+{
+    m_impl->block_compression = v;
+}
+
+int GlimmerTextureLoader::update()
+{
+    auto& m = *m_impl;
+    std::vector<impl::record_ptr> decoded;
+    {
+        std::unique_lock<std::mutex> lock(m.mutex);
+        decoded.swap(m.decoded);
+    }
+
+    int ret = 0;
+    for (auto& rec : decoded) {
+        // records in decoded are not touched by workers any more
+        rec->texture = m.ctx->createTexture(rec->size.x, rec->size.y, rec->format);
+        rec->texture->uploadMipChain(rec->mips.cdata());
+        rec->mips.clear();
+        rec->mips.shrink_to_fit();
+
+        std::vector<Callback> callbacks;
+        {
+            std::unique_lock<std::mutex> lock(m.mutex);
+            rec->state = impl::State::Ready;
+            callbacks.swap(rec->callbacks);
+        }
+        for (auto& cb : callbacks)
+            cb(rec->fallback, rec->texture);
+        ++ret;
+    }
+    return ret;
+}
+
+void GlimmerTextureLoader::wait()
+{
+    m_impl->pool.wait();
+    update();
+}
+
+void GlimmerTextureLoader::cancel(const std::string& path)
+{
+    auto& m = *m_impl;
+    std::unique_lock<std::mutex> lock(m.mutex);
+    auto it = m.records.find(path);
+    if (it == m.records.end())
+        return;
+    auto& rec = it->second;
+    if (rec->state == impl::State::Queued && m.pool.cancel(rec->task)) {
+        rec->state = impl::State::Canceled;
+        rec->callbacks.clear();
+    }
+}
+
+void GlimmerTextureLoader::cancelAll()
+{
+    auto& m = *m_impl;
+    std::unique_lock<std::mutex> lock(m.mutex);
+    for (auto& kvp : m.records) {
+        auto& rec = kvp.second;
+        if (rec->state == impl::State::Queued && m.pool.cancel(rec->task)) {
+            rec->state = impl::State::Canceled;
+            rec->callbacks.clear();
+        }
+    }
+}
+
+void GlimmerTextureLoader::clear()
+{
+    auto& m = *m_impl;
+    m.pool.cancelAll();
+    m.pool.wait();
+
+    std::unique_lock<std::mutex> lock(m.mutex);
+    m.records.clear();
+    m.decoded.clear();
+    m.fallbacks.clear();
+}
+
+size_t GlimmerTextureLoader::getPendingCount() const
+{
+    auto& m = *m_impl;
+    std::unique_lock<std::mutex> lock(m.mutex);
+    size_t ret = 0;
+    for (auto& kvp : m.records) {
+        auto state = kvp.second->state;
+        if (state == impl::State::Queued || state == impl::State::Decoded)
+            ++ret;
+    }
+    return ret;
+}
+
+
+// set a map of dst to the fallback of src first, and swap it for the full image when loaded unless it is changed meanwhile.
+static void SetupGlimmerMap(gpt::IMaterial& dst, const TexturePtr& src, GlimmerTextureLoader* loader,
+    void (gpt::IMaterial::*setter)(gpt::ITexture*), gpt::ITexture* (gpt::IMaterial::*getter)() const)
+{
+    if (!src || !*src) {
+        (dst.*setter)(nullptr);
+        return;
+    }
+
+    gpt::IMaterialPtr mat = &dst;
+    auto* tex = loader->getTexture(*src, 0, [mat, setter, getter](gpt::ITexture* fallback, gpt::ITexture* loaded) {
+        if ((mat.get()->*getter)() == fallback)
+            (mat.get()->*setter)(loaded);
+    });
+    (dst.*setter)(tex);
+}
+
+static void SetupGlimmerMaterial(gpt::IMaterial& dst, const MaterialNode& src, GlimmerTextureLoader* loader = nullptr)
+{
+    dst.setName(src.getName().c_str());
+    dst.setType(src.opacity < 1.0f ? gpt::MaterialType::Transparent : gpt::MaterialType::Opaque);
+    dst.setDiffuse(src.diffuse_color * src.diffuse);
+    dst.setRoughness(src.roughness);
+    dst.setOpacity(src.opacity);
+    dst.setEmissive(src.emissive_color);
+    if (loader) {
+        SetupGlimmerMap(dst, src.diffuse_texture, loader, &gpt::IMaterial::setDiffuseMap, &gpt::IMaterial::getDiffuseMap);
+        SetupGlimmerMap(dst, src.opacity_texture, loader, &gpt::IMaterial::setOpacityMap, &gpt::IMaterial::getOpacityMap);
+    }
+}
+
+// material cache shared by the exporters. a material is created and set up the first time its node is seen.
+static gpt::IMaterial* GetGlimmerMaterial(std::map<MaterialNode*, gpt::IMaterialPtr>& materials, gpt::IContext* ctx,
+    MaterialNode* src, GlimmerTextureLoader* loader)
+{
+    if (!src)
+        return nullptr;
+
+    auto& dst = materials[src];
+    if (!dst) {
+        dst = ctx->createMaterial();
+        SetupGlimmerMaterial(*dst, *src, loader);
+    }
+    return dst;
+}
+
+static uint64_t HashMesh(const MeshNode& mesh)
+{
+    auto hash = [](uint64_t h, const auto& v) {
+        return mu::Hash64(v.cdata(), v.size_bytes(), h);
+    };
+    uint64_t h = 0;
+    h = hash(h, mesh.points);
+    h = hash(h, mesh.normals);
+    h = hash(h, mesh.uvs);
+    h = hash(h, mesh.counts);
+    h = hash(h, mesh.indices);
+    for (auto& fs : mesh.facesets) {
+        h = mu::Hash64(&fs->material, sizeof(fs->material), h);
+        h = hash(h, fs->faces);
+    }
+    return h;
+}
+
+
+// GlimmerInstanceExporter
+
+struct GlimmerInstanceExporter::impl
+{
+    struct proto_record
+    {
+        std::vector<GlimmerSubmesh> submeshes;
+        uint64_t hash = 0;
+        int generation = 0;   // incremented when submeshes are recreated. 0: not built yet
+        uint64_t updated = 0; // update serial of the last check
+        int num_instances = 0; // instance records that refer this
+    };
+
+    struct instance_record
+    {
+        proto_record* proto = nullptr;
+        int generation = -1;
+        float4x4 matrix = float4x4::identity();
+        std::vector<gpt::IMeshInstancePtr> objects; // one per submesh
+    };
+
+    struct instancer_record
+    {
+        std::vector<instance_record> instances;
+    };
+
+    struct instance_item
+    {
+        proto_record* proto;
+        float4x4 matrix;
+    };
+
+    gpt::IContextPtr ctx;
+    gpt::IScenePtr scene;
+    GlimmerTextureLoader* texture_loader = nullptr;
+    std::map<MaterialNode*, gpt::IMaterialPtr> materials;
+    // keyed by (instancer, proto index). protos of a nested instancer are shared by all its parents.
+    std::map<std::pair<InstancerNode*, int>, proto_record> protos;
+    std::map<InstancerNode*, instancer_record> instancers;
+    std::vector<instance_item> items;
+    uint64_t update_serial = 0;
+
+    gpt::IMaterial* getMaterial(MaterialNode* src);
+    proto_record& updateProto(InstancerNode& inst, int pi);
+    void gather(InstancerNode& inst, const float4x4& trans);
+    void release(instance_record& rec);
+    // erase protos no instance refers to. protos checked by the update keep_serial are kept (0: none).
+    void eraseUnusedProtos(uint64_t keep_serial);
+};
+
+gpt::IMaterial* GlimmerInstanceExporter::impl::getMaterial(MaterialNode* src)
+{
+    return GetGlimmerMaterial(materials, ctx, src, texture_loader);
+}
+
+GlimmerInstanceExporter::impl::proto_record& GlimmerInstanceExporter::impl::updateProto(InstancerNode& inst, int pi)
+{
+    auto& prec = protos[{ &inst, pi }];
+    if (prec.updated == update_serial)
+        return prec;
+    prec.updated = update_serial;
+
+    // merge meshes in the proto. nested instancers are not baked but exported as instances.
+    MeshNode merged;
+    for (auto& mrec : inst.proto_records[pi].mesh_records) {
+        if (mrec.mesh)
+            mrec.mesh->bake(merged, mrec.matrix);
+    }
+
+    uint64_t hash = HashMesh(merged);
+    bool first = prec.generation == 0;
+    if (first || hash != prec.hash) {
+        prec.hash = hash;
+        auto prev = prec.submeshes;
+        ToGlimmerMeshes(ctx, merged, prec.submeshes);
+        if (first || prev.size() != prec.submeshes.size() ||
+            !std::equal(prev.begin(), prev.end(), prec.submeshes.begin(), [](auto& a, auto& b) { return a.mesh == b.mesh; }))
+            ++prec.generation;
+    }
+    return prec;
+}
+
+void GlimmerInstanceExporter::impl::gather(InstancerNode& inst, const float4x4& trans)
+{
+    inst.gatherMeshes();
+
+    int nprotos = (int)inst.protos.size();
+    std::vector<proto_record*> precs(nprotos);
+    for (int pi = 0; pi < nprotos; ++pi)
+        precs[pi] = &updateProto(inst, pi);
+
+    size_t ninstances = inst.proto_indices.size();
+    if (inst.matrices.size() != ninstances)
+        return;
+
+    for (size_t i = 0; i < ninstances; ++i) {
+        int pi = inst.proto_indices[i];
+        float4x4 m = inst.matrices[i] * trans;
+        items.push_back({ precs[pi], m });
+
+        for (auto& mrec : inst.proto_records[pi].mesh_records) {
+            if (mrec.instancer)
+                gather(*mrec.instancer, mrec.matrix * m);
+        }
+    }
+}
+
+void GlimmerInstanceExporter::impl::release(instance_record& rec)
+{
+    for (auto& obj : rec.objects)
+        scene->removeInstance(obj);
+    rec.objects.clear();
+    if (rec.proto)
+        --rec.proto->num_instances;
+    rec.proto = nullptr;
+    rec.generation = -1;
+}
+
+void GlimmerInstanceExporter::impl::eraseUnusedProtos(uint64_t keep_serial)
+{
+    for (auto it = protos.begin(); it != protos.end(); ) {
+        auto& prec = it->second;
+        if (prec.num_instances == 0 && prec.updated != keep_serial)
+            it = protos.erase(it);
+        else
+            ++it;
+    }
+}
+
+GlimmerInstanceExporter::GlimmerInstanceExporter(gpt::IContext* ctx, gpt::IScene* scene)
+    : m_impl(new impl())
+{
+    m_impl->ctx = ctx;
+    m_impl->scene = scene;
+}
+
+GlimmerInstanceExporter::~GlimmerInstanceExporter()
+{
+    clear();
+}
+
+void GlimmerInstanceExporter::update(InstancerNode& inst, const float4x4& trans)
+{
+    auto& m = *m_impl;
+    ++m.update_serial;
+    m.items.clear();
+    m.gather(inst, trans);
+
+    auto& irec = m.instancers[&inst];
+    size_t nitems = m.items.size();
+    for (size_t i = nitems; i < irec.instances.size(); ++i)
+        m.release(irec.instances[i]);
+    irec.instances.resize(nitems);
+
+    for (size_t i = 0; i < nitems; ++i) {
+        auto& item = m.items[i];
+        auto& rec = irec.instances[i];
+        if (rec.proto != item.proto || rec.generation != item.proto->generation) {
+            // proto is changed or its meshes are recreated
+            m.release(rec);
+            rec.proto = item.proto;
+            ++rec.proto->num_instances;
+            rec.generation = item.proto->generation;
+            rec.matrix = item.matrix;
+            for (auto& sm : item.proto->submeshes) {
+                auto obj = m.ctx->createMeshInstance(sm.mesh);
+                obj->setMaterial(m.getMaterial(sm.material));
+                obj->setTransform(item.matrix);
+                m.scene->addInstance(obj);
+                rec.objects.push_back(obj);
+            }
+        }
+        else if (rec.matrix != item.matrix) {
+            rec.matrix = item.matrix;
+            for (auto& obj : rec.objects)
+                obj->setTransform(item.matrix);
+        }
+    }
+    m.eraseUnusedProtos(m.update_serial);
+}
+
+void GlimmerInstanceExporter::remove(InstancerNode& inst)
+{
+    auto& m = *m_impl;
+    auto it = m.instancers.find(&inst);
+    if (it == m.instancers.end())
+        return;
+    for (auto& rec : it->second.instances)
+        m.release(rec);
+    m.instancers.erase(it);
+    m.eraseUnusedProtos(0);
+}
+
+void GlimmerInstanceExporter::clear()
+{
+    auto& m = *m_impl;
+    for (auto& kvp : m.instancers)
+        for (auto& rec : kvp.second.instances)
+            m.release(rec);
+    m.instancers.clear();
+    m.protos.clear();
+    m.materials.clear();
+}
+
+void GlimmerInstanceExporter::setTextureLoader(GlimmerTextureLoader* loader)
+{
+    m_impl->texture_loader = loader;
+}
+
+gpt::IMaterial* GlimmerInstanceExporter::getMaterial(MaterialNode* src)
+{
+    return m_impl->getMaterial(src);
+}
+
+size_t GlimmerInstanceExporter::getInstanceCount() const
+{
+    size_t ret = 0;
+    for (auto& kvp : m_impl->instancers)
+        for (auto& rec : kvp.second.instances)
+            ret += rec.objects.size();
+    return ret;
+}
+
+
+
+// GlimmerSceneSync
+
+// skinning and blendshape setup. their animated parts (joint matrices, weights) are not included.
+static uint64_t HashDeformers(const MeshNode& mesh)
+{
+    auto hash = [](uint64_t h, const auto& v) {
+        return mu::Hash64(v.cdata(), v.size_bytes(), h);
+    };
+    uint64_t h = 0;
+    if (mesh.isSkinned()) {
+        h = hash(h, mesh.joint_indices);
+        h = hash(h, mesh.joint_weights);
+        h = mu::Hash64(&mesh.bind_transform, sizeof(float4x4), h);
+        for (auto* joint : mesh.joints)
+            h = mu::Hash64(&joint->bindpose, sizeof(float4x4), h);
+    }
+    for (auto* bs : mesh.blendshapes) {
+        h = hash(h, bs->indices);
+        for (auto& t : bs->targets) {
+            h = mu::Hash64(&t->weight, sizeof(float), h);
+            h = hash(h, t->point_offsets);
+        }
+    }
+    return h;
+}
+
+// set joint weights and blendshapes of the flattened submesh.
+// normal offsets of blendshapes are not needed as Glimmer generates normals from deformed points.
+static void SetupGlimmerDeformers(gpt::IMesh& dst, const MeshNode& src, const flattened_mesh& fm)
+{
+    size_t nvertices = fm.index_map.size();
+    auto* indices = src.indices.cdata();
+
+    if (src.isSkinned()) {
+        int jpv = src.joints_per_vertex;
+        auto* joint_indices = src.joint_indices.cdata();
+        auto* joint_weights = src.joint_weights.cdata();
+
+        RawVector<gpt::JointWeight> weights;
+        RawVector<int> counts;
+        weights.reserve(nvertices * jpv);
+        counts.resize(nvertices);
+        for (size_t i = 0; i < nvertices; ++i) {
+            int vi = indices[fm.index_map[i]];
+            int count = 0;
+            for (int k = 0; k < jpv; ++k) {
+                float w = joint_weights[vi * jpv + k];
+                if (w > 0.0f) {
+                    weights.push_back({ w, joint_indices[vi * jpv + k] });
+                    ++count;
+                }
+            }
+            counts[i] = count;
+        }
+
+        RawVector<float4x4> bindposes;
+        for (auto* joint : src.joints)
+            bindposes.push_back(src.bind_transform * mu::invert(joint->bindpose));
+
+        dst.setJointBindposes(bindposes.cdata(), bindposes.size());
+        dst.setJointWeights(weights.cdata(), weights.size());
+        dst.setJointCounts(counts.cdata(), counts.size());
+    }
+
+    while (dst.getBlendshapeCount() > 0)
+        dst.removeBlendshape(dst.getBlendshape(0));
+    if (!src.blendshapes.empty()) {
+        size_t npoints = src.points.size();
+        RawVector<float3> vertex_deltas, deltas;
+        deltas.resize_discard(nvertices);
+        for (auto* bs : src.blendshapes) {
+            auto* gbs = dst.addBlendshape();
+            gbs->setName(bs->getName().c_str());
+            for (auto& t : bs->targets) {
+                // expand to per-vertex of the source, then to flattened vertices
+                auto& po = t->point_offsets;
+                vertex_deltas.resize_zeroclear(npoints);
+                if (bs->indices.empty()) {
+                    size_t n = std::min(po.size(), npoints);
+                    for (size_t i = 0; i < n; ++i)
+                        vertex_deltas[i] = po[i];
+                }
+                else {
+                    size_t n = std::min(po.size(), bs->indices.size());
+                    for (size_t i = 0; i < n; ++i)
+                        vertex_deltas[bs->indices[i]] = po[i];
+                }
+                for (size_t i = 0; i < nvertices; ++i)
+                    deltas[i] = vertex_deltas[indices[fm.index_map[i]]];
+
+                gbs->addFrame(t->weight)->setDeltaPoints(deltas.cdata(), deltas.size());
+            }
+        }
+    }
+}
+
+struct GlimmerSceneSync::impl
+{
+    struct mesh_record
+    {
+        std::vector<GlimmerSubmesh> submeshes;
+        std::vector<gpt::IMeshInstancePtr> instances; // one per submesh
+        SkeletonNode* skeleton = nullptr;
+        uint64_t hash = 0;
+        int uploads = 0;
+    };
+
+    gpt::IContextPtr ctx;
+    gpt::IScenePtr scene;
+    GlimmerTextureLoader* texture_loader = nullptr;
+    std::map<MaterialNode*, gpt::IMaterialPtr> materials;
+    // records are keyed by nodes, which are valid only within a Scene::generation
+    std::map<MeshNode*, mesh_record> meshes;
+    std::map<SkeletonNode*, std::set<MeshNode*>> skinned_meshes;
+    uint64_t scene_generation = 0;
+
+    gpt::IMaterial* getMaterial(MaterialNode* src);
+    void updateMesh(MeshNode& node, DirtyFlag flags);
+    void updateJoints(MeshNode& node, mesh_record& rec);
+    void release(MeshNode* node);
+    void releaseAll();
+};
+
+gpt::IMaterial* GlimmerSceneSync::impl::getMaterial(MaterialNode* src)
+{
+    return GetGlimmerMaterial(materials, ctx, src, texture_loader);
+}
+
+void GlimmerSceneSync::impl::updateMesh(MeshNode& node, DirtyFlag flags)
+{
+    auto& rec = meshes[&node];
+    bool first = rec.uploads == 0;
+    bool recreated = false;
+
+    if (first || (flags & (DirtyFlag::Points | DirtyFlag::Topology)) != DirtyFlag::None) {
+        // Scene::read() marks everything dirty. hashes filter out meshes that are not actually changed.
+        uint64_t hash = HashMesh(node) ^ HashDeformers(node);
+        if (first || hash != rec.hash) {
+            rec.hash = hash;
+            auto prev = rec.submeshes;
+            ToGlimmerMeshesImpl(ctx, node, rec.submeshes, [&rec, &node](size_t i, const flattened_mesh& fm) {
+                SetupGlimmerDeformers(*rec.submeshes[i].mesh, node, fm);
+            });
+            // meshes updated more than once are likely to be animated
+            if (++rec.uploads == 2) {
+                for (auto& sm : rec.submeshes)
+                    sm.mesh->markDynamic();
+            }
+
+            recreated = prev.size() != rec.submeshes.size() ||
+                !std::equal(prev.begin(), prev.end(), rec.submeshes.begin(), [](auto& a, auto& b) { return a.mesh == b.mesh; });
+            if (recreated) {
+                for (auto& inst : rec.instances)
+                    scene->removeInstance(inst);
+                rec.instances.clear();
+                for (auto& sm : rec.submeshes) {
+                    auto inst = ctx->createMeshInstance(sm.mesh);
+                    scene->addInstance(inst);
+                    rec.instances.push_back(inst);
+                }
+            }
+            for (size_t i = 0; i < rec.instances.size(); ++i)
+                rec.instances[i]->setMaterial(getMaterial(rec.submeshes[i].material));
+
+            auto* skel = node.isSkinned() ? node.skeleton : nullptr;
+            if (rec.skeleton != skel) {
+                if (rec.skeleton)
+                    skinned_meshes[rec.skeleton].erase(&node);
+                if (skel)
+                    skinned_meshes[skel].insert(&node);
+                rec.skeleton = skel;
+            }
+        }
+    }
+
+    if (recreated || (flags & DirtyFlag::Transform) != DirtyFlag::None) {
+        for (auto& inst : rec.instances) {
+            inst->setTransform(node.global_matrix);
+            inst->setEnabled(node.visibility);
+        }
+    }
+    if (recreated || (flags & DirtyFlag::Joints) != DirtyFlag::None)
+        updateJoints(node, rec);
+    if (recreated || (flags & DirtyFlag::Blendshapes) != DirtyFlag::None) {
+        if (!node.blendshapes.empty() && node.blendshape_weights.size() == node.blendshapes.size()) {
+            for (auto& inst : rec.instances)
+                inst->setBlendshapeWeights(node.blendshape_weights.cdata());
+        }
+    }
+}
+
+void GlimmerSceneSync::impl::updateJoints(MeshNode& node, mesh_record& rec)
+{
+    if (!rec.skeleton)
+        return;
+
+    RawVector<float4x4> matrices;
+    matrices.resize_discard(node.joints.size());
+    for (size_t i = 0; i < node.joints.size(); ++i)
+        matrices[i] = node.joints[i]->global_matrix;
+    for (auto& inst : rec.instances)
+        inst->setJointMatrices(matrices.cdata());
+}
+
+void GlimmerSceneSync::impl::release(MeshNode* node)
+{
+    auto it = meshes.find(node);
+    if (it == meshes.end())
+        return;
+    for (auto& inst : it->second.instances)
+        scene->removeInstance(inst);
+    if (it->second.skeleton)
+        skinned_meshes[it->second.skeleton].erase(node);
+    meshes.erase(it);
+}
+
+void GlimmerSceneSync::impl::releaseAll()
+{
+    for (auto& kvp : meshes)
+        for (auto& inst : kvp.second.instances)
+            scene->removeInstance(inst);
+    meshes.clear();
+    skinned_meshes.clear();
+    materials.clear();
+}
+
+GlimmerSceneSync::GlimmerSceneSync(gpt::IContext* ctx, gpt::IScene* scene)
+    : m_impl(new impl())
+{
+    m_impl->ctx = ctx;
+    m_impl->scene = scene;
+}
+
+GlimmerSceneSync::~GlimmerSceneSync()
+{
+    clear();
+}
+
+void GlimmerSceneSync::sync(Scene& scene)
+{
+    auto& m = *m_impl;
+
+    // all nodes are replaced (closed, deserialized or another scene). records of the old nodes are gone with them.
+    // the new nodes are all dirty unless the scene is closed, in which case there is nothing to show.
+    if (m.scene_generation != scene.generation) {
+        m.releaseAll();
+        m.scene_generation = scene.generation;
+    }
+
+    scene.eachDirtyNode([&m](Node* n) {
+        auto flags = n->dirty_flags;
+        if (auto mesh = dynamic_cast<MeshNode*>(n)) {
+            if (n->removed)
+                m.release(mesh);
+            else
+                m.updateMesh(*mesh, flags);
+        }
+        else if (auto material = dynamic_cast<MaterialNode*>(n)) {
+            auto it = m.materials.find(material);
+            if (it == m.materials.end())
+                return;
+            if (n->removed)
+                m.materials.erase(it); // instances still hold the material
+            else if ((flags & DirtyFlag::Material) != DirtyFlag::None)
+                SetupGlimmerMaterial(*it->second, *material, m.texture_loader);
+        }
+        else if (auto skel = dynamic_cast<SkeletonNode*>(n)) {
+            if (n->removed)
+                m.skinned_meshes.erase(skel);
+        }
+    });
+
+    // joint matrices of skinned meshes follow their skeletons
+    scene.eachDirtyNode([&m](Node* n) {
+        auto skel = dynamic_cast<SkeletonNode*>(n);
+        if (!skel || (n->dirty_flags & DirtyFlag::Joints) == DirtyFlag::None)
+            return;
+        auto it = m.skinned_meshes.find(skel);
+        if (it == m.skinned_meshes.end())
+            return;
+        for (auto* mesh : it->second) {
+            if (!mesh->isDirty(DirtyFlag::Joints))
+                m.updateJoints(*mesh, m.meshes[mesh]);
+        }
+    });
+
+    scene.clearDirty();
+}
+
+void GlimmerSceneSync::clear()
+{
+    m_impl->releaseAll();
+}
+
+void GlimmerSceneSync::setTextureLoader(GlimmerTextureLoader* loader)
+{
+    m_impl->texture_loader = loader;
+}
+
+gpt::IMaterial* GlimmerSceneSync::getMaterial(MaterialNode* src)
+{
+    return m_impl->getMaterial(src);
+}
+
+size_t GlimmerSceneSync::getInstanceCount() const
+{
+    size_t ret = 0;
+    for (auto& kvp : m_impl->meshes)
+        ret += kvp.second.instances.size();
+    return ret;
+}
+
+} // namespace sg
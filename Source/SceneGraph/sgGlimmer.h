@@ -0,0 +1,123 @@
+#pragma once
+#include "SceneGraph.h"
+
+#ifndef gptImpl
+#define gptImpl
+namespace gpt {
+using mu::float2;
+using mu::float3;
+using mu::float4;
+using mu::quatf;
+using mu::float4x4;
+} // namespace gpt
+#endif
+#include "Glimmer/gptInterface.h"
+
+namespace sg {
+
+struct GlimmerSubmesh
+{
+    MaterialNode* material = nullptr;
+    gpt::IMeshPtr mesh;
+};
+
+// triangulate and flatten src into Glimmer meshes. one gpt::IMesh per faceset (= per material).
+// if dst already has meshes for the same materials, they are updated in place instead of being recreated.
+void ToGlimmerMeshes(gpt::IContext* ctx, const MeshNode& src, std::vector<GlimmerSubmesh>& dst);
+
+
+// loads Texture::file_path into gpt::ITexture on worker threads.
+// getTexture() never blocks: it returns the loaded texture if available, otherwise a 1x1 texture of Texture::fallback
+// and queues the file. files are read, decoded, mipmapped and block compressed by a thread pool in order of priority,
+// and the finished mip chains are uploaded to Glimmer in update() on the calling thread.
+// on_loaded callbacks are invoked from update() to swap the fallback for the full image.
+class GlimmerTextureLoader
+{
+public:
+    using Callback = std::function<void(gpt::ITexture* fallback, gpt::ITexture* loaded)>;
+
+    // num_threads <= 0: number of hardware threads
+    GlimmerTextureLoader(gpt::IContext* ctx, int num_threads = 0);
+    ~GlimmerTextureLoader();
+
+    // higher priority is loaded first. requesting a queued file again with higher priority raises its priority.
+    gpt::ITexture* getTexture(const Texture& src, int priority = 0, const Callback& on_loaded = nullptr);
+
+    // files decoded after this are uploaded as BC4 / BC5 / BC7 (8 bit) or BC6H (float). off by default.
+    void enableBlockCompression(bool v);
+
+    // upload textures decoded since the last call and invoke their callbacks. returns the number of textures uploaded.
+    int update();
+    // wait for all queued files and update()
+    void wait();
+
+    // cancel loading files that are not started yet. fallback textures are kept.
+    void cancel(const std::string& path);
+    void cancelAll();
+    void clear();
+
+    size_t getPendingCount() const;
+
+private:
+    struct impl;
+    std::unique_ptr<impl> m_impl;
+};
+
+
+// exports InstancerNode to Glimmer without baking.
+// the merged mesh of each proto becomes gpt::IMesh and each matrix becomes gpt::IMeshInstance that refers it.
+// protos of nested instancers are exported as their own meshes and their instances are multiplied out.
+// materials are shared among all instancers exported by the same exporter.
+class GlimmerInstanceExporter
+{
+public:
+    GlimmerInstanceExporter(gpt::IContext* ctx, gpt::IScene* scene);
+    ~GlimmerInstanceExporter();
+
+    // add or update. proto meshes are re-uploaded only when their content is changed,
+    // and only instances whose matrix or proto is changed are pushed.
+    void update(InstancerNode& inst, const float4x4& trans = float4x4::identity());
+    void remove(InstancerNode& inst);
+    void clear();
+
+    // if set, textures of materials are loaded through loader. loader must outlive this.
+    void setTextureLoader(GlimmerTextureLoader* loader);
+
+    gpt::IMaterial* getMaterial(MaterialNode* src);
+    size_t getInstanceCount() const;
+
+private:
+    struct impl;
+    std::unique_ptr<impl> m_impl;
+};
+
+
+// keeps a Glimmer scene in sync with sg::Scene.
+// sync() visits only nodes marked dirty since the last sync and pushes what is changed: transforms, joint
+// matrices and blendshape weights are set to the existing instances, and meshes are re-uploaded only when
+// their points, topology, skinning or blendshapes are actually changed. skinning and blendshapes are
+// set up on the Glimmer meshes and deformed by Glimmer, not baked.
+// nodes removed by Scene::removeNode() are removed from the Glimmer scene. when all nodes of the scene are
+// replaced (Scene::close(), Scene::deserialize()) or another Scene is given, everything is exported again.
+class GlimmerSceneSync
+{
+public:
+    GlimmerSceneSync(gpt::IContext* ctx, gpt::IScene* scene);
+    ~GlimmerSceneSync();
+
+    // clears dirty flags of scene
+    void sync(Scene& scene);
+    void clear();
+
+    // if set, textures of materials are loaded through loader. loader must outlive this.
+    void setTextureLoader(GlimmerTextureLoader* loader);
+
+    gpt::IMaterial* getMaterial(MaterialNode* src);
+    size_t getInstanceCount() const;
+
+private:
+    struct impl;
+    std::unique_ptr<impl> m_impl;
+};
+
+} // namespace sg
@@ -0,0 +1,525 @@
+#include "pch.h"
+#include "sgSampleCache.h"
+#include <unordered_map>
+
+namespace sg {
+
+// times closer than this are treated as the same sample
+static const double sgSampleTimeEpsilon = 1e-6;
+
+struct faceset_sample
+{
+    int material_id = -1; // path id of the material
+    RawVector<int> faces;
+    RawVector<int> counts;
+    RawVector<int> indices;
+};
+
+struct node_sample
+{
+    int path_id = -1;
+    bool visibility = true;
+    float4x4 local_matrix;
+    float4x4 global_matrix;
+
+    // MeshNode
+    RawVector<float3> points;
+    RawVector<float3> normals;
+    RawVector<float2> uvs;
+    RawVector<float4> colors;
+    RawVector<int> material_ids;
+    RawVector<int> counts;
+    RawVector<int> indices;
+    RawVector<float> blendshape_weights;
+    std::vector<faceset_sample> facesets;
+
+    // SkeletonNode
+    RawVector<float4x4> joint_local_matrices;
+    RawVector<float4x4> joint_global_matrices;
+
+    // InstancerNode
+    RawVector<int> proto_indices;
+    RawVector<float4x4> matrices;
+
+    size_t size_bytes() const
+    {
+        size_t ret = sizeof(*this);
+        ret += points.size_bytes() + normals.size_bytes() + uvs.size_bytes() + colors.size_bytes();
+        ret += material_ids.size_bytes() + counts.size_bytes() + indices.size_bytes() + blendshape_weights.size_bytes();
+        for (auto& fs : facesets)
+            ret += sizeof(fs) + fs.faces.size_bytes() + fs.counts.size_bytes() + fs.indices.size_bytes();
+        ret += joint_local_matrices.size_bytes() + joint_global_matrices.size_bytes();
+        ret += proto_indices.size_bytes() + matrices.size_bytes();
+        return ret;
+    }
+};
+
+struct frame_sample
+{
+    std::vector<node_sample> nodes; // sorted by path_id
+    size_t size = 0;
+    uint64_t last_used = 0;
+
+    const node_sample* find(int path_id) const
+    {
+        auto it = std::lower_bound(nodes.begin(), nodes.end(), path_id,
+            [](const node_sample& a, int b) { return a.path_id < b; });
+        return it != nodes.end() && it->path_id == path_id ? &*it : nullptr;
+    }
+};
+using frame_samplePtr = std::shared_ptr<frame_sample>;
+
+
+template<class Dst, class Src>
+static inline void CopyArray(Dst& dst, const Src& src)
+{
+    dst.assign(src.cdata(), src.size());
+}
+
+// interpolate if sizes match, otherwise take a
+template<class Dst, class Src>
+static inline void LerpArray(Dst& dst, const Src& a, const Src& b, float w)
+{
+    if (a.size() != b.size()) {
+        CopyArray(dst, a);
+        return;
+    }
+    dst.resize_discard(a.size());
+    mu::Lerp(dst.data(), a.cdata(), b.cdata(), a.size(), w);
+}
+
+static float4x4 LerpMatrix(const float4x4& a, const float4x4& b, float w)
+{
+    if (a == b)
+        return a;
+    float3 ta, sa, tb, sb;
+    quatf ra, rb;
+    mu::extract_trs(a, ta, ra, sa);
+    mu::extract_trs(b, tb, rb, sb);
+    return mu::transform(ta + (tb - ta) * w, mu::slerp(ra, rb, w), sa + (sb - sa) * w);
+}
+
+static void LerpMatrices(RawVector<float4x4>& dst, const RawVector<float4x4>& a, const RawVector<float4x4>& b, float w)
+{
+    if (a.size() != b.size()) {
+        dst = a;
+        return;
+    }
+    size_t n = a.size();
+    dst.resize_discard(n);
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = LerpMatrix(a[i], b[i], w);
+}
+
+
+struct SampleCache::impl
+{
+    mutable std::mutex mutex;
+    std::map<double, frame_samplePtr> frames;
+    std::map<uint64_t, double> lru; // last_used -> time of the frame. begin() is the least recently used
+    std::vector<std::string> paths;
+    std::unordered_map<std::string, int> path_ids;
+    size_t memory_budget = 1024 * 1024 * 1024;
+    size_t memory_usage = 0;
+    double interpolation_span = 0.0;
+    uint64_t use_serial = 0;
+
+    std::future<void> prefetch_task;
+    std::atomic_bool prefetch_canceled{ false };
+
+    // mutex must be locked
+    int getPathID(const std::string& path);
+    std::map<double, frame_samplePtr>::iterator findFrame(double time);
+    void touch(std::map<double, frame_samplePtr>::iterator it);
+    void evict();
+
+    // mutex must not be locked
+    void capture(node_sample& dst, const XformNode& src);
+    void apply(Scene& scene, XformNode& dst, const node_sample& src);
+    void apply(Scene& scene, XformNode& dst, const node_sample& a, const node_sample& b, float w);
+    Node* findNode(Scene& scene, int path_id);
+};
+
+int SampleCache::impl::getPathID(const std::string& path)
+{
+    auto it = path_ids.find(path);
+    if (it != path_ids.end())
+        return it->second;
+    int ret = (int)paths.size();
+    paths.push_back(path);
+    path_ids[path] = ret;
+    return ret;
+}
+
+std::map<double, frame_samplePtr>::iterator SampleCache::impl::findFrame(double time)
+{
+    auto it = frames.lower_bound(time - sgSampleTimeEpsilon);
+    if (it != frames.end() && it->first <= time + sgSampleTimeEpsilon)
+        return it;
+    return frames.end();
+}
+
+void SampleCache::impl::touch(std::map<double, frame_samplePtr>::iterator it)
+{
+    auto& frame = *it->second;
+    lru.erase(frame.last_used);
+    frame.last_used = ++use_serial;
+    lru[frame.last_used] = it->first;
+}
+
+void SampleCache::impl::evict()
+{
+    // keep at least the most recently used one
+    while (memory_usage > memory_budget && frames.size() > 1) {
+        auto oldest = lru.begin();
+        auto it = frames.find(oldest->second);
+        lru.erase(oldest);
+        memory_usage -= it->second->size;
+        frames.erase(it);
+    }
+}
+
+void SampleCache::impl::capture(node_sample& dst, const XformNode& src)
+{
+    dst.visibility = src.visibility;
+    dst.local_matrix = src.local_matrix;
+    dst.global_matrix = src.global_matrix;
+
+    if (auto mesh = dynamic_cast<const MeshNode*>(&src)) {
+        CopyArray(dst.points, mesh->points);
+        CopyArray(dst.normals, mesh->normals);
+        CopyArray(dst.uvs, mesh->uvs);
+        CopyArray(dst.colors, mesh->colors);
+        CopyArray(dst.material_ids, mesh->material_ids);
+        CopyArray(dst.counts, mesh->counts);
+        CopyArray(dst.indices, mesh->indices);
+        CopyArray(dst.blendshape_weights, mesh->blendshape_weights);
+        dst.facesets.resize(mesh->facesets.size());
+        for (size_t i = 0; i < mesh->facesets.size(); ++i) {
+            auto& sfs = *mesh->facesets[i];
+            auto& dfs = dst.facesets[i];
+            CopyArray(dfs.faces, sfs.faces);
+            CopyArray(dfs.counts, sfs.counts);
+            CopyArray(dfs.indices, sfs.indices);
+        }
+    }
+    else if (auto skel = dynamic_cast<const SkeletonNode*>(&src)) {
+        size_t n = skel->joints.size();
+        dst.joint_local_matrices.resize_discard(n);
+        dst.joint_global_matrices.resize_discard(n);
+        for (size_t i = 0; i < n; ++i) {
+            dst.joint_local_matrices[i] = skel->joints[i]->local_matrix;
+            dst.joint_global_matrices[i] = skel->joints[i]->global_matrix;
+        }
+    }
+    else if (auto inst = dynamic_cast<const InstancerNode*>(&src)) {
+        CopyArray(dst.proto_indices, inst->proto_indices);
+        CopyArray(dst.matrices, inst->matrices);
+    }
+}
+
+Node* SampleCache::impl::findNode(Scene& scene, int path_id)
+{
+    if (path_id < 0)
+        return nullptr;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        path = paths[path_id];
+    }
+    return scene.findNodeByPath(path);
+}
+
+void SampleCache::impl::apply(Scene& scene, XformNode& dst, const node_sample& src)
+{
+    dst.visibility = src.visibility;
+    dst.local_matrix = src.local_matrix;
+    dst.global_matrix = src.global_matrix;
+    DirtyFlag dirty = DirtyFlag::Transform;
+
+    if (auto mesh = dynamic_cast<MeshNode*>(&dst)) {
+        dirty = dirty | DirtyFlag::Points | DirtyFlag::Topology | DirtyFlag::Blendshapes;
+        CopyArray(mesh->points, src.points);
+        CopyArray(mesh->normals, src.normals);
+        CopyArray(mesh->uvs, src.uvs);
+        CopyArray(mesh->colors, src.colors);
+        CopyArray(mesh->material_ids, src.material_ids);
+        CopyArray(mesh->counts, src.counts);
+        CopyArray(mesh->indices, src.indices);
+        CopyArray(mesh->blendshape_weights, src.blendshape_weights);
+
+        mesh->facesets.resize(src.facesets.size());
+        for (size_t i = 0; i < src.facesets.size(); ++i) {
+            auto& sfs = src.facesets[i];
+            auto& dfs = mesh->facesets[i];
+            if (!dfs)
+                dfs = std::make_shared<FaceSet>();
+            dfs->material = dynamic_cast<MaterialNode*>(findNode(scene, sfs.material_id));
+            CopyArray(dfs->faces, sfs.faces);
+            CopyArray(dfs->counts, sfs.counts);
+            CopyArray(dfs->indices, sfs.indices);
+        }
+    }
+    else if (auto skel = dynamic_cast<SkeletonNode*>(&dst)) {
+        size_t n = std::min(skel->joints.size(), src.joint_local_matrices.size());
+        for (size_t i = 0; i < n; ++i) {
+            skel->joints[i]->local_matrix = src.joint_local_matrices[i];
+            skel->joints[i]->global_matrix = src.joint_global_matrices[i];
+        }
+        dirty = dirty | DirtyFlag::Joints;
+    }
+    else if (auto inst = dynamic_cast<InstancerNode*>(&dst)) {
+        CopyArray(inst->proto_indices, src.proto_indices);
+        CopyArray(inst->matrices, src.matrices);
+        dirty = dirty | DirtyFlag::Topology;
+    }
+    dst.markDirty(dirty);
+}
+
+void SampleCache::impl::apply(Scene& scene, XformNode& dst, const node_sample& a, const node_sample& b, float w)
+{
+    // topology and other discrete states are taken from a
+    apply(scene, dst, a);
+    dst.local_matrix = LerpMatrix(a.local_matrix, b.local_matrix, w);
+    dst.global_matrix = LerpMatrix(a.global_matrix, b.global_matrix, w);
+
+    if (auto mesh = dynamic_cast<MeshNode*>(&dst)) {
+        if (a.counts.size() == b.counts.size() && a.indices.size() == b.indices.size()) {
+            LerpArray(mesh->points, a.points, b.points, w);
+            LerpArray(mesh->normals, a.normals, b.normals, w);
+            if (a.normals.size() == b.normals.size())
+                mu::Normalize(mesh->normals.data(), mesh->normals.size());
+            LerpArray(mesh->uvs, a.uvs, b.uvs, w);
+            LerpArray(mesh->colors, a.colors, b.colors, w);
+        }
+        LerpArray(mesh->blendshape_weights, a.blendshape_weights, b.blendshape_weights, w);
+    }
+    else if (auto skel = dynamic_cast<SkeletonNode*>(&dst)) {
+        RawVector<float4x4> local, global;
+        LerpMatrices(local, a.joint_local_matrices, b.joint_local_matrices, w);
+        LerpMatrices(global, a.joint_global_matrices, b.joint_global_matrices, w);
+        size_t n = std::min(skel->joints.size(), local.size());
+        for (size_t i = 0; i < n; ++i) {
+            skel->joints[i]->local_matrix = local[i];
+            skel->joints[i]->global_matrix = global[i];
+        }
+    }
+    else if (auto inst = dynamic_cast<InstancerNode*>(&dst)) {
+        if (a.proto_indices == b.proto_indices) {
+            RawVector<float4x4> matrices;
+            LerpMatrices(matrices, a.matrices, b.matrices, w);
+            inst->matrices = std::move(matrices);
+        }
+    }
+}
+
+
+SampleCache::SampleCache()
+    : m_impl(std::make_unique<impl>())
+{
+}
+
+SampleCache::~SampleCache()
+{
+    cancelPrefetch();
+}
+
+void SampleCache::setMemoryBudget(size_t bytes)
+{
+    auto& m = *m_impl;
+    std::lock_guard<std::mutex> lock(m.mutex);
+    m.memory_budget = bytes;
+    m.evict();
+}
+
+size_t SampleCache::getMemoryBudget() const
+{
+    auto& m = *m_impl;
+    std::lock_guard<std::mutex> lock(m.mutex);
+    return m.memory_budget;
+}
+
+size_t SampleCache::getMemoryUsage() const
+{
+    auto& m = *m_impl;
+    std::lock_guard<std::mutex> lock(m.mutex);
+    return m.memory_usage;
+}
+
+void SampleCache::setInterpolationSpan(double span)
+{
+    auto& m = *m_impl;
+    std::lock_guard<std::mutex> lock(m.mutex);
+    m.interpolation_span = span;
+}
+
+double SampleCache::getInterpolationSpan() const
+{
+    auto& m = *m_impl;
+    std::lock_guard<std::mutex> lock(m.mutex);
+    return m.interpolation_span;
+}
+
+void SampleCache::store(const Scene& scene, double time)
+{
+    auto& m = *m_impl;
+
+    std::vector<const XformNode*> xforms;
+    for (auto& n : scene.nodes) {
+        if (auto xf = dynamic_cast<const XformNode*>(n.get()))
+            xforms.push_back(xf);
+    }
+
+    // copying arrays is done outside the lock. only path ids need it.
+    auto frame = std::make_shared<frame_sample>();
+    frame->nodes.resize(xforms.size());
+    mu::parallel_for(0, (int)xforms.size(), 16, [&](int i) {
+        m.capture(frame->nodes[i], *xforms[i]);
+    });
+    {
+        std::lock_guard<std::mutex> lock(m.mutex);
+        for (size_t i = 0; i < xforms.size(); ++i) {
+            auto& ns = frame->nodes[i];
+            ns.path_id = m.getPathID(xforms[i]->getPath());
+            if (auto mesh = dynamic_cast<const MeshNode*>(xforms[i])) {
+                for (size_t fi = 0; fi < ns.facesets.size(); ++fi) {
+                    auto* material = mesh->facesets[fi]->material;
+                    ns.facesets[fi].material_id = material ? m.getPathID(material->getPath()) : -1;
+                }
+            }
+        }
+    }
+    std::sort(frame->nodes.begin(), frame->nodes.end(),
+        [](const node_sample& a, const node_sample& b) { return a.path_id < b.path_id; });
+    for (auto& ns : frame->nodes)
+        frame->size += ns.size_bytes();
+
+    std::lock_guard<std::mutex> lock(m.mutex);
+    auto it = m.findFrame(time);
+    if (it != m.frames.end()) {
+        m.memory_usage -= it->second->size;
+        m.lru.erase(it->second->last_used);
+        it->second = frame;
+    }
+    else {
+        it = m.frames.emplace(time, frame).first;
+    }
+    m.touch(it);
+    m.memory_usage += frame->size;
+    m.evict();
+}
+
+bool SampleCache::restore(Scene& scene, double time)
+{
+    auto& m = *m_impl;
+
+    frame_samplePtr a, b;
+    float w = 0.0f;
+    {
+        std::lock_guard<std::mutex> lock(m.mutex);
+        auto it = m.findFrame(time);
+        if (it != m.frames.end()) {
+            a = it->second;
+            m.touch(it);
+        }
+        else if (m.interpolation_span > 0.0) {
+            auto upper = m.frames.upper_bound(time);
+            if (upper != m.frames.end() && upper != m.frames.begin()) {
+                auto lower = std::prev(upper);
+                double span = upper->first - lower->first;
+                if (span <= m.interpolation_span) {
+                    a = lower->second;
+                    b = upper->second;
+                    w = (float)((time - lower->first) / span);
+                    m.touch(upper);
+                    m.touch(lower);
+                }
+            }
+        }
+        if (!a)
+            return false;
+    }
+
+    // frames are immutable once stored, and held by a and b even if evicted meanwhile.
+    // resolve nodes serially as findNodeByPath() builds its index lazily. after this, lookups of materials
+    // in the parallel loop only read the index.
+    std::vector<XformNode*> dst(a->nodes.size());
+    {
+        std::lock_guard<std::mutex> lock(m.mutex);
+        for (size_t i = 0; i < a->nodes.size(); ++i)
+            dst[i] = dynamic_cast<XformNode*>(scene.findNodeByPath(m.paths[a->nodes[i].path_id]));
+    }
+    mu::parallel_for(0, (int)dst.size(), 16, [&](int i) {
+        if (!dst[i])
+            return;
+        auto& sa = a->nodes[i];
+        const node_sample* sb = b ? b->find(sa.path_id) : nullptr;
+        if (sb)
+            m.apply(scene, *dst[i], sa, *sb, w);
+        else
+            m.apply(scene, *dst[i], sa);
+    });
+    return true;
+}
+
+bool SampleCache::contains(double time) const
+{
+    auto& m = *m_impl;
+    std::lock_guard<std::mutex> lock(m.mutex);
+    return m.findFrame(time) != m.frames.end();
+}
+
+size_t SampleCache::getSampleCount() const
+{
+    auto& m = *m_impl;
+    std::lock_guard<std::mutex> lock(m.mutex);
+    return m.frames.size();
+}
+
+void SampleCache::clear()
+{
+    auto& m = *m_impl;
+    std::lock_guard<std::mutex> lock(m.mutex);
+    m.frames.clear();
+    m.lru.clear();
+    m.memory_usage = 0;
+}
+
+void SampleCache::prefetch(ScenePtr reader, double time, int num_frames)
+{
+    cancelPrefetch();
+    if (!reader || num_frames <= 0)
+        return;
+
+    auto& m = *m_impl;
+    m.prefetch_canceled = false;
+    m.prefetch_task = std::async(std::launch::async, [this, reader, time, num_frames]() {
+        // read through SceneInterface, not a cache. otherwise a reader that shares this cache may restore
+        // interpolated samples and nothing is stored.
+        auto reader_cache = std::move(reader->sample_cache);
+        double interval = 1.0 / reader->frame_rate;
+        for (int i = 1; i <= num_frames && !m_impl->prefetch_canceled; ++i) {
+            double t = time + interval * i;
+            if (contains(t))
+                continue;
+            reader->read(t);
+            store(*reader, t);
+        }
+        reader->sample_cache = std::move(reader_cache);
+    });
+}
+
+void SampleCache::cancelPrefetch()
+{
+    m_impl->prefetch_canceled = true;
+    waitPrefetch();
+}
+
+void SampleCache::waitPrefetch()
+{
+    auto& m = *m_impl;
+    if (m.prefetch_task.valid())
+        m.prefetch_task.wait();
+}
+
+} // namespace sg
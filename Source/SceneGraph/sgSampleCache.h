@@ -0,0 +1,46 @@
+#pragma once
+#include "SceneGraph.h"
+
+namespace sg {
+
+// cache of time samples for Scene::read(time).
+// Scene::read() restores nodes from the cache if the time is already sampled, otherwise reads them through
+// SceneInterface and stores the result. only animatable states (matrices, vertex arrays, joint matrices,
+// instance matrices, etc) are cached. nodes are identified by path, so samples stored by one Scene can be
+// restored into another Scene opened on the same file. this is how prefetch works.
+// all methods are thread-safe.
+class SampleCache
+{
+public:
+    SampleCache();
+    ~SampleCache();
+
+    // least recently used samples are discarded when the total size exceeds the budget. default is 1GB.
+    void setMemoryBudget(size_t bytes);
+    size_t getMemoryBudget() const;
+    size_t getMemoryUsage() const;
+
+    // if > 0, times between two cached samples closer than span are restored by interpolation
+    // instead of reading. vertex arrays are interpolated only if their sizes match. default is 0.
+    void setInterpolationSpan(double span);
+    double getInterpolationSpan() const;
+
+    void store(const Scene& scene, double time);
+    bool restore(Scene& scene, double time);
+    bool contains(double time) const;
+    size_t getSampleCount() const;
+    void clear();
+
+    // read num_frames frames after time by reader on a background thread and store them.
+    // reader must be another Scene opened on the same file as the Scene that restores samples,
+    // and must not be used elsewhere until waitPrefetch() or the next prefetch() returns.
+    void prefetch(ScenePtr reader, double time, int num_frames);
+    void cancelPrefetch();
+    void waitPrefetch();
+
+private:
+    struct impl;
+    std::unique_ptr<impl> m_impl;
+};
+
+} // namespace sg
@@ -0,0 +1,308 @@
+#include "pch.h"
+#include "sgSceneStream.h"
+#include "sgSerializationImpl.h"
+
+namespace sg {
+
+static const char sgStreamMagic[8] = { 's', 'g', 's', 't', 'r', 'e', 'a', 'm' };
+static const char sgStreamIndexMagic[8] = { 's', 'g', 's', 'i', 'n', 'd', 'e', 'x' };
+static const uint32_t sgStreamVersion = 1;
+static const size_t sgInvalidFrame = ~size_t(0);
+
+struct frame_record
+{
+    uint64_t offset;
+    uint64_t size;
+    double time;
+    uint32_t keyframe; // index of the keyframe this frame refers to
+    uint32_t objects;  // number of serialized objects. used to preallocate pointer records
+};
+
+
+// SceneStreamWriter
+
+struct SceneStreamWriter::impl
+{
+    std::ofstream file;
+    std::vector<frame_record> frames;
+    array_dictionary dictionary;
+    ArrayCodec codec = ArrayCodec::Default;
+    int keyframe_interval = 0;
+    uint32_t last_keyframe = 0;
+};
+
+SceneStreamWriter::SceneStreamWriter()
+    : m_impl(std::make_unique<impl>())
+{
+}
+
+SceneStreamWriter::~SceneStreamWriter()
+{
+    close();
+}
+
+bool SceneStreamWriter::open(const char* path)
+{
+    close();
+
+    auto& m = *m_impl;
+    m.file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!m.file)
+        return false;
+
+    uint32_t pad = 0;
+    m.file.write(sgStreamMagic, sizeof(sgStreamMagic));
+    m.file.write((const char*)&sgStreamVersion, sizeof(sgStreamVersion));
+    m.file.write((const char*)&pad, sizeof(pad));
+    return m.file.good();
+}
+
+bool SceneStreamWriter::close()
+{
+    auto& m = *m_impl;
+    if (!m.file.is_open())
+        return false;
+
+    // frame index and footer
+    uint64_t index_offset = (uint64_t)m.file.tellp();
+    uint32_t frame_count = (uint32_t)m.frames.size();
+    uint32_t pad = 0;
+    m.file.write((const char*)&frame_count, sizeof(frame_count));
+    m.file.write((const char*)&pad, sizeof(pad));
+    m.file.write((const char*)m.frames.data(), sizeof(frame_record) * m.frames.size());
+    m.file.write((const char*)&index_offset, sizeof(index_offset));
+    m.file.write(sgStreamIndexMagic, sizeof(sgStreamIndexMagic));
+
+    bool ret = m.file.good();
+    m.file.close();
+    m.frames.clear();
+    m.dictionary.clear();
+    m.last_keyframe = 0;
+    return ret;
+}
+
+bool SceneStreamWriter::isOpened() const
+{
+    return m_impl->file.is_open();
+}
+
+void SceneStreamWriter::setKeyframeInterval(int v)
+{
+    m_impl->keyframe_interval = v;
+}
+
+void SceneStreamWriter::setCodec(ArrayCodec v)
+{
+    m_impl->codec = v;
+}
+
+bool SceneStreamWriter::write(const Scene& scene, double time)
+{
+    auto& m = *m_impl;
+    if (!m.file.is_open())
+        return false;
+
+    uint32_t index = (uint32_t)m.frames.size();
+    bool keyframe = index == 0 || (m.keyframe_interval > 0 && int(index - m.last_keyframe) >= m.keyframe_interval);
+    if (keyframe) {
+        m.dictionary.clear();
+        m.last_keyframe = index;
+    }
+    // only keyframes register arrays. so a frame depends only on its keyframe.
+    m.dictionary.recording = keyframe;
+
+    frame_record rec{};
+    rec.offset = (uint64_t)m.file.tellp();
+    rec.time = time;
+    rec.keyframe = m.last_keyframe;
+    {
+        serializer s(m.file);
+        s.setCodec(m.codec);
+        s.setDictionary(&m.dictionary);
+        scene.serialize(s);
+        rec.objects = (uint32_t)s.getObjectCount();
+    }
+    rec.size = (uint64_t)m.file.tellp() - rec.offset;
+    m.frames.push_back(rec);
+    return m.file.good();
+}
+
+bool SceneStreamWriter::write(const Scene& scene)
+{
+    return write(scene, scene.time_current);
+}
+
+
+// SceneStreamReader
+
+struct SceneStreamReader::impl
+{
+    std::ifstream file;
+    std::vector<frame_record> frames;
+    array_dictionary dictionary;
+    size_t loaded_keyframe = sgInvalidFrame;
+
+    // frames have to lie between the header and the index, refer to a keyframe before them,
+    // and have room for their objects. an object takes at least its handle.
+    bool validateFrames(uint64_t begin, uint64_t end) const
+    {
+        for (size_t i = 0; i < frames.size(); ++i) {
+            auto& f = frames[i];
+            if (f.offset < begin || f.offset > end || f.size > end - f.offset ||
+                f.keyframe > i || frames[f.keyframe].keyframe != f.keyframe ||
+                f.objects > f.size / sizeof(hptr))
+                return false;
+        }
+        return true;
+    }
+
+    bool readFrame(size_t frame, Scene& dst)
+    {
+        file.clear();
+        file.seekg(frames[frame].offset);
+        deserializer d(file);
+        d.reserve(frames[frame].objects);
+        d.setDictionary(&dictionary);
+        return dst.deserialize(d) && file.good();
+    }
+};
+
+SceneStreamReader::SceneStreamReader()
+    : m_impl(std::make_unique<impl>())
+{
+}
+
+SceneStreamReader::~SceneStreamReader()
+{
+    close();
+}
+
+bool SceneStreamReader::open(const char* path)
+{
+    close();
+
+    auto& m = *m_impl;
+    m.file.open(path, std::ios::in | std::ios::binary);
+    if (!m.file)
+        return false;
+
+    // header
+    char magic[8];
+    uint32_t version = 0, pad = 0;
+    m.file.read(magic, sizeof(magic));
+    m.file.read((char*)&version, sizeof(version));
+    m.file.read((char*)&pad, sizeof(pad));
+    if (!m.file || memcmp(magic, sgStreamMagic, sizeof(magic)) != 0 || version != sgStreamVersion) {
+        close();
+        return false;
+    }
+
+    // footer and frame index
+    const uint64_t header_size = sizeof(magic) + sizeof(version) + sizeof(pad);
+    uint64_t index_offset = 0;
+    m.file.seekg(-(int)(sizeof(index_offset) + sizeof(magic)), std::ios::end);
+    uint64_t footer_offset = (uint64_t)m.file.tellg();
+    m.file.read((char*)&index_offset, sizeof(index_offset));
+    m.file.read(magic, sizeof(magic));
+    if (!m.file || memcmp(magic, sgStreamIndexMagic, sizeof(magic)) != 0) {
+        // not closed properly
+        close();
+        return false;
+    }
+
+    // the index has to fit between index_offset and the footer. checked before the frame table is allocated
+    uint32_t frame_count = 0;
+    if (index_offset < header_size || index_offset > footer_offset ||
+        footer_offset - index_offset < sizeof(frame_count) + sizeof(pad)) {
+        close();
+        return false;
+    }
+    m.file.seekg(index_offset);
+    m.file.read((char*)&frame_count, sizeof(frame_count));
+    m.file.read((char*)&pad, sizeof(pad));
+    if (!m.file || frame_count > (footer_offset - index_offset - sizeof(frame_count) - sizeof(pad)) / sizeof(frame_record)) {
+        close();
+        return false;
+    }
+    m.frames.resize(frame_count);
+    m.file.read((char*)m.frames.data(), sizeof(frame_record) * frame_count);
+    if (!m.file || !m.validateFrames(header_size, index_offset)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SceneStreamReader::close()
+{
+    auto& m = *m_impl;
+    m.file.close();
+    m.frames.clear();
+    m.dictionary.clear();
+    m.loaded_keyframe = sgInvalidFrame;
+}
+
+bool SceneStreamReader::isOpened() const
+{
+    return m_impl->file.is_open();
+}
+
+size_t SceneStreamReader::getFrameCount() const
+{
+    return m_impl->frames.size();
+}
+
+double SceneStreamReader::getFrameTime(size_t frame) const
+{
+    auto& frames = m_impl->frames;
+    return frame < frames.size() ? frames[frame].time : default_time;
+}
+
+bool SceneStreamReader::isKeyframe(size_t frame) const
+{
+    auto& frames = m_impl->frames;
+    return frame < frames.size() && frames[frame].keyframe == frame;
+}
+
+size_t SceneStreamReader::findFrame(double time) const
+{
+    auto& frames = m_impl->frames;
+    if (frames.empty())
+        return 0;
+
+    auto it = std::lower_bound(frames.begin(), frames.end(), time,
+        [](const frame_record& r, double t) { return r.time < t; });
+    if (it == frames.end())
+        return frames.size() - 1;
+    if (it != frames.begin() && time - (it - 1)->time < it->time - time)
+        --it;
+    return std::distance(frames.begin(), it);
+}
+
+ScenePtr SceneStreamReader::read(size_t frame)
+{
+    auto& m = *m_impl;
+    if (frame >= m.frames.size())
+        return nullptr;
+
+    size_t keyframe = m.frames[frame].keyframe;
+    if (keyframe == frame || keyframe != m.loaded_keyframe) {
+        m.dictionary.clear();
+        m.loaded_keyframe = sgInvalidFrame;
+    }
+    if (keyframe != frame && m.loaded_keyframe == sgInvalidFrame) {
+        // the keyframe has to be read first to resolve references
+        Scene tmp;
+        if (!m.readFrame(keyframe, tmp))
+            return nullptr;
+        m.loaded_keyframe = keyframe;
+    }
+
+    auto ret = std::make_shared<Scene>();
+    if (!m.readFrame(frame, *ret))
+        return nullptr;
+    m.loaded_keyframe = keyframe;
+    return ret;
+}
+
+} // namespace sg
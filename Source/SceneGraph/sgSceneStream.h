@@ -0,0 +1,57 @@
+#pragma once
+#include "SceneGraph.h"
+
+namespace sg {
+
+// keyframe + delta scene stream for animated caches.
+// a keyframe is a complete scene. subsequent frames are complete scenes too, but arrays that are identical to
+// the ones in their keyframe (detected by content hash) are written as references. so unchanged topology, UVs
+// and so on are stored only once per keyframe. frames can be read in any order through the frame index.
+//
+// file layout: [header][frame]...[frame][frame index][footer]
+
+class SceneStreamWriter
+{
+public:
+    SceneStreamWriter();
+    ~SceneStreamWriter();
+    bool open(const char* path);
+    bool close();
+    bool isOpened() const;
+
+    // 0: only the first frame is a keyframe
+    void setKeyframeInterval(int v);
+    void setCodec(ArrayCodec v);
+
+    bool write(const Scene& scene, double time);
+    bool write(const Scene& scene);
+
+private:
+    struct impl;
+    std::unique_ptr<impl> m_impl;
+};
+
+class SceneStreamReader
+{
+public:
+    SceneStreamReader();
+    ~SceneStreamReader();
+    bool open(const char* path);
+    void close();
+    bool isOpened() const;
+
+    size_t getFrameCount() const;
+    double getFrameTime(size_t frame) const;
+    bool isKeyframe(size_t frame) const;
+    // frame nearest to time
+    size_t findFrame(double time) const;
+
+    // read a frame into a new scene. the keyframe is loaded on demand and kept until a frame of another keyframe is read.
+    ScenePtr read(size_t frame);
+
+private:
+    struct impl;
+    std::unique_ptr<impl> m_impl;
+};
+
+} // namespace sg
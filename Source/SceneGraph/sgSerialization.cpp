@@ -97,12 +97,332 @@ void* create_instance_(const char* name)
 }
 
 
+// array dictionary
+
+static const size_t array_ref_threshold = 256; // in bytes
+
+uint32_t array_dictionary::find(uint64_t hash, size_t size) const
+{
+    auto it = m_records.find(hash);
+    if (it != m_records.end() && it->second.size == size)
+        return it->second.id;
+    return 0;
+}
+
+uint32_t array_dictionary::add(uint64_t hash, size_t size)
+{
+    // a hash that is already registered with another size gets a new id. ids are never reused
+    uint32_t id = m_next_id++;
+    m_records[hash] = { id, size };
+    return id;
+}
+
+void array_dictionary::set(uint32_t id, const void* data, size_t size)
+{
+    // ids come from the stream. a map keeps a corrupted id from sizing the table
+    m_arrays[id].assign((const char*)data, size);
+}
+
+const RawVector<char>* array_dictionary::get(uint32_t id) const
+{
+    auto it = m_arrays.find(id);
+    return it != m_arrays.end() ? &it->second : nullptr;
+}
+
+void array_dictionary::clear()
+{
+    m_records.clear();
+    m_arrays.clear();
+    m_next_id = 1;
+}
+
+bool write_array_ref(serializer& s, const void* data, uint32_t size, size_t element_size)
+{
+    auto* dict = s.getDictionary();
+    size_t data_size = element_size * size;
+    if (data_size < array_ref_threshold || (size & array_flags_mask) != 0)
+        return false;
+
+    uint64_t hash = mu::Hash64(data, data_size);
+    if (uint32_t id = dict->find(hash, data_size)) {
+        write(s, size | array_ref_flag);
+        write(s, id);
+        return true;
+    }
+    else if (dict->recording) {
+        write(s, size | array_keyed_flag);
+        write(s, dict->add(hash, data_size));
+    }
+    return false;
+}
+
+
+// compressed arrays
+
+// layout: [size | array_compressed_flag][applied codecs][stage size][payload size][payload][align]
+// stage is the data after DeltaPack or Quantize, and payload is the stage after LZ.
+static const size_t compress_threshold = 1024; // in bytes
+
+static inline bool has(ArrayCodec v, ArrayCodec f) { return (v & f) != ArrayCodec::None; }
+
+bool write_compressed_array(serializer& s, const void* data, uint32_t size, size_t element_size, array_type type)
+{
+    ArrayCodec codec = s.getCodec();
+    size_t data_size = element_size * size;
+    if (data_size < compress_threshold || (size & array_flags_mask) != 0)
+        return false;
+
+    ArrayCodec applied = ArrayCodec::None;
+    const char* stage = (const char*)data;
+    size_t stage_size = data_size;
+    RawVector<char> stage_buf;
+    if (type == array_type::Int && has(codec, ArrayCodec::DeltaPack)) {
+        stage_buf.resize_discard(mu::DeltaPackBound(size) * sizeof(uint32_t));
+        size_t words = mu::DeltaPack((uint32_t*)stage_buf.data(), (const int*)data, size);
+        stage_buf.resize(words * sizeof(uint32_t));
+        applied = applied | ArrayCodec::DeltaPack;
+    }
+    else if (type == array_type::Float3 && has(codec, ArrayCodec::Quantize)) {
+        RawVector<mu::float3> src;
+        src.assign((const mu::float3*)data, size);
+        mu::BoundedArrayU16x3 packed;
+        mu::encode(packed, src);
+
+        stage_buf.resize_discard(sizeof(mu::float3) * 2 + packed.packed.size_bytes());
+        char* dst = stage_buf.data();
+        memcpy(dst, &packed.bound_min, sizeof(mu::float3));
+        memcpy(dst + sizeof(mu::float3), &packed.bound_max, sizeof(mu::float3));
+        memcpy(dst + sizeof(mu::float3) * 2, packed.packed.cdata(), packed.packed.size_bytes());
+        applied = applied | ArrayCodec::Quantize;
+    }
+    if (applied != ArrayCodec::None) {
+        stage = stage_buf.cdata();
+        stage_size = stage_buf.size();
+    }
+
+    const char* payload = stage;
+    size_t payload_size = stage_size;
+    RawVector<char> payload_buf;
+    if (has(codec, ArrayCodec::LZ)) {
+        payload_buf.resize_discard(mu::LZCompressBound(stage_size));
+        size_t compressed_size = mu::LZCompress(payload_buf.data(), payload_buf.size(), stage, stage_size);
+        if (compressed_size > 0 && compressed_size < stage_size) {
+            payload = payload_buf.cdata();
+            payload_size = compressed_size;
+            applied = applied | ArrayCodec::LZ;
+        }
+    }
+    if (applied == ArrayCodec::None || payload_size >= data_size)
+        return false;
+
+    write(s, size | array_compressed_flag);
+    write(s, (uint32_t)applied);
+    write(s, (uint32_t)stage_size);
+    write(s, (uint32_t)payload_size);
+    s.write(payload, payload_size);
+    write_align(s, payload_size);
+    return true;
+}
+
+bool read_compressed_array_info(deserializer& d, uint32_t size, size_t element_size, compressed_array_info& info)
+{
+    uint32_t applied_;
+    read(d, applied_);
+    read(d, info.stage_size);
+    read(d, info.payload_size);
+    info.applied = (ArrayCodec)applied_;
+    info.valid = false;
+
+    auto applied = info.applied;
+    uint64_t data_size = (uint64_t)element_size * size;
+    uint64_t stage_size = info.stage_size;
+    uint64_t payload_size = info.payload_size;
+    auto& stream = d.getStream();
+
+    // sizes are validated against each other and the input, so that corrupted data can't cause huge allocations
+    bool ok = (applied_ & ~(uint32_t)(ArrayCodec::DeltaPack | ArrayCodec::Quantize | ArrayCodec::LZ)) == 0 &&
+        applied != ArrayCodec::None &&
+        !(has(applied, ArrayCodec::DeltaPack) && has(applied, ArrayCodec::Quantize));
+    if (ok) {
+        if (has(applied, ArrayCodec::DeltaPack)) {
+            // every block has 2 header words. DeltaPackBound() is the header words + size
+            uint64_t min_words = mu::DeltaPackBound(size) - size;
+            ok = element_size == sizeof(int) && stage_size % sizeof(uint32_t) == 0 &&
+                stage_size >= min_words * sizeof(uint32_t) &&
+                stage_size <= mu::DeltaPackBound(size) * sizeof(uint32_t);
+        }
+        else if (has(applied, ArrayCodec::Quantize)) {
+            ok = element_size == sizeof(mu::float3) && stage_size == sizeof(mu::float3) * 2 + sizeof(mu::unorm16x3) * (uint64_t)size;
+        }
+        else {
+            ok = stage_size == data_size;
+        }
+    }
+    if (ok) {
+        if (has(applied, ArrayCodec::LZ))
+            ok = payload_size < stage_size && stage_size <= payload_size * 256 + 64; // LZ can't expand more than ~255x
+        else
+            ok = payload_size == stage_size;
+    }
+    if (ok && typeid(stream) == typeid(mu::MemoryStream))
+        ok = (uint64_t)stream.rdbuf()->in_avail() >= payload_size;
+
+    if (!ok) {
+#ifdef sgDebug
+        mu::Print("read_compressed_array(): corrupted data\n");
+        mu::DbgBreak();
+#endif
+        // the stream can't be trusted from here
+        stream.setstate(std::ios::failbit);
+        return false;
+    }
+    info.valid = true;
+    return true;
+}
+
+bool read_compressed_array(deserializer& d, const compressed_array_info& info, void* dst, uint32_t size, size_t element_size)
+{
+    if (!info.valid)
+        return false;
+    auto applied = info.applied;
+    uint32_t stage_size = info.stage_size;
+    uint32_t payload_size = info.payload_size;
+    size_t data_size = element_size * size;
+
+    bool ok = true;
+    const char* payload;
+    RawVector<char> payload_buf;
+    auto& stream = d.getStream();
+    if (typeid(stream) == typeid(mu::MemoryStream)) {
+        payload = (const char*)static_cast<mu::MemoryStream&>(stream).gskip(payload_size);
+    }
+    else {
+        payload_buf.resize_discard(payload_size);
+        d.read(payload_buf.data(), payload_size);
+        ok = (size_t)stream.gcount() == payload_size;
+        payload = payload_buf.cdata();
+    }
+    read_align(d, payload_size);
+
+    const char* stage = payload;
+    RawVector<char> stage_buf;
+    bool has_stage = has(applied, ArrayCodec::DeltaPack) || has(applied, ArrayCodec::Quantize);
+    if (ok && has(applied, ArrayCodec::LZ)) {
+        if (has_stage) {
+            stage_buf.resize_discard(stage_size);
+            ok = mu::LZDecompress(stage_buf.data(), stage_size, payload, payload_size) == stage_size;
+            stage = stage_buf.cdata();
+        }
+        else {
+            // LZ only. decompress directly into dst
+            ok = stage_size == data_size && mu::LZDecompress(dst, data_size, payload, payload_size) == data_size;
+        }
+    }
+
+    if (ok && has(applied, ArrayCodec::DeltaPack)) {
+        ok = mu::DeltaUnpack((int*)dst, size, (const uint32_t*)stage, stage_size / sizeof(uint32_t));
+    }
+    else if (ok && has(applied, ArrayCodec::Quantize)) {
+        mu::BoundedArrayU16x3 packed;
+        memcpy(&packed.bound_min, stage, sizeof(mu::float3));
+        memcpy(&packed.bound_max, stage + sizeof(mu::float3), sizeof(mu::float3));
+        packed.packed.assign((const mu::unorm16x3*)(stage + sizeof(mu::float3) * 2), size);
+
+        RawVector<mu::float3> tmp;
+        mu::decode(tmp, packed);
+        memcpy(dst, tmp.cdata(), data_size);
+    }
+
+    if (!ok) {
+#ifdef sgDebug
+        mu::Print("read_compressed_array(): corrupted data\n");
+        mu::DbgBreak();
+#endif
+        memset(dst, 0, data_size);
+    }
+    return ok;
+}
+
+
 // serializer
 
+// pointer -> handle index table. open addressing with linear probing.
+class pointer_table
+{
+public:
+    using pointer_t = serializer::pointer_t;
+
+    void reserve(size_t n)
+    {
+        size_t capacity = 64;
+        while (capacity < n * 2)
+            capacity *= 2;
+        if (capacity > m_slots.size())
+            rehash(capacity);
+    }
+
+    // returns reference to the value. the value is 0 if the key is newly added.
+    uint32_t& get(pointer_t key)
+    {
+        if ((m_size + 1) * 2 > m_slots.size())
+            rehash(std::max<size_t>(64, m_slots.size() * 2));
+
+        auto& slot = m_slots[find(key)];
+        if (!slot.key) {
+            slot.key = key;
+            ++m_size;
+        }
+        return slot.value;
+    }
+
+    size_t size() const { return m_size; }
+
+private:
+    struct slot
+    {
+        pointer_t key = nullptr;
+        uint32_t value = 0;
+    };
+
+    static size_t hash(pointer_t p)
+    {
+        uint64_t v = (uint64_t)(uintptr_t)p;
+        v ^= v >> 29;
+        v *= 0xbf58476d1ce4e5b9ULL;
+        v ^= v >> 32;
+        return (size_t)v;
+    }
+
+    size_t find(pointer_t key) const
+    {
+        size_t mask = m_slots.size() - 1;
+        size_t i = hash(key) & mask;
+        while (m_slots[i].key && m_slots[i].key != key)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    void rehash(size_t capacity)
+    {
+        std::vector<slot> old;
+        old.swap(m_slots);
+        m_slots.resize(capacity);
+        for (auto& s : old) {
+            if (s.key)
+                m_slots[find(s.key)] = s;
+        }
+    }
+
+    std::vector<slot> m_slots;
+    size_t m_size = 0;
+};
+
 struct serializer::impl
 {
     std::ostream& stream;
-    std::map<pointer_t, uint32_t> pointer_records;
+    pointer_table pointer_records;
+    ArrayCodec codec = ArrayCodec::None;
+    array_dictionary* dictionary = nullptr;
 
     impl(std::ostream& s) : stream(s) {}
 };
@@ -132,7 +452,7 @@ hptr serializer::getHandle(pointer_t v)
         return { 0 };
 
     hptr ret;
-    uint32_t& index = m_impl->pointer_records[v];
+    uint32_t& index = m_impl->pointer_records.get(v);
     if (index == 0) {
         index = (uint32_t)m_impl->pointer_records.size();
         ret = { index | hptr::kFleshFlag };
@@ -143,6 +463,36 @@ hptr serializer::getHandle(pointer_t v)
     return ret;
 }
 
+void serializer::reserve(size_t num_objects)
+{
+    m_impl->pointer_records.reserve(num_objects);
+}
+
+size_t serializer::getObjectCount() const
+{
+    return m_impl->pointer_records.size();
+}
+
+void serializer::setCodec(ArrayCodec v)
+{
+    m_impl->codec = v;
+}
+
+ArrayCodec serializer::getCodec() const
+{
+    return m_impl->codec;
+}
+
+void serializer::setDictionary(array_dictionary* v)
+{
+    m_impl->dictionary = v;
+}
+
+array_dictionary* serializer::getDictionary() const
+{
+    return m_impl->dictionary;
+}
+
 
 // deserializer
 
@@ -150,6 +500,7 @@ struct deserializer::impl
 {
     std::istream& stream;
     std::vector<Record> pointer_records;
+    array_dictionary* dictionary = nullptr;
 
     impl(std::istream& s) : stream(s) {}
 };
@@ -182,6 +533,14 @@ void deserializer::setPointer(hptr h, pointer_t v)
     records[index].pointer = v;
 }
 
+void deserializer::reserve(size_t num_objects)
+{
+    // index 0 is null
+    auto& records = m_impl->pointer_records;
+    if (records.size() < num_objects + 1)
+        records.resize(num_objects + 1);
+}
+
 deserializer::Record& deserializer::getRecord(hptr h)
 {
     return m_impl->pointer_records[h.getIndex()];
@@ -208,4 +567,14 @@ bool deserializer::getPointer_(hptr h, pointer_t& v)
     return true;
 }
 
+void deserializer::setDictionary(array_dictionary* v)
+{
+    m_impl->dictionary = v;
+}
+
+array_dictionary* deserializer::getDictionary() const
+{
+    return m_impl->dictionary;
+}
+
 } // namespace sg
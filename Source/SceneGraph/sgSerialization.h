@@ -7,6 +7,8 @@
 
 namespace sg {
 
+class array_dictionary;
+
 struct hptr
 {
     enum {
@@ -21,6 +23,19 @@ struct hptr
     uint32_t handle;
 };
 
+// optional per-array codecs. applied to POD arrays (RawVector / SharedVector) large enough to be worth it.
+// the reader doesn't need to know which codecs the writer used.
+enum class ArrayCodec : uint32_t
+{
+    None        = 0x00,
+    DeltaPack   = 0x01, // int arrays: delta + bit-packing. lossless
+    Quantize    = 0x02, // float3 arrays: 16 bit quantization in the bounds of the array. lossy
+    LZ          = 0x04, // LZ on top of the above. lossless
+    Default     = DeltaPack | LZ,
+};
+inline ArrayCodec operator|(ArrayCodec a, ArrayCodec b) { return ArrayCodec((uint32_t)a | (uint32_t)b); }
+inline ArrayCodec operator&(ArrayCodec a, ArrayCodec b) { return ArrayCodec((uint32_t)a & (uint32_t)b); }
+
 class serializer
 {
 public:
@@ -32,6 +47,14 @@ public:
 
     std::ostream& getStream();
     hptr getHandle(pointer_t v);
+    // preallocate pointer table for num_objects. just a hint.
+    void reserve(size_t num_objects);
+    size_t getObjectCount() const;
+
+    void setCodec(ArrayCodec v);
+    ArrayCodec getCodec() const;
+    void setDictionary(array_dictionary* v);
+    array_dictionary* getDictionary() const;
 
 private:
     struct impl;
@@ -53,6 +76,8 @@ public:
     void read(void* v, size_t size);
 
     std::istream& getStream();
+    // preallocate pointer records for num_objects. just a hint.
+    void reserve(size_t num_objects);
     void setPointer(hptr h, pointer_t v);
     Record& getRecord(hptr h);
     bool getPointer_(hptr h, pointer_t& v);
@@ -63,6 +88,9 @@ public:
         return getPointer_(h, (pointer_t&)v);
     }
 
+    void setDictionary(array_dictionary* v);
+    array_dictionary* getDictionary() const;
+
 private:
     struct impl;
     std::unique_ptr<impl> m_impl;
@@ -8,6 +8,7 @@
 #include <list>
 #include <set>
 #include <map>
+#include <unordered_map>
 
 
 namespace sg {
@@ -235,6 +236,139 @@ static void read_array(deserializer& d, T** v, uint32_t n)
 }
 
 
+// flags in the size field of POD arrays. plain arrays keep the original layout.
+// keyed and ref flags are meaningful only if the serializer / deserializer has a dictionary (scene streams).
+// arrays whose size overlaps the flags are never compressed nor keyed. so scene streams can't hold arrays of 2^29
+// elements or more, and plain files can't hold arrays of 2^31 elements or more.
+static const uint32_t array_compressed_flag = 0x80000000; // written with a codec
+static const uint32_t array_keyed_flag      = 0x40000000; // followed by dictionary id and the array itself
+static const uint32_t array_ref_flag        = 0x20000000; // followed by dictionary id. the content is in the dictionary
+static const uint32_t array_flags_mask      = array_compressed_flag | array_keyed_flag | array_ref_flag;
+
+
+// content-addressed array table shared across serializations (see sgSceneStream.h).
+// writer: while recording, large arrays get an id. arrays whose content is already registered are written as references.
+// reader: keyed arrays are stored by id to resolve references.
+class array_dictionary
+{
+public:
+    uint32_t find(uint64_t hash, size_t size) const; // 0 if not found
+    uint32_t add(uint64_t hash, size_t size);
+    void set(uint32_t id, const void* data, size_t size);
+    const RawVector<char>* get(uint32_t id) const;
+    void clear();
+
+    bool recording = true;
+
+private:
+    struct record
+    {
+        uint32_t id;
+        size_t size;
+    };
+    std::unordered_map<uint64_t, record> m_records;
+    std::unordered_map<uint32_t, RawVector<char>> m_arrays;
+    uint32_t m_next_id = 1;
+};
+
+// returns true if the array has been written as a reference.
+// otherwise it may have been tagged with an id and the caller writes the data as usual.
+bool write_array_ref(serializer& s, const void* data, uint32_t size, size_t element_size);
+
+template<class T, class Vector>
+inline bool read_array_ref(deserializer& d, uint32_t size, Vector& v)
+{
+    auto* dict = d.getDictionary();
+    if (!serializable_pod<T>::value || !dict)
+        return false;
+
+    if (size & array_ref_flag) {
+        uint32_t id;
+        read(d, id);
+        auto* data = dict->get(id);
+        if (!data || data->size() != sizeof(T) * (size & ~array_ref_flag)) {
+            // unknown id. the keyframe is missing or the data is corrupted
+            d.getStream().setstate(std::ios::failbit);
+            v.clear();
+            return true;
+        }
+        size_t n = data->size() / sizeof(T);
+        v.resize_discard(n);
+        if (n)
+            memcpy((void*)v.data(), data->cdata(), sizeof(T) * n);
+        return true;
+    }
+    else if (size & array_keyed_flag) {
+        uint32_t id;
+        read(d, id);
+        read(d, v);
+        dict->set(id, v.cdata(), sizeof(T) * v.size());
+        return true;
+    }
+    return false;
+}
+
+
+// compressed POD arrays
+
+enum class array_type : uint32_t
+{
+    Generic,
+    Int,
+    Float3,
+};
+template<class T> struct array_type_of { static constexpr array_type value = array_type::Generic; };
+template<> struct array_type_of<int> { static constexpr array_type value = array_type::Int; };
+template<> struct array_type_of<mu::float3> { static constexpr array_type value = array_type::Float3; };
+
+// write_compressed_array() returns false if the array is not worth compressing. nothing is written in that case.
+bool write_compressed_array(serializer& s, const void* data, uint32_t size, size_t element_size, array_type type);
+// the header is read and validated before the destination is allocated.
+// on failure the stream is set to fail state because the rest of it can't be located.
+struct compressed_array_info
+{
+    ArrayCodec applied = ArrayCodec::None;
+    uint32_t stage_size = 0;
+    uint32_t payload_size = 0;
+    bool valid = false;
+};
+bool read_compressed_array_info(deserializer& d, uint32_t size, size_t element_size, compressed_array_info& info);
+bool read_compressed_array(deserializer& d, const compressed_array_info& info, void* dst, uint32_t size, size_t element_size);
+
+template<class T>
+inline void write_vector(serializer& s, const T* data, uint32_t size)
+{
+    if (serializable_pod<T>::value && s.getDictionary() &&
+        write_array_ref(s, data, size, sizeof(T)))
+        return;
+    if (serializable_pod<T>::value && s.getCodec() != ArrayCodec::None &&
+        write_compressed_array(s, data, size, sizeof(T), array_type_of<T>::value))
+        return;
+
+    write(s, size);
+    write_array(s, data, size);
+    write_align(s, sizeof(T) * size); // align
+}
+
+// returns false if the array is not compressed. size is the value read from the size field.
+template<class T, class Vector>
+inline bool read_compressed_vector(deserializer& d, uint32_t size, Vector& v)
+{
+    if (!serializable_pod<T>::value || (size & array_compressed_flag) == 0)
+        return false;
+
+    size &= ~array_compressed_flag;
+    compressed_array_info info;
+    if (!read_compressed_array_info(d, size, sizeof(T), info)) {
+        v.clear();
+        return true;
+    }
+    v.resize_discard(size);
+    read_compressed_array(d, info, v.data(), size, sizeof(T));
+    return true;
+}
+
+
 // specializations
 
 template<class T>
@@ -404,16 +538,16 @@ struct serializable<RawVector<T>> : serialize_nonintrusive<RawVector<T>>
 {
     static void serialize(serializer& s, const RawVector<T>& v)
     {
-        uint32_t size = (uint32_t)v.size();
-        write(s, size);
-        write_array(s, v.cdata(), size);
-        write_align(s, sizeof(T) * size); // align
+        write_vector(s, v.cdata(), (uint32_t)v.size());
     }
 
     static void deserialize(deserializer& d, RawVector<T>& v)
     {
         uint32_t size;
         read(d, size);
+        if (read_array_ref<T>(d, size, v) || read_compressed_vector<T>(d, size, v))
+            return;
+
         v.resize_discard(size);
         read_array(d, v.data(), size);
         read_align(d, sizeof(T) * size); // align
@@ -426,16 +560,15 @@ struct serializable<SharedVector<T>> : serialize_nonintrusive<SharedVector<T>>
 {
     static void serialize(serializer& s, const SharedVector<T>& v)
     {
-        uint32_t size = (uint32_t)v.size();
-        write(s, size);
-        write_array(s, v.cdata(), size);
-        write_align(s, sizeof(T) * size); // align
+        write_vector(s, v.cdata(), (uint32_t)v.size());
     }
 
     static void deserialize(deserializer& d, SharedVector<T>& v)
     {
         uint32_t size;
         read(d, size);
+        if (read_array_ref<T>(d, size, v) || read_compressed_vector<T>(d, size, v))
+            return;
 
         auto& stream = d.getStream();
         if (typeid(stream) == typeid(mu::MemoryStream)) {
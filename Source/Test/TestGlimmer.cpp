@@ -3,6 +3,7 @@
 #include "AssetGenerator.h"
 #define gptImpl
 #include "gptInterface.h"
+#include "SceneGraph/sgGlimmer.h"
 
 TestCase(TestMath)
 {
@@ -37,6 +38,481 @@ TestCase(TestImage)
     checker.write("checker.jpg");
     height_map.write("height_map.png");
     normal_map.write("normal_map.png");
+
+    // multi layer EXR round trip
+    {
+        mu::EXRLayer layers[] = { { "", checker }, { "normal", normal_map } };
+        mu::EXRWriteOptions opt;
+        opt.compression = mu::EXRCompression::ZIP;
+        {
+            std::ofstream ofs("layers.exr", std::ios::binary);
+            Expect(mu::WriteEXR(ofs, layers, 2, opt));
+        }
+
+        std::vector<mu::EXRLayer> result;
+        std::ifstream ifs("layers.exr", std::ios::binary);
+        Expect(mu::ReadEXR(ifs, result) && result.size() == 2);
+        Expect(result[1].name == "normal");
+        Expect(memcmp(result[1].image.data(), normal_map.data(), normal_map.getSizeInByte()) == 0);
+
+        // windows that overflow or that the file can't hold are rejected before anything is allocated
+        ifs.close();
+        ifs.open("layers.exr", std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        const std::string window_attr("dataWindow\0box2i\0", 17);
+        auto pos = data.find(window_attr);
+        Expect(pos != std::string::npos);
+        auto read_with_window = [&](mu::int4 window) {
+            auto tmp = data;
+            memcpy(&tmp[pos + window_attr.size() + sizeof(int)], &window, sizeof(window));
+            std::istringstream is(tmp);
+            std::vector<mu::EXRLayer> r;
+            return mu::ReadEXR(is, r);
+        };
+        Expect(!read_with_window({ INT_MIN, 0, INT_MAX, height - 1 }));
+        Expect(!read_with_window({ 0, 0, 1 << 30, 1 << 30 }));
+        Expect(read_with_window({ 0, 0, width - 1, height - 1 }));
+    }
+
+    // block compression round trips. mean absolute error of the encoded channels, normalized to [0, 1] for 8 bit formats
+    {
+        auto round_trip = [&](const mu::Image& src, mu::BlockFormat bf, int num_channels) {
+            auto src_format = mu::GetBlockSourceFormat(bf);
+            auto img = src.convert(src_format);
+            RawVector<char> blocks(mu::GetBlockCompressedSize(width, height, bf));
+            mu::Image decoded(width, height, src_format);
+            Expect(mu::EncodeBlocks(blocks.data(), img.data(), width, height, bf));
+            Expect(mu::DecodeBlocks(decoded.data(), blocks.cdata(), width, height, bf));
+
+            int ch = mu::GetChannelCount(src_format);
+            size_t n = (size_t)width * height;
+            double error = 0.0;
+            if (src_format == mu::ImageFormat::RGBAf16) {
+                auto* s = img.data<mu::half>();
+                auto* d = decoded.data<mu::half>();
+                for (size_t i = 0; i < n; ++i)
+                    for (int c = 0; c < num_channels; ++c)
+                        error += std::abs((float)s[i * ch + c] - (float)d[i * ch + c]);
+            }
+            else {
+                auto* s = img.data<uint8_t>();
+                auto* d = decoded.data<uint8_t>();
+                for (size_t i = 0; i < n; ++i)
+                    for (int c = 0; c < num_channels; ++c)
+                        error += std::abs(s[i * ch + c] - d[i * ch + c]) / 255.0;
+            }
+            return error / (double)(n * num_channels);
+        };
+
+        struct Case { mu::BlockFormat format; const char* name; int num_channels; double max_error; };
+        const Case cases[] = {
+            { mu::BlockFormat::BC1, "BC1", 3, 3.0 / 255.0 },
+            { mu::BlockFormat::BC4, "BC4", 1, 1.0 / 255.0 },
+            { mu::BlockFormat::BC5, "BC5", 2, 1.0 / 255.0 },
+            { mu::BlockFormat::BC6H, "BC6H", 3, 0.01 },
+            { mu::BlockFormat::BC7, "BC7", 4, 2.0 / 255.0 },
+        };
+        for (auto& c : cases) {
+            double error = round_trip(normal_map, c.format, c.num_channels);
+            printf("%s mean absolute error: %f\n", c.name, error);
+            Expect(error < c.max_error);
+        }
+
+        // an encoded mip chain is the concatenation of each level encoded alone
+        auto src = normal_map.convert(mu::ImageFormat::RGu8);
+        int num_levels = mu::GetMipCount(width, height);
+        RawVector<char> chain(mu::GetMipChainSize(width, height, mu::ImageFormat::RGu8, num_levels));
+        RawVector<char> blocks(mu::GetBlockCompressedMipChainSize(width, height, mu::BlockFormat::BC5, num_levels));
+        Expect(mu::GenerateMipChain(chain.data(), src.data(), width, height, mu::ImageFormat::RGu8, num_levels));
+        Expect(mu::EncodeMipChain(blocks.data(), chain.cdata(), width, height, mu::BlockFormat::BC5, num_levels));
+
+        bool match = true;
+        const char* s = chain.cdata();
+        const char* d = blocks.cdata();
+        for (int i = 0; i < num_levels; ++i) {
+            auto size = mu::GetMipSize(width, height, i);
+            RawVector<char> level(mu::GetBlockCompressedSize(size.x, size.y, mu::BlockFormat::BC5));
+            mu::EncodeBlocks(level.data(), s, size.x, size.y, mu::BlockFormat::BC5);
+            match &= memcmp(level.cdata(), d, level.size()) == 0;
+            s += (size_t)size.x * size.y * 2;
+            d += level.size();
+        }
+        Expect(match && d == blocks.cdata() + blocks.size());
+    }
+
+    // every BC7 and BC6H mode. both endpoints of a subset are equal, so each pixel gets the color of its subset
+    {
+        struct BC7Case { uint8_t block[16]; uint32_t subsets; uint8_t colors[3][4]; };
+        const BC7Case bc7_cases[] = {
+            { { 0x95, 0x48, 0x24, 0x82, 0x79, 0xc6, 0x2c, 0x62, 0x37, 0x82, 0x7f, 0x5c, 0x10, 0x8f, 0x98, 0x3d },
+              0xaaaa5500, { { 66, 198, 16, 255 }, { 41, 57, 189, 255 }, { 24, 107, 24, 255 } } }, // mode 0
+            { { 0x2e, 0xb6, 0xcd, 0x71, 0xc7, 0x71, 0x1c, 0xcf, 0x23, 0xcb, 0xc0, 0x5e, 0xb3, 0x2f, 0x80, 0x8e },
+              0x54400000, { { 217, 28, 60, 255 }, { 112, 28, 201, 255 }, { 0, 0, 0, 0 } } }, // mode 1
+            { { 0x8c, 0xa4, 0x3c, 0xc7, 0x18, 0xad, 0xe7, 0x64, 0x2c, 0xa5, 0xb5, 0xee, 0xb5, 0x69, 0x77, 0x9e },
+              0x0a425054, { { 148, 214, 74, 255 }, { 57, 156, 90, 255 }, { 49, 99, 189, 255 } } }, // mode 2
+            { { 0xa8, 0xfd, 0xff, 0xf7, 0x7b, 0xbb, 0x4d, 0xa7, 0x43, 0xa1, 0x5c, 0xee, 0x24, 0x74, 0x5c, 0xcb },
+              0x14141414, { { 255, 219, 161, 255 }, { 238, 232, 184, 255 }, { 0, 0, 0, 0 } } }, // mode 3
+            { { 0x30, 0xa5, 0xcc, 0xf9, 0xff, 0xba, 0x22, 0x28, 0xd9, 0x26, 0xf1, 0xf3, 0x92, 0x6f, 0xee, 0xfa },
+              0x00000000, { { 174, 156, 255, 41 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 } } }, // mode 4
+            { { 0x20, 0x1e, 0xcf, 0x7a, 0xad, 0x52, 0xbd, 0xbe, 0x8a, 0x2f, 0xab, 0xbb, 0x83, 0xaf, 0x2c, 0x7d },
+              0x00000000, { { 60, 215, 84, 175 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 } } }, // mode 5
+            { { 0xc0, 0xf5, 0x5a, 0xa1, 0x98, 0x4c, 0xa0, 0xd0, 0x1f, 0xc1, 0xfd, 0x63, 0x7b, 0x4a, 0xa5, 0x59 },
+              0x00000000, { { 215, 21, 39, 161 }, { 0, 0, 0, 0 }, { 0, 0, 0, 0 } } }, // mode 6
+            { { 0x80, 0x7f, 0xef, 0xde, 0x13, 0x42, 0x48, 0x29, 0x63, 0xc4, 0x38, 0xe7, 0x53, 0xeb, 0x74, 0xb7 },
+              0x54540404, { { 239, 36, 44, 142 }, { 247, 36, 28, 158 }, { 0, 0, 0, 0 } } }, // mode 7
+        };
+        for (auto& c : bc7_cases) {
+            uint8_t px[16][4];
+            Expect(mu::DecodeBlocks(px, c.block, 4, 4, mu::BlockFormat::BC7));
+            bool match = true;
+            for (int i = 0; i < 16; ++i)
+                match &= memcmp(px[i], c.colors[(c.subsets >> (i * 2)) & 3], 4) == 0;
+            Expect(match);
+        }
+
+        struct BC6HCase { uint8_t block[16]; uint16_t subsets; uint16_t colors[2][3]; };
+        const BC6HCase bc6h_cases[] = {
+            { { 0xd8, 0xf3, 0xdc, 0x3b, 0x07, 0x0c, 0x30, 0x80, 0xd7, 0x35, 0xe3, 0x76, 0xe9, 0xdb, 0xf7, 0x73 },
+              0x3110, { { 0x7031, 0x7376, 0x7012 }, { 0x7186, 0x7430, 0x6f96 } } }, // mode 1
+            { { 0x01, 0xf5, 0x41, 0x20, 0x07, 0x06, 0x18, 0x60, 0x3d, 0x4f, 0xa6, 0x88, 0xc4, 0xff, 0x2d, 0x01 },
+              0x7100, { { 0x273c, 0x0364, 0x0ffc }, { 0x444c, 0x064c, 0x0b24 } } }, // mode 2
+            { { 0x82, 0xab, 0xa8, 0xe7, 0x00, 0x0e, 0x3e, 0x28, 0x29, 0xda, 0x70, 0xd1, 0xe6, 0x62, 0x7b, 0x4a },
+              0xfec8, { { 0x1519, 0x716f, 0x44fe }, { 0x145f, 0x71db, 0x4491 } } }, // mode 3
+            { { 0xe6, 0xc5, 0x88, 0x8a, 0x80, 0x1d, 0x70, 0x80, 0xc3, 0x38, 0xb6, 0x6f, 0xfa, 0x58, 0x4d, 0x16 },
+              0x008e, { { 0x5fe0, 0x108f, 0x0435 }, { 0x5fef, 0x1070, 0x03f7 } } }, // mode 4
+            { { 0x4a, 0x1f, 0xa9, 0x7c, 0x80, 0x06, 0x1a, 0x00, 0x8e, 0x83, 0x3d, 0xbf, 0x29, 0xca, 0x45, 0x82 },
+              0xffe8, { { 0x4d2a, 0x527e, 0x03c8 }, { 0x4d97, 0x52ad, 0x03c8 } } }, // mode 5
+            { { 0x6e, 0x18, 0x43, 0x5a, 0x03, 0x1a, 0x68, 0x00, 0x34, 0x6d, 0xf9, 0xba, 0xbc, 0x93, 0xed, 0xfe },
+              0xe800, { { 0x2f59, 0x2093, 0x6805 }, { 0x2de5, 0x23b9, 0x6805 } } }, // mode 6
+            { { 0x72, 0xe6, 0x0a, 0x95, 0x04, 0x0a, 0x28, 0x50, 0x82, 0xa0, 0x2d, 0x6e, 0xb8, 0x54, 0xf6, 0xa2 },
+              0xff00, { { 0x18f2, 0x0a6a, 0x2416 }, { 0x196e, 0x0516, 0x1d4e } } }, // mode 7
+            { { 0x96, 0xcf, 0x03, 0x79, 0x05, 0x03, 0x08, 0x00, 0x3d, 0xff, 0xad, 0xe3, 0xcc, 0xe6, 0x96, 0x30 },
+              0xf000, { { 0x3c4e, 0x03a2, 0x5b4e }, { 0x3b56, 0x0bde, 0x576e } } }, // mode 8
+            { { 0x3a, 0x0a, 0x32, 0x8c, 0x01, 0x0c, 0x34, 0xa0, 0xc7, 0x11, 0x86, 0x34, 0xea, 0xae, 0xdd, 0xd2 },
+              0xf710, { { 0x277a, 0x30ae, 0x6026 }, { 0x28ee, 0x3396, 0x6672 } } }, // mode 9
+            { { 0xde, 0xb7, 0x52, 0x2c, 0xf2, 0xb3, 0x4c, 0x6b, 0xfa, 0x3e, 0x22, 0x01, 0x4d, 0xa5, 0x19, 0x72 },
+              0x008e, { { 0x7918, 0x48a8, 0x2b98 }, { 0x7728, 0x1268, 0x44c8 } } }, // mode 10
+            { { 0xc3, 0xbf, 0x3d, 0xbe, 0xf0, 0x6f, 0x8f, 0x2f, 0xd6, 0xb4, 0xdf, 0x0f, 0xe9, 0xb1, 0x79, 0x92 },
+              0x0000, { { 0x3dd1, 0x0ef4, 0x0b90 }, { 0x0000, 0x0000, 0x0000 } } }, // mode 11
+            { { 0x47, 0xc3, 0xbc, 0x96, 0x03, 0x00, 0x00, 0x00, 0x9b, 0x65, 0x59, 0x50, 0x2b, 0xab, 0x9f, 0xbb },
+              0x0000, { { 0x209a, 0x16db, 0x59d2 }, { 0x0000, 0x0000, 0x0000 } } }, // mode 12
+            { { 0xab, 0x8f, 0x8f, 0x24, 0x01, 0x10, 0x00, 0x00, 0x82, 0x52, 0xf0, 0xec, 0xe3, 0x32, 0x96, 0x08 },
+              0x0000, { { 0x22cc, 0x08b4, 0x046f }, { 0x0000, 0x0000, 0x0000 } } }, // mode 13
+            { { 0x4f, 0x5c, 0x28, 0xcf, 0x05, 0x08, 0x48, 0x78, 0x13, 0x32, 0xf1, 0x45, 0xd8, 0xe6, 0xd5, 0xff },
+              0x0000, { { 0x0545, 0x128e, 0x7797 }, { 0x0000, 0x0000, 0x0000 } } }, // mode 14
+        };
+        for (auto& c : bc6h_cases) {
+            uint16_t px[16][4];
+            Expect(mu::DecodeBlocks(px, c.block, 4, 4, mu::BlockFormat::BC6H));
+            bool match = true;
+            for (int i = 0; i < 16; ++i)
+                match &= memcmp(px[i], c.colors[(c.subsets >> i) & 1], 6) == 0 && px[i][3] == 0x3c00;
+            Expect(match);
+        }
+
+        // reserved modes are decoded as 0 and reported
+        uint8_t reserved[16] = {};
+        uint8_t px8[16][4];
+        Expect(!mu::DecodeBlocks(px8, reserved, 4, 4, mu::BlockFormat::BC7));
+        reserved[0] = 0x13;
+        uint16_t px16[16][4];
+        Expect(!mu::DecodeBlocks(px16, reserved, 4, 4, mu::BlockFormat::BC6H));
+    }
+
+    // tiled texture round trip
+    {
+        auto src = checker.convert(mu::ImageFormat::RGBAu8);
+        mu::TiledTextureDesc desc;
+        desc.width = width;
+        desc.height = height;
+        desc.format = mu::ImageFormat::RGBAu8;
+        desc.tile_size = 128;
+        desc.border = 4;
+        {
+            std::ofstream ofs("checker.muvt", std::ios::binary);
+            Expect(mu::WriteTiledTexture(ofs, src.data(), desc));
+        }
+
+        mu::TiledTextureReader reader;
+        Expect(reader.open("checker.muvt"));
+        auto& layout = reader.getLayout();
+        auto tail = layout.getTailSize();
+        Expect(layout.tiled_level_count == 2 && tail.x == 128 && tail.y == 128);
+
+        // tile (1, 1) of level 0 including its border
+        int padded = layout.padded_tile_size;
+        RawVector<uint32_t> tile(padded * padded);
+        Expect(reader.readTile(0, 1, 1, tile.data()));
+        auto* s = (const uint32_t*)src.data();
+        bool match = true;
+        for (int y = 0; y < padded; ++y)
+            for (int x = 0; x < padded; ++x)
+                match &= tile[padded * y + x] == s[width * (128 + y - 4) + (128 + x - 4)];
+        Expect(match);
+        Expect(!reader.readTile(0, 4, 0, tile.data()));
+    }
+}
+
+TestCase(TestPNG)
+{
+    // noise over gradients: every filter type is picked somewhere, and RGBA is large enough for
+    // several deflate chunks and IDAT chunks
+    const int width = 1031;
+    const int height = 517;
+    std::mt19937 rng(0);
+    auto make = [&](mu::ImageFormat format) {
+        mu::Image img(width, height, format);
+        int ch = mu::GetChannelCount(format);
+        auto* d = img.data<uint8_t>();
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                for (int c = 0; c < ch; ++c)
+                    *d++ = (uint8_t)(y < height / 2 ? x + y * c : x * c + (rng() % 8));
+        return img;
+    };
+    auto round_trip = [](const mu::Image& img, int level, mu::Image& result) {
+        std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+        mu::PNGWriteOptions opt;
+        opt.compression_level = level;
+        if (!mu::WritePNG(ss, img, opt))
+            return false;
+        ss.seekg(0);
+        return result.read(ss, mu::ImageFileFormat::PNG);
+    };
+
+    const mu::ImageFormat formats[] = { mu::ImageFormat::Ru8, mu::ImageFormat::RGu8, mu::ImageFormat::RGBu8, mu::ImageFormat::RGBAu8 };
+    for (auto format : formats) {
+        auto src = make(format);
+        for (int level : { 0, 1, 6, 9 }) {
+            mu::Image result;
+            Expect(round_trip(src, level, result));
+            Expect(result.getFormat() == format && result.getSize() == src.getSize());
+            Expect(result.getSizeInByte() == src.getSizeInByte() && memcmp(result.data(), src.data(), src.getSizeInByte()) == 0);
+        }
+    }
+
+    // float images are stored as 8 bit
+    {
+        auto src = make(mu::ImageFormat::RGBAu8).convert(mu::ImageFormat::RGBAf16);
+        mu::Image result;
+        Expect(round_trip(src, 6, result));
+        auto expected = src.convert(mu::ImageFormat::RGBAu8);
+        Expect(result.getFormat() == mu::ImageFormat::RGBAu8 && memcmp(result.data(), expected.data(), expected.getSizeInByte()) == 0);
+    }
+}
+
+TestCase(TestThreadPool)
+{
+    // one worker. the first task blocks it until all others are queued, so the rest run strictly by priority.
+    mu::ThreadPool pool(1);
+    std::promise<void> started, release;
+    auto release_future = release.get_future().share();
+    pool.enqueue([&started, release_future]() {
+        started.set_value();
+        release_future.wait();
+    });
+    started.get_future().wait();
+
+    std::vector<int> order;
+    std::mutex order_mutex;
+    auto task = [&](int v) {
+        return [&order, &order_mutex, v]() {
+            std::lock_guard<std::mutex> lock(order_mutex);
+            order.push_back(v);
+        };
+    };
+    pool.enqueue(task(0), 0);
+    pool.enqueue(task(1), 5);
+    auto id2 = pool.enqueue(task(2), 0);
+    pool.enqueue(task(3), 5);
+    auto id4 = pool.enqueue(task(4), -1);
+    auto id5 = pool.enqueue(task(5), 0);
+    Expect(pool.getPendingCount() == 6);
+    Expect(pool.setPriority(id4, 10)); // 4 goes first
+    Expect(pool.cancel(id5));          // 5 never runs
+    Expect(!pool.cancel(id5));
+    release.set_value();
+    pool.wait();
+
+    // higher priority first, FIFO among the same priority
+    std::vector<int> expected{ 4, 1, 3, 0, 2 };
+    Expect(order == expected);
+    Expect(pool.getPendingCount() == 0);
+    Expect(!pool.setPriority(id2, 1)); // already finished
+}
+
+TestCase(TestMipChain)
+{
+    Expect(mu::GetMipCount(4, 4) == 3);
+    Expect(mu::GetMipCount(5, 3) == 3);
+    Expect(mu::GetMipCount(8, 2) == 4);
+    Expect(mu::GetMipCount(1, 1) == 1);
+    Expect(mu::GetMipSize(8, 2, 3) == (mu::int2{ 1, 1 }));
+    Expect(mu::GetMipChainSize(4, 4, mu::ImageFormat::Rf32, 3) == (16 + 4 + 1) * sizeof(float));
+
+    // Box, even sizes: 2x2 averages
+    {
+        float src[16];
+        for (int i = 0; i < 16; ++i)
+            src[i] = float(i);
+        float chain[21];
+        Expect(mu::GenerateMipChain(chain, src, 4, 4, mu::ImageFormat::Rf32));
+        const float expected[] = { 2.5f, 4.5f, 10.5f, 12.5f, 7.5f };
+        Expect(memcmp(chain, src, sizeof(src)) == 0);
+        Expect(memcmp(chain + 16, expected, sizeof(expected)) == 0);
+    }
+    // u8 rounds to nearest
+    {
+        const uint8_t src[] = { 1, 2, 3, 4,  2, 2, 3, 4,  2, 2, 3, 5,  2, 2, 3, 5 };
+        uint8_t dst[4];
+        Expect(mu::GenerateMip(dst, src, 2, 2, mu::ImageFormat::RGBAu8));
+        Expect(dst[0] == 2 && dst[1] == 2 && dst[2] == 3 && dst[3] == 5);
+    }
+    // Box, odd sizes: texels are weighted by coverage. 5 -> 2 covers [0, 2.5] and [2.5, 5]
+    {
+        const float src[] = { 0.0f, 10.0f, 20.0f, 30.0f, 40.0f };
+        float dst[2];
+        Expect(mu::GenerateMip(dst, src, 5, 1, mu::ImageFormat::Rf32));
+        Expect(std::abs(dst[0] - 8.0f) < 1e-4f && std::abs(dst[1] - 32.0f) < 1e-4f);
+    }
+    // Kaiser: normalized and symmetric. constants stay constant and ramps stay linear away from the borders
+    {
+        const int w = 32, h = 4;
+        RawVector<float> src(w * h), chain(mu::GetMipChainSize(w, h, mu::ImageFormat::Rf32, mu::GetMipCount(w, h)) / sizeof(float));
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x)
+                src[w * y + x] = float(x);
+        Expect(mu::GenerateMipChain(chain.data(), src.cdata(), w, h, mu::ImageFormat::Rf32, 0, mu::MipFilter::Kaiser));
+        const float* level1 = chain.cdata() + w * h;
+        bool linear = true;
+        for (int y = 0; y < h / 2; ++y)
+            for (int x = 3; x <= 12; ++x)
+                linear &= std::abs(level1[(w / 2) * y + x] - (2.0f * x + 0.5f)) < 1e-3f;
+        Expect(linear);
+
+        std::fill(src.begin(), src.end(), 0.5f);
+        Expect(mu::GenerateMipChain(chain.data(), src.cdata(), w, h, mu::ImageFormat::Rf32, 0, mu::MipFilter::Kaiser));
+        bool constant = true;
+        for (float v : chain)
+            constant &= std::abs(v - 0.5f) < 1e-5f;
+        Expect(constant);
+    }
+    Expect(!mu::GenerateMip(nullptr, nullptr, 0, 4, mu::ImageFormat::Rf32));
+}
+
+TestCase(TestImageConvert)
+{
+    using mu::ImageFormat;
+    auto make = [](ImageFormat format, std::initializer_list<float> values) {
+        mu::Image img((int)values.size() / mu::GetChannelCount(format), 1, format);
+        size_t i = 0;
+        for (float v : values) {
+            switch (format & ImageFormat::TypeMask) {
+            case ImageFormat::U8: img.data<uint8_t>()[i++] = (uint8_t)v; break;
+            case ImageFormat::F16: img.data<mu::half>()[i++] = mu::half(v); break;
+            default: img.data<float>()[i++] = v; break;
+            }
+        }
+        return img;
+    };
+    auto equals = [](const mu::Image& a, const mu::Image& b) {
+        return a.getFormat() == b.getFormat() && a.getSize() == b.getSize() &&
+            memcmp(a.data(), b.data(), a.getSizeInByte()) == 0;
+    };
+
+    // gray is replicated to RGB, missing alpha is 1, other missing channels 0
+    Expect(equals(make(ImageFormat::Ru8, { 0, 128, 255 }).convert(ImageFormat::RGBAu8),
+        make(ImageFormat::RGBAu8, { 0, 0, 0, 255,  128, 128, 128, 255,  255, 255, 255, 255 })));
+    Expect(equals(make(ImageFormat::RGu8, { 10, 20,  30, 40 }).convert(ImageFormat::RGBAu8),
+        make(ImageFormat::RGBAu8, { 10, 20, 0, 255,  30, 40, 0, 255 })));
+    Expect(equals(make(ImageFormat::RGBf32, { 0.25f, 0.5f, 1.0f }).convert(ImageFormat::RGBAf16),
+        make(ImageFormat::RGBAf16, { 0.25f, 0.5f, 1.0f, 1.0f })));
+
+    // channels are dropped from the end. u8 <-> float is exact for all 256 values
+    Expect(equals(make(ImageFormat::RGBAf32, { 0.0f, 0.2f, 1.0f, 0.5f }).convert(ImageFormat::RGu8),
+        make(ImageFormat::RGu8, { 0, 51 })));
+    {
+        mu::Image all(256, 1, ImageFormat::Ru8);
+        for (int i = 0; i < 256; ++i)
+            all.data<uint8_t>()[i] = (uint8_t)i;
+        Expect(equals(all.convert(ImageFormat::Rf32).convert(ImageFormat::Ru8), all));
+        Expect(equals(all.convert(ImageFormat::RGBAu8).convert(ImageFormat::Ru8), all));
+    }
+
+    // color conversion applies to color channels only. alpha stays linear
+    {
+        auto srgb = make(ImageFormat::RGBAf32, { 0.5f, 0.0f, 1.0f, 0.5f }).convert(ImageFormat::RGBAf32, mu::ColorConversion::LinearToSRGB);
+        auto* d = srgb.data<float>();
+        Expect(std::abs(d[0] - mu::LinearToSRGB(0.5f)) < 1e-6f && d[1] == 0.0f && std::abs(d[2] - 1.0f) < 1e-6f && d[3] == 0.5f);
+        auto linear = srgb.convert(ImageFormat::RGBAf32, mu::ColorConversion::SRGBToLinear);
+        Expect(std::abs(linear.data<float>()[0] - 0.5f) < 1e-5f && linear.data<float>()[3] == 0.5f);
+    }
+
+    // same format without conversion is a plain copy
+    auto src = make(ImageFormat::RGBAu8, { 1, 2, 3, 4 });
+    Expect(equals(src.convert(ImageFormat::RGBAu8), src));
+}
+
+TestCase(TestTileKey)
+{
+    // keys round trip at the edges of each field
+    {
+        const int values[][4] = { { 0, 0, 0, 0 }, { 4095, 15, 255, 255 }, { 1, 2, 3, 4 }, { 4095, 0, 255, 0 }, { 0, 15, 0, 255 } };
+        for (auto& v : values) {
+            int tid, level, x, y;
+            mu::DecodeTileKey(mu::EncodeTileKey(v[0], v[1], v[2], v[3]), tid, level, x, y);
+            Expect(tid == v[0] && level == v[1] && x == v[2] && y == v[3]);
+        }
+    }
+
+    // a texture is in range if its id and tile counts fit in the key
+    {
+        mu::TiledTextureLayout layout;
+        mu::TiledTextureDesc desc;
+        desc.format = mu::ImageFormat::RGBAu8;
+        desc.tile_size = 128;
+        desc.width = desc.height = 128 * 256;
+        Expect(layout.setup(desc));
+        Expect(mu::CanEncodeTileKeys(0, layout) && mu::CanEncodeTileKeys(4095, layout));
+        Expect(!mu::CanEncodeTileKeys(4096, layout) && !mu::CanEncodeTileKeys(-1, layout));
+        desc.width = 128 * 256 + 1;
+        Expect(layout.setup(desc) && !mu::CanEncodeTileKeys(0, layout));
+    }
+
+    // the page table of a texture is its tiled levels in order, each in row-major order.
+    // walk it the way SampleVirtualTexture() in gptPathTracer.hlsl does
+    {
+        mu::TiledTextureDesc desc;
+        desc.width = 1000;
+        desc.height = 600;
+        desc.format = mu::ImageFormat::RGBAu8;
+        desc.tile_size = 128;
+        mu::TiledTextureLayout layout;
+        Expect(layout.setup(desc));
+        Expect(layout.tiled_level_count == 3);
+
+        int page = 0;
+        bool match = true;
+        for (int level = 0; level < layout.tiled_level_count; ++level) {
+            auto count = layout.getTileCount(level);
+            auto size = mu::GetMipSize(desc.width, desc.height, level);
+            match &= count.x == mu::ceildiv(size.x, desc.tile_size) && count.y == mu::ceildiv(size.y, desc.tile_size);
+            for (int y = 0; y < count.y; ++y)
+                for (int x = 0; x < count.x; ++x)
+                    match &= layout.getTileIndex(level, x, y) == page + count.x * y + x;
+            match &= layout.getTileIndex(level, count.x, 0) == -1 && layout.getTileIndex(level, 0, count.y) == -1;
+            page += count.x * count.y;
+        }
+        Expect(match);
+        Expect(page == layout.tile_offsets.back());
+        Expect(layout.getTileIndex(layout.tiled_level_count, 0, 0) == -1);
+
+        // the tail is the first level that fits in a tile
+        auto tail = layout.getTailSize();
+        auto last = mu::GetMipSize(desc.width, desc.height, layout.tiled_level_count - 1);
+        Expect(tail.x <= desc.tile_size && tail.y <= desc.tile_size);
+        Expect(last.x > desc.tile_size || last.y > desc.tile_size);
+    }
 }
 
 TestCase(TestFont)
@@ -75,6 +551,62 @@ TestCase(TestFont)
     fa.getImage().write("atlas.png");
 }
 
+TestCase(TestGlimmerSceneSync)
+{
+    auto ctx = gptCreateContext(gpt::DeviceType::DXR);
+    if (!ctx) {
+        printf("DXR is not supported on this system.\n");
+        return;
+    }
+    auto gscene = ctx->createScene();
+
+    sg::Scene scene;
+    auto root = scene.createNode(nullptr, "/", sg::Node::Type::Root);
+    for (int i = 0; i < 2; ++i) {
+        auto mesh = scene.createNode<sg::MeshNode>(root, mu::Format("Mesh%d", i));
+        mesh->points = { { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f } };
+        mesh->counts = { 3 };
+        mesh->indices = { 0, 1, 2 };
+    }
+
+    sg::GlimmerSceneSync sync(ctx, gscene);
+    sync.sync(scene);
+    Expect(sync.getInstanceCount() == 2);
+    Expect(gscene->getInstanceCount() == 2);
+
+    // nothing is dirty. nothing changes.
+    sync.sync(scene);
+    Expect(gscene->getInstanceCount() == 2);
+
+    // reload. all nodes are replaced and records of the old ones must not remain.
+    RawVector<char> buf;
+    {
+        mu::MemoryStream os(buf);
+        sg::serializer s(os);
+        scene.serialize(s);
+        os.flush();
+        buf.resize(os.getWCount());
+    }
+    for (int i = 0; i < 2; ++i) {
+        mu::MemoryStream is(buf);
+        sg::deserializer d(is);
+        Expect(scene.deserialize(d));
+        sync.sync(scene);
+        Expect(sync.getInstanceCount() == 2);
+        Expect(gscene->getInstanceCount() == 2);
+    }
+
+    scene.removeNode(scene.findNodeByPath("/Mesh0"));
+    sync.sync(scene);
+    Expect(sync.getInstanceCount() == 1);
+    Expect(gscene->getInstanceCount() == 1);
+
+    scene.close();
+    sync.sync(scene);
+    Expect(sync.getInstanceCount() == 0);
+    Expect(gscene->getInstanceCount() == 0);
+}
+
 #define EnableWindow
 
 class GlimmerTest : public gpt::IWindowCallback
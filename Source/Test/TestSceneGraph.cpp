@@ -0,0 +1,1329 @@
+﻿#include "pch.h"
+#include "Test.h"
+#include "SceneGraph/SceneGraph.h"
+#include "SceneGraph/sgSerializationImpl.h"
+#include "SceneGraph/sgSceneStream.h"
+#include "SceneGraph/sgSampleCache.h"
+
+using namespace sg;
+
+// many meshes with shared sub-objects. most of the cost is pointer table lookups, not array copies.
+static void MakeSerializationBenchmarkScene(Scene& scene, int num_meshes, int num_facesets)
+{
+    auto root = scene.createNode(nullptr, "/", Node::Type::Root);
+
+    std::vector<MaterialNode*> materials;
+    for (int i = 0; i < 64; ++i)
+        materials.push_back(scene.createNode<MaterialNode>(root, mu::Format("Material%d", i)));
+
+    for (int i = 0; i < num_meshes; ++i) {
+        auto mesh = scene.createNode<MeshNode>(root, mu::Format("Mesh%d", i));
+        for (int j = 0; j < num_facesets; ++j) {
+            auto fs = std::make_shared<FaceSet>();
+            fs->material = materials[(i + j) % materials.size()];
+            fs->faces = { j, j + 1 };
+            mesh->facesets.push_back(fs);
+        }
+    }
+}
+
+template<class Vector>
+static bool BitEqual(const Vector& a, const Vector& b)
+{
+    return a.size() == b.size() && (a.empty() || memcmp(a.cdata(), b.cdata(), sizeof(a[0]) * a.size()) == 0);
+}
+
+TestCase(TestSerializationBenchmark)
+{
+    const int num_try = 5;
+    Scene scene;
+    MakeSerializationBenchmarkScene(scene, 50000, 8);
+
+    RawVector<char> buf;
+    size_t num_objects = 0;
+    TestScope("serialize", [&]() {
+        buf.clear();
+        mu::MemoryStream os(buf);
+        serializer s(os);
+        scene.serialize(s);
+        os.flush();
+        buf.resize(os.getWCount());
+        num_objects = s.getObjectCount();
+    }, num_try);
+
+    auto deserialize = [&](bool reserve) {
+        Scene dst;
+        mu::MemoryStream is(buf);
+        deserializer d(is);
+        if (reserve)
+            d.reserve(num_objects);
+        Expect(dst.deserialize(d));
+    };
+    TestScope("deserialize", [&]() { deserialize(false); }, num_try);
+    TestScope("deserialize (reserved)", [&]() { deserialize(true); }, num_try);
+
+    Print("    %d objects, %.2f MB\n", (int)num_objects, (double)buf.size() / (1024.0 * 1024.0));
+}
+
+TestCase(TestArrayCodec)
+{
+    const int num = 10000;
+    RawVector<int> ints;
+    RawVector<float3> points;
+    RawVector<float> floats;
+    ints.resize_discard(num);
+    points.resize_discard(num);
+    floats.resize_discard(num);
+    for (int i = 0; i < num; ++i) {
+        ints[i] = i * 3 + (i % 7);
+        points[i] = { (float)(i % 100), (float)(i / 100), 1.0f };
+        floats[i] = (float)(i % 256);
+    }
+
+    auto serialize = [&](ArrayCodec codec) {
+        RawVector<char> buf;
+        mu::MemoryStream os(buf);
+        serializer s(os);
+        s.setCodec(codec);
+        write(s, ints);
+        write(s, points);
+        write(s, floats);
+        os.flush();
+        buf.resize(os.getWCount());
+        return buf;
+    };
+
+    const ArrayCodec codecs[] = {
+        ArrayCodec::None, ArrayCodec::DeltaPack, ArrayCodec::Quantize, ArrayCodec::LZ,
+        ArrayCodec::DeltaPack | ArrayCodec::LZ, ArrayCodec::Quantize | ArrayCodec::LZ,
+    };
+    for (auto codec : codecs) {
+        auto buf = serialize(codec);
+        mu::MemoryStream is(buf);
+        deserializer d(is);
+        RawVector<int> ints2;
+        RawVector<float3> points2;
+        RawVector<float> floats2;
+        read(d, ints2);
+        read(d, points2);
+        read(d, floats2);
+        Expect(is.good());
+        Expect(ints2 == ints);
+        Expect(floats2 == floats);
+        if ((codec & ArrayCodec::Quantize) != ArrayCodec::None) {
+            Expect(points2.size() == points.size() && mu::NearEqual(points2.cdata(), points.cdata(), points.size(), 0.01f));
+        }
+        else {
+            Expect(points2 == points);
+        }
+    }
+
+    // corrupted sizes must be rejected without reading past the input or allocating for them
+    auto corrupt = [&](ArrayCodec codec, size_t field, uint32_t value) {
+        auto buf = serialize(codec);
+        // [size | flag][applied codecs][stage size][payload size]
+        memcpy(buf.data() + sizeof(uint32_t) * field, &value, sizeof(value));
+        mu::MemoryStream is(buf);
+        deserializer d(is);
+        RawVector<int> ints2;
+        read(d, ints2);
+        return is.fail() && ints2.empty();
+    };
+    Expect(corrupt(ArrayCodec::DeltaPack, 2, 0x7fffffff));
+    Expect(corrupt(ArrayCodec::DeltaPack, 3, 0x7fffffff));
+    Expect(corrupt(ArrayCodec::DeltaPack | ArrayCodec::LZ, 2, 0x7fffffff));
+    Expect(corrupt(ArrayCodec::DeltaPack | ArrayCodec::LZ, 3, 0x7fffffff));
+    Expect(corrupt(ArrayCodec::DeltaPack, 1, 0xff));
+}
+
+TestCase(TestSceneStream)
+{
+    const char* path = "test.sgstream";
+    const int num_frames = 6;
+    const int num_points = 1000;
+
+    // topology is constant and written as references to the keyframe. points change every frame
+    Scene scene;
+    auto root = scene.createNode(nullptr, "/", Node::Type::Root);
+    auto mesh = scene.createNode<MeshNode>(root, "Mesh");
+    mesh->indices.resize(num_points * 3);
+    mesh->counts.resize(num_points);
+    for (int i = 0; i < num_points * 3; ++i)
+        mesh->indices[i] = i % num_points;
+    for (int i = 0; i < num_points; ++i)
+        mesh->counts[i] = 3;
+    mesh->points.resize(num_points);
+
+    auto set_points = [&](Scene& dst, int frame) {
+        auto* m = dynamic_cast<MeshNode*>(dst.findNodeByPath("/Mesh"));
+        for (int i = 0; i < num_points; ++i)
+            m->points[i] = { (float)i, (float)frame, 0.0f };
+    };
+
+    {
+        SceneStreamWriter writer;
+        Expect(writer.open(path));
+        writer.setKeyframeInterval(3);
+        for (int f = 0; f < num_frames; ++f) {
+            set_points(scene, f);
+            Expect(writer.write(scene, (double)f));
+        }
+        Expect(writer.close());
+    }
+
+    SceneStreamReader reader;
+    Expect(reader.open(path));
+    Expect(reader.getFrameCount() == num_frames);
+    Expect(reader.isKeyframe(0) && reader.isKeyframe(3) && !reader.isKeyframe(4));
+    // out of order, so that keyframes are loaded on demand
+    const int order[] = { 4, 1, 0, 5, 3, 2 };
+    for (int f : order) {
+        auto frame = reader.read(f);
+        Expect(frame);
+        if (!frame)
+            continue;
+        auto* m = dynamic_cast<MeshNode*>(frame->findNodeByPath("/Mesh"));
+        Expect(m && m->indices.size() == mesh->indices.size() && m->counts.size() == mesh->counts.size());
+        if (!m)
+            continue;
+        Expect(memcmp(m->indices.cdata(), mesh->indices.cdata(), sizeof(int) * mesh->indices.size()) == 0);
+        Expect(m->points.size() == num_points && m->points[10].y == (float)f);
+    }
+    reader.close();
+
+    // counts in the index are checked against the file before anything is allocated
+    auto corrupt = [&](size_t offset_from_index, uint32_t value) {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        uint64_t index_offset = 0;
+        file.seekg(-16, std::ios::end);
+        file.read((char*)&index_offset, sizeof(index_offset));
+        file.seekp(index_offset + offset_from_index);
+        file.write((const char*)&value, sizeof(value));
+    };
+    // frame_count is the first field of the index. objects is the last field of the first frame record
+    const size_t frame_count_offset = 0;
+    const size_t objects_offset = 8 + 8 + 8 + 8 + 4;
+    uint32_t objects = 0;
+    {
+        std::ifstream file(path, std::ios::binary);
+        uint64_t index_offset = 0;
+        file.seekg(-16, std::ios::end);
+        file.read((char*)&index_offset, sizeof(index_offset));
+        file.seekg(index_offset + objects_offset);
+        file.read((char*)&objects, sizeof(objects));
+    }
+    corrupt(frame_count_offset, 0x7fffffff);
+    Expect(!reader.open(path));
+    corrupt(frame_count_offset, num_frames);
+    Expect(reader.open(path));
+    reader.close();
+    corrupt(objects_offset, 0xffffffff);
+    Expect(!reader.open(path));
+    corrupt(objects_offset, objects);
+    Expect(reader.open(path) && reader.read(0));
+
+    // ids stay unique when a hash is registered again with another size
+    array_dictionary dict;
+    uint32_t id1 = dict.add(1, 16);
+    uint32_t id2 = dict.add(1, 32);
+    uint32_t id3 = dict.add(2, 16);
+    Expect(id1 != id2 && id2 != id3 && id1 != id3);
+    Expect(dict.find(1, 32) == id2 && dict.find(1, 16) == 0);
+
+    // ids read from a stream don't size the table
+    const int payload = 42;
+    dict.set(0xfffffff0, &payload, sizeof(payload));
+    Expect(dict.get(0xfffffff0) && dict.get(0xfffffff0)->size() == sizeof(payload) && !dict.get(id1));
+}
+
+TestCase(TestCompressionBenchmark)
+{
+    const int num_try = 5;
+    const int num = 1024 * 1024 * 8;
+    RawVector<float3> points, normals, decoded;
+    points.resize_discard(num);
+    normals.resize_discard(num);
+    for (int i = 0; i < num; ++i) {
+        float t = (float)i * 0.001f;
+        points[i] = { std::sin(t) * 100.0f, std::cos(t * 0.7f) * 50.0f, std::sin(t * 0.3f) * 25.0f };
+        normals[i] = mu::normalize(float3{ std::sin(t), std::cos(t * 1.3f), std::abs(std::sin(t * 0.5f)) + 1.0f });
+    }
+    double mb = (double)(sizeof(float3) * num) / (1024.0 * 1024.0);
+
+    auto bench = [&](const char* name, auto& packed, const RawVector<float3>& src, float eps) {
+        auto e = Now();
+        for (int i = 0; i < num_try; ++i)
+            mu::encode(packed, src);
+        auto d = Now();
+        for (int i = 0; i < num_try; ++i)
+            mu::decode(decoded, packed);
+        auto end = Now();
+        Print("    %s: encode %.0f MB/s, decode %.0f MB/s\n", name,
+            mb * num_try * 1000.0 / NS2MS(d - e), mb * num_try * 1000.0 / NS2MS(end - d));
+        Expect(mu::NearEqual(decoded.cdata(), src.cdata(), src.size(), eps));
+    };
+
+    mu::BoundedArrayU16x3 bounded16;
+    mu::BoundedArrayU8x3 bounded8;
+    mu::PackedArrayS16x3 packed16;
+    mu::PackedArrayS3_32 packed32;
+    bench("BoundedArrayU16x3", bounded16, points, 0.01f);
+    bench("BoundedArrayU8x3", bounded8, points, 1.0f);
+    bench("PackedArrayS16x3", packed16, normals, 0.001f);
+    bench("PackedArrayS3_32", packed32, normals, 0.02f);
+}
+
+TestCase(TestLZCompression)
+{
+    const int num_try = 5;
+    // float arrays with many repeats, like typical scene caches
+    RawVector<float3> points;
+    points.resize_discard(1024 * 1024 * 8);
+    for (size_t i = 0; i < points.size(); ++i)
+        points[i] = { (float)(i % 1000) * 0.5f, (float)(i / 1000 % 64), 1.0f };
+    auto* raw = (const char*)points.cdata();
+    size_t raw_size = points.size() * sizeof(float3);
+    double mb = (double)raw_size / (1024.0 * 1024.0);
+
+    RawVector<char> packed, unpacked;
+    auto c = Now();
+    for (int i = 0; i < num_try; ++i)
+        mu::Compress(packed, raw, raw_size);
+    auto d = Now();
+    for (int i = 0; i < num_try; ++i)
+        Expect(mu::Decompress(unpacked, packed.cdata(), packed.size()));
+    auto end = Now();
+    Print("    Compress %.0f MB/s, Decompress %.0f MB/s, ratio %.2f\n",
+        mb * num_try * 1000.0 / NS2MS(d - c), mb * num_try * 1000.0 / NS2MS(end - d), (double)raw_size / (double)packed.size());
+    Expect(unpacked.size() == raw_size && memcmp(unpacked.cdata(), raw, raw_size) == 0);
+
+    // corrupted frames must be rejected
+    Expect(!mu::Decompress(unpacked, packed.cdata(), packed.size() / 2));
+    // a header alone claims the whole frame. it is rejected before dst is sized for it
+    unpacked.clear();
+    Expect(!mu::Decompress(unpacked, packed.cdata(), mu::LZFrameHeaderSize));
+    Expect(unpacked.empty());
+
+    // stream: several frames plus a small tail, and random data that is stored as is
+    RawVector<char> noise;
+    noise.resize_discard(1024 * 300);
+    uint32_t seed = 1;
+    for (auto& v : noise) {
+        seed = seed * 1664525u + 1013904223u;
+        v = (char)(seed >> 24);
+    }
+
+    RawVector<char> buf;
+    {
+        mu::MemoryStream ms(buf);
+        mu::LZOStream os(ms, 1024 * 1024);
+        os.write(raw, raw_size);
+        os.write(noise.cdata(), noise.size());
+        os << "tail";
+        os.flush();
+        Expect(os.getRawSize() == raw_size + noise.size() + 4);
+        ms.flush();
+        buf.resize(ms.getWCount());
+    }
+    {
+        mu::MemoryStream ms(buf);
+        mu::LZIStream is(ms);
+        unpacked.resize_discard(raw_size + noise.size() + 4);
+        is.read(unpacked.data(), unpacked.size());
+        Expect((size_t)is.gcount() == unpacked.size());
+        Expect(memcmp(unpacked.cdata(), raw, raw_size) == 0);
+        Expect(memcmp(unpacked.cdata() + raw_size, noise.cdata(), noise.size()) == 0);
+        Expect(memcmp(unpacked.cdata() + raw_size + noise.size(), "tail", 4) == 0);
+        Expect(is.get() == EOF);
+    }
+
+    // frames over the limit of the reader are treated as corrupted
+    {
+        mu::MemoryStream ms(buf);
+        mu::LZIStream is(ms, 1024 * 64);
+        Expect(is.get() == EOF);
+    }
+    // a broken header that claims huge sizes must not be allocated
+    {
+        RawVector<char> broken = buf;
+        uint64_t huge = 1ull << 40;
+        memcpy(broken.data() + 8, &huge, sizeof(huge));  // raw_size
+        memcpy(broken.data() + 16, &huge, sizeof(huge)); // frame_size
+        mu::MemoryStream ms(broken);
+        mu::LZIStream is(ms);
+        Expect(is.get() == EOF);
+    }
+}
+
+TestCase(TestMappedStream)
+{
+    const char* path = "mapped_stream.bin";
+    RawVector<int> data;
+    data.resize_discard(1024 * 1024 * 4);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (int)i;
+    Span<char> bytes((const char*)data.cdata(), data.size() * sizeof(int));
+    Expect(mu::BufferToFile(path, bytes));
+
+    mu::MappedStream is(path);
+    Expect(is.good() && is.getFile().size() == data.size() * sizeof(int));
+
+    // zero-copy access and regular reads on the same stream
+    auto* head = (const int*)is.gskip(sizeof(int) * 4);
+    Expect(head && head[0] == 0 && head[3] == 3);
+    int v = 0;
+    is.read((char*)&v, sizeof(v));
+    Expect(v == 4 && is.getRCount() == sizeof(int) * 5);
+
+    is.seekg(-(std::streamoff)sizeof(int), std::ios::end);
+    is.read((char*)&v, sizeof(v));
+    Expect(v == (int)data.size() - 1);
+    Expect(is.gskip(1) == nullptr);
+    Expect(is.get() == EOF);
+
+    is.clear();
+    is.seekg(0);
+    is.getFile().advise(mu::MappedFile::Access::Random);
+    Expect(memcmp(is.gskip(data.size() * sizeof(int)), data.cdata(), data.size() * sizeof(int)) == 0);
+
+    is.close();
+    Expect(!is.open("mapped_stream_not_exist.bin") && is.fail());
+}
+
+TestCase(TestAsyncIO)
+{
+    const int num_files = 64;
+    const size_t file_size = 1024 * 1024;
+    std::vector<mu::IORequest> reqs(num_files);
+    RawVector<char> data;
+    data.resize_discard(file_size);
+    for (int i = 0; i < num_files; ++i) {
+        for (size_t j = 0; j < file_size; ++j)
+            data[j] = char(i + j);
+        reqs[i].path = mu::Format("async_io%d.bin", i);
+        Expect(mu::BufferToFile(reqs[i].path.c_str(), data));
+    }
+
+    mu::AsyncIO io;
+    Print("    %s\n", io.isIOUring() ? "io_uring" : "thread pool");
+
+    std::atomic_int num_callbacks{ 0 };
+    std::vector<std::future<mu::IOResult>> results;
+    TestScope("batched read", [&]() {
+        results = io.read(reqs, [&](size_t, mu::IOResult& r) {
+            if (r.ok)
+                ++num_callbacks;
+        });
+        io.wait();
+    });
+    Expect(num_callbacks == num_files);
+    for (int i = 0; i < num_files; ++i) {
+        auto r = results[i].get();
+        Expect(r.ok && r.size == file_size && r.data.size() == file_size);
+        Expect(r.data[0] == char(i) && r.data[file_size - 1] == char(i + file_size - 1));
+    }
+
+    // part of a file into the caller's buffer. reading past the end is truncated
+    char part[16];
+    mu::IORequest req;
+    req.path = reqs[3].path;
+    req.offset = file_size - 8;
+    req.size = sizeof(part);
+    req.dst = part;
+    auto r = io.read(req).get();
+    Expect(r.ok && r.size == 8 && r.data.empty() && part[0] == char(3 + file_size - 8));
+
+    Expect(!io.readFile("async_io_not_exist.bin").get().ok);
+}
+
+TestCase(TestAsyncOStream)
+{
+    const size_t bufsize = 1024 * 64;
+    const int num_buffers = 4;
+    const int num_frames = 32;
+
+    // slow consumer. the producer only waits when all buffers are queued
+    RawVector<char> written;
+    std::atomic_int num_writes{ 0 };
+    auto sink = [&](const char* data, size_t size) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        written.insert(written.end(), data, data + size);
+        ++num_writes;
+        return true;
+    };
+
+    RawVector<char> frame;
+    frame.resize_discard(bufsize);
+    mu::AsyncOStream os(sink, bufsize, num_buffers);
+    TestScope("write", [&]() {
+        for (int i = 0; i < num_frames; ++i) {
+            memset(frame.data(), i, frame.size());
+            os.write(frame.cdata(), frame.size());
+        }
+    });
+    TestScope("close", [&]() { Expect(os.close()); });
+    Expect(num_writes == num_frames);
+    Expect(written.size() == bufsize * num_frames);
+    Expect(written[0] == 0 && written[bufsize * 3] == 3 && written.back() == num_frames - 1);
+
+    // to another stream
+    RawVector<char> buf;
+    {
+        mu::MemoryStream ms(buf);
+        mu::AsyncOStream aos(ms, 16);
+        aos << "async" << 123;
+        Expect(aos.close());
+        ms.flush();
+        buf.resize(ms.getWCount());
+    }
+    Expect(std::string(buf.cdata(), buf.size()) == "async123");
+
+    // a failing sink makes the stream fail instead of blocking
+    mu::AsyncOStream bad([](const char*, size_t) { return false; }, 16, 2);
+    for (int i = 0; i < 16; ++i)
+        bad << "0123456789";
+    Expect(!bad.close());
+}
+
+TestCase(TestPipeStream)
+{
+#ifndef _WIN32
+    // a child process writes what it receives to a file. cat is not available on Windows
+    const char* path = "pipe_stream.bin";
+    auto write_cmd = std::string("cat > ") + path;
+    auto read_cmd = std::string("cat ") + path;
+    auto read_file = [&]() {
+        std::ifstream ifs(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    };
+
+    // binary: every byte value, larger than the buffers of the writer thread.
+    // close() and then the destructor closes again
+    std::string bin;
+    bin.resize(1024 * 1024 + 17);
+    for (size_t i = 0; i < bin.size(); ++i)
+        bin[i] = (char)(i * 7 + i / 256);
+    {
+        mu::PipeStream ps(write_cmd.c_str(), std::ios::out | std::ios::binary);
+        Expect(ps.good());
+        ps.write(bin.data(), bin.size());
+        Expect(ps.close() == 0);
+        Expect(ps.close() == 0);
+    }
+    Expect(read_file() == bin);
+    {
+        mu::PipeStream ps(read_cmd.c_str(), std::ios::in | std::ios::binary);
+        std::string result(bin.size(), '\0');
+        ps.read(&result[0], result.size());
+        Expect((size_t)ps.gcount() == bin.size() && result == bin);
+    }
+
+    // text: closed by the destructor only
+    std::string text;
+    {
+        mu::PipeStream ps(write_cmd.c_str(), std::ios::out);
+        for (int i = 0; i < 10000; ++i) {
+            ps << "line " << i << "\n";
+            text += "line " + std::to_string(i) + "\n";
+        }
+    }
+    Expect(read_file() == text);
+    {
+        mu::PipeStream ps(read_cmd.c_str(), std::ios::in);
+        std::string line;
+        int n = 0;
+        bool match = true;
+        while (std::getline(ps, line))
+            match &= line == "line " + std::to_string(n++);
+        Expect(match && n == 10000);
+    }
+#endif
+}
+
+TestCase(TestNodeLookup)
+{
+    const int num_nodes = 100000;
+    Scene scene;
+    auto root = scene.createNode(nullptr, "/", Node::Type::Root);
+    std::vector<Node*> parents{ root };
+    TestScope("createNode", [&]() {
+        for (int i = 0; i < num_nodes; ++i)
+            parents.push_back(scene.createNode<XformNode>(parents[i / 4], mu::Format("Node%d", i)));
+    });
+
+    int num_found = 0;
+    TestScope("findNodeByPath", [&]() {
+        for (auto& n : scene.nodes) {
+            if (scene.findNodeByPath(n->path) == n.get())
+                ++num_found;
+        }
+    });
+    Expect(num_found == (int)scene.nodes.size());
+    Expect(scene.findNodeByPath("/Node0/NotExist") == nullptr);
+    Expect(scene.findNodeByID(parents.back()->id) == parents.back());
+
+    int num_children = 0;
+    TestScope("eachChildR", [&]() {
+        num_children = 0;
+        root->eachChildR([&](Node*) { ++num_children; });
+    }, 5);
+    Expect(num_children == num_nodes);
+}
+
+TestCase(TestNodeEdit)
+{
+    Scene scene;
+    auto root = scene.createNode(nullptr, "/", Node::Type::Root);
+    auto a = scene.createNode<XformNode>(root, "A");
+    auto b = scene.createNode<XformNode>(a, "B");
+    auto c = scene.createNode<MeshNode>(b, "C");
+    auto d = scene.createNode<XformNode>(root, "D");
+    a->local_matrix = mu::transform(float3{ 1.0f, 0.0f, 0.0f }, quatf::identity(), float3::one());
+    d->local_matrix = mu::transform(float3{ 0.0f, 2.0f, 0.0f }, quatf::identity(), float3::one());
+    scene.updateGlobalMatrices();
+
+    // build the index before editing
+    Expect(scene.findNodeByPath("/A/B/C") == c);
+
+    scene.renameNode(b, "B2");
+    Expect(b->path == "/A/B2" && c->path == "/A/B2/C");
+    Expect(scene.findNodeByPath("/A/B/C") == nullptr);
+    Expect(scene.findNodeByPath("/A/B2") == b);
+    Expect(scene.findNodeByPath("/A/B2/C") == c);
+
+    scene.reparentNode(b, d);
+    Expect(c->path == "/D/B2/C");
+    Expect(b->parent_xform == d && a->children.empty() && d->children.size() == 1);
+    Expect(scene.findNodeByPath("/A/B2/C") == nullptr);
+    Expect(scene.findNodeByPath("/D/B2/C") == c);
+    scene.updateGlobalMatrices();
+    Expect(c->global_matrix[3].y == 2.0f && c->global_matrix[3].x == 0.0f);
+
+    // a node can't be moved under its own descendant
+    scene.reparentNode(d, c);
+    Expect(d->parent == root);
+
+    scene.clearDirty();
+    scene.removeNode(b);
+    Expect(b->removed && c->removed && !d->removed);
+    Expect(d->children.empty());
+    Expect(c->isDirty(DirtyFlag::All));
+    Expect(scene.findNodeByPath("/D/B2") == nullptr);
+    Expect(scene.findNodeByPath("/D/B2/C") == nullptr);
+    Expect(scene.findNodeByPath("/D") == d);
+
+    // a new node can take the path of a removed one
+    auto b3 = scene.createNode<XformNode>(d, "B2");
+    Expect(scene.findNodeByPath("/D/B2") == b3);
+    scene.updateGlobalMatrices();
+    Expect(b3->global_matrix[3].y == 2.0f);
+
+    // global matrices set directly (as importers do) survive updates and rebuilds of the hierarchy
+    a->setGlobalTRS(float3{ 7.0f, 0.0f, 0.0f }, quatf::identity(), float3::one());
+    scene.updateGlobalMatrices();
+    scene.createNode<XformNode>(root, "E");
+    scene.updateGlobalMatrices();
+    Expect(a->global_matrix[3].x == 7.0f);
+}
+
+TestCase(TestTransformHierarchy)
+{
+    const int num = 100000;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> d(-1.0f, 1.0f);
+
+    // parents precede children as joints and nodes are added.
+    // rotations about random axes and non-uniform scales, so that every element of the matrices matters.
+    auto random_matrix = [&]() {
+        auto axis = mu::normalize(float3{ d(rng), d(rng), d(rng) } + float3{ 0.0f, 2.0f, 0.0f });
+        auto scale = float3{ 1.0f + d(rng) * 0.05f, 1.0f + d(rng) * 0.05f, 1.0f + d(rng) * 0.05f };
+        return mu::transform(float3{ d(rng), d(rng), d(rng) }, mu::rotate(axis, d(rng)), scale);
+    };
+    RawVector<int> parents;
+    RawVector<float4x4> locals, expected;
+    for (int i = 0; i < num; ++i) {
+        parents.push_back(i < 10 ? -1 : (int)(rng() % i));
+        locals.push_back(random_matrix());
+    }
+    auto update_expected = [&]() {
+        expected.resize(num);
+        for (int i = 0; i < num; ++i)
+            expected[i] = parents[i] < 0 ? locals[i] : locals[i] * expected[parents[i]];
+    };
+    auto check = [&](TransformHierarchy& th) {
+        update_expected();
+        for (int i = 0; i < num; ++i) {
+            auto& a = th.getGlobal(i);
+            auto& e = expected[i];
+            for (int r = 0; r < 4; ++r)
+                if (!mu::near_equal(a[r], e[r], 1e-3f))
+                    return false;
+        }
+        return true;
+    };
+
+    TransformHierarchy th;
+    th.build(parents.cdata(), num);
+    for (int i = 0; i < num; ++i)
+        th.setLocal(i, locals[i]);
+    TestScope("update (all)", [&]() { th.markAllDirty(); th.update(); }, 5);
+    Expect(check(th));
+
+    for (int k = 0; k < 10; ++k) {
+        int i = rng() % num;
+        locals[i] = random_matrix();
+        th.setLocal(i, locals[i]);
+    }
+    TestScope("update (10 dirty)", [&]() { th.update(); });
+    Expect(check(th));
+
+    // reparenting a joint keeps the joint count. the skeleton has to notice it anyway
+    SkeletonNode skel;
+    auto* j0 = skel.addJoint("/j0");
+    auto* j1 = skel.addJoint("/j0/j1");
+    auto* j2 = skel.addJoint("/j0/j1/j2");
+    j1->parent = j0;
+    j2->parent = j1;
+    j0->local_matrix = mu::transform(float3{ 1.0f, 0.0f, 0.0f }, quatf::identity(), float3::one());
+    j1->local_matrix = mu::transform(float3{ 0.0f, 2.0f, 0.0f }, quatf::identity(), float3::one());
+    j2->local_matrix = mu::transform(float3{ 0.0f, 0.0f, 4.0f }, quatf::identity(), float3::one());
+    skel.updateGlobalMatrices(float4x4::identity());
+    Expect(j2->global_matrix[3] == (float4{ 1.0f, 2.0f, 4.0f, 1.0f }));
+    j2->parent = j0;
+    skel.updateGlobalMatrices(float4x4::identity());
+    Expect(j2->global_matrix[3] == (float4{ 1.0f, 0.0f, 4.0f, 1.0f }));
+
+    // global matrices set directly are kept unless their local matrices change
+    j1->setGlobalTRS(float3{ 5.0f, 0.0f, 0.0f }, quatf::identity(), float3::one());
+    skel.updateGlobalMatrices(float4x4::identity());
+    Expect(j1->global_matrix[3] == (float4{ 5.0f, 0.0f, 0.0f, 1.0f }));
+    j1->local_matrix = mu::transform(float3{ 0.0f, 3.0f, 0.0f }, quatf::identity(), float3::one());
+    skel.updateGlobalMatrices(float4x4::identity());
+    Expect(j1->global_matrix[3] == (float4{ 1.0f, 3.0f, 0.0f, 1.0f }));
+}
+
+// reference: the per-vertex loop MeshNode::applySkinning used before joint matrices were blended
+static void ApplySkinningReference(MeshNode& mesh, float3* dst_points, float3* dst_normals)
+{
+    RawVector<float4x4> joint_matrices;
+    for (auto j : mesh.joints)
+        joint_matrices.push_back(mu::invert(j->bindpose) * j->global_matrix);
+
+    int npoints = (int)mesh.points.size();
+    int nnormals = (int)mesh.normals.size();
+    auto skin = [&](int pi, auto&& mul, const float3& v) {
+        auto* iv = mesh.joint_indices.cdata() + pi * mesh.joints_per_vertex;
+        auto* wv = mesh.joint_weights.cdata() + pi * mesh.joints_per_vertex;
+        auto t = mul(mesh.bind_transform, v);
+        auto r = float3::zero();
+        for (int ji = 0; ji < mesh.joints_per_vertex; ++ji)
+            r += mul(joint_matrices[iv[ji]], t) * wv[ji];
+        return r;
+    };
+    auto mul_p = [](const float4x4& m, const float3& v) { return mu::mul_p(m, v); };
+    auto mul_v = [](const float4x4& m, const float3& v) { return mu::mul_v(m, v); };
+
+    for (int pi = 0; pi < npoints; ++pi)
+        dst_points[pi] = skin(pi, mul_p, dst_points[pi]);
+    for (int ni = 0; ni < nnormals; ++ni)
+        dst_normals[ni] = skin(nnormals == npoints ? ni : mesh.indices[ni], mul_v, dst_normals[ni]);
+}
+
+TestCase(TestSkinningEquivalence)
+{
+    const int num_points = 10000;
+    const int num_joints = 64;
+    const int jpv = 4;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> d(-1.0f, 1.0f);
+    auto random_matrix = [&]() {
+        return mu::transform(float3{ d(rng), d(rng), d(rng) }, mu::rotate(mu::normalize(float3{ d(rng), d(rng), d(rng) } + float3{ 0.0f, 2.0f, 0.0f }), d(rng)), float3::one());
+    };
+
+    Scene scene;
+    auto root = scene.createNode(nullptr, "/", Node::Type::Root);
+    auto skel = scene.createNode<SkeletonNode>(root, "Skeleton");
+    auto mesh = scene.createNode<MeshNode>(root, "Mesh");
+    for (int i = 0; i < num_joints; ++i) {
+        auto joint = skel->addJoint(mu::Format("Joint%d", i));
+        joint->bindpose = random_matrix();
+        joint->global_matrix = random_matrix();
+        mesh->joints.push_back(joint);
+    }
+    mesh->skeleton = skel;
+    mesh->bind_transform = random_matrix();
+    mesh->joints_per_vertex = jpv;
+    for (int i = 0; i < num_points; ++i) {
+        mesh->points.push_back(float3{ d(rng), d(rng), d(rng) } * 10.0f);
+        float total = 0.0f;
+        for (int j = 0; j < jpv; ++j) {
+            float w = d(rng) + 1.0f;
+            mesh->joint_indices.push_back(rng() % num_joints);
+            mesh->joint_weights.push_back(w);
+            total += w;
+        }
+        for (int j = 0; j < jpv; ++j)
+            mesh->joint_weights[i * jpv + j] /= total;
+    }
+    for (int i = 0; i < num_points * 3; ++i)
+        mesh->indices.push_back(rng() % num_points);
+    for (int i = 0; i < num_points; ++i)
+        mesh->counts.push_back(3);
+
+    auto compare = [&](const char* name) {
+        RawVector<float3> points = mesh->points, normals = mesh->normals;
+        RawVector<float3> ref_points = points, ref_normals = normals;
+        TestScope(name, [&]() { mesh->applySkinning(points.data(), normals.data()); });
+        ApplySkinningReference(*mesh, ref_points.data(), ref_normals.data());
+
+        // bind_transform is folded in the joint matrices now, so results differ by rounding only
+        int num_mismatch = 0;
+        for (size_t i = 0; i < points.size(); ++i) {
+            if (!mu::near_equal(points[i], ref_points[i], 1e-3f))
+                ++num_mismatch;
+        }
+        for (size_t i = 0; i < normals.size(); ++i) {
+            if (!mu::near_equal(normals[i], ref_normals[i], 1e-4f))
+                ++num_mismatch;
+        }
+        Expect(num_mismatch == 0);
+    };
+
+    // per-vertex normals
+    for (int i = 0; i < num_points; ++i)
+        mesh->normals.push_back(mu::normalize(float3{ d(rng), d(rng), d(rng) } + float3{ 0.0f, 0.0f, 2.0f }));
+    compare("applySkinning (per-vertex normals)");
+
+    // per-index normals
+    mesh->normals.clear();
+    for (int i = 0; i < num_points * 3; ++i)
+        mesh->normals.push_back(mu::normalize(float3{ d(rng), d(rng), d(rng) } + float3{ 0.0f, 0.0f, 2.0f }));
+    compare("applySkinning (per-index normals)");
+
+    // changed bindposes must invalidate the cached inverses
+    mesh->joints[0]->bindpose = random_matrix();
+    compare("applySkinning (bindpose changed)");
+}
+
+// reference: MeshNode::convert as it was before options were fused into one pass per attribute
+static void ConvertReference(MeshNode& mesh, const ConvertOptions& opt)
+{
+    mesh.XformNode::convert(opt);
+
+    if (opt.scale_factor != 1.0f) {
+        mu::Scale(mesh.points.data(), opt.scale_factor, mesh.points.size());
+        (float3&)mesh.bind_transform[3] *= opt.scale_factor;
+        mesh.eachBSTarget([&opt](auto& t) {
+            mu::Scale(t.point_offsets.data(), opt.scale_factor, t.point_offsets.size());
+        });
+    }
+    if (opt.flip_x) {
+        mu::InvertX(mesh.points.data(), mesh.points.size());
+        mu::InvertX(mesh.normals.data(), mesh.normals.size());
+        mesh.bind_transform = mu::flip_x(mesh.bind_transform);
+        mesh.eachBSTarget([](auto& t) {
+            mu::InvertX(t.point_offsets.data(), t.point_offsets.size());
+            mu::InvertX(t.normal_offsets.data(), t.normal_offsets.size());
+        });
+    }
+    if (opt.flip_yz) {
+        auto convert = [](auto& v) { return mu::flip_z(mu::swap_yz(v)); };
+        for (auto& v : mesh.points) v = convert(v);
+        for (auto& v : mesh.normals) v = convert(v);
+        mesh.bind_transform = convert(mesh.bind_transform);
+        mesh.eachBSTarget([&convert](auto& t) {
+            for (auto& v : t.point_offsets) v = convert(v);
+            for (auto& v : t.normal_offsets) v = convert(v);
+        });
+    }
+    if (opt.flip_v)
+        mu::InvertV(mesh.uvs.data(), mesh.uvs.size());
+    if (opt.flip_faces) {
+        size_t nindices = mesh.indices.size();
+        auto do_flip = [&mesh](auto* data) {
+            for (int c : mesh.counts) {
+                std::reverse(data, data + c);
+                data += c;
+            }
+        };
+        do_flip(mesh.indices.data());
+        if (mesh.uvs.size() == nindices)
+            do_flip(mesh.uvs.data());
+        if (mesh.normals.size() == nindices)
+            do_flip(mesh.normals.data());
+        if (mesh.colors.size() == nindices)
+            do_flip(mesh.colors.data());
+        mesh.eachBSTarget([&](auto& t) {
+            if (t.normal_offsets.size() == nindices)
+                do_flip(t.normal_offsets.data());
+        });
+    }
+}
+
+TestCase(TestConvertEquivalence)
+{
+    const int num_faces = 5000;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> d(-1.0f, 1.0f);
+    auto rand3 = [&]() { return float3{ d(rng), d(rng), d(rng) }; };
+
+    Scene scene;
+    auto root = scene.createNode(nullptr, "/", Node::Type::Root);
+    auto make_mesh = [&](const std::string& name, bool per_index_normals) {
+        rng.seed(0);
+        auto mesh = scene.createNode<MeshNode>(root, name.c_str());
+        mesh->local_matrix = mesh->global_matrix = mu::transform(rand3(), mu::rotate(float3{ 0.0f, 1.0f, 0.0f }, d(rng)), float3::one());
+        mesh->bind_transform = mu::transform(rand3(), mu::rotate(float3{ 1.0f, 0.0f, 0.0f }, d(rng)), float3::one());
+        int num_points = num_faces * 2;
+        for (int i = 0; i < num_points; ++i)
+            mesh->points.push_back(rand3() * 10.0f);
+        for (int fi = 0; fi < num_faces; ++fi) {
+            int c = 3 + (int)(rng() % 3);
+            mesh->counts.push_back(c);
+            for (int i = 0; i < c; ++i) {
+                mesh->indices.push_back(rng() % num_points);
+                mesh->uvs.push_back(float2{ d(rng), d(rng) });
+                mesh->colors.push_back(float4{ d(rng), d(rng), d(rng), 1.0f });
+            }
+        }
+        int num_normals = per_index_normals ? (int)mesh->indices.size() : num_points;
+        for (int i = 0; i < num_normals; ++i)
+            mesh->normals.push_back(rand3());
+
+        auto bs = scene.createNode<BlendshapeNode>(root, (name + "_BS").c_str());
+        for (int ti = 0; ti < 2; ++ti) {
+            auto t = bs->addTarget(0.5f * float(ti + 1));
+            for (int i = 0; i < num_points; ++i)
+                t->point_offsets.push_back(rand3());
+            for (int i = 0; i < num_normals; ++i)
+                t->normal_offsets.push_back(rand3());
+        }
+        mesh->blendshapes.push_back(bs);
+        return mesh;
+    };
+
+    int num_mismatch = 0;
+    for (int per_index = 0; per_index < 2; ++per_index) {
+        for (int bits = 0; bits < 32; ++bits) {
+            ConvertOptions opt;
+            opt.scale_factor = (bits & 1) ? 0.01f : 1.0f;
+            opt.flip_v = (bits & 2) != 0;
+            opt.flip_x = (bits & 4) != 0;
+            opt.flip_yz = (bits & 8) != 0;
+            opt.flip_faces = (bits & 16) != 0;
+
+            auto a = make_mesh(mu::Format("A%d_%d", per_index, bits), per_index != 0);
+            auto b = make_mesh(mu::Format("B%d_%d", per_index, bits), per_index != 0);
+            a->convert(opt);
+            ConvertReference(*b, opt);
+
+            bool eq = BitEqual(a->points, b->points) && BitEqual(a->normals, b->normals) &&
+                BitEqual(a->uvs, b->uvs) && BitEqual(a->colors, b->colors) && BitEqual(a->indices, b->indices) &&
+                a->bind_transform == b->bind_transform && a->global_matrix == b->global_matrix;
+            for (size_t ti = 0; ti < a->blendshapes[0]->targets.size(); ++ti) {
+                auto& ta = *a->blendshapes[0]->targets[ti];
+                auto& tb = *b->blendshapes[0]->targets[ti];
+                eq = eq && BitEqual(ta.point_offsets, tb.point_offsets) && BitEqual(ta.normal_offsets, tb.normal_offsets);
+            }
+            if (!eq) {
+                Print("    mismatch: per_index_normals=%d options=%d\n", per_index, bits);
+                ++num_mismatch;
+            }
+        }
+    }
+    Expect(num_mismatch == 0);
+}
+
+// reference: MeshNode::buildFaceSets / buildMaterialIDs as they were before the counting sort
+static void BuildFaceSetsReference(MeshNode& mesh)
+{
+    mesh.facesets.resize(mesh.materials.size() + 1);
+    for (size_t i = 0; i < mesh.facesets.size(); ++i) {
+        auto& faceset = mesh.facesets[i];
+        faceset = std::make_shared<FaceSet>();
+        if (i < mesh.materials.size())
+            faceset->material = mesh.materials[i];
+    }
+    for (int fi = 0; fi < (int)mesh.material_ids.size(); ++fi) {
+        int mid = mesh.material_ids[fi];
+        if (mid >= 0)
+            mesh.facesets[mid]->faces.push_back(fi);
+    }
+    erase_if(mesh.facesets, [](auto& faceset) {
+        return faceset->faces.empty();
+    });
+}
+
+static void BuildMaterialIDsReference(MeshNode& mesh)
+{
+    mesh.material_ids.resize_discard(mesh.counts.size());
+    fill(mesh.material_ids, -1);
+    for (int i = (int)mesh.facesets.size() - 1; i >= 0; --i) {
+        auto m = mesh.facesets[i]->material;
+        int mi = m ? m->index : -1;
+        for (int f : mesh.facesets[i]->faces)
+            mesh.material_ids[f] = mi;
+    }
+}
+
+TestCase(TestFaceSetsEquivalence)
+{
+    const int num_faces = 100000;
+    const int num_materials = 7;
+    std::mt19937 rng(0);
+
+    Scene scene;
+    auto root = scene.createNode(nullptr, "/", Node::Type::Root);
+    auto mesh = scene.createNode<MeshNode>(root, "Mesh");
+    auto ref = scene.createNode<MeshNode>(root, "Reference");
+    for (int i = 0; i < num_materials; ++i) {
+        auto material = scene.createNode<MaterialNode>(root, mu::Format("Material%d", i));
+        material->index = i;
+        mesh->materials.push_back(material);
+    }
+    for (int i = 0; i < num_faces; ++i) {
+        mesh->counts.push_back(3);
+        // -1 and the extra bin (== num_materials) are valid too
+        mesh->material_ids.push_back((int)(rng() % (num_materials + 2)) - 1);
+    }
+    ref->counts = mesh->counts;
+    ref->materials = mesh->materials;
+    ref->material_ids = mesh->material_ids;
+
+    auto facesets_equal = [](const MeshNode& a, const MeshNode& b) {
+        if (a.facesets.size() != b.facesets.size())
+            return false;
+        for (size_t i = 0; i < a.facesets.size(); ++i) {
+            if (a.facesets[i]->material != b.facesets[i]->material || !BitEqual(a.facesets[i]->faces, b.facesets[i]->faces))
+                return false;
+        }
+        return true;
+    };
+
+    TestScope("buildFaceSets", [&]() { mesh->buildFaceSets(false); });
+    BuildFaceSetsReference(*ref);
+    Expect(facesets_equal(*mesh, *ref));
+
+    // sorted facesets (output of buildFaceSets)
+    TestScope("buildMaterialIDs", [&]() { mesh->buildMaterialIDs(false); });
+    BuildMaterialIDsReference(*ref);
+    Expect(BitEqual(mesh->material_ids, ref->material_ids));
+
+    // unsorted facesets with overlaps. earlier facesets win.
+    for (auto* m : { mesh, ref }) {
+        auto dummy = std::make_shared<FaceSet>();
+        for (int i = 0; i < num_faces / 2; ++i)
+            dummy->faces.push_back(rng() % num_faces);
+        m->facesets.push_back(dummy);
+        std::reverse(m->facesets[0]->faces.begin(), m->facesets[0]->faces.end());
+    }
+    mesh->facesets.back()->faces = ref->facesets.back()->faces;
+    mesh->buildMaterialIDs(false);
+    BuildMaterialIDsReference(*ref);
+    Expect(BitEqual(mesh->material_ids, ref->material_ids));
+}
+
+TestCase(TestMulAddIndexed)
+{
+    const int num_dst = 1000;
+    const int num_src = 100000;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> d(-1.0f, 1.0f);
+
+    // unsorted and heavily duplicated indices. runs of the same index land in one SIMD gang.
+    RawVector<float3> src;
+    RawVector<int> indices;
+    for (int i = 0; i < num_src; ++i) {
+        src.push_back(float3{ d(rng), d(rng), d(rng) });
+        indices.push_back(i % 64 < 16 ? (i / 64) % num_dst : (int)(rng() % num_dst));
+    }
+
+    RawVector<float3> expected, actual;
+    expected.resize_zeroclear(num_dst);
+    actual.resize_zeroclear(num_dst);
+    mu::MulAddIndexed_Generic(expected.data(), src.cdata(), indices.cdata(), num_src, 0.5f);
+    TestScope("MulAddIndexed", [&]() {
+        mu::MulAddIndexed(actual.data(), src.cdata(), indices.cdata(), num_src, 0.5f);
+    });
+    Expect(BitEqual(actual, expected));
+}
+
+TestCase(TestBoundedConversion)
+{
+    // the dispatched versions go to MeshUtilsCore.ispc when it is enabled. the generic ones are the reference.
+    // odd counts leave a tail after the last full block of nc * lanes, and values out of bounds are clamped.
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> d(-1.2f, 1.2f);
+    const float bmin[4] = { -1.0f, -0.5f, 0.0f, -2.0f };
+    const float size[4] = { 2.0f, 1.0f, 1.0f, 3.0f };
+    float rsize[4];
+    for (int c = 0; c < 4; ++c)
+        rsize[c] = 1.0f / size[c];
+
+    for (int nc = 1; nc <= 4; ++nc) {
+        for (size_t num : { 1, 7, 1000, 1003 }) {
+            RawVector<float> src(num * nc);
+            for (auto& v : src)
+                v = d(rng);
+
+            RawVector<mu::unorm8> e8(src.size()), a8(src.size());
+            RawVector<mu::unorm16> e16(src.size()), a16(src.size());
+            mu::F32ToU8B_Generic(e8.data(), src.cdata(), num, nc, bmin, rsize);
+            mu::F32ToU8B(a8.data(), src.cdata(), num, nc, bmin, rsize);
+            mu::F32ToU16B_Generic(e16.data(), src.cdata(), num, nc, bmin, rsize);
+            mu::F32ToU16B(a16.data(), src.cdata(), num, nc, bmin, rsize);
+            Expect(BitEqual(a8, e8));
+            Expect(BitEqual(a16, e16));
+
+            // decoding may be fused into multiply-adds
+            RawVector<float> ef(src.size()), af(src.size());
+            mu::U8BToF32_Generic(ef.data(), e8.cdata(), num, nc, bmin, size);
+            mu::U8BToF32(af.data(), e8.cdata(), num, nc, bmin, size);
+            Expect(mu::NearEqual(af.cdata(), ef.cdata(), af.size(), 1e-5f));
+            mu::U16BToF32_Generic(ef.data(), e16.cdata(), num, nc, bmin, size);
+            mu::U16BToF32(af.data(), e16.cdata(), num, nc, bmin, size);
+            Expect(mu::NearEqual(af.cdata(), ef.cdata(), af.size(), 1e-5f));
+        }
+    }
+}
+
+TestCase(TestInstancerBake)
+{
+    const int num_instances = 1000;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> d(-1.0f, 1.0f);
+    auto rand3 = [&]() { return float3{ d(rng), d(rng), d(rng) }; };
+    auto random_matrix = [&]() {
+        return mu::transform(rand3() * 10.0f, mu::rotate(float3{ 0.0f, 1.0f, 0.0f }, d(rng)), float3::one());
+    };
+
+    Scene scene;
+    auto root = scene.createNode(nullptr, "/", Node::Type::Root);
+    MaterialNode* materials[3];
+    for (int i = 0; i < 3; ++i) {
+        materials[i] = scene.createNode<MaterialNode>(root, mu::Format("Material%d", i));
+        materials[i]->index = i;
+    }
+
+    // two protos with different attribute sets and materials
+    auto make_mesh = [&](Node* parent, const char* name, int num_faces, bool uvs, std::vector<MaterialNode*> mats) {
+        auto mesh = scene.createNode<MeshNode>(parent, name);
+        mesh->local_matrix = mesh->global_matrix = random_matrix();
+        for (int i = 0; i < num_faces + 2; ++i)
+            mesh->points.push_back(rand3());
+        for (int fi = 0; fi < num_faces; ++fi) {
+            mesh->counts.push_back(3);
+            for (int i = 0; i < 3; ++i) {
+                mesh->indices.push_back(fi + i);
+                mesh->normals.push_back(mu::normalize(rand3()));
+                if (uvs)
+                    mesh->uvs.push_back(float2{ d(rng), d(rng) });
+            }
+            mesh->material_ids.push_back((int)mats.size() > 1 ? fi % 2 : 0);
+        }
+        mesh->materials = mats;
+        mesh->buildFaceSets(false);
+        return mesh;
+    };
+    auto proto0 = scene.createNode<XformNode>(root, "Proto0");
+    make_mesh(proto0, "Mesh0", 10, true, { materials[0], materials[1] });
+    auto proto1 = scene.createNode<XformNode>(root, "Proto1");
+    make_mesh(proto1, "Mesh1", 7, false, { materials[2] });
+
+    auto inst = scene.createNode<InstancerNode>(root, "Instancer");
+    inst->protos = { proto0, proto1 };
+    for (int i = 0; i < num_instances; ++i) {
+        inst->proto_indices.push_back(rng() % 2);
+        inst->matrices.push_back(random_matrix());
+    }
+    float4x4 trans = random_matrix();
+
+    MeshNode baked;
+    TestScope("InstancerNode::bake", [&]() { baked.clear(); inst->bake(baked, trans); });
+
+    // reference: merge instances one by one, then transform
+    MeshNode ref;
+    for (int i = 0; i < num_instances; ++i)
+        ref.merge(inst->proto_records[inst->proto_indices[i]].merged_mesh, inst->matrices[i]);
+    mu::MulPoints(trans, ref.points.data(), ref.points.data(), ref.points.size());
+    mu::MulVectors(trans, ref.normals.data(), ref.normals.data(), ref.normals.size());
+
+    auto near_equal = [](const auto& a, const auto& b, float eps) {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); ++i)
+            if (!mu::near_equal(a[i], b[i], eps))
+                return false;
+        return true;
+    };
+    Expect(near_equal(baked.points, ref.points, 1e-3f));
+    Expect(near_equal(baked.normals, ref.normals, 1e-4f));
+    Expect(BitEqual(baked.indices, ref.indices));
+    Expect(BitEqual(baked.counts, ref.counts));
+    Expect(BitEqual(baked.material_ids, ref.material_ids));
+    Expect(baked.materials.size() == 3);
+
+    // MeshNode::merge doesn't pad uvs of a mesh without them. bake does.
+    Expect(baked.uvs.size() == baked.indices.size());
+    {
+        int num_mismatch = 0;
+        size_t io = 0;
+        for (int i = 0; i < num_instances; ++i) {
+            auto& mesh = inst->proto_records[inst->proto_indices[i]].merged_mesh;
+            for (size_t ii = 0; ii < mesh.indices.size() && io + ii < baked.uvs.size(); ++ii) {
+                auto expected = mesh.uvs.empty() ? float2::zero() : mesh.uvs[ii];
+                if (baked.uvs[io + ii] != expected)
+                    ++num_mismatch;
+            }
+            io += mesh.indices.size();
+        }
+        Expect(num_mismatch == 0);
+    }
+
+    Expect(baked.facesets.size() == ref.facesets.size());
+    for (size_t i = 0; i < baked.facesets.size() && i < ref.facesets.size(); ++i) {
+        Expect(baked.facesets[i]->material == ref.facesets[i]->material);
+        Expect(BitEqual(baked.facesets[i]->faces, ref.facesets[i]->faces));
+    }
+
+    // baking appends to existing content
+    MeshNode twice;
+    inst->bake(twice);
+    inst->bake(twice);
+    Expect(twice.points.size() == baked.points.size() * 2);
+    Expect(twice.indices[baked.indices.size()] == baked.indices[0] + (int)baked.points.size());
+
+    // faces go to the first faceset of dst with the same material. a second one is kept as it is
+    MeshNode shared;
+    inst->bake(shared);
+    auto extra = shared.facesets[0]->clone();
+    shared.facesets.push_back(extra);
+    size_t num_facesets = shared.facesets.size();
+    inst->bake(shared);
+    Expect(shared.facesets.size() == num_facesets && shared.facesets[0]->material == baked.facesets[0]->material);
+    Expect(shared.facesets.back() == extra && extra->faces.size() == baked.facesets[0]->faces.size());
+    {
+        auto& faces = shared.facesets[0]->faces;
+        auto& ref_faces = baked.facesets[0]->faces;
+        bool ok = faces.size() == ref_faces.size() * 2;
+        for (size_t i = 0; ok && i < ref_faces.size(); ++i)
+            ok = faces[i] == ref_faces[i] && faces[ref_faces.size() + i] == ref_faces[i] + (int)baked.counts.size();
+        Expect(ok);
+    }
+}
+
+// animated scene for SampleCache tests. an Xform and a Mesh move along x by time.
+class AnimatedSceneInterface : public SceneInterface
+{
+public:
+    Scene* scene = nullptr;
+    std::atomic_int num_reads{ 0 };
+
+    AnimatedSceneInterface(Scene* s) : scene(s) {}
+    bool open(const char*) override { return true; }
+    bool create(const char*) override { return true; }
+    bool save() override { return true; }
+    void close() override {}
+    void write() override {}
+    bool isNodeTypeSupported(Node::Type) override { return true; }
+    bool wrapNode(Node*) override { return true; }
+    double frameToTime(int frame) override { return frame / scene->frame_rate; }
+
+    Node* createNode(Node* parent, const char* name, Node::Type type) override
+    {
+        auto ret = scene->createNodeImpl(parent, name, type);
+        scene->registerNode(ret);
+        return ret;
+    }
+
+    void read() override
+    {
+        ++num_reads;
+        float t = (float)scene->time_current;
+        scene->eachNode<XformNode>([t](XformNode* n) {
+            n->local_matrix = n->global_matrix = mu::transform(float3{ t, 0.0f, 0.0f }, quatf::identity(), float3::one());
+            if (auto mesh = n->cast<MeshNode>()) {
+                mesh->points.resize(1000);
+                for (int i = 0; i < 1000; ++i)
+                    mesh->points[i] = float3{ t, (float)i, 0.0f };
+            }
+        });
+    }
+};
+
+static ScenePtr MakeAnimatedScene(std::shared_ptr<AnimatedSceneInterface>& ifs)
+{
+    auto scene = std::make_shared<Scene>();
+    ifs = std::make_shared<AnimatedSceneInterface>(scene.get());
+    scene->impl = ifs;
+    scene->frame_rate = 10.0;
+    auto root = scene->createNode(nullptr, "/", Node::Type::Root);
+    auto xf = scene->createNode<XformNode>(root, "Xform");
+    scene->createNode<MeshNode>(xf, "Mesh");
+    return scene;
+}
+
+TestCase(TestSampleCache)
+{
+    std::shared_ptr<AnimatedSceneInterface> ifs;
+    auto scene = MakeAnimatedScene(ifs);
+    auto mesh = scene->findNodeByPath("/Xform/Mesh")->cast<MeshNode>();
+    auto cache = std::make_shared<SampleCache>();
+    scene->sample_cache = cache;
+
+    // store & restore
+    for (int f = 0; f < 5; ++f)
+        scene->read(f * 0.1);
+    Expect(ifs->num_reads == 5 && cache->getSampleCount() == 5);
+    scene->read(0.2);
+    Expect(ifs->num_reads == 5);
+    Expect(mesh->points[10] == (float3{ 0.2f, 10.0f, 0.0f }));
+    Expect(mesh->local_matrix[3].x == 0.2f);
+
+    // interpolation between frames closer than the span
+    cache->clear();
+    cache->setInterpolationSpan(0.25);
+    scene->read(0.0);
+    scene->read(0.2);
+    int num_reads = ifs->num_reads;
+    scene->read(0.05);
+    Expect(ifs->num_reads == num_reads);
+    Expect(mu::near_equal(mesh->points[10], float3{ 0.05f, 10.0f, 0.0f }));
+    Expect(mu::near_equal(mesh->local_matrix[3].x, 0.05f));
+    // too far apart to interpolate
+    scene->read(0.6);
+    scene->read(0.4);
+    Expect(ifs->num_reads == num_reads + 2);
+    cache->setInterpolationSpan(0.0);
+
+    // evict the least recently used first. 0.0 is used again, so 0.2 goes.
+    size_t frame_size = cache->getMemoryUsage() / cache->getSampleCount();
+    cache->setMemoryBudget(frame_size * 4);
+    Expect(cache->getSampleCount() == 4);
+    scene->read(0.0);
+    scene->read(0.8);
+    Expect(cache->getSampleCount() == 4);
+    Expect(cache->contains(0.0) && !cache->contains(0.2) && cache->contains(0.8));
+    cache->setMemoryBudget(frame_size * 2);
+    Expect(cache->contains(0.0) && cache->contains(0.8) && cache->getSampleCount() == 2);
+    cache->setMemoryBudget(1024 * 1024 * 1024);
+
+    // prefetch by a reader that shares the cache. interpolatable times must still be read and stored.
+    cache->clear();
+    cache->setInterpolationSpan(1.0);
+    scene->read(0.0);
+    scene->read(1.0);
+    std::shared_ptr<AnimatedSceneInterface> reader_ifs;
+    auto reader = MakeAnimatedScene(reader_ifs);
+    reader->sample_cache = cache;
+    cache->prefetch(reader, 0.0, 5);
+    cache->waitPrefetch();
+    Expect(reader_ifs->num_reads == 5);
+    Expect(cache->getSampleCount() == 7);
+    Expect(reader->sample_cache == cache);
+
+    num_reads = ifs->num_reads;
+    scene->read(0.3);
+    Expect(ifs->num_reads == num_reads);
+    Expect(mesh->points[10] == (float3{ 0.3f, 10.0f, 0.0f }));
+}
@@ -9,6 +9,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <cstdint>
+#include <climits>
 #include <cstdarg>
 #include <cmath>
 #include <string>